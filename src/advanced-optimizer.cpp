@@ -1,50 +1,80 @@
 #include "advanced-optimizer.h"
+#include "profile-instrumenter.h"
 #include <iostream>
 #include <algorithm>
 #include <queue>
 
-AdvancedOptimizer::AdvancedOptimizer() {
+AdvancedOptimizer::AdvancedOptimizer()
+    : optimize_for_size(false), remarks(nullptr), first_free_temp(0), thread_labels(0) {
     cfg = std::make_unique<ControlFlowGraph>();
 }
 
 void AdvancedOptimizer::apply_dataflow_optimizations(IRCode& instructions) {
     // Build control flow graph
     cfg->build_from_ir(instructions);
+    first_free_temp = next_temporary(instructions);
     
+    // Unreachable code elimination is linear and runs everywhere; the rest
+    // iterate over the function and skip functions over the budget
+    unreachable_code_elimination(instructions);
+    size_t limit = budget.dataflow_function_size;
+    run_within_budget(instructions, limit, "simplify-cfg", remarks, [this](IRCode& code) { simplify_cfg(code); });
+    run_within_budget(instructions, limit, "if-conversion", remarks, [this](IRCode& code) { if_conversion(code); });
+    run_within_budget(instructions, limit, "dce", remarks, [this](IRCode& code) { eliminate_dead_code(code); });
+}
+
+void AdvancedOptimizer::eliminate_dead_code(IRCode& instructions) {
     // Perform data flow analyses
     reaching_definitions_analysis(instructions);
-    live_variable_analysis(instructions);
     available_expressions_analysis(instructions);
     
-    // Apply optimizations based on analysis
-    unreachable_code_elimination(instructions);
-    
-    // Remove dead code based on liveness analysis
-    auto it = instructions.begin();
-    while (it != instructions.end()) {
-        size_t index = std::distance(instructions.begin(), it);
+    // Remove dead code based on liveness analysis; removing one definition
+    // can make the values it used dead, so repeat until nothing changes
+    std::unordered_map<std::string, long long> removed;
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        live_variable_analysis(instructions);
         
-        if (it->modifies_result()) {
-            std::string defined_var = it->get_defined_variable();
-            if (liveness_info.find(index) != liveness_info.end() &&
-                liveness_info[index].live_out.find(defined_var) == liveness_info[index].live_out.end()) {
-                // Variable is not live after this instruction, remove it
-                it = instructions.erase(it);
+        IRCode live_code;
+        live_code.reserve(instructions.size());
+        std::string function;
+        for (size_t i = 0; i < instructions.size(); ++i) {
+            const auto& instr = instructions[i];
+            if (instr.op == OpCode::FUNCTION_BEGIN) function = instr.result;
+            if (is_pure(instr) &&
+                liveness_info[i].live_out.count(instr.result) == 0) {
+                ++removed[function];
+                changed = true;
                 continue;
             }
+            live_code.push_back(instr);
         }
-        ++it;
+        instructions.swap(live_code);
+    }
+    if (remarks) {
+        remarks->emit_per_function("dce", "DeadDefinitionsRemoved", instructions, removed,
+                                   "values not live after their definition", "Instructions");
     }
 }
 
 void AdvancedOptimizer::apply_aggressive_optimizations(IRCode& instructions) {
-    // Apply more aggressive optimizations
-    loop_invariant_code_motion(instructions);
+    // Apply more aggressive optimizations; the loop passes and the peephole
+    // rewrites move code with vector inserts and erases, so they are budgeted
+    size_t limit = budget.loop_function_size;
+    run_within_budget(instructions, limit, "licm", remarks,
+                      [this](IRCode& code) { loop_invariant_code_motion(code); });
     strength_reduction(instructions);
-    loop_unrolling(instructions);
+    run_within_budget(instructions, limit, "loop-unroll", remarks, [this](IRCode& code) { loop_unrolling(code); });
     tail_call_optimization(instructions);
-    peephole_optimizations(instructions);
+    run_within_budget(instructions, limit, "peephole", remarks,
+                      [this](IRCode& code) { peephole_optimizations(code); });
     instruction_scheduling(instructions);
+    
+    // Allocate registers last, on the final instruction stream; functions
+    // over the budget get no assignment and keep their values in stack slots
+    run_within_budget(instructions, budget.allocation_function_size, "regalloc", remarks,
+                      [this](IRCode& code) { graph_coloring_allocation(code); });
 }
 
 // Dataflow, loop, and peephole optimizations
@@ -61,6 +91,12 @@ void AdvancedOptimizer::reaching_definitions_analysis(const IRCode& instructions
 
 void AdvancedOptimizer::live_variable_analysis(const IRCode& instructions) {
     liveness_info.clear();
+    label_positions.clear();
+    for (size_t i = 0; i < instructions.size(); ++i) {
+        if (instructions[i].is_label()) {
+            label_positions[instructions[i].result] = i;
+        }
+    }
     
     // Initialize liveness info for each instruction
     for (size_t i = 0; i < instructions.size(); ++i) {
@@ -88,102 +124,430 @@ void AdvancedOptimizer::available_expressions_analysis(const IRCode& instruction
 }
 
 void AdvancedOptimizer::unreachable_code_elimination(IRCode& instructions) {
-    std::set<size_t> reachable_instructions;
+    label_positions.clear();
+    for (size_t i = 0; i < instructions.size(); ++i) {
+        if (instructions[i].is_label()) {
+            label_positions[instructions[i].result] = i;
+        }
+    }
+    
+    std::vector<bool> reachable(instructions.size(), false);
     std::queue<size_t> worklist;
     
-    // Start from entry point
-    worklist.push(0);
-    reachable_instructions.insert(0);
+    // Every function entry is a root; function markers are always kept
+    for (size_t i = 0; i < instructions.size(); ++i) {
+        OpCode op = instructions[i].op;
+        if (op == OpCode::FUNCTION_BEGIN || op == OpCode::FUNCTION_END) {
+            reachable[i] = true;
+            if (op == OpCode::FUNCTION_BEGIN) worklist.push(i);
+        }
+    }
     
     while (!worklist.empty()) {
         size_t current = worklist.front();
         worklist.pop();
         
-        if (current >= instructions.size()) continue;
+        for (size_t succ : get_successors(instructions, current)) {
+            if (!reachable[succ]) {
+                reachable[succ] = true;
+                worklist.push(succ);
+            }
+        }
+    }
+    
+    // Remove unreachable instructions
+    IRCode reachable_code;
+    reachable_code.reserve(instructions.size());
+    for (size_t i = 0; i < instructions.size(); ++i) {
+        if (reachable[i]) {
+            reachable_code.push_back(instructions[i]);
+        }
+    }
+    instructions.swap(reachable_code);
+}
+
+void AdvancedOptimizer::simplify_cfg(IRCode& instructions) {
+    // Repeat until nothing changes: each rewrite can expose another. Every
+    // round rescans the whole program, so the rounds are capped to keep the
+    // pass linear; real code settles in two or three
+    const int max_rounds = 4;
+    bool changed = true;
+    for (int round = 0; changed && round < max_rounds; ++round) {
+        changed = false;
+        label_positions.clear();
+        for (size_t i = 0; i < instructions.size(); ++i) {
+            if (instructions[i].is_label()) {
+                label_positions[instructions[i].result] = i;
+            }
+        }
+        
+        // First instruction executed after reaching position i; nested
+        // blocks end in long runs of labels, so this is filled in once
+        std::vector<size_t> past_labels(instructions.size() + 1, instructions.size());
+        for (size_t i = instructions.size(); i-- > 0;) {
+            past_labels[i] = instructions[i].is_label() ? past_labels[i + 1] : i;
+        }
+        auto skip_labels = [&past_labels](size_t i) {
+            return past_labels[std::min(i, past_labels.size() - 1)];
+        };
+        auto target_of = [&](const std::string& label) {
+            auto it = label_positions.find(label);
+            return it != label_positions.end() ? skip_labels(it->second) : instructions.size();
+        };
         
-        const auto& instr = instructions[current];
+        // Thread jumps through blocks that only jump
+        for (auto& instr : instructions) {
+            if (!instr.is_branch()) continue;
+            std::unordered_set<std::string> seen = {instr.result};
+            std::string target = instr.result;
+            size_t next = target_of(target);
+            while (next < instructions.size() && instructions[next].op == OpCode::GOTO &&
+                   seen.insert(instructions[next].result).second) {
+                target = instructions[next].result;
+                next = target_of(target);
+            }
+            if (target != instr.result) {
+                instr.result = target;
+                changed = true;
+            }
+        }
         
-        // Add successors to worklist
-        if (instr.is_branch()) {
-            // Handle branch targets
-            for (size_t i = 0; i < instructions.size(); ++i) {
-                if (instructions[i].is_label() && instructions[i].result == instr.result) {
-                    if (reachable_instructions.find(i) == reachable_instructions.end()) {
-                        reachable_instructions.insert(i);
-                        worklist.push(i);
+        // Thread branches whose condition is known on the edge into a block
+        // that starts by testing it again: after a conditional branch on the
+        // same value, or after a jump from a block that set it to a constant
+        // New labels are placed after the scan, in one sweep; until then
+        // branches to them look unresolved and are left alone
+        std::map<size_t, std::string> new_labels;   // position -> label
+        for (size_t i = 0; i < instructions.size(); ++i) {
+            IRInstruction& instr = instructions[i];
+            if (!instr.is_branch()) continue;
+            size_t j = target_of(instr.result);
+            if (j >= instructions.size() || j == i) continue;
+            const IRInstruction& test = instructions[j];
+            if (test.op != OpCode::IF_FALSE && test.op != OpCode::IF_TRUE) continue;
+            
+            int known = -1;   // value of the condition being non-zero on this edge
+            if (instr.op != OpCode::GOTO && instr.arg1 == test.arg1 && !is_constant(instr.arg1)) {
+                known = instr.op == OpCode::IF_TRUE ? 1 : 0;
+            } else if (instr.op == OpCode::GOTO && !is_constant(test.arg1)) {
+                for (size_t k = i; k-- > 0;) {
+                    const IRInstruction& prev = instructions[k];
+                    if (prev.is_label() || prev.is_branch() || prev.op == OpCode::FUNCTION_BEGIN ||
+                        (prev.op == OpCode::CALL && !is_temporary(test.arg1))) {
+                        break;
+                    }
+                    if (get_variables_defined(prev).count(test.arg1)) {
+                        if ((prev.op == OpCode::ASSIGN || prev.op == OpCode::COPY) && is_constant(prev.arg1)) {
+                            known = std::stoi(prev.arg1) != 0 ? 1 : 0;
+                        }
+                        break;
                     }
                 }
             }
+            if (known < 0) continue;
+            
+            bool taken = (known == 1) == (test.op == OpCode::IF_TRUE);
+            if (taken) {
+                if (test.result == instr.result) continue;
+                instr.result = test.result;
+            } else if (j + 1 < instructions.size() && instructions[j + 1].is_label()) {
+                instr.result = instructions[j + 1].result;
+            } else {
+                auto label = new_labels.find(j + 1);
+                if (label == new_labels.end()) {
+                    label = new_labels.emplace(j + 1, ".Lthread" + std::to_string(thread_labels++)).first;
+                }
+                instr.result = label->second;
+            }
+            changed = true;
+        }
+        if (!new_labels.empty()) {
+            IRCode threaded;
+            threaded.reserve(instructions.size() + new_labels.size());
+            auto label = new_labels.begin();
+            for (size_t i = 0; i < instructions.size(); ++i) {
+                if (label != new_labels.end() && label->first == i) {
+                    threaded.emplace_back(OpCode::LABEL, label->second);
+                    ++label;
+                }
+                threaded.push_back(std::move(instructions[i]));
+            }
+            for (; label != new_labels.end(); ++label) threaded.emplace_back(OpCode::LABEL, label->second);
+            instructions.swap(threaded);
+            continue;
         }
         
-        // Add fall-through successor
-        if (current + 1 < instructions.size() && 
-            instr.op != OpCode::GOTO && instr.op != OpCode::RETURN) {
-            if (reachable_instructions.find(current + 1) == reachable_instructions.end()) {
-                reachable_instructions.insert(current + 1);
-                worklist.push(current + 1);
+        // Local cleanups: a conditional branch over a jump becomes the inverse
+        // branch, and jumps to the next instruction go away
+        IRCode simplified;
+        simplified.reserve(instructions.size());
+        for (size_t i = 0; i < instructions.size(); ++i) {
+            IRInstruction instr = instructions[i];
+            if ((instr.op == OpCode::IF_FALSE || instr.op == OpCode::IF_TRUE) &&
+                i + 2 < instructions.size() && instructions[i + 1].op == OpCode::GOTO &&
+                label_positions.count(instr.result) && label_positions[instr.result] > i + 1 &&
+                skip_labels(i + 2) > label_positions[instr.result]) {
+                instr.op = instr.op == OpCode::IF_FALSE ? OpCode::IF_TRUE : OpCode::IF_FALSE;
+                instr.result = instructions[i + 1].result;
+                ++i;
+                changed = true;
             }
+            if (instr.is_branch() && label_positions.count(instr.result)) {
+                size_t label = label_positions[instr.result];
+                if (label > i && skip_labels(i + 1) > label) {
+                    changed = true;
+                    continue;
+                }
+            }
+            simplified.push_back(instr);
         }
-    }
-    
-    // Remove unreachable instructions
-    auto it = instructions.begin();
-    size_t index = 0;
-    while (it != instructions.end()) {
-        if (reachable_instructions.find(index) == reachable_instructions.end()) {
-            it = instructions.erase(it);
-        } else {
-            ++it;
+        instructions.swap(simplified);
+        
+        // Labels nothing jumps to merge their block into the one before
+        std::unordered_set<std::string> referenced;
+        for (const auto& instr : instructions) {
+            if (instr.is_branch()) referenced.insert(instr.result);
         }
-        ++index;
+        size_t before = instructions.size();
+        instructions.erase(
+            std::remove_if(instructions.begin(), instructions.end(), [&referenced](const IRInstruction& instr) {
+                return instr.is_label() && !referenced.count(instr.result);
+            }),
+            instructions.end());
+        changed |= instructions.size() != before;
+        
+        before = instructions.size();
+        unreachable_code_elimination(instructions);
+        changed |= instructions.size() != before;
     }
 }
 
-void AdvancedOptimizer::loop_invariant_code_motion(IRCode& instructions) {
-    // Simple loop detection and invariant code motion
-    std::map<std::string, std::pair<size_t, size_t>> loops; // label -> (start, end)
+void AdvancedOptimizer::if_conversion(IRCode& instructions) {
+    // Arms are speculated, so they may hold only a few instructions that can
+    // neither trap nor touch memory
+    const size_t max_arm_size = 4;
+    auto speculatable = [](const IRInstruction& instr) {
+        switch (instr.op) {
+            case OpCode::ADD: case OpCode::SUB: case OpCode::MUL:
+            case OpCode::EQ: case OpCode::NE: case OpCode::LT: case OpCode::LE: case OpCode::GT: case OpCode::GE:
+            case OpCode::AND: case OpCode::OR: case OpCode::NOT:
+            case OpCode::BIT_AND: case OpCode::BIT_OR: case OpCode::BIT_XOR: case OpCode::BIT_NOT:
+            case OpCode::SHL: case OpCode::SHR:
+            case OpCode::ASSIGN: case OpCode::COPY:
+                return !instr.result.empty();
+            default:
+                return false;
+        }
+    };
     
-    // Find loops
-    for (size_t i = 0; i < instructions.size(); ++i) {
-        if (instructions[i].is_branch()) {
-            // Look for backward branches
-            std::string target = instructions[i].result;
-            for (size_t j = 0; j < i; ++j) {
-                if (instructions[j].is_label() && instructions[j].result == target) {
-                    loops[target] = {j, i};
-                    break;
+    // Fresh temporaries continue the IRGenerator numbering
+    int next_temp = std::max(next_temporary(instructions), first_free_temp);
+    
+    // Missed remarks are kept from the last scan only, which sees the final code
+    std::vector<OptimizationRemark> missed;
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        missed.clear();
+        
+        std::unordered_map<std::string, int> label_refs, use_count, def_count;
+        for (const auto& instr : instructions) {
+            if (instr.is_branch()) ++label_refs[instr.result];
+            for (const auto& var : get_variables_used(instr)) ++use_count[var];
+            for (const auto& var : get_variables_defined(instr)) ++def_count[var];
+        }
+        
+        // An arm qualifies when it ends by defining its target and everything
+        // else it defines is a temporary nobody outside the arm sees
+        auto arm_target = [&](size_t begin, size_t end, const std::string& cond) -> std::string {
+            if (begin == end || end - begin > max_arm_size) return "";
+            const std::string& target = instructions[end - 1].result;
+            if (target == cond) return "";
+            std::unordered_map<std::string, int> arm_uses, arm_defs;
+            for (size_t k = begin; k < end; ++k) {
+                for (const auto& var : get_variables_used(instructions[k])) ++arm_uses[var];
+                for (const auto& var : get_variables_defined(instructions[k])) ++arm_defs[var];
+            }
+            if (arm_defs.count(cond) || arm_defs[target] != 1) return "";
+            for (const auto& def : arm_defs) {
+                if (def.first == target) continue;
+                if (!is_temporary(def.first) || def_count[def.first] != def.second ||
+                    use_count[def.first] != arm_uses[def.first]) {
+                    return "";
+                }
+            }
+            return target;
+        };
+        
+        // Converted regions are spliced into a copy in one sweep rather than
+        // erased in place, so a scan stays linear however many it converts
+        IRCode rewritten;
+        size_t copied = 0;
+        for (size_t i = 0; i < instructions.size(); ++i) {
+            if (instructions[i].op != OpCode::IF_FALSE) continue;
+            const std::string cond = instructions[i].arg1;
+            const std::string skip_label = instructions[i].result;
+            
+            size_t then_end = i + 1;
+            while (then_end < instructions.size() && speculatable(instructions[then_end])) ++then_end;
+            if (then_end >= instructions.size()) continue;
+            
+            // Triangle: IF_FALSE c, L; then; L:
+            // Diamond:  IF_FALSE c, L; then; GOTO E; L: else; E:
+            size_t else_begin = 0, else_end = 0, region_end = 0;
+            const IRInstruction& after_then = instructions[then_end];
+            if (after_then.is_label() && after_then.result == skip_label) {
+                region_end = then_end;
+            } else if (after_then.op == OpCode::GOTO && then_end + 1 < instructions.size() &&
+                       instructions[then_end + 1].is_label() &&
+                       instructions[then_end + 1].result == skip_label) {
+                else_begin = then_end + 2;
+                else_end = else_begin;
+                while (else_end < instructions.size() && speculatable(instructions[else_end])) ++else_end;
+                if (else_end >= instructions.size() || !instructions[else_end].is_label() ||
+                    instructions[else_end].result != after_then.result ||
+                    label_refs[after_then.result] != 1) {
+                    continue;
                 }
+                region_end = else_end;
+            } else {
+                continue;
+            }
+            if (label_refs[skip_label] != 1) continue;
+            
+            size_t then_size = then_end - i - 1;
+            size_t else_size = else_end - else_begin;
+            std::string target = arm_target(i + 1, then_end, cond);
+            if (!target.empty() && else_begin && arm_target(else_begin, else_end, cond) != target) {
+                target.clear();
             }
+            if (target.empty()) {
+                if (remarks) {
+                    OptimizationRemark remark;
+                    remark.name = std::max(then_size, else_size) > max_arm_size ? "ArmTooLarge" : "NoCommonTarget";
+                    remark.function = RemarkCollector::function_at(instructions, i);
+                    remark.line = instructions[i].line_number;
+                    remark.reason = remark.name == "ArmTooLarge" ?
+                        "an arm is longer than " + std::to_string(max_arm_size) + " instructions" :
+                        "the arms do not end by assigning one variable, or their temporaries escape";
+                    remark.metrics = {{"ThenSize", static_cast<long long>(then_size)},
+                                      {"ElseSize", static_cast<long long>(else_size)}};
+                    missed.push_back(remark);
+                }
+                continue;
+            }
+            
+            // The then arm computes its value aside; the else arm (if any) writes
+            // the target directly and the select picks between them
+            IRCode converted(instructions.begin() + i + 1, instructions.begin() + then_end);
+            std::string value;
+            IRInstruction& last = converted.back();
+            if (last.op == OpCode::ASSIGN || last.op == OpCode::COPY) {
+                value = last.arg1;
+                converted.pop_back();
+            } else {
+                value = "t" + std::to_string(next_temp++);
+                last.result = value;
+            }
+            if (else_begin && value == target) continue;   // the else arm would clobber it
+            if (else_begin) {
+                converted.insert(converted.end(), instructions.begin() + else_begin,
+                                 instructions.begin() + else_end);
+            }
+            converted.emplace_back(OpCode::SELECT, target, cond, value, instructions[i].line_number);
+            if (remarks) {
+                remarks->emit("if-conversion", RemarkKind::Applied, "Converted", instructions, i,
+                              "branch on " + cond + " replaced by a select of " + target,
+                              {{"ThenSize", static_cast<long long>(then_size)},
+                               {"ElseSize", static_cast<long long>(else_size)}});
+            }
+            
+            if (rewritten.empty()) rewritten.reserve(instructions.size());
+            rewritten.insert(rewritten.end(), instructions.begin() + copied, instructions.begin() + i);
+            rewritten.insert(rewritten.end(), converted.begin(), converted.end());
+            copied = region_end + 1;
+            i = region_end;
+            
+            // The select also reads the old target; keep the counts later
+            // regions of this scan are checked against current
+            ++use_count[target];
+            changed = true;
+        }
+        if (changed) {
+            rewritten.insert(rewritten.end(), instructions.begin() + copied, instructions.end());
+            instructions.swap(rewritten);
         }
     }
-    
-    // For each loop, find invariant code
+    if (remarks) {
+        for (auto& remark : missed) {
+            remarks->emit_function("if-conversion", RemarkKind::Missed, remark.name, remark.function,
+                                   remark.line, remark.reason, std::move(remark.metrics));
+        }
+    }
+}
+
+void AdvancedOptimizer::loop_invariant_code_motion(IRCode& instructions) {
+    // Loops come innermost first, and hoisting out of one only shifts code
+    // inside it, so the bounds found up front hold for the loops after it
+    auto loops = find_loops(instructions);
+    std::vector<std::string> headers;
     for (const auto& loop : loops) {
-        size_t start = loop.second.first;
-        size_t end = loop.second.second;
-        
-        std::set<std::string> loop_vars;
+        headers.push_back(instructions[loop.first].result);
+    }
+    
+    for (size_t l = 0; l < loops.size(); ++l) {
+        size_t start = loops[l].first, end = loops[l].second;
+        const std::string& header = headers[l];
+        if (!instructions[start].is_label() || instructions[start].result != header) continue;
         
-        // Collect variables defined in the loop
+        // Count definitions inside the loop
+        std::map<std::string, int> loop_defs;
         for (size_t i = start; i <= end; ++i) {
-            if (instructions[i].modifies_result()) {
-                loop_vars.insert(instructions[i].get_defined_variable());
+            for (const auto& var : get_variables_defined(instructions[i])) {
+                ++loop_defs[var];
             }
         }
         
-        // Find invariant instructions
-        std::vector<size_t> invariant_instructions;
+        // Hoist temporaries computed from values the loop never changes.
+        // Division is left alone: it may trap on a path that never runs it.
         for (size_t i = start + 1; i < end; ++i) {
-            if (is_loop_invariant(instructions[i], loop_vars)) {
-                invariant_instructions.push_back(i);
+            const IRInstruction& instr = instructions[i];
+            if (!is_pure(instr) || instr.op == OpCode::ARRAY_ACCESS) continue;
+            
+            bool invariant = true;
+            for (const auto& var : get_variables_used(instr)) {
+                if (loop_defs.count(var) && loop_defs[var] > 0) {
+                    invariant = false;
+                    break;
+                }
             }
-        }
-        
-        // Move invariant instructions before the loop
-        for (auto it = invariant_instructions.rbegin(); it != invariant_instructions.rend(); ++it) {
-            IRInstruction instr = instructions[*it];
-            instructions.erase(instructions.begin() + *it);
-            instructions.insert(instructions.begin() + start, instr);
+            if (!invariant) continue;
+            
+            const char* blocker = nullptr;
+            if (instr.op == OpCode::DIV || instr.op == OpCode::MOD) {
+                blocker = "division may trap on an iteration that would not run it";
+            } else if (!is_temporary(instr.result)) {
+                blocker = "the result is a variable, which may be read before the loop assigns it";
+            } else if (loop_defs[instr.result] != 1) {
+                blocker = "the result is defined more than once in the loop";
+            }
+            if (blocker) {
+                if (remarks) {
+                    remarks->emit("licm", RemarkKind::Missed, "NotHoisted", instructions, i,
+                                  opCodeToString(instr.op) + " into " + instr.result + " is invariant but " + blocker);
+                }
+                continue;
+            }
+            if (remarks) {
+                remarks->emit("licm", RemarkKind::Applied, "Hoisted", instructions, i,
+                              opCodeToString(instr.op) + " into " + instr.result + " hoisted out of loop " + header);
+            }
+            
+            // Rotating it above the header moves only the loop so far
+            std::string result = instr.result;
+            std::rotate(instructions.begin() + start, instructions.begin() + i, instructions.begin() + i + 1);
+            loop_defs[result] = 0;
+            ++start;
         }
     }
 }
@@ -191,114 +555,253 @@ void AdvancedOptimizer::loop_invariant_code_motion(IRCode& instructions) {
 void AdvancedOptimizer::strength_reduction(IRCode& instructions) {
     // Replace expensive operations with cheaper ones
     for (auto& instr : instructions) {
-        if (instr.op == OpCode::MUL) {
-            // Replace multiplication by power of 2 with shift
-            if (instr.arg2 == "2") {
+        if (instr.op == OpCode::MUL && is_constant(instr.arg2)) {
+            long long factor = std::stoll(instr.arg2);
+            if (factor == 2) {
                 instr.op = OpCode::ADD;
                 instr.arg2 = instr.arg1;
-            } else if (instr.arg2 == "4") {
-                // Could implement left shift by 2, but keep simple for now
-                // This is a placeholder for more sophisticated strength reduction
+            } else if (factor > 2 && (factor & (factor - 1)) == 0) {
+                // Multiplication by a power of two is a left shift
+                instr.op = OpCode::SHL;
+                instr.arg2 = std::to_string(__builtin_ctzll(static_cast<unsigned long long>(factor)));
             }
-        } else if (instr.op == OpCode::DIV) {
-            // Replace division by power of 2 with shift
-            if (instr.arg2 == "2") {
-                // This would need right shift implementation
-                // Placeholder for now
+            if (remarks && instr.op != OpCode::MUL) {
+                remarks->emit("strength-reduction", RemarkKind::Applied, "MulReduced", instructions,
+                              static_cast<size_t>(&instr - instructions.data()),
+                              "multiplication by " + std::to_string(factor) + " became " + opCodeToString(instr.op),
+                              {{"Factor", factor}});
             }
         }
+        // Signed division by a power of two needs a bias for negative
+        // dividends; the code generator lowers it to shifts
     }
 }
 
 void AdvancedOptimizer::loop_unrolling(IRCode& instructions) {
-    // Simple loop unrolling for small loops
-    // This is a simplified implementation
+    // Unroll small innermost loops by two. The copy keeps every exit test, so
+    // any trip count is handled without a remainder loop.
+    const size_t max_body = 16;
     
-    std::map<std::string, std::pair<size_t, size_t>> loops;
-    
-    // Find loops
-    for (size_t i = 0; i < instructions.size(); ++i) {
-        if (instructions[i].is_branch()) {
-            std::string target = instructions[i].result;
-            for (size_t j = 0; j < i; ++j) {
-                if (instructions[j].is_label() && instructions[j].result == target) {
-                    loops[target] = {j, i};
-                    break;
-                }
-            }
-        }
+    // Unrolled loops are innermost, so none holds another's copy; decide on
+    // the original positions and splice every copy in with one sweep
+    auto loops = find_loops(instructions);
+    std::unordered_map<size_t, size_t> loop_end_at;   // header position -> back branch
+    for (const auto& loop : loops) {
+        loop_end_at[loop.first] = loop.second;
     }
+    struct Unrolled {
+        size_t back_branch;
+        IRCode copy;              // goes before the back branch
+        std::string exit_label;   // goes after it, when the branch is conditional
+    };
+    std::vector<Unrolled> copies;
     
-    // Unroll small loops
     for (const auto& loop : loops) {
-        size_t start = loop.second.first;
-        size_t end = loop.second.second;
+        size_t start = loop.first, end = loop.second;
+        const std::string header = instructions[start].result;
+        long long body_size = static_cast<long long>(end - start - 1);
+        auto missed = [&](const std::string& name, const std::string& reason) {
+            if (remarks) {
+                remarks->emit("loop-unroll", RemarkKind::Missed, name, instructions, end, reason,
+                              {{"BodySize", body_size}, {"Limit", static_cast<long long>(max_body)}});
+            }
+        };
+        if (optimize_for_size) {
+            missed("OptimizingForSize", "unrolling grows code, which -Os does not allow");
+            continue;
+        }
+        if (end - start - 1 > max_body) {
+            missed("TooLarge", "the body is longer than " + std::to_string(max_body) + " instructions");
+            continue;
+        }
         
-        if (end - start <= 5) { // Only unroll very small loops
-            // Duplicate loop body
-            std::vector<IRInstruction> loop_body;
-            for (size_t i = start + 1; i < end; ++i) {
-                loop_body.push_back(instructions[i]);
+        // Innermost only, and no function boundaries inside
+        bool innermost = true, simple = true;
+        for (size_t i = start + 1; i < end; ++i) {
+            auto inner = loop_end_at.find(i);
+            if (inner != loop_end_at.end() && inner->second < end) innermost = false;
+            if (instructions[i].op == OpCode::FUNCTION_BEGIN ||
+                instructions[i].op == OpCode::FUNCTION_END) {
+                simple = false;
             }
-            
-            // Insert duplicated body before the loop
-            instructions.insert(instructions.begin() + end, loop_body.begin(), loop_body.end());
         }
+        if (!innermost || !simple) {
+            missed(innermost ? "NotSimple" : "NotInnermost",
+                   innermost ? "the body crosses a function boundary" : "the loop contains another loop");
+            continue;
+        }
+        
+        // A loop the training run never entered is not worth the code size
+        auto counter = std::find_if(instructions.begin() + start + 1, instructions.begin() + end,
+            [](const IRInstruction& instr) { return instr.op == OpCode::PROFILE_COUNT; });
+        if (counter != instructions.begin() + end && profiled_count(*counter) == 0) {
+            missed("NeverEntered", "the profile shows the loop body never ran");
+            continue;
+        }
+        if (remarks) {
+            remarks->emit("loop-unroll", RemarkKind::Applied, "Unrolled", instructions, end,
+                          "unrolled by 2, keeping the exit test between the copies",
+                          {{"BodySize", body_size}, {"Factor", 2}});
+        }
+        
+        // Labels and temporaries defined in the body get fresh names in the copy
+        std::unordered_map<std::string, std::string> renamed;
+        for (size_t i = start + 1; i < end; ++i) {
+            const auto& instr = instructions[i];
+            if (instr.is_label()) {
+                renamed[instr.result] = instr.result + "_u";
+            } else if (is_pure(instr) || instr.op == OpCode::CALL) {
+                if (is_temporary(instr.result)) renamed[instr.result] = instr.result + "_u";
+            }
+        }
+        auto rename = [&renamed](const std::string& name) {
+            auto it = renamed.find(name);
+            return it != renamed.end() ? it->second : name;
+        };
+        
+        IRCode copy;
+        IRInstruction& back_branch = instructions[end];
+        if (back_branch.op != OpCode::GOTO) {
+            // Leave between the copies when the bottom test fails
+            OpCode inverse = back_branch.op == OpCode::IF_TRUE ? OpCode::IF_FALSE : OpCode::IF_TRUE;
+            copy.emplace_back(inverse, header + "_x", back_branch.arg1);
+        }
+        for (size_t i = start + 1; i < end; ++i) {
+            IRInstruction instr = instructions[i];
+            instr.result = rename(instr.result);
+            if (instr.op != OpCode::CALL) {
+                instr.arg1 = rename(instr.arg1);
+                instr.arg2 = rename(instr.arg2);
+            }
+            copy.push_back(instr);
+        }
+        std::string exit_label;
+        if (back_branch.op != OpCode::GOTO) {
+            back_branch.arg1 = rename(back_branch.arg1);
+            exit_label = header + "_x";
+        }
+        copies.push_back({end, std::move(copy), exit_label});
+    }
+    if (copies.empty()) return;
+    
+    IRCode unrolled;
+    size_t grown = 0;
+    for (const auto& unrolled_loop : copies) grown += unrolled_loop.copy.size() + 1;
+    unrolled.reserve(instructions.size() + grown);
+    auto next = copies.begin();
+    for (size_t i = 0; i < instructions.size(); ++i) {
+        if (next == copies.end() || next->back_branch != i) {
+            unrolled.push_back(std::move(instructions[i]));
+            continue;
+        }
+        unrolled.insert(unrolled.end(), next->copy.begin(), next->copy.end());
+        unrolled.push_back(std::move(instructions[i]));
+        if (!next->exit_label.empty()) unrolled.emplace_back(OpCode::LABEL, next->exit_label);
+        ++next;
     }
+    instructions.swap(unrolled);
 }
 
 void AdvancedOptimizer::tail_call_optimization(IRCode& instructions) {
-    // Convert tail calls to jumps
+    // A self call whose result is returned directly becomes a jump back to the
+    // top of the function. Only calls without arguments qualify: the callee's
+    // parameters live in the caller's pushed arguments, which a jump cannot update.
+    // The rewritten code is built in a copy; only the function being
+    // rewritten moves when its entry label goes in
+    std::string current_function;
+    size_t function_start = 0;   // position in `optimized`
+    IRCode optimized;
+    optimized.reserve(instructions.size());
+    
     for (size_t i = 0; i < instructions.size(); ++i) {
-        if (instructions[i].op == OpCode::CALL && 
-            i + 1 < instructions.size() && 
-            instructions[i + 1].op == OpCode::RETURN) {
-            
-            // Replace call + return with jump
-            instructions[i].op = OpCode::GOTO;
-            instructions[i].result = instructions[i].arg1;
-            instructions[i].arg1 = "";
-            instructions[i].arg2 = "";
-            
-            // Remove the return instruction
-            instructions.erase(instructions.begin() + i + 1);
+        const auto& instr = instructions[i];
+        if (instr.op == OpCode::FUNCTION_BEGIN) {
+            current_function = instr.result;
+            function_start = optimized.size();
+            optimized.push_back(instr);
+            continue;
+        }
+        
+        if (instr.op != OpCode::CALL || instr.arg1 != current_function ||
+            i + 1 >= instructions.size() || instructions[i + 1].op != OpCode::RETURN ||
+            instructions[i + 1].arg1 != instr.result) {
+            optimized.push_back(instr);
+            continue;
+        }
+        if (instr.arg2 != "0") {
+            if (remarks) {
+                remarks->emit("tail-call", RemarkKind::Missed, "HasArguments", instructions, i,
+                              "self tail call passes arguments, which a jump cannot update",
+                              {{"Arguments", std::stoll(instr.arg2)}});
+            }
+            optimized.push_back(instr);
+            continue;
+        }
+        if (remarks) {
+            remarks->emit("tail-call", RemarkKind::Applied, "TailCallEliminated", instructions, i,
+                          "self tail call became a jump to the function entry");
+        }
+        
+        std::string entry = ".Ltail_" + current_function;
+        if (optimized.size() == function_start + 1 || optimized[function_start + 1].result != entry ||
+            !optimized[function_start + 1].is_label()) {
+            optimized.insert(optimized.begin() + function_start + 1, IRInstruction(OpCode::LABEL, entry));
         }
+        
+        optimized.emplace_back(OpCode::GOTO, entry, "", "", instr.line_number);
+        ++i;   // the return it replaces
     }
+    instructions.swap(optimized);
 }
 
 void AdvancedOptimizer::peephole_optimizations(IRCode& instructions) {
-    // Local optimizations on small instruction windows
-    for (size_t i = 0; i < instructions.size() - 1; ++i) {
-        // Pattern: load then store of same variable
-        if (instructions[i].op == OpCode::ASSIGN && 
-            instructions[i + 1].op == OpCode::ASSIGN &&
-            instructions[i].result == instructions[i + 1].arg1) {
-            
-            // Replace with direct assignment
-            instructions[i].arg1 = instructions[i + 1].arg1;
-            instructions.erase(instructions.begin() + i + 1);
+    std::unordered_map<std::string, int> use_count;
+    std::unordered_map<std::string, int> def_count;
+    for (const auto& instr : instructions) {
+        for (const auto& var : get_variables_used(instr)) ++use_count[var];
+        for (const auto& var : get_variables_defined(instr)) ++def_count[var];
+    }
+    
+    // Local optimizations on small instruction windows. Instructions are
+    // compacted in place: `first` is the last one kept, and a copy merged
+    // into it is dropped by not keeping it.
+    if (instructions.empty()) return;
+    size_t kept = 0;
+    for (size_t i = 1; i < instructions.size(); ++i) {
+        IRInstruction& first = instructions[kept];
+        const IRInstruction& second = instructions[i];
+        
+        // Pattern: temporary computed then copied, e.g. t = x + 1; x = t
+        if ((second.op == OpCode::ASSIGN || second.op == OpCode::COPY) &&
+            (is_pure(first) || first.op == OpCode::CALL) && first.op != OpCode::SELECT &&
+            first.result == second.arg1 && is_temporary(second.arg1) &&
+            use_count[second.arg1] == 1 && def_count[second.arg1] == 1) {
+            first.result = second.result;
+            continue;
         }
         
         // Pattern: add 0 or multiply by 1
-        if (instructions[i].op == OpCode::ADD && instructions[i].arg2 == "0") {
-            instructions[i].op = OpCode::ASSIGN;
-            instructions[i].arg2 = "";
+        if (first.op == OpCode::ADD && first.arg2 == "0") {
+            first.op = OpCode::ASSIGN;
+            first.arg2 = "";
         }
         
-        if (instructions[i].op == OpCode::MUL && instructions[i].arg2 == "1") {
-            instructions[i].op = OpCode::ASSIGN;
-            instructions[i].arg2 = "";
+        if (first.op == OpCode::MUL && first.arg2 == "1") {
+            first.op = OpCode::ASSIGN;
+            first.arg2 = "";
         }
+        if (++kept != i) instructions[kept] = std::move(instructions[i]);
     }
+    instructions.erase(instructions.begin() + kept + 1, instructions.end());
 }
 
 void AdvancedOptimizer::instruction_scheduling(IRCode& instructions) {
     // Simple instruction scheduling to reduce pipeline stalls
     // This is a placeholder for more sophisticated scheduling
     
-    // Look for independent instructions that can be reordered
-    for (size_t i = 0; i < instructions.size() - 1; ++i) {
-        if (!instructions[i].is_branch() && !instructions[i + 1].is_branch()) {
+    // Look for independent side-effect free instructions that can be reordered
+    for (size_t i = 0; i + 1 < instructions.size(); ++i) {
+        if (is_pure(instructions[i]) && is_pure(instructions[i + 1])) {
             auto used_i = get_variables_used(instructions[i]);
             auto def_i = get_variables_defined(instructions[i]);
             auto used_i1 = get_variables_used(instructions[i + 1]);
@@ -307,7 +810,7 @@ void AdvancedOptimizer::instruction_scheduling(IRCode& instructions) {
             // Check if instructions can be reordered
             bool can_reorder = true;
             for (const auto& var : def_i) {
-                if (used_i1.find(var) != used_i1.end()) {
+                if (used_i1.count(var) || def_i1.count(var)) {
                     can_reorder = false;
                     break;
                 }
@@ -325,11 +828,18 @@ void AdvancedOptimizer::instruction_scheduling(IRCode& instructions) {
             // If we can reorder and it's beneficial, swap them
             if (can_reorder && should_reorder_for_performance(instructions[i], instructions[i + 1])) {
                 std::swap(instructions[i], instructions[i + 1]);
+                ++i;
             }
         }
     }
 }
 
+void AdvancedOptimizer::graph_coloring_allocation(IRCode& instructions) {
+    GraphColoringAllocator allocator;
+    register_assignment = allocator.allocate(instructions);
+    allocation_stats = allocator.get_stats();
+}
+
 bool AdvancedOptimizer::should_reorder_for_performance(const IRInstruction& first, const IRInstruction& second) {
     // Heuristic: put memory operations before arithmetic operations
     if (first.op == OpCode::ASSIGN && 
@@ -345,6 +855,11 @@ bool AdvancedOptimizer::should_reorder_for_performance(const IRInstruction& firs
 std::set<std::string> AdvancedOptimizer::get_variables_used(const IRInstruction& instr) {
     std::set<std::string> used;
     
+    // Call operands are the callee name and argument count
+    if (instr.op == OpCode::CALL) {
+        return used;
+    }
+    
     if (!instr.arg1.empty() && !is_constant(instr.arg1)) {
         used.insert(instr.arg1);
     }
@@ -353,19 +868,106 @@ std::set<std::string> AdvancedOptimizer::get_variables_used(const IRInstruction&
         used.insert(instr.arg2);
     }
     
+    // A store to one element keeps the rest of the array live, and a select
+    // keeps the old value when its condition is false
+    if (instr.op == OpCode::ARRAY_ASSIGN || instr.op == OpCode::SELECT) {
+        used.insert(instr.result);
+    }
+    
     return used;
 }
 
 std::set<std::string> AdvancedOptimizer::get_variables_defined(const IRInstruction& instr) {
     std::set<std::string> defined;
     
-    if (instr.modifies_result() && !instr.result.empty()) {
+    if ((is_pure(instr) || instr.op == OpCode::CALL || instr.op == OpCode::LOAD_PARAM) &&
+        !instr.result.empty()) {
         defined.insert(instr.result);
     }
     
     return defined;
 }
 
+std::vector<size_t> AdvancedOptimizer::get_successors(const IRCode& instructions, size_t index) const {
+    std::vector<size_t> successors;
+    const auto& instr = instructions[index];
+    
+    if (instr.op == OpCode::RETURN || instr.op == OpCode::FUNCTION_END) {
+        return successors;
+    }
+    
+    if (instr.is_branch()) {
+        auto target = label_positions.find(instr.result);
+        if (target != label_positions.end()) {
+            successors.push_back(target->second);
+        }
+    }
+    
+    if (instr.op != OpCode::GOTO && index + 1 < instructions.size()) {
+        successors.push_back(index + 1);
+    }
+    
+    return successors;
+}
+
+std::vector<std::pair<size_t, size_t>> AdvancedOptimizer::find_loops(const IRCode& instructions) const {
+    // A loop is a label and the last backward branch to it, in branch order
+    std::unordered_map<std::string, size_t> labels;
+    std::map<std::string, std::pair<size_t, size_t>> by_header;
+    
+    for (size_t i = 0; i < instructions.size(); ++i) {
+        const auto& instr = instructions[i];
+        if (instr.is_label()) {
+            labels[instr.result] = i;
+        } else if (instr.is_branch()) {
+            auto target = labels.find(instr.result);
+            if (target != labels.end()) {
+                by_header[instr.result] = {target->second, i};
+            }
+        }
+    }
+    
+    std::vector<std::pair<size_t, size_t>> loops;
+    for (const auto& entry : by_header) {
+        loops.push_back(entry.second);
+    }
+    std::sort(loops.begin(), loops.end(),
+              [](const auto& a, const auto& b) { return a.second < b.second; });
+    return loops;
+}
+
+bool AdvancedOptimizer::is_pure(const IRInstruction& instr) const {
+    // Instructions whose only effect is defining their result
+    switch (instr.op) {
+        case OpCode::ADD: case OpCode::SUB: case OpCode::MUL: case OpCode::DIV: case OpCode::MOD:
+        case OpCode::EQ: case OpCode::NE: case OpCode::LT: case OpCode::LE: case OpCode::GT: case OpCode::GE:
+        case OpCode::AND: case OpCode::OR: case OpCode::NOT:
+        case OpCode::BIT_AND: case OpCode::BIT_OR: case OpCode::BIT_XOR: case OpCode::BIT_NOT:
+        case OpCode::SHL: case OpCode::SHR:
+        case OpCode::ASSIGN: case OpCode::COPY: case OpCode::SELECT: case OpCode::ARRAY_ACCESS:
+            return !instr.result.empty();
+        default:
+            return false;
+    }
+}
+
+bool AdvancedOptimizer::is_temporary(const std::string& name) const {
+    // IRGenerator temporaries are t0, t1, ...; they are defined once
+    return name.size() > 1 && name[0] == 't' && std::isdigit(static_cast<unsigned char>(name[1]));
+}
+
+int AdvancedOptimizer::next_temporary(const IRCode& instructions) const {
+    int next = 0;
+    for (const auto& instr : instructions) {
+        for (const auto* name : {&instr.result, &instr.arg1, &instr.arg2}) {
+            if (is_temporary(*name) && name->find_first_not_of("0123456789", 1) == std::string::npos) {
+                next = std::max(next, std::stoi(name->substr(1)) + 1);
+            }
+        }
+    }
+    return next;
+}
+
 bool AdvancedOptimizer::is_loop_invariant(const IRInstruction& instr, const std::set<std::string>& loop_vars) {
     // Check if instruction is loop invariant
     auto used_vars = get_variables_used(instr);
@@ -389,6 +991,10 @@ void AdvancedOptimizer::print_optimization_stats() const {
     std::cout << "Reaching definitions computed: " << reaching_definitions.size() << " points" << std::endl;
     std::cout << "Liveness analysis completed: " << liveness_info.size() << " instructions" << std::endl;
     std::cout << "Available expressions: " << available_expressions.size() << " points" << std::endl;
+    std::cout << "Registers: " << allocation_stats.colored << " colored, "
+              << allocation_stats.spilled << " spilled, "
+              << allocation_stats.rematerialized << " rematerialized, "
+              << allocation_stats.coalesced_moves << " moves coalesced" << std::endl;
     std::cout << "========================================" << std::endl;
 }
 
@@ -403,8 +1009,33 @@ bool AdvancedOptimizer::update_reaching_definitions(const IRCode& instructions)
 }
 
 bool AdvancedOptimizer::update_liveness_info(const IRCode& instructions) {
-    // TODO: implement liveness analysis iteration
-    return false;
+    // One backward sweep: out = union of successors' in, in = use + (out - def)
+    bool changed = false;
+    
+    for (size_t i = instructions.size(); i-- > 0;) {
+        LivenessInfo& info = liveness_info[i];
+        
+        std::set<std::string> live_out;
+        for (size_t succ : get_successors(instructions, i)) {
+            const auto& succ_in = liveness_info[succ].live_in;
+            live_out.insert(succ_in.begin(), succ_in.end());
+        }
+        
+        std::set<std::string> live_in = info.use;
+        for (const auto& var : live_out) {
+            if (info.def.find(var) == info.def.end()) {
+                live_in.insert(var);
+            }
+        }
+        
+        if (live_out != info.live_out || live_in != info.live_in) {
+            info.live_out.swap(live_out);
+            info.live_in.swap(live_in);
+            changed = true;
+        }
+    }
+    
+    return changed;
 }
 
 bool AdvancedOptimizer::update_available_expressions(const IRCode& instructions) {
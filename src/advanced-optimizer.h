@@ -2,6 +2,9 @@
 
 #include "ir-types.h"
 #include "cfg.h"
+#include "graph-coloring-allocator.h"
+#include "optimization-remarks.h"
+#include "compile-budget.h"
 #include <vector>
 #include <set>
 #include <map>
@@ -39,6 +42,28 @@ private:
     
     // Control flow graph
     std::unique_ptr<ControlFlowGraph> cfg;
+    std::unordered_map<std::string, size_t> label_positions;
+    
+    // Register allocation results for the code generator
+    RegisterAssignment register_assignment;
+    AllocationStats allocation_stats;
+    
+    // -Os: skip transforms that trade code size for speed
+    bool optimize_for_size;
+    
+    // -fsave-optimization-record: where passes report their decisions (null: off)
+    RemarkCollector* remarks;
+    
+    // Size limits past which the superlinear passes skip a function
+    CompileBudget budget;
+    
+    // Lowest temporary number free in the whole program, for passes that
+    // see only part of it
+    int first_free_temp;
+    
+    // Labels made by jump threading are numbered across calls, so a program
+    // optimized a function at a time gets no duplicates
+    int thread_labels;
     
     // Helper methods for data flow analysis
     void initialize_dataflow_sets(const IRCode& instructions);
@@ -53,6 +78,12 @@ private:
     std::set<std::string> get_variables_defined(const IRInstruction& instr);
     bool is_loop_invariant(const IRInstruction& instr, const std::set<std::string>& loop_vars);
     std::string get_expression_key(const IRInstruction& instr);
+    std::vector<size_t> get_successors(const IRCode& instructions, size_t index) const;
+    std::vector<std::pair<size_t, size_t>> find_loops(const IRCode& instructions) const;
+    bool is_pure(const IRInstruction& instr) const;
+    bool is_temporary(const std::string& name) const;
+    int next_temporary(const IRCode& instructions) const;
+    void eliminate_dead_code(IRCode& instructions);
     
 public:
     AdvancedOptimizer();
@@ -61,6 +92,9 @@ public:
     // Main optimization interface
     void apply_dataflow_optimizations(IRCode& instructions);
     void apply_aggressive_optimizations(IRCode& instructions);
+    void set_optimize_for_size(bool enable) { optimize_for_size = enable; }
+    void set_remarks(RemarkCollector* collector) { remarks = collector; }
+    void set_budget(const CompileBudget& limits) { budget = limits; }
     
     // Data flow optimizations
     void reaching_definitions_analysis(const IRCode& instructions);
@@ -69,6 +103,8 @@ public:
     
     // Control flow optimizations
     void unreachable_code_elimination(IRCode& instructions);
+    void simplify_cfg(IRCode& instructions);
+    void if_conversion(IRCode& instructions);
     void loop_invariant_code_motion(IRCode& instructions);
     void strength_reduction(IRCode& instructions);
     void loop_unrolling(IRCode& instructions);
@@ -77,6 +113,7 @@ public:
     // Advanced register allocation
     void graph_coloring_allocation(IRCode& instructions);
     void linear_scan_allocation(IRCode& instructions);
+    const RegisterAssignment& get_register_assignment() const { return register_assignment; }
     
     // Peephole optimizations
     void peephole_optimizations(IRCode& instructions);
@@ -1,106 +1,499 @@
 // Assembly Generator: emits x86_64 assembly from IR
 #include "assembly-generator.h"
+#include "cfg.h"
+#include "block-layout.h"
+#include "profile-instrumenter.h"
 #include <iostream>
 #include <sstream>
+#include <cstdlib>
+#include <algorithm>
 
-AssemblyGenerator::AssemblyGenerator(const std::string& output_filename) 
-    : register_allocator(std::make_unique<RegisterAllocator>()),
-      stack_offset(0), label_counter(0), current_stack_size(0) {
+namespace {
+
+// -finstrument-functions table row: calls, inclusive cycles, exclusive
+// cycles, and a flag the report sets once the row is printed
+constexpr size_t TIMER_ROW_BYTES = 32;
+
+// Shadow stack of [entry timestamp, cycles spent in callees] per active
+// call; deep enough for any recursion that fits in an 8 MiB stack
+constexpr size_t TIMER_STACK_ENTRIES = size_t(1) << 20;
+
+const char* const TIMER_TITLE = "function calls inclusive-cycles exclusive-cycles";
+
+// Condition code suffix for a comparison; NOT compares against zero
+std::string condition_code(OpCode op, bool negate = false) {
+    switch (op) {
+        case OpCode::EQ: case OpCode::NOT: return negate ? "ne" : "e";
+        case OpCode::NE: return negate ? "e" : "ne";
+        case OpCode::LT: return negate ? "ge" : "l";
+        case OpCode::LE: return negate ? "g" : "le";
+        case OpCode::GT: return negate ? "le" : "g";
+        case OpCode::GE: return negate ? "l" : "ge";
+        default: return negate ? "ne" : "e";
+    }
+}
+
+// Variables an instruction reads or writes through its frame location
+std::vector<std::string> frame_operands(const IRInstruction& instr) {
+    std::vector<std::string> operands;
+    auto add = [&operands](const std::string& var) {
+        if (!var.empty() && !std::isdigit(var[0]) && var[0] != '-') {
+            operands.push_back(var);
+        }
+    };
     
+    switch (instr.op) {
+        case OpCode::LABEL:
+        case OpCode::GOTO:
+            break;
+        case OpCode::IF_FALSE:
+        case OpCode::IF_TRUE:
+            add(instr.arg1);
+            break;
+        case OpCode::CALL:
+        case OpCode::LOAD_PARAM:
+            add(instr.result);
+            break;
+        default:
+            add(instr.result);
+            add(instr.arg1);
+            add(instr.arg2);
+            break;
+    }
+    return operands;
+}
+
+} // namespace
+
+AssemblyGenerator::AssemblyGenerator(const std::string& output_filename)
+    : AssemblyGenerator(output_file) {
     output_file.open(output_filename);
     if (!output_file.is_open()) {
         throw std::runtime_error("Failed to open output file: " + output_filename);
     }
 }
 
+AssemblyGenerator::AssemblyGenerator(std::ostream& output_stream)
+    : register_allocator(std::make_unique<RegisterAllocator>()), output(&output_stream),
+      stack_offset(0), label_counter(0), debug_line(0), current_allocation(nullptr),
+      saved_registers(0), function_begin(0), current_instruction(0), current_stack_size(0),
+      omit_frame_pointer(false), pushed_bytes(8), push_depth(0), shrink_wrap(false),
+      frame_shrink_wrapped(false), frame_active(true), frame_setup_index(SIZE_MAX),
+      block_layout(false), profile_generate(false), profile_checksum(0), profile_counters(0),
+      instrument_functions(false), optimize_size(false), buffering(false), red_zone_slots(false) {}
+
 AssemblyGenerator::~AssemblyGenerator() {
     close_output();
 }
 
+void AssemblyGenerator::set_register_assignment(const RegisterAssignment& assignment) {
+    register_assignment = assignment;
+}
+
+void AssemblyGenerator::set_target(const TargetMachine& machine) {
+    target = machine;
+}
+
+void AssemblyGenerator::set_omit_frame_pointer(bool omit) {
+    omit_frame_pointer = omit;
+}
+
+void AssemblyGenerator::set_shrink_wrap(bool enable) {
+    shrink_wrap = enable;
+}
+
+void AssemblyGenerator::set_block_layout(bool enable) {
+    block_layout = enable;
+}
+
+void AssemblyGenerator::set_profile_generate(const std::string& path, uint64_t checksum, size_t counters) {
+    profile_generate = true;
+    profile_path = path;
+    profile_checksum = checksum;
+    profile_counters = counters;
+}
+
+void AssemblyGenerator::set_instrument_functions(bool enable) {
+    instrument_functions = enable;
+}
+
+void AssemblyGenerator::set_optimize_size(bool enable) {
+    optimize_size = enable;
+}
+
+void AssemblyGenerator::set_debug_source(const std::string& source) {
+    debug_source = source;
+}
+
 void AssemblyGenerator::generate_from_ir(const IRCode& instructions) {
+    buffering = optimize_size;
+    text_lines.clear();
+    
+    timed_functions.clear();
+    timer_rows.clear();
+    if (instrument_functions) {
+        for (const auto& instr : instructions) {
+            if (instr.op == OpCode::FUNCTION_BEGIN) {
+                timer_rows[instr.result] = timed_functions.size();
+                timed_functions.push_back(instr.result);
+            }
+        }
+    }
+    
     emit_program_header();
     emit_runtime_functions();
     
+    if (block_layout) {
+        noreturn_functions = BlockLayout::find_noreturn_functions(instructions);
+    }
+    generate_functions(instructions);
+    emit_program_footer();
+    output->flush();
+}
+
+void AssemblyGenerator::begin_program(const std::unordered_set<std::string>& defined_functions) {
+    buffering = false;
+    text_lines.clear();
+    timed_functions.clear();
+    timer_rows.clear();
+    
+    emit_program_header();
+    emit_runtime_functions();
+    noreturn_functions = BlockLayout::runtime_noreturn_functions(defined_functions);
+}
+
+void AssemblyGenerator::generate_function(const IRCode& function) {
+    if (block_layout) {
+        BlockLayout::add_noreturn_functions(function, noreturn_functions);
+    }
+    generate_functions(function);
+}
+
+void AssemblyGenerator::end_program() {
+    emit_program_footer();
+    output->flush();
+}
+
+void AssemblyGenerator::generate_functions(const IRCode& instructions) {
+    loop_headers.clear();
+    std::unordered_set<std::string> seen_labels;
     for (const auto& instr : instructions) {
-        emit_comment("IR: " + instr.to_string());
-        
-        switch (instr.op) {
-            case OpCode::ADD:
-            case OpCode::SUB:
-            case OpCode::MUL:
-            case OpCode::DIV:
-            case OpCode::MOD:
-                generate_arithmetic(instr);
-                break;
-                
-            case OpCode::EQ:
-            case OpCode::NE:
-            case OpCode::LT:
-            case OpCode::LE:
-            case OpCode::GT:
-            case OpCode::GE:
-                generate_comparison(instr);
-                break;
-                
-            case OpCode::ASSIGN:
-            case OpCode::COPY:
-                generate_assignment(instr);
-                break;
-                
-            case OpCode::GOTO:
-            case OpCode::IF_FALSE:
-            case OpCode::IF_TRUE:
-                generate_branch(instr);
-                break;
-                
-            case OpCode::CALL:
-                generate_function_call(instr);
-                break;
-                
-            case OpCode::RETURN:
-                generate_return(instr);
-                break;
-                
-            case OpCode::ARRAY_ACCESS:
-            case OpCode::ARRAY_ASSIGN:
-                generate_array_access(instr);
-                break;
-                
-            case OpCode::LABEL:
-                emit_label(instr.result);
-                break;
-                
-            case OpCode::FUNCTION_BEGIN:
-                process_function_begin(instr);
-                break;
-                
-            case OpCode::FUNCTION_END:
-                process_function_end(instr);
-                break;
-                
-            case OpCode::PARAM:
-                // Handle parameter passing
-                {
-                    std::string reg = register_allocator->allocate_register();
-                    std::string operand = get_operand(instr.arg1);
-                    emit_instruction("mov " + reg + ", " + operand);
-                    emit_instruction("push " + reg);
-                    register_allocator->free_register(reg);
-                }
+        if (instr.is_label()) {
+            seen_labels.insert(instr.result);
+        } else if (instr.is_branch() && seen_labels.count(instr.result)) {
+            loop_headers.insert(instr.result);
+        }
+    }
+    
+    for (size_t i = 0; i < instructions.size(); ++i) {
+        if (block_layout && instructions[i].op == OpCode::FUNCTION_BEGIN) {
+            i = generate_laid_out_function(instructions, i);
+        } else {
+            generate_instruction(instructions, i);
+        }
+    }
+    
+    if (buffering) {
+        size_optimizer.optimize(text_lines);
+        buffering = false;
+        for (const auto& line : text_lines) {
+            write_line(line.text);
+        }
+        text_lines.clear();
+    }
+}
+
+void AssemblyGenerator::generate_from_assembly(const std::string& functions) {
+    emit_program_header();
+    emit_runtime_functions();
+    *output << functions;
+    emit_program_footer();
+    output->flush();
+}
+
+void AssemblyGenerator::enter_instruction(size_t index, const IRInstruction& instr) {
+    current_instruction = index;
+    
+    // Instructions with no line keep the one before them
+    if (!debug_source.empty() && instr.line_number > 0 && instr.line_number != debug_line) {
+        debug_line = instr.line_number;
+        emit_instruction(".loc 1 " + std::to_string(debug_line));
+    }
+    
+    // Shrink-wrapped functions switch frame state at block boundaries
+    auto block = block_in_frame.find(index);
+    if (block != block_in_frame.end()) {
+        frame_active = block->second;
+    }
+    if (index == frame_setup_index) {
+        emit_frame_setup();
+    }
+    
+    emit_comment("IR: " + instr.to_string());
+}
+
+void AssemblyGenerator::generate_instruction(const IRCode& instructions, size_t i) {
+    const IRInstruction& instr = instructions[i];
+    enter_instruction(i, instr);
+    
+    switch (instr.op) {
+        case OpCode::ADD:
+        case OpCode::SUB:
+        case OpCode::MUL:
+        case OpCode::DIV:
+        case OpCode::MOD:
+            generate_arithmetic(instr);
+            break;
+            
+        case OpCode::BIT_NOT:
+            if (target.has(TargetFeature::BMI1) && fold_into_andn(instructions, i)) {
+                pending_not[instr.result] = instr.arg1;
                 break;
-                
-            default:
-                emit_comment("Unhandled IR instruction: " + instr.to_string());
+            }
+            generate_bitwise(instr);
+            break;
+            
+        case OpCode::BIT_AND:
+        case OpCode::BIT_OR:
+        case OpCode::BIT_XOR:
+            generate_bitwise(instr);
+            break;
+            
+        case OpCode::SHL:
+        case OpCode::SHR:
+            generate_shift(instr);
+            break;
+            
+        case OpCode::NOT:
+        case OpCode::EQ:
+        case OpCode::NE:
+        case OpCode::LT:
+        case OpCode::LE:
+        case OpCode::GT:
+        case OpCode::GE:
+            if (fuse_with_branch(instructions, i)) {
+                pending_compare.insert_or_assign(instr.result, instr);
                 break;
+            }
+            generate_comparison(instr);
+            break;
+            
+        case OpCode::ASSIGN:
+        case OpCode::COPY:
+            generate_assignment(instr);
+            break;
+            
+        case OpCode::SELECT:
+            generate_select(instr);
+            break;
+            
+        case OpCode::GOTO:
+        case OpCode::IF_FALSE:
+        case OpCode::IF_TRUE:
+            generate_branch(instr);
+            break;
+            
+        case OpCode::CALL:
+            generate_function_call(instr);
+            break;
+            
+        case OpCode::RETURN:
+            generate_return(instr);
+            break;
+            
+        case OpCode::ARRAY_ACCESS:
+        case OpCode::ARRAY_ASSIGN:
+            generate_array_access(instr);
+            break;
+            
+        case OpCode::LABEL:
+            if (loop_headers.count(instr.result) && !optimize_size) {
+                emit_instruction(".p2align 4,,10");
+            }
+            emit_label(instr.result);
+            break;
+            
+        case OpCode::FUNCTION_BEGIN:
+            layout_frame(instructions, i);
+            process_function_begin(instr);
+            break;
+            
+        case OpCode::FUNCTION_END:
+            process_function_end(instr);
+            break;
+            
+        case OpCode::PARAM:
+            // Handle parameter passing
+            {
+                PhysReg reg = register_allocator->allocate_register();
+                std::string operand = get_operand(instr.arg1);
+                emit_instruction("mov " + reg_name(reg) + ", " + operand);
+                emit_instruction("push " + reg_name(reg));
+                push_depth += 8;
+                register_allocator->free_register(reg);
+            }
+            break;
+            
+        case OpCode::PROFILE_COUNT:
+            // Counts recorded under -fprofile-use only guide optimization
+            if (profile_generate) {
+                emit_instruction("inc qword ptr [rip + __cmmc_profile_counters + " +
+                                 std::to_string(8 * std::stoul(instr.arg1)) + "]");
+            }
+            break;
+            
+        case OpCode::LOAD_PARAM:
+            // Parameters left in memory are addressed in place by layout_frame;
+            // deferred ones are loaded by emit_frame_setup
+            if (current_allocation && current_allocation->registers.count(instr.result) &&
+                !deferred_params.count(instr.result)) {
+                emit_instruction("mov " + get_location(instr.result) + ", " +
+                                 frame_address(8 + 8 * std::stoi(instr.arg1)));
+            }
+            break;
+            
+        default:
+            emit_comment("Unhandled IR instruction: " + instr.to_string());
+            break;
+    }
+}
+
+size_t AssemblyGenerator::generate_laid_out_function(const IRCode& instructions, size_t begin) {
+    BlockLayout layout(noreturn_functions);
+    layout.run(instructions, begin);
+    const std::vector<LayoutBlock>& blocks = layout.get_blocks();
+    const std::vector<int>& hot = layout.get_hot_order();
+    const std::vector<int>& cold = layout.get_cold_blocks();
+    const std::string& name = instructions[begin].result;
+    int exit = static_cast<int>(blocks.size()) - 1;
+    
+    // Block emitted right after each one in its section, -1 if none
+    std::vector<int> next(blocks.size(), -1);
+    for (size_t k = 0; k + 1 < hot.size(); ++k) next[hot[k]] = hot[k + 1];
+    for (size_t k = 0; k + 1 < cold.size(); ++k) next[cold[k]] = cold[k + 1];
+    
+    // Blocks without an IR label get one when a fall-through becomes a jump
+    std::vector<bool> needs_label(blocks.size(), false);
+    for (size_t b = 0; b < blocks.size(); ++b) {
+        int fallthrough = blocks[b].fallthrough;
+        if (fallthrough >= 0 && fallthrough != next[b]) needs_label[fallthrough] = true;
+    }
+    auto block_label = [&](int b) {
+        return blocks[b].label.empty() ? ".LB_" + name + "_" + std::to_string(b) : blocks[b].label;
+    };
+    
+    // Frame state is recorded per CFG block, which may span several of ours;
+    // each takes the state of the nearest one at or before it, -1 if none.
+    // Argument bytes pushed on entry are counted in IR order too, since a
+    // block from between a call's pushes may be emitted ahead of them
+    std::vector<int> frame_state(blocks.size(), -1);
+    std::vector<int> entry_push_depth(blocks.size(), 0);
+    int depth = 0;
+    for (size_t b = 0; b < blocks.size(); ++b) {
+        auto state = block_in_frame.find(blocks[b].begin);
+        if (state != block_in_frame.end()) {
+            frame_state[b] = state->second;
+        } else if (b > 0) {
+            frame_state[b] = frame_state[b - 1];
+        }
+        entry_push_depth[b] = depth;
+        for (size_t i = blocks[b].begin; i < blocks[b].end; ++i) {
+            if (instructions[i].op == OpCode::PARAM) {
+                depth += 8;
+            } else if (instructions[i].op == OpCode::CALL) {
+                depth -= 8 * std::stoi(instructions[i].arg2);
+            }
         }
     }
     
-    emit_program_footer();
+    auto emit_block = [&](int b) {
+        const LayoutBlock& block = blocks[b];
+        if (frame_state[b] >= 0) frame_active = frame_state[b];
+        push_depth = entry_push_depth[b];
+        if (block.label.empty() && needs_label[b]) emit_label(block_label(b));
+        for (size_t i = block.begin; i + 1 < block.end; ++i) {
+            generate_instruction(instructions, i);
+        }
+        
+        size_t last = block.end - 1;
+        const IRInstruction& instr = instructions[last];
+        int fallthrough = block.fallthrough;
+        if (!instr.is_branch() || block.target < 0) {
+            generate_instruction(instructions, last);
+        } else {
+            enter_instruction(last, instr);
+            if (instr.op == OpCode::GOTO) {
+                if (block.target != next[b]) generate_branch(instr);
+                return;
+            }
+            if (block.target == next[b] && fallthrough != next[b]) {
+                // Branch to the fall-through block instead, keeping the target adjacent
+                IRInstruction inverted = instr;
+                inverted.op = instr.op == OpCode::IF_FALSE ? OpCode::IF_TRUE : OpCode::IF_FALSE;
+                inverted.result = block_label(fallthrough);
+                generate_branch(inverted);
+                return;
+            }
+            generate_branch(instr);
+        }
+        if (fallthrough >= 0 && fallthrough != next[b]) {
+            emit_instruction("jmp " + block_label(fallthrough));
+        }
+    };
+    
+    generate_instruction(instructions, begin);
+    for (int b : hot) {
+        if (b != exit) emit_block(b);
+    }
+    
+    // Cold blocks go out of line so they do not dilute the hot code
+    if (!cold.empty()) {
+        emit_instruction(".section .text.unlikely,\"ax\",@progbits");
+        emit_label(name + ".cold");
+        for (int b : cold) emit_block(b);
+        emit_instruction(".text");
+    }
+    
+    emit_block(exit);
+    return blocks[exit].begin;
 }
 
 void AssemblyGenerator::generate_arithmetic(const IRInstruction& instr) {
-    std::string reg1 = register_allocator->allocate_register();
-    std::string reg2 = register_allocator->allocate_register();
+    bool is_division = instr.op == OpCode::DIV || instr.op == OpCode::MOD;
+    
+    // Signed division by 2^k: bias negative dividends by 2^k - 1, then shift
+    std::string divisor = get_operand(instr.arg2);
+    if (is_division && std::isdigit(divisor[0])) {
+        long long value = std::stoll(divisor);
+        int shift = __builtin_ctzll(static_cast<unsigned long long>(value));
+        if (value > 1 && (value & (value - 1)) == 0 && shift <= 31) {
+            PhysReg dividend = register_allocator->allocate_register();
+            PhysReg bias = register_allocator->allocate_register();
+            emit_instruction("mov " + reg_name(dividend) + ", " + get_operand(instr.arg1));
+            emit_instruction("mov " + reg_name(bias) + ", " + reg_name(dividend));
+            emit_instruction("sar " + reg_name(bias) + ", 63");
+            emit_instruction("shr " + reg_name(bias) + ", " + std::to_string(64 - shift));
+            emit_instruction("add " + reg_name(bias) + ", " + reg_name(dividend));
+            if (instr.op == OpCode::DIV) {
+                emit_instruction("sar " + reg_name(bias) + ", " + std::to_string(shift));
+                emit_instruction("mov " + get_location(instr.result) + ", " + reg_name(bias));
+            } else {
+                emit_instruction("and " + reg_name(bias) + ", " + std::to_string(-value));
+                emit_instruction("sub " + reg_name(dividend) + ", " + reg_name(bias));
+                emit_instruction("mov " + get_location(instr.result) + ", " + reg_name(dividend));
+            }
+            register_allocator->free_register(dividend);
+            register_allocator->free_register(bias);
+            return;
+        }
+    }
+    
+    PhysReg left = register_allocator->allocate_register();
+    // idiv overwrites rdx, so the divisor must live elsewhere
+    PhysReg right = register_allocator->allocate_register(
+        is_division ? reg_bit(PhysReg::RDX) : RegMask(0));
+    const std::string& reg1 = reg_name(left);
+    const std::string& reg2 = reg_name(right);
     
     // Load operands
     emit_instruction("mov " + reg1 + ", " + get_operand(instr.arg1));
@@ -118,14 +511,14 @@ void AssemblyGenerator::generate_arithmetic(const IRInstruction& instr) {
             emit_instruction("imul " + reg1 + ", " + reg2);
             break;
         case OpCode::DIV:
-            emit_instruction("xor rdx, rdx");  // Clear rdx for division
             emit_instruction("mov rax, " + reg1);
+            emit_instruction("cqo");  // Sign-extend rax into rdx for division
             emit_instruction("idiv " + reg2);
             emit_instruction("mov " + reg1 + ", rax");
             break;
         case OpCode::MOD:
-            emit_instruction("xor rdx, rdx");
             emit_instruction("mov rax, " + reg1);
+            emit_instruction("cqo");
             emit_instruction("idiv " + reg2);
             emit_instruction("mov " + reg1 + ", rdx");
             break;
@@ -134,53 +527,207 @@ void AssemblyGenerator::generate_arithmetic(const IRInstruction& instr) {
     }
     
     // Store result
-    emit_instruction("mov " + get_memory_location(instr.result) + ", " + reg1);
+    emit_instruction("mov " + get_location(instr.result) + ", " + reg1);
+    
+    register_allocator->free_register(left);
+    register_allocator->free_register(right);
+}
+
+bool AssemblyGenerator::fold_into_andn(const IRCode& instructions, size_t i) {
+    // ~x can wait for the & that is its only use when that comes later in the
+    // same block and nothing in between overwrites where x lives
+    const IRInstruction& instr = instructions[i];
+    std::string source = get_operand(instr.arg1);
+    for (size_t j = i + 1; j < instructions.size(); ++j) {
+        const IRInstruction& next = instructions[j];
+        switch (next.op) {
+            case OpCode::ADD: case OpCode::SUB: case OpCode::MUL:
+            case OpCode::BIT_AND: case OpCode::BIT_OR: case OpCode::BIT_XOR: case OpCode::BIT_NOT:
+            case OpCode::SHL: case OpCode::SHR:
+            case OpCode::EQ: case OpCode::NE: case OpCode::LT:
+            case OpCode::LE: case OpCode::GT: case OpCode::GE:
+            case OpCode::ASSIGN: case OpCode::COPY:
+                break;
+            default:
+                return false;
+        }
+        const auto used = next.get_used_variables();
+        if (std::find(used.begin(), used.end(), instr.result) != used.end()) {
+            return next.op == OpCode::BIT_AND && next.arg1 != next.arg2 && use_counts[instr.result] == 1;
+        }
+        if (!next.result.empty() && get_location(next.result) == source) return false;
+    }
+    return false;
+}
+
+void AssemblyGenerator::generate_bitwise(const IRInstruction& instr) {
+    PhysReg left = register_allocator->allocate_register();
+    const std::string& reg1 = reg_name(left);
+    
+    if (instr.op == OpCode::BIT_NOT) {
+        emit_instruction("mov " + reg1 + ", " + get_operand(instr.arg1));
+        emit_instruction("not " + reg1);
+        emit_instruction("mov " + get_location(instr.result) + ", " + reg1);
+        register_allocator->free_register(left);
+        return;
+    }
+    
+    PhysReg right = register_allocator->allocate_register();
+    const std::string& reg2 = reg_name(right);
     
-    register_allocator->free_register(reg1);
-    register_allocator->free_register(reg2);
+    // andn computes ~first & second
+    auto inverted = pending_not.find(instr.arg1);
+    bool swapped = inverted == pending_not.end();
+    if (swapped) inverted = pending_not.find(instr.arg2);
+    if (instr.op == OpCode::BIT_AND && inverted != pending_not.end()) {
+        emit_instruction("mov " + reg1 + ", " + get_operand(inverted->second));
+        emit_instruction("mov " + reg2 + ", " + get_operand(swapped ? instr.arg1 : instr.arg2));
+        emit_instruction("andn " + reg1 + ", " + reg1 + ", " + reg2);
+        pending_not.erase(inverted);
+    } else {
+        emit_instruction("mov " + reg1 + ", " + get_operand(instr.arg1));
+        emit_instruction("mov " + reg2 + ", " + get_operand(instr.arg2));
+        const char* mnemonic = instr.op == OpCode::BIT_AND ? "and " :
+                               instr.op == OpCode::BIT_OR ? "or " : "xor ";
+        emit_instruction(mnemonic + reg1 + ", " + reg2);
+    }
+    emit_instruction("mov " + get_location(instr.result) + ", " + reg1);
+    
+    register_allocator->free_register(left);
+    register_allocator->free_register(right);
+}
+
+void AssemblyGenerator::generate_shift(const IRInstruction& instr) {
+    bool left_shift = instr.op == OpCode::SHL;
+    std::string count = get_operand(instr.arg2);
+    
+    // Constant counts are masked to 0-63 as the hardware does
+    if (std::isdigit(count[0]) || count[0] == '-') {
+        PhysReg value = register_allocator->allocate_register();
+        emit_instruction("mov " + reg_name(value) + ", " + get_operand(instr.arg1));
+        emit_instruction(std::string(left_shift ? "shl " : "sar ") + reg_name(value) + ", " +
+                         std::to_string(std::stoll(count) & 63));
+        emit_instruction("mov " + get_location(instr.result) + ", " + reg_name(value));
+        register_allocator->free_register(value);
+        return;
+    }
+    
+    // BMI2 shifts take the count in any register; the legacy forms need cl
+    PhysReg amount = target.has(TargetFeature::BMI2) ? register_allocator->allocate_register() :
+        register_allocator->allocate_register(static_cast<RegMask>(~reg_bit(PhysReg::RCX)));
+    PhysReg value = register_allocator->allocate_register(reg_bit(PhysReg::RCX));
+    emit_instruction("mov " + reg_name(value) + ", " + get_operand(instr.arg1));
+    emit_instruction("mov " + reg_name(amount) + ", " + count);
+    if (target.has(TargetFeature::BMI2)) {
+        emit_instruction(std::string(left_shift ? "shlx " : "sarx ") + reg_name(value) + ", " +
+                         reg_name(value) + ", " + reg_name(amount));
+    } else {
+        emit_instruction(std::string(left_shift ? "shl " : "sar ") + reg_name(value) + ", cl");
+    }
+    emit_instruction("mov " + get_location(instr.result) + ", " + reg_name(value));
+    
+    register_allocator->free_register(value);
+    register_allocator->free_register(amount);
+}
+
+bool AssemblyGenerator::fuse_with_branch(const IRCode& instructions, size_t i) {
+    const IRInstruction& instr = instructions[i];
+    if (i + 1 >= instructions.size() || instructions[i + 1].arg1 != instr.result ||
+        (instructions[i + 1].op != OpCode::IF_FALSE && instructions[i + 1].op != OpCode::IF_TRUE)) {
+        return false;
+    }
+    
+    // The flags carry the result, so nothing else may read it
+    return use_counts[instr.result] == 1;
 }
 
 void AssemblyGenerator::generate_comparison(const IRInstruction& instr) {
-    std::string reg1 = register_allocator->allocate_register();
-    std::string reg2 = register_allocator->allocate_register();
+    PhysReg left = register_allocator->allocate_register();
+    PhysReg right = register_allocator->allocate_register();
+    const std::string& reg1 = reg_name(left);
+    const std::string& reg2 = reg_name(right);
     
     emit_instruction("mov " + reg1 + ", " + get_operand(instr.arg1));
-    emit_instruction("mov " + reg2 + ", " + get_operand(instr.arg2));
+    emit_instruction("mov " + reg2 + ", " + (instr.op == OpCode::NOT ? "0" : get_operand(instr.arg2)));
     emit_instruction("cmp " + reg1 + ", " + reg2);
     
-    std::string condition;
-    switch (instr.op) {
-        case OpCode::EQ: condition = "sete"; break;
-        case OpCode::NE: condition = "setne"; break;
-        case OpCode::LT: condition = "setl"; break;
-        case OpCode::LE: condition = "setle"; break;
-        case OpCode::GT: condition = "setg"; break;
-        case OpCode::GE: condition = "setge"; break;
-        default: condition = "sete"; break;
-    }
-    
-    emit_instruction(condition + " al");
+    emit_instruction("set" + condition_code(instr.op) + " al");
     emit_instruction("movzx " + reg1 + ", al");
-    emit_instruction("mov " + get_memory_location(instr.result) + ", " + reg1);
+    emit_instruction("mov " + get_location(instr.result) + ", " + reg1);
     
-    register_allocator->free_register(reg1);
-    register_allocator->free_register(reg2);
+    register_allocator->free_register(left);
+    register_allocator->free_register(right);
 }
 
 void AssemblyGenerator::generate_assignment(const IRInstruction& instr) {
-    std::string reg = register_allocator->allocate_register();
-    emit_instruction("mov " + reg + ", " + get_operand(instr.arg1));
-    emit_instruction("mov " + get_memory_location(instr.result) + ", " + reg);
+    // Rematerialized constants are materialized at each use instead
+    if (is_rematerialized(instr.result)) return;
+    
+    std::string source = get_operand(instr.arg1);
+    std::string dest = get_location(instr.result);
+    if (source == dest) return;  // coalesced copy
+    
+    // At most one side may be memory; immediates into memory need a register
+    bool dest_in_register = dest[0] != '[';
+    bool source_in_register = source[0] != '[' && !std::isdigit(source[0]) && source[0] != '-';
+    if (dest_in_register || source_in_register) {
+        emit_instruction("mov " + dest + ", " + source);
+        return;
+    }
+    
+    PhysReg reg = register_allocator->allocate_register();
+    emit_instruction("mov " + reg_name(reg) + ", " + source);
+    emit_instruction("mov " + dest + ", " + reg_name(reg));
     register_allocator->free_register(reg);
 }
 
+void AssemblyGenerator::generate_select(const IRInstruction& instr) {
+    PhysReg cond = register_allocator->allocate_register();
+    emit_instruction("mov " + reg_name(cond) + ", " + get_operand(instr.arg1));
+    emit_instruction("test " + reg_name(cond) + ", " + reg_name(cond));
+    
+    // cmov takes a register or memory source and a register destination
+    PhysReg value_reg = PhysReg::NONE;
+    std::string value = get_operand(instr.arg2);
+    if (std::isdigit(value[0]) || value[0] == '-') {
+        value_reg = register_allocator->allocate_register();
+        emit_instruction("mov " + reg_name(value_reg) + ", " + value);
+        value = reg_name(value_reg);
+    }
+    
+    std::string dest = get_location(instr.result);
+    if (dest[0] != '[') {
+        emit_instruction("cmovnz " + dest + ", " + value);
+    } else {
+        PhysReg merged = register_allocator->allocate_register();
+        emit_instruction("mov " + reg_name(merged) + ", " + dest);
+        emit_instruction("cmovnz " + reg_name(merged) + ", " + value);
+        emit_instruction("mov " + dest + ", " + reg_name(merged));
+        register_allocator->free_register(merged);
+    }
+    
+    register_allocator->free_register(value_reg);
+    register_allocator->free_register(cond);
+}
+
 void AssemblyGenerator::generate_branch(const IRInstruction& instr) {
+    auto fused = instr.op == OpCode::GOTO ? pending_compare.end() : pending_compare.find(instr.arg1);
     if (instr.op == OpCode::GOTO) {
         emit_instruction("jmp " + instr.result);
+    } else if (fused != pending_compare.end()) {
+        // cmp against the right operand where it lives; only the left needs a register
+        const IRInstruction& compare = fused->second;
+        PhysReg reg = register_allocator->allocate_register();
+        emit_instruction("mov " + reg_name(reg) + ", " + get_operand(compare.arg1));
+        emit_instruction("cmp " + reg_name(reg) + ", " +
+                         (compare.op == OpCode::NOT ? "0" : get_operand(compare.arg2)));
+        emit_instruction("j" + condition_code(compare.op, instr.op == OpCode::IF_FALSE) + " " + instr.result);
+        register_allocator->free_register(reg);
+        pending_compare.erase(fused);
     } else {
-        std::string reg = register_allocator->allocate_register();
-        emit_instruction("mov " + reg + ", " + get_operand(instr.arg1));
-        emit_instruction("test " + reg + ", " + reg);
+        PhysReg reg = register_allocator->allocate_register();
+        emit_instruction("mov " + reg_name(reg) + ", " + get_operand(instr.arg1));
+        emit_instruction("test " + reg_name(reg) + ", " + reg_name(reg));
         
         if (instr.op == OpCode::IF_FALSE) {
             emit_instruction("jz " + instr.result);
@@ -193,6 +740,22 @@ void AssemblyGenerator::generate_branch(const IRInstruction& instr) {
 }
 
 void AssemblyGenerator::generate_function_call(const IRInstruction& instr) {
+    // Caller-saved registers holding values that outlive the call
+    RegMask live = 0;
+    if (current_allocation) {
+        auto it = current_allocation->call_saves.find(current_instruction - function_begin);
+        if (it != current_allocation->call_saves.end()) {
+            live = it->second;
+        }
+    }
+    auto slot = [this](PhysReg reg) {
+        return frame_address(call_save_slots.at(reg));
+    };
+    
+    for (const auto& line : register_allocator->save_caller_saved_registers(live, slot)) {
+        emit_instruction(line);
+    }
+    
     // Function call with parameter count in arg2
     emit_instruction("call " + instr.arg1);
     
@@ -200,48 +763,235 @@ void AssemblyGenerator::generate_function_call(const IRInstruction& instr) {
     int param_count = std::stoi(instr.arg2);
     if (param_count > 0) {
         emit_instruction("add rsp, " + std::to_string(param_count * 8));
+        push_depth -= param_count * 8;
+    }
+    
+    for (const auto& line : register_allocator->restore_caller_saved_registers(live, slot)) {
+        emit_instruction(line);
     }
     
     // Store return value
     if (!instr.result.empty()) {
-        emit_instruction("mov " + get_memory_location(instr.result) + ", rax");
+        emit_instruction("mov " + get_location(instr.result) + ", rax");
     }
 }
 
 void AssemblyGenerator::generate_return(const IRInstruction& instr) {
     if (!instr.arg1.empty()) {
-        std::string reg = register_allocator->allocate_register();
-        emit_instruction("mov " + reg + ", " + get_operand(instr.arg1));
-        emit_instruction("mov rax, " + reg);
+        PhysReg reg = register_allocator->allocate_register();
+        emit_instruction("mov " + reg_name(reg) + ", " + get_operand(instr.arg1));
+        emit_instruction("mov rax, " + reg_name(reg));
         register_allocator->free_register(reg);
     }
     
-    emit_function_epilogue();
+    if (frame_active) {
+        emit_function_epilogue();
+    }
+    emit_timer_exit();
     emit_instruction("ret");
 }
 
 void AssemblyGenerator::generate_array_access(const IRInstruction& instr) {
-    std::string base_reg = register_allocator->allocate_register();
-    std::string index_reg = register_allocator->allocate_register();
+    PhysReg base = register_allocator->allocate_register();
+    PhysReg index = register_allocator->allocate_register();
+    const std::string& base_reg = reg_name(base);
+    const std::string& index_reg = reg_name(index);
     
     if (instr.op == OpCode::ARRAY_ACCESS) {
         // result = array[index]
-        emit_instruction("mov " + base_reg + ", " + get_memory_location(instr.arg1));
+        emit_instruction("mov " + base_reg + ", " + get_location(instr.arg1));
         emit_instruction("mov " + index_reg + ", " + get_operand(instr.arg2));
         emit_instruction("mov " + base_reg + ", [" + base_reg + " + " + index_reg + " * 8]");
-        emit_instruction("mov " + get_memory_location(instr.result) + ", " + base_reg);
+        emit_instruction("mov " + get_location(instr.result) + ", " + base_reg);
     } else {
         // array[index] = value
-        emit_instruction("mov " + base_reg + ", " + get_memory_location(instr.result));
+        emit_instruction("mov " + base_reg + ", " + get_location(instr.result));
         emit_instruction("mov " + index_reg + ", " + get_operand(instr.arg1));
-        std::string value_reg = register_allocator->allocate_register();
-        emit_instruction("mov " + value_reg + ", " + get_operand(instr.arg2));
-        emit_instruction("mov [" + base_reg + " + " + index_reg + " * 8], " + value_reg);
-        register_allocator->free_register(value_reg);
+        PhysReg value = register_allocator->allocate_register();
+        emit_instruction("mov " + reg_name(value) + ", " + get_operand(instr.arg2));
+        emit_instruction("mov [" + base_reg + " + " + index_reg + " * 8], " + reg_name(value));
+        register_allocator->free_register(value);
+    }
+    
+    register_allocator->free_register(base);
+    register_allocator->free_register(index);
+}
+
+void AssemblyGenerator::layout_frame(const IRCode& instructions, size_t begin) {
+    function_begin = begin;
+    auto it = register_assignment.find(instructions[begin].result);
+    current_allocation = it != register_assignment.end() ? &it->second : nullptr;
+    saved_registers = current_allocation ?
+        static_cast<RegMask>(current_allocation->used_registers & CALLEE_SAVED_REGS) : RegMask(0);
+    
+    // rbp and the callee-saved registers are pushed first; slots start under them
+    pushed_bytes = 8 * __builtin_popcount(saved_registers) + (omit_frame_pointer ? 0 : 8);
+    push_depth = 0;
+    int slot_bytes = 0;
+    bool is_leaf = true;
+    local_variables.clear();
+    use_counts.clear();
+    
+    auto add_slot = [&](const std::string& var) {
+        if (current_allocation && (current_allocation->registers.count(var) ||
+                                   current_allocation->constants.count(var))) {
+            return;
+        }
+        if (local_variables.count(var)) return;
+        slot_bytes += 8;
+        local_variables[var] = -(pushed_bytes + slot_bytes);
+    };
+    
+    for (size_t i = begin + 1; i < instructions.size(); ++i) {
+        const IRInstruction& instr = instructions[i];
+        if (instr.op == OpCode::FUNCTION_END) break;
+        if (instr.op == OpCode::CALL) is_leaf = false;
+        for (const auto& var : instr.get_used_variables()) ++use_counts[var];
+        
+        if (instr.op == OpCode::LOAD_PARAM) {
+            // Argument i sits above the return address
+            if (!current_allocation || !current_allocation->registers.count(instr.result)) {
+                local_variables.emplace(instr.result, 8 + 8 * std::stoi(instr.arg1));
+            }
+            continue;
+        }
+        for (const auto& var : frame_operands(instr)) {
+            add_slot(var);
+        }
+    }
+    
+    // One save slot per caller-saved register that some call must preserve
+    call_save_slots.clear();
+    RegMask call_saved = 0;
+    if (current_allocation) {
+        for (const auto& site : current_allocation->call_saves) {
+            call_saved |= site.second;
+        }
+    }
+    for (RegMask regs = call_saved; regs; regs &= static_cast<RegMask>(regs - 1)) {
+        slot_bytes += 8;
+        call_save_slots[static_cast<PhysReg>(__builtin_ctz(regs))] = -(pushed_bytes + slot_bytes);
+    }
+    
+    red_zone_slots = slot_bytes > 0;
+    if (omit_frame_pointer && is_leaf && slot_bytes <= 128) {
+        // Leaf functions keep their slots in the red zone below rsp
+        current_stack_size = 0;
+    } else {
+        // Keep rsp 16-byte aligned at call sites (the return address makes 8)
+        current_stack_size = ((8 + pushed_bytes + slot_bytes + 15) / 16) * 16 - 8 - pushed_bytes;
     }
     
-    register_allocator->free_register(base_reg);
-    register_allocator->free_register(index_reg);
+    frame_shrink_wrapped = false;
+    frame_setup_index = SIZE_MAX;
+    block_in_frame.clear();
+    deferred_params.clear();
+    if (shrink_wrap && omit_frame_pointer && (pushed_bytes > 0 || current_stack_size > 0)) {
+        plan_shrink_wrap(instructions, begin);
+    }
+    frame_active = !frame_shrink_wrapped;
+    
+    // Scratch registers must not disturb assigned registers, nor callee-saved
+    // registers the prologue does not save
+    register_allocator->reset();
+    register_allocator->reserve_registers(static_cast<RegMask>(
+        CALLEE_SAVED_REGS | (current_allocation ? current_allocation->used_registers : RegMask(0))));
+}
+
+void AssemblyGenerator::plan_shrink_wrap(const IRCode& instructions, size_t begin) {
+    size_t end = begin;
+    while (end < instructions.size() && instructions[end].op != OpCode::FUNCTION_END) {
+        ++end;
+    }
+    IRCode body(instructions.begin() + begin, instructions.begin() + std::min(end + 1, instructions.size()));
+    
+    ControlFlowGraph cfg;
+    cfg.build_from_ir(body);
+    cfg.compute_dominators();
+    cfg.compute_post_dominators();
+    BasicBlock* entry = cfg.get_entry_block();
+    
+    std::unordered_map<BasicBlock*, size_t> block_start;
+    size_t offset = begin;
+    for (const auto& block : cfg.get_blocks()) {
+        block_start[block.get()] = offset;
+        offset += block->instructions.size();
+    }
+    
+    // Parameters in callee-saved registers that are never reassigned can be
+    // read from their incoming slots until the frame exists
+    std::unordered_map<std::string, int> def_count;
+    for (const auto& instr : body) {
+        if (instr.modifies_result() && !instr.is_branch() && instr.op != OpCode::ARRAY_ASSIGN) {
+            ++def_count[instr.result];
+        }
+    }
+    std::unordered_map<std::string, int> deferrable;
+    for (const auto& instr : body) {
+        if (instr.op != OpCode::LOAD_PARAM || !current_allocation) continue;
+        auto reg = current_allocation->registers.find(instr.result);
+        if (reg != current_allocation->registers.end() &&
+            (reg_bit(reg->second) & CALLEE_SAVED_REGS) && def_count[instr.result] == 1) {
+            deferrable[instr.result] = 8 + 8 * std::stoi(instr.arg1);
+        }
+    }
+    
+    // Calls, callee-saved registers and slots beyond the red zone need the frame
+    auto needs_frame = [&](const IRInstruction& instr) {
+        if (instr.op == OpCode::CALL || instr.op == OpCode::PARAM) return true;
+        for (const auto& var : frame_operands(instr)) {
+            if (current_allocation) {
+                auto reg = current_allocation->registers.find(var);
+                if (reg != current_allocation->registers.end()) {
+                    if ((reg_bit(reg->second) & CALLEE_SAVED_REGS) && !deferrable.count(var)) return true;
+                    continue;
+                }
+            }
+            auto slot = local_variables.find(var);
+            if (slot != local_variables.end() && slot->second < -128) return true;
+        }
+        return false;
+    };
+    
+    // The frame goes in the nearest block dominating every use of it
+    BasicBlock* save = nullptr;
+    bool any_need = false;
+    for (const auto& block : cfg.get_blocks()) {
+        if (!cfg.dominates(entry, block.get())) continue;   // unreachable
+        for (const auto& instr : block->instructions) {
+            if (needs_frame(instr)) {
+                save = any_need ? cfg.nearest_common_dominator(save, block.get()) : block.get();
+                any_need = true;
+                break;
+            }
+        }
+    }
+    
+    // Setup must run once per call and cover everything reachable after it:
+    // hoist out of loops and past blocks that rejoin paths without the frame
+    auto movable_to = [&](BasicBlock* block) {
+        auto reached = cfg.get_reachable_blocks(block);
+        if (reached.count(block)) return false;   // in a loop
+        for (BasicBlock* other : reached) {
+            if (other != cfg.get_exit_block() && !cfg.dominates(block, other)) return false;
+        }
+        return true;
+    };
+    while (save && save != entry && !movable_to(save)) {
+        save = cfg.get_immediate_dominator(save);
+    }
+    
+    // Nothing to gain when every path through the function needs the frame
+    if (any_need && (!save || save == entry || cfg.post_dominates(save, entry))) return;
+    
+    frame_shrink_wrapped = true;
+    deferred_params = deferrable;
+    for (const auto& block : cfg.get_blocks()) {
+        block_in_frame[block_start[block.get()]] = save && cfg.dominates(save, block.get());
+    }
+    if (save) {
+        frame_setup_index = block_start[save] + (save->instructions.front().is_label() ? 1 : 0);
+    }
 }
 
 void AssemblyGenerator::process_function_begin(const IRInstruction& instr) {
@@ -250,27 +1000,128 @@ void AssemblyGenerator::process_function_begin(const IRInstruction& instr) {
 }
 
 void AssemblyGenerator::process_function_end(const IRInstruction& instr) {
-    emit_function_epilogue();
+    (void)instr;
+    // Falling off the end of a function returns to the caller
+    if (frame_active) {
+        emit_function_epilogue();
+    }
+    emit_timer_exit();
+    emit_instruction("ret");
     current_function.clear();
+    current_allocation = nullptr;
+    saved_registers = 0;
+    frame_shrink_wrapped = false;
+    frame_setup_index = SIZE_MAX;
+    frame_active = true;
+    block_in_frame.clear();
+    deferred_params.clear();
 }
 
 void AssemblyGenerator::emit_function_prologue(const std::string& func_name) {
     emit_label(func_name);
-    emit_instruction("push rbp");
-    emit_instruction("mov rbp, rsp");
+    emit_timer_entry(func_name);
+    if (!frame_shrink_wrapped) {
+        emit_frame_setup();
+    }
+}
+
+void AssemblyGenerator::emit_frame_setup() {
+    if (!omit_frame_pointer) {
+        emit_instruction("push rbp");
+        emit_instruction("mov rbp, rsp");
+    }
+    
+    for (const auto& line : register_allocator->save_callee_saved_registers(saved_registers)) {
+        emit_instruction(line);
+    }
+    
+    if (current_stack_size > 0) {
+        emit_instruction("sub rsp, " + std::to_string(current_stack_size));
+    }
+    frame_active = true;
+    
+    for (const auto& param : deferred_params) {
+        emit_instruction("mov " + reg_name(current_allocation->registers.at(param.first)) + ", " +
+                         frame_address(param.second));
+    }
+}
+
+void AssemblyGenerator::emit_timer_entry(const std::string& func_name) {
+    auto row = timer_rows.find(func_name);
+    if (row == timer_rows.end()) return;
     
-    // Reserve space for local variables (adjust as needed)
-    current_stack_size = 64; // Reserve 64 bytes for local variables
-    emit_instruction("sub rsp, " + std::to_string(current_stack_size));
+    // Arguments are on the stack, so rax and rdx are free on entry
+    emit_instruction("rdtsc");
+    emit_instruction("shl rdx, 32");
+    emit_instruction("or rax, rdx");
+    emit_instruction("mov rdx, [rip + __cmmc_timer_top]");
+    emit_instruction("add rdx, 16");
+    emit_instruction("mov [rip + __cmmc_timer_top], rdx");
+    emit_instruction("mov [rdx], rax");
+    emit_instruction("mov qword ptr [rdx + 8], 0");
+    emit_instruction("inc qword ptr [rip + __cmmc_timer_table + " +
+                     std::to_string(row->second * TIMER_ROW_BYTES) + "]");
+}
+
+void AssemblyGenerator::emit_timer_exit() {
+    auto row = timer_rows.find(current_function);
+    if (row == timer_rows.end()) return;
+    
+    // Runs after the epilogue, so only the return value in rax needs keeping;
+    // the elapsed cycles also count as callee time of the caller's entry
+    std::string base = "[rip + __cmmc_timer_table + " + std::to_string(row->second * TIMER_ROW_BYTES);
+    emit_instruction("mov r11, rax");
+    emit_instruction("rdtsc");
+    emit_instruction("shl rdx, 32");
+    emit_instruction("or rax, rdx");
+    emit_instruction("mov rcx, [rip + __cmmc_timer_top]");
+    emit_instruction("sub rax, [rcx]");
+    emit_instruction("add " + base + " + 8], rax");
+    emit_instruction("mov rdx, rax");
+    emit_instruction("sub rdx, [rcx + 8]");
+    emit_instruction("add " + base + " + 16], rdx");
+    emit_instruction("sub rcx, 16");
+    emit_instruction("mov [rip + __cmmc_timer_top], rcx");
+    emit_instruction("add [rcx + 8], rax");
+    emit_instruction("mov rax, r11");
 }
 
 void AssemblyGenerator::emit_function_epilogue() {
-    emit_instruction("mov rsp, rbp");
+    if (omit_frame_pointer) {
+        if (current_stack_size > 0) {
+            emit_instruction("add rsp, " + std::to_string(current_stack_size));
+        }
+        for (const auto& line : register_allocator->restore_callee_saved_registers(saved_registers)) {
+            emit_instruction(line);
+        }
+        return;
+    }
+    
+    int saved_count = __builtin_popcount(saved_registers);
+    if (saved_count == 0) {
+        emit_instruction("mov rsp, rbp");
+        emit_instruction("pop rbp");
+        return;
+    }
+    
+    emit_instruction("lea rsp, [rbp - " + std::to_string(8 * saved_count) + "]");
+    for (const auto& line : register_allocator->restore_callee_saved_registers(saved_registers)) {
+        emit_instruction(line);
+    }
     emit_instruction("pop rbp");
 }
 
 void AssemblyGenerator::emit_program_header() {
     emit_instruction(".intel_syntax noprefix");
+    if (!debug_source.empty()) {
+        std::string escaped;
+        for (char c : debug_source) {
+            if (c == '"' || c == '\\') escaped += '\\';
+            escaped += c;
+        }
+        emit_instruction(".file 1 \"" + escaped + "\"");
+    }
+    emit_comment("-march=" + target.describe());
     emit_instruction(".global _start");
     emit_instruction("");
     emit_instruction(".section .text");
@@ -279,6 +1130,16 @@ void AssemblyGenerator::emit_program_header() {
     // Program entry point
     emit_label("_start");
     emit_instruction("call main");
+    if (profile_generate) {
+        emit_instruction("push rax");
+        emit_instruction("call __cmmc_profile_dump");
+        emit_instruction("pop rax");
+    }
+    if (instrument_functions) {
+        emit_instruction("push rax");
+        emit_instruction("call __cmmc_timer_report");
+        emit_instruction("pop rax");
+    }
     emit_instruction("mov rdi, rax");        // Exit code
     emit_instruction("mov rax, 60");         // sys_exit
     emit_instruction("syscall");
@@ -290,11 +1151,50 @@ void AssemblyGenerator::emit_program_footer() {
     emit_instruction(".section .data");
     emit_instruction("input_buffer: .space 16");
     emit_instruction("output_buffer: .space 16");
+    
+    if (instrument_functions) {
+        emit_instruction(".p2align 3");
+        emit_instruction("__cmmc_timer_top: .quad __cmmc_timer_stack");
+        emit_instruction("__cmmc_timer_names:");
+        for (size_t i = 0; i < timed_functions.size(); ++i) {
+            emit_instruction(".quad __cmmc_timer_name_" + std::to_string(i) + ", " +
+                             std::to_string(timed_functions[i].size()));
+        }
+        for (size_t i = 0; i < timed_functions.size(); ++i) {
+            emit_instruction("__cmmc_timer_name_" + std::to_string(i) + ": .ascii \"" + timed_functions[i] + "\"");
+        }
+        emit_instruction("__cmmc_timer_title: .ascii \"" + std::string(TIMER_TITLE) + "\\n\"");
+        emit_instruction("__cmmc_timer_newline: .ascii \"\\n\"");
+        emit_instruction(".section .bss");
+        emit_instruction(".p2align 3");
+        emit_instruction("__cmmc_timer_table: .zero " +
+                         std::to_string(TIMER_ROW_BYTES * std::max<size_t>(timed_functions.size(), 1)));
+        emit_instruction("__cmmc_timer_stack: .zero " + std::to_string(16 * (TIMER_STACK_ENTRIES + 1)));
+        emit_instruction(".section .data");
+        emit_instruction("");
+    }
+    
+    if (profile_generate) {
+        // Profile file: magic, layout checksum, counter count, then the counters
+        std::string path;
+        for (char c : profile_path) {
+            if (c == '"' || c == '\\') path += '\\';
+            path += c;
+        }
+        emit_instruction("__cmmc_profile_path: .asciz \"" + path + "\"");
+        emit_instruction("__cmmc_profile_header: .ascii \"" + std::string(PROFILE_MAGIC) + "\"");
+        emit_instruction(".quad " + std::to_string(profile_checksum));
+        emit_instruction(".quad " + std::to_string(profile_counters));
+        emit_instruction("");
+        emit_instruction(".section .bss");
+        emit_instruction(".p2align 3");
+        emit_instruction("__cmmc_profile_counters: .zero " + std::to_string(8 * std::max<size_t>(profile_counters, 1)));
+    }
 }
 
 void AssemblyGenerator::emit_runtime_functions() {
     // Input function implementation
-    emit_label("input");
+    begin_runtime_routine("input");
     emit_instruction("push rbp");
     emit_instruction("mov rbp, rsp");
     emit_instruction("sub rsp, 16");
@@ -314,7 +1214,7 @@ void AssemblyGenerator::emit_runtime_functions() {
     emit_instruction("");
     
     // Output function implementation
-    emit_label("output");
+    begin_runtime_routine("output");
     emit_instruction("push rbp");
     emit_instruction("mov rbp, rsp");
     emit_instruction("sub rsp, 16");
@@ -336,7 +1236,7 @@ void AssemblyGenerator::emit_runtime_functions() {
     emit_instruction("");
     
     // Simple atoi implementation
-    emit_label("atoi");
+    begin_runtime_routine("atoi");
     emit_instruction("push rbp");
     emit_instruction("mov rbp, rsp");
     emit_instruction("xor rax, rax");
@@ -360,7 +1260,7 @@ void AssemblyGenerator::emit_runtime_functions() {
     emit_instruction("");
     
     // Simple itoa implementation
-    emit_label("itoa");
+    begin_runtime_routine("itoa");
     emit_instruction("push rbp");
     emit_instruction("mov rbp, rsp");
     emit_instruction("push rbx");
@@ -382,6 +1282,142 @@ void AssemblyGenerator::emit_runtime_functions() {
     emit_instruction("pop rbp");
     emit_instruction("ret");
     emit_instruction("");
+    
+    if (profile_generate) {
+        // Write the counters out when main returns; each run replaces the file
+        begin_runtime_routine("__cmmc_profile_dump");
+        emit_instruction("push rbx");
+        emit_instruction("mov rax, 2");             // sys_open
+        emit_instruction("lea rdi, [rip + __cmmc_profile_path]");
+        emit_instruction("mov rsi, 577");           // O_WRONLY | O_CREAT | O_TRUNC
+        emit_instruction("mov rdx, 420");           // 0644
+        emit_instruction("syscall");
+        emit_instruction("test rax, rax");
+        emit_instruction("js __cmmc_profile_done");
+        emit_instruction("mov rbx, rax");
+        
+        emit_instruction("mov rax, 1");             // sys_write
+        emit_instruction("mov rdi, rbx");
+        emit_instruction("lea rsi, [rip + __cmmc_profile_header]");
+        emit_instruction("mov rdx, 24");
+        emit_instruction("syscall");
+        emit_instruction("mov rax, 1");
+        emit_instruction("mov rdi, rbx");
+        emit_instruction("lea rsi, [rip + __cmmc_profile_counters]");
+        emit_instruction("mov rdx, " + std::to_string(8 * profile_counters));
+        emit_instruction("syscall");
+        
+        emit_instruction("mov rax, 3");             // sys_close
+        emit_instruction("mov rdi, rbx");
+        emit_instruction("syscall");
+        emit_label("__cmmc_profile_done");
+        emit_instruction("pop rbx");
+        emit_instruction("ret");
+        emit_instruction("");
+    }
+    
+    if (instrument_functions) {
+        // One line per function that ran, most exclusive cycles first: pick
+        // the largest unprinted row, print it, repeat
+        std::string rows = std::to_string(timed_functions.size());
+        begin_runtime_routine("__cmmc_timer_report");
+        emit_instruction("push rbx");
+        emit_instruction("push r12");
+        emit_instruction("push r13");
+        emit_instruction("push r14");
+        emit_instruction("mov rax, 1");             // sys_write
+        emit_instruction("mov rdi, 2");             // stderr
+        emit_instruction("lea rsi, [rip + __cmmc_timer_title]");
+        emit_instruction("mov rdx, " + std::to_string(std::string(TIMER_TITLE).size() + 1));
+        emit_instruction("syscall");
+        emit_instruction("mov r12, " + rows);
+        
+        emit_label("__cmmc_timer_pick");
+        emit_instruction("xor r13, r13");
+        emit_instruction("mov r14, -1");
+        emit_label("__cmmc_timer_scan");
+        emit_instruction("cmp r13, " + rows);
+        emit_instruction("jae __cmmc_timer_print");
+        emit_instruction("mov rbx, r13");
+        emit_instruction("shl rbx, 5");
+        emit_instruction("lea rax, [rip + __cmmc_timer_table]");
+        emit_instruction("add rbx, rax");
+        emit_instruction("cmp qword ptr [rbx + 24], 0");
+        emit_instruction("jne __cmmc_timer_skip");
+        emit_instruction("cmp r14, -1");
+        emit_instruction("je __cmmc_timer_take");
+        emit_instruction("cmp [rbx + 16], rcx");
+        emit_instruction("jbe __cmmc_timer_skip");
+        emit_label("__cmmc_timer_take");
+        emit_instruction("mov r14, r13");
+        emit_instruction("mov rcx, [rbx + 16]");
+        emit_label("__cmmc_timer_skip");
+        emit_instruction("inc r13");
+        emit_instruction("jmp __cmmc_timer_scan");
+        
+        emit_label("__cmmc_timer_print");
+        emit_instruction("mov rbx, r14");
+        emit_instruction("shl rbx, 5");
+        emit_instruction("lea rax, [rip + __cmmc_timer_table]");
+        emit_instruction("add rbx, rax");
+        emit_instruction("mov qword ptr [rbx + 24], 1");
+        emit_instruction("cmp qword ptr [rbx], 0");
+        emit_instruction("je __cmmc_timer_next");   // never called
+        emit_instruction("shl r14, 4");
+        emit_instruction("lea rax, [rip + __cmmc_timer_names]");
+        emit_instruction("add r14, rax");
+        emit_instruction("mov rax, 1");
+        emit_instruction("mov rdi, 2");
+        emit_instruction("mov rsi, [r14]");
+        emit_instruction("mov rdx, [r14 + 8]");
+        emit_instruction("syscall");
+        emit_instruction("mov rdi, [rbx]");
+        emit_instruction("call __cmmc_timer_number");
+        emit_instruction("mov rdi, [rbx + 8]");
+        emit_instruction("call __cmmc_timer_number");
+        emit_instruction("mov rdi, [rbx + 16]");
+        emit_instruction("call __cmmc_timer_number");
+        emit_instruction("mov rax, 1");
+        emit_instruction("mov rdi, 2");
+        emit_instruction("lea rsi, [rip + __cmmc_timer_newline]");
+        emit_instruction("mov rdx, 1");
+        emit_instruction("syscall");
+        emit_label("__cmmc_timer_next");
+        emit_instruction("dec r12");
+        emit_instruction("jnz __cmmc_timer_pick");
+        emit_instruction("pop r14");
+        emit_instruction("pop r13");
+        emit_instruction("pop r12");
+        emit_instruction("pop rbx");
+        emit_instruction("ret");
+        emit_instruction("");
+        
+        // Write a space and rdi in decimal to stderr
+        begin_runtime_routine("__cmmc_timer_number");
+        emit_instruction("sub rsp, 32");
+        emit_instruction("lea rsi, [rsp + 32]");
+        emit_instruction("mov rax, rdi");
+        emit_instruction("mov rcx, 10");
+        emit_label("__cmmc_timer_digit");
+        emit_instruction("xor edx, edx");
+        emit_instruction("div rcx");
+        emit_instruction("add dl, 48");
+        emit_instruction("dec rsi");
+        emit_instruction("mov [rsi], dl");
+        emit_instruction("test rax, rax");
+        emit_instruction("jnz __cmmc_timer_digit");
+        emit_instruction("dec rsi");
+        emit_instruction("mov byte ptr [rsi], 32");
+        emit_instruction("lea rdx, [rsp + 32]");
+        emit_instruction("sub rdx, rsi");
+        emit_instruction("mov rax, 1");
+        emit_instruction("mov rdi, 2");
+        emit_instruction("syscall");
+        emit_instruction("add rsp, 32");
+        emit_instruction("ret");
+        emit_instruction("");
+    }
+    runtime_routine.clear();
 }
 
 // Output helpers
@@ -394,40 +1430,101 @@ std::string AssemblyGenerator::get_operand(const std::string& operand) {
     }
     
     // It's a variable or temporary
-    return get_memory_location(operand);
+    return get_location(operand);
+}
+
+std::string AssemblyGenerator::get_location(const std::string& var) {
+    if (!frame_active) {
+        auto param = deferred_params.find(var);
+        if (param != deferred_params.end()) {
+            return frame_address(param->second);
+        }
+    }
+    if (current_allocation) {
+        auto constant = current_allocation->constants.find(var);
+        if (constant != current_allocation->constants.end()) {
+            return constant->second;
+        }
+        auto reg = current_allocation->registers.find(var);
+        if (reg != current_allocation->registers.end()) {
+            return reg_name(reg->second);
+        }
+    }
+    return get_memory_location(var);
 }
 
 std::string AssemblyGenerator::get_memory_location(const std::string& var) {
-    // Simple stack-based allocation
-    static std::unordered_map<std::string, int> var_offsets;
-    static int next_offset = -8;
-    
-    if (var_offsets.find(var) == var_offsets.end()) {
-        var_offsets[var] = next_offset;
-        next_offset -= 8;
+    // Stack slot assigned by layout_frame
+    auto it = local_variables.find(var);
+    if (it == local_variables.end()) {
+        throw std::runtime_error("No stack slot for variable: " + var);
     }
     
-    return "[rbp " + std::to_string(var_offsets[var]) + "]";
+    return frame_address(it->second);
+}
+
+std::string AssemblyGenerator::frame_address(int entry_offset) const {
+    if (omit_frame_pointer) {
+        int offset = entry_offset + push_depth + (frame_active ? pushed_bytes + current_stack_size : 0);
+        if (offset == 0) return "[rsp]";
+        return "[rsp " + std::string(offset < 0 ? "- " : "+ ") + std::to_string(std::abs(offset)) + "]";
+    }
+    // rbp sits one slot below the return address
+    int offset = entry_offset + 8;
+    return "[rbp " + std::string(offset < 0 ? "- " : "+ ") + std::to_string(std::abs(offset)) + "]";
+}
+
+bool AssemblyGenerator::is_rematerialized(const std::string& var) const {
+    return current_allocation && current_allocation->constants.count(var) != 0;
 }
 
 void AssemblyGenerator::emit_instruction(const std::string& instr) {
-    output_file << "    " << instr << std::endl;
+    write_line("    " + instr);
 }
 
 void AssemblyGenerator::emit_label(const std::string& label) {
-    output_file << label << ":" << std::endl;
+    write_line(label + ":");
 }
 
 void AssemblyGenerator::emit_comment(const std::string& comment) {
-    output_file << "    # " << comment << std::endl;
+    write_line("    # " + comment);
+}
+
+void AssemblyGenerator::write_line(const std::string& line) {
+    // Flushed once a whole program is written, not per line
+    if (!buffering) {
+        *output << line << '\n';
+        return;
+    }
+    
+    AsmLine asm_line;
+    asm_line.text = line;
+    asm_line.routine = runtime_routine.empty() ? current_function : runtime_routine;
+    asm_line.runtime = !runtime_routine.empty();
+    // A call would overwrite red zone slots with its return address
+    bool uses_red_zone = omit_frame_pointer && red_zone_slots && (!frame_active || current_stack_size == 0);
+    asm_line.outlinable = runtime_routine.empty() && !current_function.empty() && !uses_red_zone;
+    text_lines.push_back(asm_line);
+}
+
+void AssemblyGenerator::begin_runtime_routine(const std::string& name) {
+    runtime_routine = name;
+    // Line 0: generated code with no source line of its own
+    if (debug_line != 0) {
+        debug_line = 0;
+        emit_instruction(".loc 1 0");
+    }
+    emit_label(name);
 }
 
 void AssemblyGenerator::close_output() {
     if (output_file.is_open()) {
         output_file.close();
+    } else {
+        output->flush();
     }
 }
 
 bool AssemblyGenerator::is_open() const {
-    return output_file.is_open();
+    return output == &output_file ? output_file.is_open() : static_cast<bool>(*output);
 }
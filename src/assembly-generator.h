@@ -2,34 +2,121 @@
 
 #include "ir-types.h"
 #include "register-allocator.h"
+#include "graph-coloring-allocator.h"
+#include "size-optimizer.h"
+#include "target-features.h"
 #include <fstream>
 #include <string>
 #include <vector>
 #include <map>
 #include <unordered_map>
+#include <unordered_set>
 #include <memory>
+#include <cstdint>
 
 class AssemblyGenerator {
 private:
     std::unique_ptr<RegisterAllocator> register_allocator;
     std::ofstream output_file;
+    std::ostream* output;   // output_file, or the stream given to the constructor
     int stack_offset;
     int label_counter;
     
+    // Instruction set extensions selected with -march
+    TargetMachine target;
+    
+    // BIT_NOT results folded into the andn of the BIT_AND right after them
+    std::unordered_map<std::string, std::string> pending_not;
+    
+    // Comparisons whose only use is the branch right after them; the branch
+    // emits the cmp and a conditional jump instead of testing a setcc result
+    std::unordered_map<std::string, IRInstruction> pending_compare;
+    
+    // -g: source file named by .file, and the line of the last .loc (0: none)
+    std::string debug_source;
+    int debug_line;
+    
+    // Register assignment from the -O3 allocator (empty: everything lives on the stack)
+    RegisterAssignment register_assignment;
+    
     // Function-level state
     std::string current_function;
+    const FunctionAllocation* current_allocation;
+    RegMask saved_registers;    // callee-saved registers pushed by the prologue
+    // Frame slots are kept as offsets from the stack pointer at function entry
     std::unordered_map<std::string, int> local_variables;
+    std::map<PhysReg, int> call_save_slots;   // frame slots for caller-saved registers
+    size_t function_begin;
+    std::unordered_map<std::string, int> use_counts;   // reads of each value in the function
+    size_t current_instruction;
     int current_stack_size;
     
+    // Frame pointer omission: slots are addressed from rsp, which moves by
+    // pushed_bytes in the prologue and by push_depth while arguments are pushed
+    bool omit_frame_pointer;
+    int pushed_bytes;   // rbp (when kept) and callee-saved registers
+    int push_depth;
+    
+    // Shrink-wrapping: the frame is set up at frame_setup_index rather than on
+    // entry, and only blocks that index dominates run with it
+    bool shrink_wrap;
+    bool frame_shrink_wrapped;
+    bool frame_active;
+    size_t frame_setup_index;
+    std::unordered_map<size_t, bool> block_in_frame;        // block start -> frame set up
+    std::unordered_map<std::string, int> deferred_params;   // loaded with the frame
+    
+    // Targets of backward branches, aligned for the loop they start
+    std::unordered_set<std::string> loop_headers;
+    
+    // Block placement: functions are emitted block by block in BlockLayout order
+    bool block_layout;
+    std::unordered_set<std::string> noreturn_functions;
+    
+    // -fprofile-generate: PROFILE_COUNTs bump .bss counters dumped when main returns
+    bool profile_generate;
+    std::string profile_path;
+    uint64_t profile_checksum;
+    size_t profile_counters;
+    
+    // -finstrument-functions: rdtsc hooks on entry and before each ret keep
+    // per-function calls and inclusive/exclusive cycles, reported on exit
+    bool instrument_functions;
+    std::vector<std::string> timed_functions;
+    std::unordered_map<std::string, size_t> timer_rows;
+    
+    // -Os: text is collected line by line and run through SizeOptimizer
+    // before it is written; frames with slots in the red zone cannot host
+    // calls to outlined code
+    bool optimize_size;
+    bool buffering;
+    std::vector<AsmLine> text_lines;
+    std::string runtime_routine;
+    bool red_zone_slots;
+    SizeOptimizer size_optimizer;
+    
     // Code generation helpers
     void emit_instruction(const std::string& instr);
     void emit_label(const std::string& label);
     void emit_comment(const std::string& comment);
+    void write_line(const std::string& line);
+    void begin_runtime_routine(const std::string& name);
+    
+    // Per-instruction emission; enter_instruction handles block-boundary frame state
+    void enter_instruction(size_t index, const IRInstruction& instr);
+    void generate_instruction(const IRCode& instructions, size_t i);
+    size_t generate_laid_out_function(const IRCode& instructions, size_t begin);
+    void generate_functions(const IRCode& instructions);
     
     // Assembly generation for specific IR operations
     void generate_arithmetic(const IRInstruction& instr);
+    void generate_bitwise(const IRInstruction& instr);
+    bool fold_into_andn(const IRCode& instructions, size_t i);
+    bool fuse_with_branch(const IRCode& instructions, size_t i);
+    void generate_shift(const IRInstruction& instr);
     void generate_comparison(const IRInstruction& instr);
     void generate_assignment(const IRInstruction& instr);
+    void generate_select(const IRInstruction& instr);
     void generate_branch(const IRInstruction& instr);
     void generate_function_call(const IRInstruction& instr);
     void generate_return(const IRInstruction& instr);
@@ -37,20 +124,70 @@ private:
     
     // Memory and register management
     std::string get_operand(const std::string& operand);
+    std::string get_location(const std::string& var);
     std::string get_memory_location(const std::string& var);
-    int get_variable_offset(const std::string& var);
+    std::string frame_address(int entry_offset) const;
+    bool is_rematerialized(const std::string& var) const;
     
     // Function management
+    void layout_frame(const IRCode& instructions, size_t begin);
+    void plan_shrink_wrap(const IRCode& instructions, size_t begin);
+    void emit_frame_setup();
+    void emit_timer_entry(const std::string& func_name);
+    void emit_timer_exit();
     void process_function_begin(const IRInstruction& instr);
     void process_function_end(const IRInstruction& instr);
     
 public:
     AssemblyGenerator(const std::string& output_filename);
+    explicit AssemblyGenerator(std::ostream& output_stream);   // e.g. an ostringstream; not owned
     ~AssemblyGenerator();
     
     // Main generation entry point
     void generate_from_ir(const IRCode& instructions);
     
+    // The same for a program lowered a function at a time: begin_program,
+    // generate_function as each function's IR is ready, then end_program.
+    // `defined_functions` names every function the program defines. The -Os
+    // passes and -finstrument-functions need the whole program up front and
+    // are not applied.
+    void begin_program(const std::unordered_set<std::string>& defined_functions);
+    void generate_function(const IRCode& function);
+    void end_program();
+    
+    // Wrap functions already in assembly (from BaselineCompiler) with the
+    // program header, runtime routines and footer
+    void generate_from_assembly(const std::string& functions);
+    
+    // Registers chosen by the graph-coloring allocator, used instead of stack slots
+    void set_register_assignment(const RegisterAssignment& assignment);
+    
+    // Machine whose extensions instruction selection may use
+    void set_target(const TargetMachine& machine);
+    const TargetMachine& get_target() const { return target; }
+    
+    // Address the frame from rsp and drop the prologue when nothing needs it
+    void set_omit_frame_pointer(bool omit);
+    
+    // Move the prologue off paths that need no frame (requires frame pointer omission)
+    void set_shrink_wrap(bool enable);
+    
+    // Reorder blocks for fall-through along likely paths and move cold ones out of line
+    void set_block_layout(bool enable);
+    
+    // Emit the counters laid out by ProfileInstrumenter and write them to `path` on exit
+    void set_profile_generate(const std::string& path, uint64_t checksum, size_t counters);
+    
+    // Time every program function with rdtsc and print a report to stderr at exit
+    void set_instrument_functions(bool enable);
+    
+    // Optimize for size: no loop alignment, plus the SizeOptimizer passes
+    void set_optimize_size(bool enable);
+    const SizeOptimizer& get_size_optimizer() const { return size_optimizer; }
+    
+    // Emit .file/.loc so the assembler writes a DWARF line table for `source`
+    void set_debug_source(const std::string& source);
+    
     // Function prologue and epilogue
     void emit_function_prologue(const std::string& func_name);
     void emit_function_epilogue();
@@ -11,6 +11,8 @@ class Visitor;
 // Base AST node
 class ASTNode {
 public:
+    int line = 0;   // source line the node starts on, 0 if unknown
+
     virtual ~ASTNode() = default;
     virtual void print(int indent = 0) const = 0;
     virtual void accept(Visitor& visitor) = 0;
@@ -0,0 +1,472 @@
+#include "baseline-compiler.h"
+#include <algorithm>
+#include <cstdlib>
+#include <iterator>
+#include <stdexcept>
+
+namespace {
+
+// Condition code suffix for a comparison operator, empty if it is not one
+std::string condition_code(const std::string& op, bool negate = false) {
+    if (op == "==") return negate ? "ne" : "e";
+    if (op == "!=") return negate ? "e" : "ne";
+    if (op == "<") return negate ? "ge" : "l";
+    if (op == "<=") return negate ? "g" : "le";
+    if (op == ">") return negate ? "le" : "g";
+    if (op == ">=") return negate ? "l" : "ge";
+    return "";
+}
+
+} // namespace
+
+BaselineCompiler::BaselineCompiler()
+    : frame_cursor(0), frame_bytes(0), label_counter(0), debug_lines(false), debug_line(0), tiering(false) {}
+
+void BaselineCompiler::set_debug_lines(bool enable) {
+    debug_lines = enable;
+}
+
+void BaselineCompiler::set_tiering(bool enable) {
+    tiering = enable;
+}
+
+std::string BaselineCompiler::compile(Program& program) {
+    text.str("");
+    body.str("");
+    bindings.clear();
+    scopes.clear();
+    globals.clear();
+    functions.clear();
+    label_counter = 0;
+    debug_line = 0;
+    visit(program);
+    return text.str();
+}
+
+void BaselineCompiler::emit(const std::string& instr) {
+    body << "    " << instr << "\n";
+}
+
+void BaselineCompiler::emit_label(const std::string& label) {
+    body << label << ":\n";
+}
+
+std::string BaselineCompiler::new_label() {
+    return ".LB" + std::to_string(label_counter++);
+}
+
+void BaselineCompiler::open_scope() {
+    scopes.emplace_back();
+}
+
+void BaselineCompiler::close_scope() {
+    for (const auto& name : scopes.back()) {
+        auto it = bindings.find(name);
+        it->second.pop_back();
+        if (it->second.empty()) bindings.erase(it);
+    }
+    scopes.pop_back();
+}
+
+void BaselineCompiler::bind(const std::string& name, const Storage& storage) {
+    bindings[name].push_back(storage);
+    scopes.back().push_back(name);
+}
+
+const BaselineCompiler::Storage& BaselineCompiler::lookup(const std::string& name) const {
+    auto it = bindings.find(name);
+    if (it == bindings.end()) {
+        throw std::runtime_error("baseline: undeclared variable " + name);
+    }
+    return it->second.back();
+}
+
+std::string BaselineCompiler::location(const Storage& storage) const {
+    if (storage.global) return "qword ptr [rip + " + storage.name + "]";
+    return "qword ptr [rbp " + std::string(storage.offset < 0 ? "- " : "+ ") +
+           std::to_string(std::abs(storage.offset)) + "]";
+}
+
+void BaselineCompiler::load_address(const Storage& storage, const std::string& reg) {
+    if (storage.indirect) {
+        emit("mov " + reg + ", " + location(storage));
+    } else if (storage.global) {
+        emit("lea " + reg + ", [rip + " + storage.name + "]");
+    } else {
+        emit("lea " + reg + ", [rbp - " + std::to_string(-storage.offset) + "]");
+    }
+}
+
+std::string BaselineCompiler::simple_operand(ASTNode* expr) const {
+    if (auto number = dynamic_cast<Number*>(expr)) return std::to_string(number->value);
+    if (auto var = dynamic_cast<Variable*>(expr)) {
+        if (var->index) return "";
+        const Storage& storage = lookup(var->name);
+        if (!storage.array) return location(storage);
+    }
+    return "";
+}
+
+std::string BaselineCompiler::generate_operands(ASTNode* left, ASTNode* right) {
+    std::string operand = simple_operand(right);
+    if (!operand.empty()) {
+        generate_expression(left);
+        return operand;
+    }
+    generate_expression(left);
+    emit("push rax");
+    generate_expression(right);
+    emit("mov rcx, rax");
+    emit("pop rax");
+    return "rcx";
+}
+
+void BaselineCompiler::generate_expression(ASTNode* expr) {
+    if (expr) expr->accept(*this);
+}
+
+void BaselineCompiler::generate_statement(ASTNode* stmt) {
+    if (!stmt) return;
+    if (debug_lines && stmt->line > 0 && stmt->line != debug_line) {
+        debug_line = stmt->line;
+        emit(".loc 1 " + std::to_string(debug_line));
+    }
+    stmt->accept(*this);
+}
+
+void BaselineCompiler::visit(Program& node) {
+    open_scope();
+    for (const auto& decl : node.declarations) {
+        decl->accept(*this);
+    }
+    close_scope();
+
+    if (tiering) {
+        emit_tiering_support();
+    }
+    if (!globals.empty()) {
+        text << ".section .bss\n";
+        text << ".p2align 3\n";
+        for (const auto& global : globals) {
+            text << global.first << ": .zero " << global.second << "\n";
+        }
+        text << ".section .text\n";
+    }
+}
+
+void BaselineCompiler::visit(VarDeclaration& node) {
+    Storage storage;
+    storage.array = node.arraySize >= 0;
+    int bytes = 8 * std::max(node.arraySize, 1);
+    if (scopes.size() == 1) {
+        storage.global = true;
+        storage.name = "__cmmc_global_" + node.name;
+        globals.push_back({storage.name, bytes});
+    } else {
+        // Arrays grow upward from their lowest slot
+        frame_cursor += bytes;
+        frame_bytes = std::max(frame_bytes, frame_cursor);
+        storage.offset = -frame_cursor;
+    }
+    bind(node.name, storage);
+}
+
+void BaselineCompiler::visit(FunDeclaration& node) {
+    body.str("");
+    frame_cursor = 0;
+    frame_bytes = 0;
+    return_label = new_label();
+    current_function = node.name;
+    functions.push_back(node.name);
+    if (tiering) {
+        emit("inc qword ptr [rip + " + calls_symbol(node.name) + "]");
+    }
+
+    // Arguments are pushed last to first, so argument i sits above the
+    // return address and the saved rbp
+    open_scope();
+    for (size_t i = 0; i < node.params.size(); ++i) {
+        Storage storage;
+        storage.offset = 16 + 8 * static_cast<int>(i);
+        storage.array = node.params[i]->isArray;
+        storage.indirect = storage.array;
+        bind(node.params[i]->name, storage);
+    }
+    if (debug_lines && node.line > 0) {
+        debug_line = node.line;
+        emit(".loc 1 " + std::to_string(debug_line));
+    }
+    generate_statement(node.body.get());
+    close_scope();
+
+    text << node.name << ":\n";
+    text << "    push rbp\n";
+    text << "    mov rbp, rsp\n";
+    if (frame_bytes > 0) {
+        text << "    sub rsp, " << (frame_bytes + 15) / 16 * 16 << "\n";
+    }
+    text << body.str();
+    text << return_label << ":\n";
+    text << "    leave\n";
+    text << "    ret\n";
+    text << "\n";
+}
+
+void BaselineCompiler::visit(Parameter& node) {
+    (void)node;
+}
+
+void BaselineCompiler::visit(CompoundStmt& node) {
+    // Slots of a block are free again once it ends
+    int saved_cursor = frame_cursor;
+    open_scope();
+    for (const auto& local : node.locals) {
+        local->accept(*this);
+    }
+    for (const auto& stmt : node.statements) {
+        generate_statement(stmt.get());
+    }
+    close_scope();
+    frame_cursor = saved_cursor;
+}
+
+void BaselineCompiler::visit(IfStmt& node) {
+    std::string else_label = new_label();
+    generate_condition(node.cond.get(), else_label, false);
+    generate_statement(node.thenStmt.get());
+    if (!node.elseStmt) {
+        emit_label(else_label);
+        return;
+    }
+    std::string end_label = new_label();
+    emit("jmp " + end_label);
+    emit_label(else_label);
+    generate_statement(node.elseStmt.get());
+    emit_label(end_label);
+}
+
+void BaselineCompiler::visit(WhileStmt& node) {
+    // Test at the bottom, entered from the top by one jump, so the condition
+    // is generated once and each iteration takes one branch
+    std::string body_label = new_label();
+    std::string test_label = new_label();
+    emit("jmp " + test_label);
+    emit_label(body_label);
+    if (tiering) {
+        emit("inc qword ptr [rip + " + back_edges_symbol(current_function) + "]");
+    }
+    generate_statement(node.body.get());
+    emit_label(test_label);
+    if (node.cond) {
+        generate_condition(node.cond.get(), body_label, true);
+    } else {
+        emit("jmp " + body_label);
+    }
+}
+
+void BaselineCompiler::visit(ReturnStmt& node) {
+    generate_expression(node.expr.get());
+    emit("jmp " + return_label);
+}
+
+void BaselineCompiler::visit(BinaryOp& node) {
+    const std::string& op = node.op;
+    if (op == "=") {
+        generate_assignment(node);
+        return;
+    }
+    if (op == "&&" || op == "||") {
+        // 0 or 1 through the same branches a condition uses
+        std::string false_label = new_label();
+        std::string end_label = new_label();
+        generate_condition(&node, false_label, false);
+        emit("mov eax, 1");
+        emit("jmp " + end_label);
+        emit_label(false_label);
+        emit("xor eax, eax");
+        emit_label(end_label);
+        return;
+    }
+
+    std::string cc = condition_code(op);
+    bool is_division = op == "/" || op == "%";
+    bool is_shift = op == "<<" || op == ">>";
+    std::string right = generate_operands(node.left.get(), node.right.get());
+    if ((is_division || is_shift) && right != "rcx") {
+        emit("mov rcx, " + right);
+        right = "rcx";
+    }
+
+    if (!cc.empty()) {
+        emit("cmp rax, " + right);
+        emit("set" + cc + " al");
+        emit("movzx eax, al");
+    } else if (op == "+") {
+        emit("add rax, " + right);
+    } else if (op == "-") {
+        emit("sub rax, " + right);
+    } else if (op == "*") {
+        emit("imul rax, " + right);
+    } else if (is_division) {
+        emit("cqo");
+        emit("idiv rcx");
+        if (op == "%") emit("mov rax, rdx");
+    } else if (op == "&") {
+        emit("and rax, " + right);
+    } else if (op == "|") {
+        emit("or rax, " + right);
+    } else if (op == "^") {
+        emit("xor rax, " + right);
+    } else if (op == "<<") {
+        emit("shl rax, cl");
+    } else if (op == ">>") {
+        emit("sar rax, cl");
+    } else {
+        throw std::runtime_error("baseline: unknown operator " + op);
+    }
+}
+
+void BaselineCompiler::visit(UnaryOp& node) {
+    generate_expression(node.operand.get());
+    if (node.op == "-") {
+        emit("neg rax");
+    } else if (node.op == "!") {
+        emit("test rax, rax");
+        emit("sete al");
+        emit("movzx eax, al");
+    } else if (node.op == "~") {
+        emit("not rax");
+    }
+}
+
+void BaselineCompiler::visit(Variable& node) {
+    const Storage& storage = lookup(node.name);
+    if (node.index) {
+        generate_expression(node.index.get());
+        load_address(storage, "rdx");
+        emit("mov rax, [rdx + rax * 8]");
+    } else if (storage.array) {
+        load_address(storage, "rax");
+    } else {
+        emit("mov rax, " + location(storage));
+    }
+}
+
+void BaselineCompiler::visit(Call& node) {
+    for (size_t i = node.args.size(); i-- > 0;) {
+        std::string operand = simple_operand(node.args[i].get());
+        if (!operand.empty()) {
+            emit("push " + operand);
+            continue;
+        }
+        generate_expression(node.args[i].get());
+        emit("push rax");
+    }
+    if (tiering && std::find(functions.begin(), functions.end(), node.name) != functions.end()) {
+        emit("call qword ptr [rip + " + slot_symbol(node.name) + "]");
+    } else {
+        emit("call " + node.name);
+    }
+    if (!node.args.empty()) {
+        emit("add rsp, " + std::to_string(8 * node.args.size()));
+    }
+}
+
+void BaselineCompiler::visit(Number& node) {
+    if (node.value == 0) {
+        emit("xor eax, eax");
+    } else {
+        emit("mov rax, " + std::to_string(node.value));
+    }
+}
+
+void BaselineCompiler::visit(ExpressionStmt& node) {
+    generate_expression(node.expr.get());
+}
+
+void BaselineCompiler::visit(EmptyStmt& node) {
+    (void)node;
+}
+
+void BaselineCompiler::generate_assignment(BinaryOp& assignment) {
+    auto var = dynamic_cast<Variable*>(assignment.left.get());
+    if (!var) throw std::runtime_error("baseline: assignment to a non-variable");
+
+    // The value is computed first, as the IR pipeline does
+    generate_expression(assignment.right.get());
+    const Storage& storage = lookup(var->name);
+    if (!var->index) {
+        emit("mov " + location(storage) + ", rax");
+        return;
+    }
+    emit("push rax");
+    generate_expression(var->index.get());
+    load_address(storage, "rdx");
+    emit("pop rcx");
+    emit("mov [rdx + rax * 8], rcx");
+    emit("mov rax, rcx");
+}
+
+void BaselineCompiler::emit_tiering_support() {
+    // rbx, rbp and r12-r15 belong to the host; optimized code may use them
+    static const char* const saved[] = {"rbx", "rbp", "r12", "r13", "r14", "r15"};
+    text << ENTRY_SYMBOL << ":\n";
+    for (const char* reg : saved) text << "    push " << reg << "\n";
+    text << "    call qword ptr [rip + " << slot_symbol("main") << "]\n";
+    for (size_t i = std::size(saved); i-- > 0;) text << "    pop " << saved[i] << "\n";
+    text << "    ret\n";
+    for (const auto& function : functions) {
+        text << stub_symbol(function) << ":\n";
+        text << "    jmp qword ptr [rip + " << slot_symbol(function) << "]\n";
+    }
+    text << "\n";
+
+    text << ".section .data\n";
+    text << ".p2align 3\n";
+    for (const auto& function : functions) {
+        text << slot_symbol(function) << ": .quad " << function << "\n";
+    }
+    text << ".section .bss\n";
+    text << ".p2align 3\n";
+    for (const auto& function : functions) {
+        text << calls_symbol(function) << ": .zero 8\n";
+        text << back_edges_symbol(function) << ": .zero 8\n";
+    }
+    text << ".section .text\n";
+}
+
+void BaselineCompiler::generate_condition(ASTNode* cond, const std::string& target, bool jump_if) {
+    // Jump to target when cond is jump_if, fall through otherwise
+    if (auto binary = dynamic_cast<BinaryOp*>(cond)) {
+        if (binary->op == "&&" || binary->op == "||") {
+            bool is_and = binary->op == "&&";
+            if (jump_if != is_and) {
+                generate_condition(binary->left.get(), target, jump_if);
+                generate_condition(binary->right.get(), target, jump_if);
+            } else {
+                std::string skip_label = new_label();
+                generate_condition(binary->left.get(), skip_label, !jump_if);
+                generate_condition(binary->right.get(), target, jump_if);
+                emit_label(skip_label);
+            }
+            return;
+        }
+        std::string cc = condition_code(binary->op, !jump_if);
+        if (!cc.empty()) {
+            std::string right = generate_operands(binary->left.get(), binary->right.get());
+            emit("cmp rax, " + right);
+            emit("j" + cc + " " + target);
+            return;
+        }
+    }
+    if (auto negation = dynamic_cast<UnaryOp*>(cond)) {
+        if (negation->op == "!") {
+            generate_condition(negation->operand.get(), target, !jump_if);
+            return;
+        }
+    }
+
+    generate_expression(cond);
+    emit("test rax, rax");
+    emit(std::string(jump_if ? "jnz " : "jz ") + target);
+}
@@ -0,0 +1,114 @@
+#pragma once
+
+#include "ast.h"
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// Single-pass code generator for --fast-compile: walks the checked AST once
+// and writes x86_64 assembly as it goes, with no IR, CFG or register
+// allocation. Expressions evaluate into rax with rcx and rdx as scratch and
+// the machine stack holding intermediate values; every variable lives in
+// memory. The code is slower than the IR pipeline's, but compile time is a
+// small constant per AST node.
+class BaselineCompiler : public Visitor {
+private:
+    // Where a name lives; arrays evaluate to their address
+    struct Storage {
+        int offset = 0;          // from rbp; unused for globals
+        bool global = false;     // in .bss as __cmmc_global_<name>
+        bool array = false;
+        bool indirect = false;   // array parameter: the slot holds the address
+        std::string name;
+    };
+    // Each visible name maps to its bindings, innermost last, so a lookup
+    // costs the same at any nesting depth; each open scope lists the names
+    // it bound, to drop them when it closes
+    std::unordered_map<std::string, std::vector<Storage>> bindings;
+    std::vector<std::vector<std::string>> scopes;
+    std::vector<std::pair<std::string, int>> globals;   // symbol, bytes
+
+    // Finished functions, then the one being generated: its frame size is
+    // known only at the end, so the prologue is written in front of it then
+    std::ostringstream text;
+    std::ostringstream body;
+    int frame_cursor;   // bytes of slots in the enclosing blocks
+    int frame_bytes;    // largest frame_cursor reached in the function
+    std::string return_label;
+    int label_counter;
+
+    // -g: emit .loc per statement line (the .file comes with the header)
+    bool debug_lines;
+    int debug_line;
+
+    // --jit: count calls and loop iterations, call through the dispatch table
+    bool tiering;
+    std::vector<std::string> functions;   // declared so far, in order
+    std::string current_function;
+
+    void emit(const std::string& instr);
+    void emit_label(const std::string& label);
+    std::string new_label();
+
+    void open_scope();
+    void close_scope();
+    void bind(const std::string& name, const Storage& storage);
+    const Storage& lookup(const std::string& name) const;
+    std::string location(const Storage& storage) const;
+    void load_address(const Storage& storage, const std::string& reg);
+
+    // Immediate or memory operand for constants and scalar variables; empty
+    // when the expression has to be evaluated
+    std::string simple_operand(ASTNode* expr) const;
+    // Evaluate `left` into rax and return the right operand: a simple one,
+    // or rcx holding the evaluated `right`
+    std::string generate_operands(ASTNode* left, ASTNode* right);
+
+    void generate_expression(ASTNode* expr);
+    void generate_statement(ASTNode* stmt);
+    void generate_assignment(BinaryOp& assignment);
+    void generate_condition(ASTNode* cond, const std::string& target, bool jump_if);
+    void emit_tiering_support();
+
+public:
+    BaselineCompiler();
+
+    // Emit .loc line directives (the caller's header names the file)
+    void set_debug_lines(bool enable);
+
+    // Tiered JIT hooks: each function bumps its call counter on entry and its
+    // back-edge counter once per loop iteration, and calls between functions
+    // go through a patchable slot holding the current code's address. Adds
+    // __cmmc_jit_entry, which calls main through its slot keeping the host's
+    // callee-saved registers, and a stub per function jumping through its slot.
+    void set_tiering(bool enable);
+    static std::string slot_symbol(const std::string& function) { return "__cmmc_slot_" + function; }
+    static std::string stub_symbol(const std::string& function) { return "__cmmc_stub_" + function; }
+    static std::string calls_symbol(const std::string& function) { return "__cmmc_calls_" + function; }
+    static std::string back_edges_symbol(const std::string& function) { return "__cmmc_loops_" + function; }
+    static constexpr const char* ENTRY_SYMBOL = "__cmmc_jit_entry";
+    // Functions of the last compile(), in declaration order
+    const std::vector<std::string>& get_functions() const { return functions; }
+
+    // Functions and globals of `program`, to be placed between the program
+    // header and footer of an AssemblyGenerator
+    std::string compile(Program& program);
+
+    void visit(Program& node) override;
+    void visit(VarDeclaration& node) override;
+    void visit(FunDeclaration& node) override;
+    void visit(Parameter& node) override;
+    void visit(CompoundStmt& node) override;
+    void visit(IfStmt& node) override;
+    void visit(WhileStmt& node) override;
+    void visit(ReturnStmt& node) override;
+    void visit(BinaryOp& node) override;
+    void visit(UnaryOp& node) override;
+    void visit(Variable& node) override;
+    void visit(Call& node) override;
+    void visit(Number& node) override;
+    void visit(ExpressionStmt& node) override;
+    void visit(EmptyStmt& node) override;
+};
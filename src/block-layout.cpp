@@ -0,0 +1,339 @@
+#include "block-layout.h"
+#include "profile-instrumenter.h"
+#include <algorithm>
+#include <cmath>
+#include <unordered_map>
+
+namespace {
+
+// Runtime routines that report an error and exit
+const char* const RUNTIME_NORETURN[] = { "runtime_error", "div_by_zero" };
+
+// Static branch probabilities (Ball-Larus)
+constexpr double LOOP_BRANCH_TAKEN = 0.88;
+constexpr double RETURN_BRANCH_TAKEN = 0.28;
+
+} // namespace
+
+BlockLayout::BlockLayout(const std::unordered_set<std::string>& noreturn)
+    : noreturn_functions(noreturn), profiled(false) {}
+
+void BlockLayout::build_blocks(const IRCode& instructions, size_t begin) {
+    blocks.clear();
+
+    size_t end = begin + 1;
+    while (end < instructions.size() && instructions[end].op != OpCode::FUNCTION_END) {
+        ++end;
+    }
+
+    // Blocks start at labels and after branches and returns; FUNCTION_END
+    // gets a block of its own
+    std::vector<size_t> starts;
+    for (size_t i = begin + 1; i < end; ++i) {
+        const IRInstruction& instr = instructions[i];
+        bool after_jump = i > begin + 1 && (instructions[i - 1].is_branch() ||
+                                            instructions[i - 1].op == OpCode::RETURN);
+        if (i == begin + 1 || instr.is_label() || after_jump) {
+            if (starts.empty() || starts.back() != i) starts.push_back(i);
+        }
+    }
+    starts.push_back(end);
+
+    std::unordered_map<std::string, int> label_block;
+    for (size_t b = 0; b < starts.size(); ++b) {
+        LayoutBlock block;
+        block.begin = starts[b];
+        block.end = b + 1 < starts.size() ? starts[b + 1] : std::min(end + 1, instructions.size());
+        if (instructions[block.begin].is_label()) {
+            block.label = instructions[block.begin].result;
+            label_block[block.label] = static_cast<int>(b);
+        }
+        blocks.push_back(block);
+    }
+
+    int exit = static_cast<int>(blocks.size()) - 1;
+    for (int b = 0; b < exit; ++b) {
+        LayoutBlock& block = blocks[b];
+        const IRInstruction& last = instructions[block.end - 1];
+        if (last.is_branch()) {
+            auto it = label_block.find(last.result);
+            if (it != label_block.end()) block.target = it->second;
+        }
+        if (last.op != OpCode::GOTO && last.op != OpCode::RETURN) {
+            block.fallthrough = b + 1;
+        }
+    }
+}
+
+bool BlockLayout::calls_noreturn(const IRCode& instructions, const LayoutBlock& block) const {
+    for (size_t i = block.begin; i < block.end; ++i) {
+        if (instructions[i].op == OpCode::CALL && noreturn_functions.count(instructions[i].arg1)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+std::vector<std::pair<int, int>> BlockLayout::edges() const {
+    std::vector<std::pair<int, int>> result;
+    for (size_t b = 0; b < blocks.size(); ++b) {
+        const LayoutBlock& block = blocks[b];
+        if (block.fallthrough >= 0) result.push_back({static_cast<int>(b), block.fallthrough});
+        if (block.target >= 0 && block.target != block.fallthrough) {
+            result.push_back({static_cast<int>(b), block.target});
+        }
+    }
+    return result;
+}
+
+void BlockLayout::mark_cold_blocks(const IRCode& instructions) {
+    int exit = static_cast<int>(blocks.size()) - 1;
+    for (int b = 1; b < exit; ++b) {
+        blocks[b].cold = calls_noreturn(instructions, blocks[b]);
+    }
+
+    // A block all of whose successors are cold only leads to them
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (int b = 1; b < exit; ++b) {
+            LayoutBlock& block = blocks[b];
+            if (block.cold || (block.target < 0 && block.fallthrough < 0)) continue;
+            bool all_cold = (block.target < 0 || blocks[block.target].cold) &&
+                            (block.fallthrough < 0 || blocks[block.fallthrough].cold);
+            if (all_cold) {
+                block.cold = true;
+                changed = true;
+            }
+        }
+    }
+}
+
+double BlockLayout::branch_probability(const IRCode& instructions, int from, int to) const {
+    const LayoutBlock& block = blocks[from];
+    if (calls_noreturn(instructions, block)) return 0.0;
+    if (block.target < 0 || block.fallthrough < 0 || block.target == block.fallthrough) return 1.0;
+
+    int other = to == block.target ? block.fallthrough : block.target;
+    if (profiled) {
+        double total = blocks[to].frequency + blocks[other].frequency;
+        return total > 0.0 ? blocks[to].frequency / total : 0.5;
+    }
+    if (blocks[to].cold != blocks[other].cold) {
+        return blocks[to].cold ? 0.0 : 1.0;
+    }
+
+    // Loop branch heuristic: backward edges stay in the loop
+    bool to_backward = blocks[to].begin <= block.begin;
+    bool other_backward = blocks[other].begin <= block.begin;
+    if (to_backward != other_backward) {
+        return to_backward ? LOOP_BRANCH_TAKEN : 1.0 - LOOP_BRANCH_TAKEN;
+    }
+
+    // Return heuristic: the path straight into a return is the unlikely one
+    auto returns = [&](int b) {
+        return instructions[blocks[b].end - 1].op == OpCode::RETURN;
+    };
+    if (returns(to) != returns(other)) {
+        return returns(to) ? RETURN_BRANCH_TAKEN : 1.0 - RETURN_BRANCH_TAKEN;
+    }
+    return 0.5;
+}
+
+bool BlockLayout::apply_profile(const IRCode& instructions) {
+    // A block's count is that of its first counter; blocks split off after
+    // instrumentation run as often as the block before them
+    std::vector<int64_t> counts(blocks.size(), -1);
+    bool any = false;
+    for (size_t b = 0; b < blocks.size(); ++b) {
+        for (size_t i = blocks[b].begin; i < blocks[b].end && counts[b] < 0; ++i) {
+            counts[b] = profiled_count(instructions[i]);
+        }
+        any |= counts[b] >= 0;
+    }
+    if (!any) return false;
+
+    for (size_t b = 0; b < blocks.size(); ++b) {
+        if (counts[b] < 0) counts[b] = b > 0 ? counts[b - 1] : 0;
+    }
+    double entry = static_cast<double>(std::max<int64_t>(counts[0], 1));
+    for (size_t b = 0; b < blocks.size(); ++b) {
+        blocks[b].frequency = static_cast<double>(counts[b]) / entry;
+    }
+
+    // Only functions that ran say anything about which of their blocks did not
+    int exit = static_cast<int>(blocks.size()) - 1;
+    if (counts[0] > 0) {
+        for (int b = 1; b < exit; ++b) {
+            if (counts[b] == 0) blocks[b].cold = true;
+        }
+    }
+    profiled = true;
+    return true;
+}
+
+void BlockLayout::estimate_frequencies(const IRCode& instructions) {
+    if (apply_profile(instructions)) return;
+
+    std::vector<std::vector<std::pair<int, double>>> incoming(blocks.size());
+    for (const auto& edge : edges()) {
+        incoming[edge.second].push_back({edge.first, branch_probability(instructions, edge.first, edge.second)});
+    }
+
+    // Gauss-Seidel over freq(b) = [b is entry] + sum of freq(p) * prob(p -> b);
+    // loop branches taken with probability below one make this converge
+    for (auto& block : blocks) block.frequency = 0.0;
+    for (int iteration = 0; iteration < 1000; ++iteration) {
+        double delta = 0.0;
+        for (size_t b = 0; b < blocks.size(); ++b) {
+            double frequency = b == 0 ? 1.0 : 0.0;
+            for (const auto& pred : incoming[b]) {
+                frequency += blocks[pred.first].frequency * pred.second;
+            }
+            delta = std::max(delta, std::fabs(frequency - blocks[b].frequency));
+            blocks[b].frequency = frequency;
+        }
+        if (delta < 1e-9) break;
+    }
+
+    // Blocks only reachable through cold paths never run
+    int exit = static_cast<int>(blocks.size()) - 1;
+    for (int b = 1; b < exit; ++b) {
+        if (blocks[b].frequency < 1e-9) blocks[b].cold = true;
+    }
+}
+
+void BlockLayout::place_chains(const IRCode& instructions) {
+    int exit = static_cast<int>(blocks.size()) - 1;
+    std::vector<std::vector<int>> chains(blocks.size());
+    std::vector<int> chain_of(blocks.size());
+    for (size_t b = 0; b < blocks.size(); ++b) {
+        chains[b] = {static_cast<int>(b)};
+        chain_of[b] = static_cast<int>(b);
+    }
+
+    // Merge chains along the heaviest edges first, tail to head
+    struct WeightedEdge {
+        int from;
+        int to;
+        double weight;
+    };
+    std::vector<WeightedEdge> weighted;
+    for (const auto& edge : edges()) {
+        int from = edge.first;
+        int to = edge.second;
+        if (from == to || to == 0 || from == exit || to == exit) continue;
+        if (blocks[from].cold || blocks[to].cold) continue;
+        weighted.push_back({from, to, blocks[from].frequency * branch_probability(instructions, from, to)});
+    }
+    std::stable_sort(weighted.begin(), weighted.end(), [](const WeightedEdge& a, const WeightedEdge& b) {
+        return a.weight > b.weight;
+    });
+
+    for (const auto& edge : weighted) {
+        int head = chain_of[edge.from];
+        int tail = chain_of[edge.to];
+        if (head == tail || chains[head].back() != edge.from || chains[tail].front() != edge.to) continue;
+        for (int b : chains[tail]) {
+            chains[head].push_back(b);
+            chain_of[b] = head;
+        }
+        chains[tail].clear();
+    }
+
+    // Entry chain first, then the rest hottest first; the exit block ends the
+    // hot part so the implicit return keeps its fall-through
+    auto heat = [&](int chain) {
+        double hottest = 0.0;
+        for (int b : chains[chain]) hottest = std::max(hottest, blocks[b].frequency);
+        return hottest;
+    };
+    std::vector<int> rest;
+    for (int chain = 1; chain < exit; ++chain) {
+        if (!chains[chain].empty() && !blocks[chains[chain].front()].cold) rest.push_back(chain);
+    }
+    std::stable_sort(rest.begin(), rest.end(), [&](int a, int b) { return heat(a) > heat(b); });
+
+    hot_order = chains[0];
+    for (int chain : rest) {
+        hot_order.insert(hot_order.end(), chains[chain].begin(), chains[chain].end());
+    }
+    if (exit > 0) hot_order.push_back(exit);
+
+    cold_blocks.clear();
+    for (int b = 1; b < exit; ++b) {
+        if (blocks[b].cold) cold_blocks.push_back(b);
+    }
+}
+
+void BlockLayout::run(const IRCode& instructions, size_t begin) {
+    build_blocks(instructions, begin);
+    mark_cold_blocks(instructions);
+    estimate_frequencies(instructions);
+    place_chains(instructions);
+}
+
+std::unordered_set<std::string> BlockLayout::find_noreturn_functions(const IRCode& instructions) {
+    std::unordered_set<std::string> defined;
+    for (const auto& instr : instructions) {
+        if (instr.op == OpCode::FUNCTION_BEGIN) defined.insert(instr.result);
+    }
+    std::unordered_set<std::string> noreturn = runtime_noreturn_functions(defined);
+    add_noreturn_functions(instructions, noreturn);
+    return noreturn;
+}
+
+std::unordered_set<std::string> BlockLayout::runtime_noreturn_functions(const std::unordered_set<std::string>& defined) {
+    std::unordered_set<std::string> noreturn;
+    for (const char* name : RUNTIME_NORETURN) {
+        if (!defined.count(name)) noreturn.insert(name);
+    }
+    return noreturn;
+}
+
+void BlockLayout::add_noreturn_functions(const IRCode& instructions, std::unordered_set<std::string>& noreturn) {
+    std::vector<size_t> functions;
+    for (size_t i = 0; i < instructions.size(); ++i) {
+        if (instructions[i].op == OpCode::FUNCTION_BEGIN) functions.push_back(i);
+    }
+
+    // A function never returns when no return is reachable without passing
+    // a call that never returns; iterate since that depends on the callees
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (size_t begin : functions) {
+            const std::string& name = instructions[begin].result;
+            if (noreturn.count(name)) continue;
+
+            BlockLayout layout(noreturn);
+            layout.build_blocks(instructions, begin);
+            const auto& blocks = layout.blocks;
+            int exit = static_cast<int>(blocks.size()) - 1;
+
+            std::vector<bool> reached(blocks.size(), false);
+            std::vector<int> worklist = {0};
+            reached[0] = true;
+            bool returns = false;
+            while (!worklist.empty() && !returns) {
+                int b = worklist.back();
+                worklist.pop_back();
+                if (b == exit || instructions[blocks[b].end - 1].op == OpCode::RETURN) {
+                    returns = true;
+                    break;
+                }
+                if (layout.calls_noreturn(instructions, blocks[b])) continue;
+                for (int next : {blocks[b].target, blocks[b].fallthrough}) {
+                    if (next >= 0 && !reached[next]) {
+                        reached[next] = true;
+                        worklist.push_back(next);
+                    }
+                }
+            }
+            if (!returns) {
+                noreturn.insert(name);
+                changed = true;
+            }
+        }
+    }
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include "ir-types.h"
+#include <string>
+#include <vector>
+#include <unordered_set>
+
+// A basic block of one function: instructions [begin, end) of the program IR
+struct LayoutBlock {
+    size_t begin = 0;
+    size_t end = 0;
+    std::string label;        // IR label the block starts with, if any
+    int target = -1;          // branch target block, -1 if none
+    int fallthrough = -1;     // block reached by falling off the end, -1 if none
+    double frequency = 0.0;   // estimated executions per call of the function
+    bool cold = false;
+};
+
+// Pettis-Hansen style block placement. Edge weights come from the counts in
+// PROFILE_COUNT instructions under -fprofile-use, and otherwise from static
+// branch heuristics (loop branches are taken, paths into returns are not).
+// Blocks that can only end in a call to a never-returning function, or that
+// never run, are cold and go to a separate section.
+class BlockLayout {
+private:
+    const std::unordered_set<std::string>& noreturn_functions;
+
+    std::vector<LayoutBlock> blocks;
+    std::vector<int> hot_order;
+    std::vector<int> cold_blocks;
+    bool profiled;
+
+    void build_blocks(const IRCode& instructions, size_t begin);
+    bool calls_noreturn(const IRCode& instructions, const LayoutBlock& block) const;
+    void mark_cold_blocks(const IRCode& instructions);
+    double branch_probability(const IRCode& instructions, int from, int to) const;
+    std::vector<std::pair<int, int>> edges() const;
+    bool apply_profile(const IRCode& instructions);
+    void estimate_frequencies(const IRCode& instructions);
+    void place_chains(const IRCode& instructions);
+
+public:
+    explicit BlockLayout(const std::unordered_set<std::string>& noreturn);
+
+    // Lay out the function whose FUNCTION_BEGIN is at `begin`. Block 0 is the
+    // entry block; the last block holds FUNCTION_END and always ends the hot part.
+    void run(const IRCode& instructions, size_t begin);
+
+    const std::vector<LayoutBlock>& get_blocks() const { return blocks; }
+    const std::vector<int>& get_hot_order() const { return hot_order; }
+    const std::vector<int>& get_cold_blocks() const { return cold_blocks; }
+
+    // Functions no call of which ever returns: runtime error handlers and
+    // program functions with no path to a return
+    static std::unordered_set<std::string> find_noreturn_functions(const IRCode& instructions);
+
+    // The same a function at a time: start from the runtime handlers the
+    // program does not define, then add each part's functions given what
+    // the earlier parts found (calls to later functions count as returning)
+    static std::unordered_set<std::string> runtime_noreturn_functions(const std::unordered_set<std::string>& defined);
+    static void add_noreturn_functions(const IRCode& instructions, std::unordered_set<std::string>& noreturn);
+};
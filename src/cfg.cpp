@@ -4,6 +4,114 @@
 #include <sstream>
 #include <stack>
 #include <algorithm>
+#include <functional>
+
+namespace {
+
+using BlockEdges = std::set<BasicBlock*> BasicBlock::*;
+
+// Cooper-Harvey-Kennedy iterative dominators over the edges `forward`, with
+// `backward` the matching reverse edges. Post-dominators run it on the
+// reversed graph from the exit block.
+std::unordered_map<BasicBlock*, BasicBlock*> compute_idoms(BasicBlock* root, BlockEdges forward,
+                                                           BlockEdges backward) {
+    std::unordered_map<BasicBlock*, BasicBlock*> idom;
+    if (!root) return idom;
+    
+    // Depth-first postorder with an explicit stack: straight-line code
+    // makes the walk as deep as the function is long
+    std::unordered_map<BasicBlock*, int> postorder_number;
+    std::vector<BasicBlock*> postorder;
+    std::vector<std::pair<BasicBlock*, std::set<BasicBlock*>::const_iterator>> stack;
+    postorder_number[root] = -1;
+    stack.push_back({root, (root->*forward).begin()});
+    while (!stack.empty()) {
+        BasicBlock* block = stack.back().first;
+        if (stack.back().second != (block->*forward).end()) {
+            BasicBlock* next = *stack.back().second++;
+            if (!postorder_number.count(next)) {
+                postorder_number[next] = -1;
+                stack.push_back({next, (next->*forward).begin()});
+            }
+            continue;
+        }
+        postorder_number[block] = static_cast<int>(postorder.size());
+        postorder.push_back(block);
+        stack.pop_back();
+    }
+    
+    auto intersect = [&](BasicBlock* a, BasicBlock* b) {
+        while (a != b) {
+            while (postorder_number[a] < postorder_number[b]) a = idom[a];
+            while (postorder_number[b] < postorder_number[a]) b = idom[b];
+        }
+        return a;
+    };
+    
+    idom[root] = root;
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (auto it = postorder.rbegin(); it != postorder.rend(); ++it) {
+            BasicBlock* block = *it;
+            if (block == root) continue;
+            
+            BasicBlock* new_idom = nullptr;
+            for (BasicBlock* pred : block->*backward) {
+                if (!idom.count(pred)) continue;
+                new_idom = new_idom ? intersect(pred, new_idom) : pred;
+            }
+            if (new_idom && idom[block] != new_idom) {
+                idom[block] = new_idom;
+                changed = true;
+            }
+        }
+    }
+    return idom;
+}
+
+// Entry and exit numbers of each block in a depth-first walk of the tree
+// `idom`, so that a dominates b exactly when a's interval encloses b's
+DominatorIntervals number_tree(const std::unordered_map<BasicBlock*, BasicBlock*>& idom) {
+    DominatorIntervals intervals;
+    std::unordered_map<BasicBlock*, std::vector<BasicBlock*>> children;
+    BasicBlock* root = nullptr;
+    for (const auto& entry : idom) {
+        if (entry.first == entry.second) {
+            root = entry.first;
+        } else {
+            children[entry.second].push_back(entry.first);
+        }
+    }
+    if (!root) return intervals;
+    
+    // Iterative, since straight-line code makes the tree as deep as it is big
+    int counter = 0;
+    std::vector<std::pair<BasicBlock*, size_t>> stack = {{root, 0}};
+    intervals[root].first = counter++;
+    while (!stack.empty()) {
+        BasicBlock* block = stack.back().first;
+        const auto& kids = children[block];
+        if (stack.back().second < kids.size()) {
+            BasicBlock* child = kids[stack.back().second++];
+            intervals[child].first = counter++;
+            stack.push_back({child, 0});
+        } else {
+            intervals[block].second = counter++;
+            stack.pop_back();
+        }
+    }
+    return intervals;
+}
+
+bool encloses(const DominatorIntervals& intervals, BasicBlock* a, BasicBlock* b) {
+    auto outer = intervals.find(a);
+    auto inner = intervals.find(b);
+    if (outer == intervals.end() || inner == intervals.end()) return false;
+    return outer->second.first <= inner->second.first && inner->second.second <= outer->second.second;
+}
+
+} // namespace
 
 ControlFlowGraph::ControlFlowGraph() : entry_block(nullptr), exit_block(nullptr), next_block_id(0) {}
 
@@ -31,7 +139,7 @@ void ControlFlowGraph::identify_basic_blocks(const IRCode& instructions) {
             block_starts.insert(i);
         }
         
-        if (instr.is_branch() && i + 1 < instructions.size()) {
+        if ((instr.is_branch() || instr.op == OpCode::RETURN) && i + 1 < instructions.size()) {
             block_starts.insert(i + 1);
         }
         
@@ -199,9 +307,63 @@ bool ControlFlowGraph::is_reachable(BasicBlock* from, BasicBlock* to) const {
     return false;
 }
 
+std::unordered_set<BasicBlock*> ControlFlowGraph::get_reachable_blocks(BasicBlock* from) const {
+    std::unordered_set<BasicBlock*> reached;
+    if (!from) return reached;
+    
+    std::vector<BasicBlock*> worklist = {from};
+    while (!worklist.empty()) {
+        BasicBlock* current = worklist.back();
+        worklist.pop_back();
+        for (BasicBlock* succ : current->successors) {
+            if (reached.insert(succ).second) worklist.push_back(succ);
+        }
+    }
+    return reached;
+}
+
+void ControlFlowGraph::compute_dominators() {
+    immediate_dominators = compute_idoms(entry_block, &BasicBlock::successors, &BasicBlock::predecessors);
+    dominator_intervals = number_tree(immediate_dominators);
+}
+
+void ControlFlowGraph::compute_post_dominators() {
+    immediate_post_dominators = compute_idoms(exit_block, &BasicBlock::predecessors, &BasicBlock::successors);
+    post_dominator_intervals = number_tree(immediate_post_dominators);
+}
+
+BasicBlock* ControlFlowGraph::get_immediate_dominator(BasicBlock* block) const {
+    auto it = immediate_dominators.find(block);
+    return it != immediate_dominators.end() && it->second != block ? it->second : nullptr;
+}
+
+BasicBlock* ControlFlowGraph::get_immediate_post_dominator(BasicBlock* block) const {
+    auto it = immediate_post_dominators.find(block);
+    return it != immediate_post_dominators.end() && it->second != block ? it->second : nullptr;
+}
+
+bool ControlFlowGraph::dominates(BasicBlock* a, BasicBlock* b) const {
+    return encloses(dominator_intervals, a, b);
+}
+
+bool ControlFlowGraph::post_dominates(BasicBlock* a, BasicBlock* b) const {
+    return encloses(post_dominator_intervals, a, b);
+}
+
+BasicBlock* ControlFlowGraph::nearest_common_dominator(BasicBlock* a, BasicBlock* b) const {
+    for (BasicBlock* candidate = a; candidate; candidate = get_immediate_dominator(candidate)) {
+        if (dominates(candidate, b)) return candidate;
+    }
+    return nullptr;
+}
+
 void ControlFlowGraph::clear() {
     blocks.clear();
     label_to_block.clear();
+    immediate_dominators.clear();
+    immediate_post_dominators.clear();
+    dominator_intervals.clear();
+    post_dominator_intervals.clear();
     entry_block = nullptr;
     exit_block = nullptr;
     next_block_id = 0;
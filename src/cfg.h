@@ -5,6 +5,7 @@
 #include <set>
 #include <memory>
 #include <unordered_map>
+#include <unordered_set>
 #include <string>
 
 // Basic block representation
@@ -67,6 +68,10 @@ public:
     }
 };
 
+// Position of each block in a depth-first walk of a dominator tree, as
+// (entry, exit) numbers; makes a dominance query two comparisons
+using DominatorIntervals = std::unordered_map<BasicBlock*, std::pair<int, int>>;
+
 // Control Flow Graph
 class ControlFlowGraph {
 private:
@@ -76,6 +81,13 @@ private:
     std::unordered_map<std::string, BasicBlock*> label_to_block;
     int next_block_id;
     
+    // Dominator trees, filled in by compute_dominators / compute_post_dominators.
+    // Unreachable blocks have no entry; roots map to themselves.
+    std::unordered_map<BasicBlock*, BasicBlock*> immediate_dominators;
+    std::unordered_map<BasicBlock*, BasicBlock*> immediate_post_dominators;
+    DominatorIntervals dominator_intervals;
+    DominatorIntervals post_dominator_intervals;
+    
     // Helper functions for CFG construction
     void identify_basic_blocks(const IRCode& instructions);
     void build_control_flow_edges();
@@ -110,6 +122,18 @@ public:
     std::vector<BasicBlock*> get_topological_order() const;
     std::vector<BasicBlock*> get_reverse_postorder() const;
     bool is_reachable(BasicBlock* from, BasicBlock* to) const;
+    // Blocks reachable along one or more edges; `from` itself only on a cycle
+    std::unordered_set<BasicBlock*> get_reachable_blocks(BasicBlock* from) const;
+    
+    // Dominance. Post-dominance is relative to the exit block, so it is only
+    // meaningful when the graph has one.
+    void compute_dominators();
+    void compute_post_dominators();
+    BasicBlock* get_immediate_dominator(BasicBlock* block) const;
+    BasicBlock* get_immediate_post_dominator(BasicBlock* block) const;
+    bool dominates(BasicBlock* a, BasicBlock* b) const;
+    bool post_dominates(BasicBlock* a, BasicBlock* b) const;
+    BasicBlock* nearest_common_dominator(BasicBlock* a, BasicBlock* b) const;
     
     // Clear CFG
     void clear();
@@ -10,17 +10,34 @@ void print_usage(const std::string& program_name) {
     std::cout << "Usage: " << program_name << " [options] <input-file> [-o <output-file>]\n\n";
     std::cout << "Options:\n";
     std::cout << "  -O0, -O1, -O2, -O3     Set optimization level (default: -O0)\n";
-    std::cout << "  -g                     Generate debug information\n";
+    std::cout << "  -Os                    Optimize for size\n";
+    std::cout << "  -march=<cpu>           Target x86-64, x86-64-v2, x86-64-v3 or native\n";
+    std::cout << "  -g                     Emit DWARF line tables for perf and gdb\n";
     std::cout << "  -v, --verbose          Verbose output\n";
     std::cout << "  -S                     Generate assembly only\n";
     std::cout << "  -c                     Generate object file only\n";
+    std::cout << "  -fomit-frame-pointer   Address locals from rsp (default at -O3)\n";
+    std::cout << "  -fno-omit-frame-pointer Keep rbp as the frame pointer\n";
+    std::cout << "  -fprofile-generate[=file] Instrument to record a profile (default.profdata)\n";
+    std::cout << "  -fprofile-use[=file]   Optimize with a recorded profile\n";
+    std::cout << "  -finstrument-functions Print per-function calls and cycles at exit\n";
+    std::cout << "  --fast-compile         At -O0, generate code straight from the AST (no IR)\n";
+    std::cout << "  --stream               Compile a function at a time; memory grows with the largest function\n";
+    std::cout << "  --jit                  Run the program in-process, recompiling hot functions at -O3\n";
+    std::cout << "  --jit-threshold=<n>    Calls plus loop iterations that make a function hot (default 10000)\n";
+    std::cout << "  -fsave-optimization-record[=yaml|json] Write what each pass did or missed and why\n";
+    std::cout << "  -foptimization-record-file=<file> Where to write it (default <output>.opt.yaml)\n";
+    std::cout << "  --param <name>=<n>     Per-function IR size limit for a pass group: max-local-opt-size,\n";
+    std::cout << "                         max-dataflow-size, max-loop-opt-size or max-regalloc-size\n";
     std::cout << "  -o <file>              Output file name\n";
+    std::cout << "  --size-report          Print bytes saved by each -Os transform\n";
     std::cout << "  --print-stages         Print compilation stages\n";
     std::cout << "  --print-ir             Print intermediate representation\n";
     std::cout << "  --print-asm            Print generated assembly\n";
     std::cout << "  --print-cfg            Print control flow graph\n";
     std::cout << "  --keep-intermediate    Keep intermediate files\n";
     std::cout << "  --profile              Enable compiler profiling\n";
+    std::cout << "  --profile-counters     Add per-phase hardware counters (perf_event_open) to the -v report\n";
     std::cout << "  --test                 Run compiler test suite\n";
     std::cout << "  --help                 Show this help message\n";
     std::cout << "  --version              Show version information\n\n";
@@ -53,6 +70,8 @@ int main(int argc, char* argv[]) {
     std::string output_file;
     bool run_tests = false;
     bool enable_profiling = false;
+    bool enable_counters = false;
+    bool run_jit = false;
     
     // Parse command line arguments
     for (int i = 1; i < argc; ++i) {
@@ -68,6 +87,9 @@ int main(int argc, char* argv[]) {
             run_tests = true;
         } else if (arg == "--profile") {
             enable_profiling = true;
+        } else if (arg == "--profile-counters") {
+            enable_profiling = true;
+            enable_counters = true;
         } else if (arg == "-O0") {
             compiler.set_optimization_level(OptimizationLevel::O0);
         } else if (arg == "-O1") {
@@ -76,6 +98,15 @@ int main(int argc, char* argv[]) {
             compiler.set_optimization_level(OptimizationLevel::O2);
         } else if (arg == "-O3") {
             compiler.set_optimization_level(OptimizationLevel::O3);
+        } else if (arg == "-Os") {
+            compiler.set_optimization_level(OptimizationLevel::Os);
+        } else if (arg.rfind("-march=", 0) == 0) {
+            try {
+                compiler.set_target_architecture(arg.substr(7));
+            } catch (const std::exception& e) {
+                std::cerr << "Error: " << e.what() << "\n";
+                return 1;
+            }
         } else if (arg == "-g") {
             compiler.enable_debug_info(true);
         } else if (arg == "-v" || arg == "--verbose") {
@@ -84,6 +115,14 @@ int main(int argc, char* argv[]) {
             compiler.set_output_format(OutputFormat::ASSEMBLY);
         } else if (arg == "-c") {
             compiler.set_output_format(OutputFormat::OBJECT);
+        } else if (arg == "-fomit-frame-pointer") {
+            compiler.set_frame_pointer(FramePointer::OMIT);
+        } else if (arg == "-fno-omit-frame-pointer") {
+            compiler.set_frame_pointer(FramePointer::KEEP);
+        } else if (arg == "-fprofile-generate" || arg.rfind("-fprofile-generate=", 0) == 0) {
+            compiler.set_profile_generate(arg.size() > 19 ? arg.substr(19) : "default.profdata");
+        } else if (arg == "-fprofile-use" || arg.rfind("-fprofile-use=", 0) == 0) {
+            compiler.set_profile_use(arg.size() > 14 ? arg.substr(14) : "default.profdata");
         } else if (arg == "-o") {
             if (i + 1 < argc) {
                 output_file = argv[++i];
@@ -91,6 +130,44 @@ int main(int argc, char* argv[]) {
                 std::cerr << "Error: -o requires an argument\n";
                 return 1;
             }
+        } else if (arg == "-finstrument-functions") {
+            compiler.set_instrument_functions(true);
+        } else if (arg == "--fast-compile") {
+            compiler.set_fast_compile(true);
+        } else if (arg == "--stream") {
+            compiler.set_streaming(true);
+        } else if (arg == "--jit") {
+            run_jit = true;
+        } else if (arg.rfind("--jit-threshold=", 0) == 0) {
+            try {
+                compiler.set_jit_hot_threshold(std::stoull(arg.substr(16)));
+            } catch (const std::exception& e) {
+                std::cerr << "Error: invalid " << arg << "\n";
+                return 1;
+            }
+        } else if (arg == "-fsave-optimization-record" || arg.rfind("-fsave-optimization-record=", 0) == 0) {
+            try {
+                compiler.set_optimization_record(arg.size() > 27 ? arg.substr(27) : "yaml");
+            } catch (const std::exception& e) {
+                std::cerr << "Error: " << e.what() << "\n";
+                return 1;
+            }
+        } else if (arg.rfind("-foptimization-record-file=", 0) == 0) {
+            compiler.set_optimization_record_file(arg.substr(27));
+        } else if (arg == "--param") {
+            std::string param = i + 1 < argc ? argv[++i] : "";
+            size_t eq = param.find('=');
+            try {
+                if (eq == std::string::npos) {
+                    throw std::runtime_error("--param requires <name>=<value>");
+                }
+                compiler.set_param(param.substr(0, eq), std::stoul(param.substr(eq + 1)));
+            } catch (const std::exception& e) {
+                std::cerr << "Error: " << e.what() << "\n";
+                return 1;
+            }
+        } else if (arg == "--size-report") {
+            compiler.set_size_report(true);
         } else if (arg == "--print-stages") {
             compiler.print_compilation_stages(true);
         } else if (arg == "--print-ir") {
@@ -139,6 +216,19 @@ int main(int argc, char* argv[]) {
         return 1;
     }
     
+    // --jit runs the program here and exits with its value
+    if (run_jit) {
+        long exit_code = 0;
+        if (!compiler.run_jit(input_file, exit_code)) {
+            std::cerr << "Execution failed:\n";
+            for (const auto& error : compiler.get_errors()) {
+                std::cerr << "  " << error << "\n";
+            }
+            return 1;
+        }
+        return static_cast<int>(exit_code & 0xff);
+    }
+    
     // Generate output file name if not specified
     if (output_file.empty()) {
         std::filesystem::path input_path(input_file);
@@ -149,6 +239,9 @@ int main(int argc, char* argv[]) {
     if (enable_profiling) {
         compiler.enable_profiling(true);
     }
+    if (enable_counters) {
+        compiler.enable_hardware_counters(true);
+    }
     
     // Compile the program
     bool success = compiler.compile(input_file, output_file);
@@ -0,0 +1,82 @@
+#include "compile-budget.h"
+#include <vector>
+
+bool set_budget_param(CompileBudget& budget, const std::string& name, size_t value) {
+    if (name == "max-local-opt-size") {
+        budget.local_function_size = value;
+    } else if (name == "max-dataflow-size") {
+        budget.dataflow_function_size = value;
+    } else if (name == "max-loop-opt-size") {
+        budget.loop_function_size = value;
+    } else if (name == "max-regalloc-size") {
+        budget.allocation_function_size = value;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+bool run_within_budget(IRCode& instructions, size_t limit, const std::string& pass_name,
+                       RemarkCollector* remarks, const std::function<void(IRCode&)>& pass) {
+    // Functions as [begin, end] ranges, end at FUNCTION_END
+    std::vector<std::pair<size_t, size_t>> over;
+    for (size_t i = 0; i < instructions.size(); ++i) {
+        if (instructions[i].op != OpCode::FUNCTION_BEGIN) continue;
+        size_t end = i;
+        while (end + 1 < instructions.size() && instructions[end].op != OpCode::FUNCTION_END) ++end;
+        if (end - i + 1 > limit) over.push_back({i, end});
+        i = end;
+    }
+    if (over.empty()) {
+        pass(instructions);
+        return false;
+    }
+
+    for (const auto& range : over) {
+        const IRInstruction& begin = instructions[range.first];
+        if (remarks) {
+            long long size = static_cast<long long>(range.second - range.first + 1);
+            remarks->emit_function(pass_name, RemarkKind::Missed, "OverBudget", begin.result, begin.line_number,
+                                   "function has " + std::to_string(size) + " IR instructions, over the limit of " +
+                                   std::to_string(limit) + "; pass skipped",
+                                   {{"Size", size}, {"Limit", static_cast<long long>(limit)}});
+        }
+    }
+
+    // The pass sees everything else; functions keep their FUNCTION_BEGIN and
+    // FUNCTION_END through every pass, so its output splits back at them
+    IRCode within;
+    within.reserve(instructions.size());
+    size_t next = 0;
+    for (const auto& range : over) {
+        within.insert(within.end(), instructions.begin() + next, instructions.begin() + range.first);
+        next = range.second + 1;
+    }
+    within.insert(within.end(), instructions.begin() + next, instructions.end());
+    pass(within);
+
+    IRCode merged;
+    merged.reserve(within.size() + instructions.size());
+    size_t taken = 0;
+    next = 0;
+    for (const auto& range : over) {
+        // Up to the skipped function, the pass output stands in for the
+        // functions that came before it in the input
+        size_t functions = 0;
+        for (size_t i = next; i < range.first; ++i) {
+            if (instructions[i].op == OpCode::FUNCTION_END) ++functions;
+        }
+        while (taken < within.size() && functions > 0) {
+            if (within[taken].op == OpCode::FUNCTION_END) --functions;
+            merged.push_back(std::move(within[taken++]));
+        }
+        while (taken < within.size() && within[taken].op != OpCode::FUNCTION_BEGIN) {
+            merged.push_back(std::move(within[taken++]));
+        }
+        merged.insert(merged.end(), instructions.begin() + range.first, instructions.begin() + range.second + 1);
+        next = range.second + 1;
+    }
+    for (; taken < within.size(); ++taken) merged.push_back(std::move(within[taken]));
+    instructions.swap(merged);
+    return true;
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+#include "ir-types.h"
+#include "optimization-remarks.h"
+#include <functional>
+#include <string>
+
+// Per-function size limits, in IR instructions, that keep optimization time
+// bounded on huge (usually generated) functions. Passes whose cost grows
+// faster than linearly leave a function over their limit alone, or run a
+// cheaper variant on it, and record a missed remark saying so. The limits
+// count instructions rather than seconds so the output does not depend on
+// how busy the machine is.
+struct CompileBudget {
+    size_t local_function_size = 20000;       // copy propagation, DCE to a fixpoint (IROptimizer)
+    size_t dataflow_function_size = 5000;     // CFG simplification, if-conversion, liveness DCE
+    size_t loop_function_size = 5000;         // LICM, unrolling, peephole rewriting
+    size_t allocation_function_size = 5000;   // graph coloring; larger functions keep stack slots
+};
+
+// Set the limit `name` (as in --param name=value); false if there is no such limit
+bool set_budget_param(CompileBudget& budget, const std::string& name, size_t value);
+
+// Run `pass` on the functions of `instructions` with at most `limit`
+// instructions, as one program; the others keep their place unchanged and
+// get a missed remark from `pass_name`. Returns whether any was left out.
+bool run_within_budget(IRCode& instructions, size_t limit, const std::string& pass_name,
+                       RemarkCollector* remarks, const std::function<void(IRCode&)>& pass);
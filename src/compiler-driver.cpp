@@ -5,6 +5,11 @@
 #include <filesystem>
 #include <chrono>
 #include <cstdlib>
+#include <cstdint>
+#include <iterator>
+#include <algorithm>
+#include <unordered_set>
+#include <unistd.h>
 
 CompilerDriver::CompilerDriver() 
     : profiler(std::make_unique<CompilerProfiler>()) {
@@ -15,8 +20,11 @@ CompilerDriver::CompilerDriver()
     ir_generator = std::make_unique<IRGenerator>(analyzer.get());
     optimizer = std::make_unique<IROptimizer>();
     advanced_optimizer = std::make_unique<AdvancedOptimizer>();
-    code_gen = std::make_unique<AssemblyGenerator>("temp.s");
-    debug_gen = std::make_unique<DebugInfoGenerator>();
+}
+
+CompilerDriver::CompilerDriver(const CompilerOptions& compiler_options) : CompilerDriver() {
+    options = compiler_options;
+    target = select_target(options.target_architecture);
 }
 
 CompilerDriver::~CompilerDriver() {
@@ -28,6 +36,7 @@ bool CompilerDriver::compile(const std::string& source_file, const std::string&
     if (options.verbose) {
         std::cout << "C-- Compiler v1.0" << std::endl;
         std::cout << "Compiling: " << source_file << " -> " << output_file << std::endl;
+        std::cout << get_target_info() << std::endl;
     }
     
     // Read source file
@@ -40,14 +49,94 @@ bool CompilerDriver::compile(const std::string& source_file, const std::string&
     std::string source_code((std::istreambuf_iterator<char>(file)),
                            std::istreambuf_iterator<char>());
     
+    source_path = source_file;
     return compile_from_source(source_code, output_file);
 }
 
 bool CompilerDriver::compile_from_source(const std::string& source_code, const std::string& output_file) {
-    clear_messages();
+    profiler->start_phase("total_compilation");
+    
+    // Phases 1-6, whole program in memory or, streaming, a function at a
+    // time straight into the assembly file
+    bool assembly_only = options.output_format == OutputFormat::ASSEMBLY;
+    std::string assembly_file = assembly_only ? output_file : get_temporary_filename(".s");
+    if (options.streaming && streaming_unsupported().empty()) {
+        std::ofstream file(assembly_file);
+        bool streamed = file.is_open() && stream_assembly(source_code, file);
+        file.close();
+        if (!streamed || file.fail()) {
+            if (error_messages.empty()) {
+                error_messages.push_back("Cannot write " + assembly_file);
+            }
+            std::error_code ignored;
+            std::filesystem::remove(assembly_file, ignored);
+            return false;
+        }
+    } else if (!generate_assembly(source_code) || !write_text_file(assembly_file, assembly_text)) {
+        return false;
+    }
+    if (!options.optimization_record_format.empty()) {
+        write_optimization_record(output_file);
+    }
+    
+    // Phase 7: Assembly and Linking
+    if (!assembly_only &&
+        !run_assembly_and_linking(assembly_file, output_file, options.output_format == OutputFormat::EXECUTABLE)) {
+        return false;
+    }
     
+    profiler->end_phase("total_compilation");
     if (options.verbose) {
-        profiler->start_phase("total_compilation");
+        print_performance_report();
+    }
+    
+    if (!options.keep_intermediate) {
+        cleanup_intermediate_files();
+    }
+    
+    return true;
+}
+
+bool CompilerDriver::compile_to_memory(const std::string& source_code, std::vector<unsigned char>* object) {
+    profiler->start_phase("total_compilation");
+    
+    bool generated;
+    if (options.streaming && streaming_unsupported().empty()) {
+        std::ostringstream assembly;
+        generated = stream_assembly(source_code, assembly);
+        assembly_text = generated ? assembly.str() : "";
+    } else {
+        generated = generate_assembly(source_code);
+    }
+    if (!generated) {
+        return false;
+    }
+    
+    if (object) {
+        // as only reads files, so the object goes through a private pair
+        std::string assembly_file = get_temporary_filename(".s");
+        std::string object_file = get_temporary_filename(".o");
+        bool assembled = write_text_file(assembly_file, assembly_text) &&
+                         run_assembly_and_linking(assembly_file, object_file, false);
+        if (assembled) {
+            std::ifstream object_stream(object_file, std::ios::binary);
+            object->assign(std::istreambuf_iterator<char>(object_stream), std::istreambuf_iterator<char>());
+        }
+        cleanup_intermediate_files();
+        if (!assembled) {
+            return false;
+        }
+    }
+    
+    profiler->end_phase("total_compilation");
+    return true;
+}
+
+bool CompilerDriver::generate_assembly(const std::string& source_code) {
+    clear_messages();
+    assembly_text.clear();
+    if (options.streaming) {
+        warning_messages.push_back("--stream ignored: " + streaming_unsupported() + " needs the whole program");
     }
     
     // Phase 1: Lexical Analysis
@@ -65,6 +154,20 @@ bool CompilerDriver::compile_from_source(const std::string& source_code, const s
         return false;
     }
     
+    // --fast-compile goes from the checked AST straight to assembly
+    bool baseline = false;
+    if (options.fast_compile) {
+        std::string unsupported = baseline_unsupported();
+        if (unsupported.empty()) {
+            baseline = true;
+        } else {
+            warning_messages.push_back("--fast-compile ignored: " + unsupported + " needs the IR pipeline");
+        }
+    }
+    if (baseline) {
+        return run_baseline_code_generation();
+    }
+    
     // Phase 4: IR Generation
     if (!run_ir_generation()) {
         return false;
@@ -76,37 +179,181 @@ bool CompilerDriver::compile_from_source(const std::string& source_code, const s
     }
     
     // Phase 6: Code Generation
-    std::string assembly_file = get_temporary_filename(".s");
-    if (!run_code_generation(assembly_file)) {
+    return run_code_generation();
+}
+
+bool CompilerDriver::stream_assembly(const std::string& source_code, std::ostream& out) {
+    clear_messages();
+    assembly_text.clear();
+    ast.reset();
+    ir_code.clear();
+    
+    // Symbols and numbering start over; nothing of an earlier compile carries in
+    analyzer = std::make_unique<SemanticAnalyzer>();
+    ir_generator = std::make_unique<IRGenerator>(analyzer.get());
+    remarks.clear();
+    RemarkCollector* collector = options.optimization_record_format.empty() ? nullptr : &remarks;
+    optimizer->set_remarks(collector);
+    advanced_optimizer->set_remarks(collector);
+    optimizer->set_budget(options.budget);
+    advanced_optimizer->set_budget(options.budget);
+    
+    // Global declaration pass: calls may precede the callee's definition, so
+    // every function is declared before any body is checked. Bodies are
+    // skipped; only the signatures are kept.
+    std::unordered_set<std::string> defined_functions;
+    profiler->start_phase("syntax_analysis");
+    try {
+        DeclarationStream declarations(source_code, true);
+        while (auto declaration = declarations.next()) {
+            if (auto function = dynamic_cast<FunDeclaration*>(declaration.get())) {
+                analyzer->declare_function(*function);
+                if (function->body) defined_functions.insert(function->name);
+            }
+        }
+        if (!declarations.get_errors().empty()) {
+            error_messages = declarations.get_errors();
+            return false;
+        }
+    } catch (const std::exception& e) {
+        error_messages.push_back("Lexical analysis failed: " + std::string(e.what()));
         return false;
     }
+    profiler->end_phase("syntax_analysis");
     
-    // Phase 7: Assembly and Linking
-    if (options.output_format == OutputFormat::EXECUTABLE) {
-        if (!run_assembly_and_linking(assembly_file, output_file)) {
+    // Then each declaration in turn is checked, lowered, optimized and
+    // emitted, and its AST and IR freed before the next is parsed. After a
+    // semantic error the rest is only checked, to report everything.
+    try {
+        AssemblyGenerator code_gen(out);
+        configure_code_generator(code_gen);
+        code_gen.begin_program(defined_functions);
+        
+        DeclarationStream declarations(source_code);
+        bool checked = true;
+        size_t functions = 0, largest = 0;
+        while (true) {
+            profiler->start_phase("syntax_analysis");
+            auto declaration = declarations.next();
+            profiler->end_phase("syntax_analysis");
+            if (!declaration) break;
+            
+            profiler->start_phase("semantic_analysis");
+            checked = analyzer->analyze_declaration(*declaration) && checked;
+            profiler->end_phase("semantic_analysis");
+            if (!checked) continue;
+            
+            profiler->start_phase("ir_generation");
+            IRCode code = ir_generator->generate_declaration(*declaration);
+            declaration.reset();
+            profiler->end_phase("ir_generation");
+            if (code.empty()) continue;
+            largest = std::max(largest, code.size());
+            
+            profiler->start_phase("optimization");
+            optimize_ir(code);
+            profiler->end_phase("optimization");
+            
+            profiler->start_phase("code_generation");
+            if (options.opt_level >= OptimizationLevel::O3) {
+                code_gen.set_register_assignment(advanced_optimizer->get_register_assignment());
+            }
+            code_gen.generate_function(code);
+            profiler->end_phase("code_generation");
+            ++functions;
+        }
+        
+        // Declarations that failed to parse were skipped; report only those,
+        // as the whole-program parse does
+        if (!declarations.get_errors().empty()) {
+            error_messages = declarations.get_errors();
             return false;
         }
-    } else {
-        // Just copy assembly file to output
-        std::filesystem::copy_file(assembly_file, output_file);
+        if (!analyzer->finish_analysis() || !checked) {
+            for (const auto& error : analyzer->get_error_collector().get_errors()) {
+                error_messages.push_back(error.format_error());
+            }
+            return false;
+        }
+        code_gen.end_program();
+        
+        if (options.print_stages) {
+            std::cout << "Streaming: " << functions << " functions emitted, at most " << largest
+                      << " IR instructions held at once" << std::endl;
+        }
+        return true;
+    } catch (const std::exception& e) {
+        error_messages.push_back("Streaming compilation failed: " + std::string(e.what()));
+        return false;
     }
+}
+
+std::string CompilerDriver::streaming_unsupported() const {
+    if (options.opt_level == OptimizationLevel::Os) return "-Os";
+    if (!options.profile_generate.empty()) return "-fprofile-generate";
+    if (!options.profile_use.empty()) return "-fprofile-use";
+    if (options.instrument_functions) return "-finstrument-functions";
+    if (options.fast_compile) return "--fast-compile";
+    if (options.print_ir) return "--print-ir";
+    if (options.print_assembly) return "--print-asm";
+    return "";
+}
+
+bool CompilerDriver::write_text_file(const std::string& path, const std::string& text) {
+    std::ofstream file(path);
+    file << text;
+    if (!file) {
+        error_messages.push_back("Cannot write " + path);
+        return false;
+    }
+    return true;
+}
+
+bool CompilerDriver::run_jit(const std::string& source_file, long& exit_code) {
+    clear_messages();
     
-    if (options.verbose) {
-        profiler->end_phase("total_compilation");
-        print_performance_report();
+    std::ifstream file(source_file);
+    if (!file.is_open()) {
+        error_messages.push_back("Cannot open source file: " + source_file);
+        return false;
     }
+    std::string source_code((std::istreambuf_iterator<char>(file)),
+                           std::istreambuf_iterator<char>());
+    source_path = source_file;
     
-    if (!options.keep_intermediate) {
-        cleanup_intermediate_files();
+    if (!run_lexical_analysis(source_code) || !run_syntax_analysis() || !run_semantic_analysis()) {
+        return false;
     }
     
-    return true;
+    try {
+        TieredJit jit(*ast, *analyzer);
+        jit.set_hot_threshold(options.jit_hot_threshold);
+        exit_code = jit.run();
+        
+        if (options.verbose) {
+            std::cout << "\nJIT tiers (hot at " << options.jit_hot_threshold << " calls + back edges):" << std::endl;
+            for (const auto& function : jit.get_functions()) {
+                std::cout << "  " << function.name << ": " << function.calls << " calls, "
+                          << function.back_edges << " back edges, ";
+                if (function.tier == TieredJit::Tier::Optimized) {
+                    std::cout << "-O3 (compiled in " << function.compile_seconds * 1000 << " ms)";
+                } else if (function.tier == TieredJit::Tier::Ineligible) {
+                    std::cout << "baseline (" << function.reason << ")";
+                } else {
+                    std::cout << "baseline";
+                }
+                std::cout << std::endl;
+            }
+        }
+        return true;
+    } catch (const std::exception& e) {
+        error_messages.push_back("JIT failed: " + std::string(e.what()));
+        return false;
+    }
 }
 
 bool CompilerDriver::run_lexical_analysis(const std::string& source) {
-    if (options.verbose) {
-        profiler->start_phase("lexical_analysis");
-    }
+    profiler->start_phase("lexical_analysis");
     
     try {
         lexer = std::make_unique<Lexer>(source);
@@ -118,9 +365,7 @@ bool CompilerDriver::run_lexical_analysis(const std::string& source) {
         
         parser = std::make_unique<Parser>(tokens);
         
-        if (options.verbose) {
-            profiler->end_phase("lexical_analysis");
-        }
+        profiler->end_phase("lexical_analysis");
         
         return true;
     } catch (const std::exception& e) {
@@ -130,9 +375,7 @@ bool CompilerDriver::run_lexical_analysis(const std::string& source) {
 }
 
 bool CompilerDriver::run_syntax_analysis() {
-    if (options.verbose) {
-        profiler->start_phase("syntax_analysis");
-    }
+    profiler->start_phase("syntax_analysis");
     
     try {
         ast = std::unique_ptr<Program>(dynamic_cast<Program*>(parser->parse_program().release()));
@@ -140,14 +383,16 @@ bool CompilerDriver::run_syntax_analysis() {
             error_messages.push_back("Syntax analysis failed: No AST generated");
             return false;
         }
+        if (!parser->get_errors().empty()) {
+            error_messages.insert(error_messages.end(), parser->get_errors().begin(), parser->get_errors().end());
+            return false;
+        }
         
         if (options.print_stages) {
             std::cout << "Syntax Analysis: AST generated successfully" << std::endl;
         }
         
-        if (options.verbose) {
-            profiler->end_phase("syntax_analysis");
-        }
+        profiler->end_phase("syntax_analysis");
         
         return true;
     } catch (const std::exception& e) {
@@ -157,9 +402,7 @@ bool CompilerDriver::run_syntax_analysis() {
 }
 
 bool CompilerDriver::run_semantic_analysis() {
-    if (options.verbose) {
-        profiler->start_phase("semantic_analysis");
-    }
+    profiler->start_phase("semantic_analysis");
     
     try {
         // Don't call parse_program again! Use stored AST
@@ -187,9 +430,7 @@ bool CompilerDriver::run_semantic_analysis() {
             std::cout << "Semantic Analysis: Passed" << std::endl;
         }
         
-        if (options.verbose) {
-            profiler->end_phase("semantic_analysis");
-        }
+        profiler->end_phase("semantic_analysis");
         
         return true;
     } catch (const std::exception& e) {
@@ -199,9 +440,7 @@ bool CompilerDriver::run_semantic_analysis() {
 }
 
 bool CompilerDriver::run_ir_generation() {
-    if (options.verbose) {
-        profiler->start_phase("ir_generation");
-    }
+    profiler->start_phase("ir_generation");
     
     try {
         // Use stored AST, don't parse again
@@ -211,7 +450,7 @@ bool CompilerDriver::run_ir_generation() {
         }
         
         Program* program = dynamic_cast<Program*>(ast.get());
-        auto ir_code = ir_generator->generate(*program);
+        ir_code = ir_generator->generate(*program);
         
         if (options.print_ir) {
             std::cout << "Generated IR:" << std::endl;
@@ -222,9 +461,7 @@ bool CompilerDriver::run_ir_generation() {
             std::cout << "IR Generation: Generated " << ir_code.size() << " instructions" << std::endl;
         }
         
-        if (options.verbose) {
-            profiler->end_phase("ir_generation");
-        }
+        profiler->end_phase("ir_generation");
         
         return true;
     } catch (const std::exception& e) {
@@ -234,91 +471,173 @@ bool CompilerDriver::run_ir_generation() {
 }
 
 bool CompilerDriver::run_optimization() {
-    if (options.verbose) {
-        profiler->start_phase("optimization");
-    }
+    profiler->start_phase("optimization");
     
     try {
-        // Use stored AST, don't parse again
-        if (!ast) {
-            error_messages.push_back("Optimization failed: No AST");
-            return false;
+        remarks.clear();
+        RemarkCollector* collector = options.optimization_record_format.empty() ? nullptr : &remarks;
+        optimizer->set_remarks(collector);
+        advanced_optimizer->set_remarks(collector);
+        optimizer->set_budget(options.budget);
+        advanced_optimizer->set_budget(options.budget);
+        optimize_ir(ir_code);
+        
+        if (options.print_stages) {
+            std::string level = options.opt_level == OptimizationLevel::Os ?
+                "s" : std::to_string(static_cast<int>(options.opt_level));
+            std::cout << "Optimization: Applied O" << level << " optimizations" << std::endl;
         }
         
-        Program* program = dynamic_cast<Program*>(ast.get());
-        auto ir_code = ir_generator->generate(*program);
+        profiler->end_phase("optimization");
         
-        // Apply optimizations based on level
-        if (options.opt_level >= OptimizationLevel::O1) {
-            ir_code = optimizer->optimize(ir_code);
+        return true;
+    } catch (const std::exception& e) {
+        error_messages.push_back("Optimization failed: " + std::string(e.what()));
+        return false;
+    }
+}
+
+void CompilerDriver::optimize_ir(IRCode& code) {
+    // Apply optimizations based on level
+    if (options.opt_level >= OptimizationLevel::O1) {
+        optimizer->set_global_variables(ir_generator->get_global_variables());
+        code = optimizer->optimize(code);
+    }
+    
+    if (options.opt_level >= OptimizationLevel::O2) {
+        advanced_optimizer->apply_dataflow_optimizations(code);
+    }
+    
+    // Counters go in before the passes that profiles steer, so both
+    // modes number the same IR
+    if (!options.profile_generate.empty() || !options.profile_use.empty()) {
+        profile_instrumenter.instrument(code);
+    }
+    if (!options.profile_use.empty()) {
+        try {
+            profile_instrumenter.apply_counts(code, profile_instrumenter.read_profile(options.profile_use));
+        } catch (const std::exception& e) {
+            warning_messages.push_back("Profile not used: " + std::string(e.what()));
         }
+    }
+    
+    if (options.opt_level >= OptimizationLevel::O3) {
+        advanced_optimizer->set_optimize_for_size(options.opt_level == OptimizationLevel::Os);
+        advanced_optimizer->apply_aggressive_optimizations(code);
+    }
+}
+
+void CompilerDriver::write_optimization_record(const std::string& output_file) {
+    std::string path = options.optimization_record_file;
+    if (path.empty()) {
+        path = std::filesystem::path(output_file).replace_extension(".opt." + options.optimization_record_format).string();
+    }
+    try {
+        remarks.write(path, options.optimization_record_format);
+        if (options.print_stages) {
+            std::cout << "Optimization record: " << remarks.get_remarks().size()
+                      << " remarks written to " << path << std::endl;
+        }
+    } catch (const std::exception& e) {
+        warning_messages.push_back("Optimization record not written: " + std::string(e.what()));
+    }
+}
+
+bool CompilerDriver::run_code_generation() {
+    profiler->start_phase("code_generation");
+    
+    try {
+        // Generate from the IR the optimization phase left behind
+        std::ostringstream assembly;
+        AssemblyGenerator code_gen(assembly);
+        configure_code_generator(code_gen);
+        if (options.opt_level >= OptimizationLevel::O3) {
+            code_gen.set_register_assignment(advanced_optimizer->get_register_assignment());
+        }
+        code_gen.generate_from_ir(ir_code);
+        assembly_text = assembly.str();
         
-        if (options.opt_level >= OptimizationLevel::O2) {
-            advanced_optimizer->apply_dataflow_optimizations(ir_code);
+        if (options.size_report && options.opt_level == OptimizationLevel::Os) {
+            long total = 0;
+            std::cout << "Size report (estimated bytes saved):" << std::endl;
+            for (const auto& entry : code_gen.get_size_optimizer().get_savings()) {
+                std::cout << "  " << entry.first << ": " << entry.second << std::endl;
+                total += entry.second;
+            }
+            std::cout << "  total: " << total << std::endl;
         }
         
-        if (options.opt_level >= OptimizationLevel::O3) {
-            advanced_optimizer->apply_aggressive_optimizations(ir_code);
+        if (options.print_assembly) {
+            print_assembly();
         }
         
         if (options.print_stages) {
-            std::cout << "Optimization: Applied O" << static_cast<int>(options.opt_level) << " optimizations" << std::endl;
+            std::cout << "Code Generation: Generated " << assembly_text.size() << " bytes of assembly" << std::endl;
         }
         
-        if (options.verbose) {
-            profiler->end_phase("optimization");
-        }
+        profiler->end_phase("code_generation");
         
         return true;
     } catch (const std::exception& e) {
-        error_messages.push_back("Optimization failed: " + std::string(e.what()));
+        error_messages.push_back("Code generation failed: " + std::string(e.what()));
         return false;
     }
 }
 
-bool CompilerDriver::run_code_generation(const std::string& output_file) {
-    if (options.verbose) {
-        profiler->start_phase("code_generation");
+void CompilerDriver::configure_code_generator(AssemblyGenerator& code_gen) {
+    bool omit_frame_pointer = options.frame_pointer == FramePointer::OMIT ||
+        (options.frame_pointer == FramePointer::DEFAULT && options.opt_level >= OptimizationLevel::O3);
+    code_gen.set_omit_frame_pointer(omit_frame_pointer);
+    code_gen.set_shrink_wrap(options.opt_level >= OptimizationLevel::O2);
+    code_gen.set_block_layout(options.opt_level >= OptimizationLevel::O2);
+    code_gen.set_target(target);
+    code_gen.set_optimize_size(options.opt_level == OptimizationLevel::Os);
+    code_gen.set_instrument_functions(options.instrument_functions);
+    if (options.debug_info) {
+        code_gen.set_debug_source(source_path.empty() ? "<source>" : source_path);
+    }
+    if (!options.profile_generate.empty()) {
+        code_gen.set_profile_generate(options.profile_generate, profile_instrumenter.get_checksum(),
+                                       profile_instrumenter.get_counter_count());
     }
+}
+
+std::string CompilerDriver::baseline_unsupported() const {
+    if (options.opt_level != OptimizationLevel::O0) return "optimization above -O0";
+    if (!options.profile_generate.empty()) return "-fprofile-generate";
+    if (!options.profile_use.empty()) return "-fprofile-use";
+    if (options.instrument_functions) return "-finstrument-functions";
+    if (!options.optimization_record_format.empty()) return "-fsave-optimization-record";
+    if (options.print_ir) return "--print-ir";
+    return "";
+}
+
+bool CompilerDriver::run_baseline_code_generation() {
+    profiler->start_phase("code_generation");
     
     try {
-        // Use stored AST, don't parse again
-        if (!ast) {
-            error_messages.push_back("Code generation failed: No AST");
-            return false;
-        }
-        
-        Program* program = dynamic_cast<Program*>(ast.get());
-        auto ir_code = ir_generator->generate(*program);
-        
-        // Apply optimizations if enabled
-        if (options.opt_level >= OptimizationLevel::O1) {
-            ir_code = optimizer->optimize(ir_code);
-        }
-        
-        code_gen = std::make_unique<AssemblyGenerator>(output_file);
-        code_gen->generate_from_ir(ir_code);
+        BaselineCompiler baseline;
+        baseline.set_debug_lines(options.debug_info);
+        std::string functions = baseline.compile(*ast);
         
+        std::ostringstream assembly;
+        AssemblyGenerator code_gen(assembly);
         if (options.debug_info) {
-            debug_gen->generate_debug_info(output_file + ".debug");
+            code_gen.set_debug_source(source_path.empty() ? "<source>" : source_path);
         }
+        code_gen.generate_from_assembly(functions);
+        assembly_text = assembly.str();
         
         if (options.print_assembly) {
-            std::ifstream asm_file(output_file);
-            std::string line;
-            std::cout << "Generated Assembly:" << std::endl;
-            while (std::getline(asm_file, line)) {
-                std::cout << line << std::endl;
-            }
+            print_assembly();
         }
         
         if (options.print_stages) {
-            std::cout << "Code Generation: Assembly generated to " << output_file << std::endl;
+            std::cout << "Code Generation: Generated " << assembly_text.size() << " bytes of baseline assembly"
+                      << std::endl;
         }
         
-        if (options.verbose) {
-            profiler->end_phase("code_generation");
-        }
+        profiler->end_phase("code_generation");
         
         return true;
     } catch (const std::exception& e) {
@@ -327,14 +646,18 @@ bool CompilerDriver::run_code_generation(const std::string& output_file) {
     }
 }
 
-bool CompilerDriver::run_assembly_and_linking(const std::string& assembly_file, const std::string& output_file) {
-    if (options.verbose) {
-        profiler->start_phase("assembly_linking");
-    }
+void CompilerDriver::print_assembly() const {
+    std::cout << "Generated Assembly:" << std::endl;
+    std::cout << assembly_text;
+}
+
+bool CompilerDriver::run_assembly_and_linking(const std::string& assembly_file, const std::string& output_file,
+                                              bool link) {
+    profiler->start_phase("assembly_linking");
     
     try {
-        // Assemble
-        std::string object_file = get_temporary_filename(".o");
+        // Assemble; without linking the object is the output
+        std::string object_file = link ? get_temporary_filename(".o") : output_file;
         std::string as_cmd = "as -64 " + assembly_file + " -o " + object_file;
         
         if (options.verbose) {
@@ -347,26 +670,26 @@ bool CompilerDriver::run_assembly_and_linking(const std::string& assembly_file,
             return false;
         }
         
-        // Link
-        std::string ld_cmd = "ld " + object_file + " -o " + output_file;
-        
-        if (options.verbose) {
-            std::cout << "Linking: " << ld_cmd << std::endl;
-        }
-        
-        int ld_result = std::system(ld_cmd.c_str());
-        if (ld_result != 0) {
-            error_messages.push_back("Linking failed");
-            return false;
+        if (link) {
+            std::string ld_cmd = "ld " + object_file + " -o " + output_file;
+            
+            if (options.verbose) {
+                std::cout << "Linking: " << ld_cmd << std::endl;
+            }
+            
+            int ld_result = std::system(ld_cmd.c_str());
+            if (ld_result != 0) {
+                error_messages.push_back("Linking failed");
+                return false;
+            }
         }
         
         if (options.print_stages) {
-            std::cout << "Assembly & Linking: Executable generated to " << output_file << std::endl;
+            std::cout << "Assembly & Linking: " << (link ? "Executable" : "Object") << " generated to "
+                      << output_file << std::endl;
         }
         
-        if (options.verbose) {
-            profiler->end_phase("assembly_linking");
-        }
+        profiler->end_phase("assembly_linking");
         
         return true;
     } catch (const std::exception& e) {
@@ -396,12 +719,83 @@ void CompilerDriver::set_output_format(OutputFormat format) {
     options.output_format = format;
 }
 
+void CompilerDriver::set_frame_pointer(FramePointer mode) {
+    options.frame_pointer = mode;
+}
+
+void CompilerDriver::set_profile_generate(const std::string& path) {
+    options.profile_generate = path;
+}
+
+void CompilerDriver::set_profile_use(const std::string& path) {
+    options.profile_use = path;
+}
+
+void CompilerDriver::set_size_report(bool enable) {
+    options.size_report = enable;
+}
+
+void CompilerDriver::set_instrument_functions(bool enable) {
+    options.instrument_functions = enable;
+}
+
+void CompilerDriver::set_fast_compile(bool enable) {
+    options.fast_compile = enable;
+}
+
+void CompilerDriver::set_streaming(bool enable) {
+    options.streaming = enable;
+}
+
+void CompilerDriver::set_source_name(const std::string& name) {
+    source_path = name;
+}
+
+std::string CompilerDriver::get_optimization_record() const {
+    if (options.optimization_record_format == "yaml") return remarks.to_yaml();
+    if (options.optimization_record_format == "json") return remarks.to_json();
+    return "";
+}
+
+void CompilerDriver::set_jit_hot_threshold(uint64_t threshold) {
+    options.jit_hot_threshold = threshold;
+}
+
+void CompilerDriver::set_optimization_record(const std::string& format) {
+    if (format != "yaml" && format != "json") {
+        throw std::runtime_error("unknown optimization record format '" + format + "' (expected yaml or json)");
+    }
+    options.optimization_record_format = format;
+}
+
+void CompilerDriver::set_optimization_record_file(const std::string& path) {
+    options.optimization_record_file = path;
+    if (options.optimization_record_format.empty()) {
+        options.optimization_record_format = "yaml";
+    }
+}
+
+void CompilerDriver::set_param(const std::string& name, size_t value) {
+    if (!set_budget_param(options.budget, name, value)) {
+        throw std::runtime_error("unknown parameter '" + name + "'");
+    }
+}
+
+void CompilerDriver::set_target_architecture(const std::string& march) {
+    target = select_target(march);
+    options.target_architecture = march;
+}
+
 void CompilerDriver::enable_profiling(bool enable) {
     if (profiler) {
         profiler->enable_profiling(enable);
     }
 }
 
+bool CompilerDriver::enable_hardware_counters(bool enable) {
+    return profiler && profiler->enable_hardware_counters(enable);
+}
+
 const std::vector<std::string>& CompilerDriver::get_errors() const {
     return error_messages;
 }
@@ -420,7 +814,7 @@ std::string CompilerDriver::get_version() const {
 }
 
 std::string CompilerDriver::get_target_info() const {
-    return "Target: x86_64-linux-gnu";
+    return "Target: x86_64-linux-gnu, -march=" + target.describe();
 }
 
 void CompilerDriver::print_help() const {
@@ -428,10 +822,25 @@ void CompilerDriver::print_help() const {
               << "Usage: cmmc [options] <source-file> -o <output-file>\n\n"
               << "Options:\n"
               << "  -O0, -O1, -O2, -O3    Set optimization level\n"
-              << "  -g                    Generate debug information\n"
+              << "  -Os                   Optimize for size\n"
+              << "  -march=<cpu>          x86-64, x86-64-v2, x86-64-v3 or native\n"
+              << "  -g                    Emit DWARF line tables for perf and gdb\n"
               << "  -v                    Verbose output\n"
               << "  -S                    Generate assembly only\n"
               << "  -c                    Generate object file only\n"
+              << "  --fast-compile        At -O0, generate code straight from the AST (no IR)\n"
+              << "  --jit                 Run in-process, recompiling hot functions at -O3\n"
+              << "  --stream              Compile a function at a time; memory grows with the largest function\n"
+              << "  -fomit-frame-pointer  Address locals from rsp (default at -O3)\n"
+              << "  -fno-omit-frame-pointer Keep rbp as the frame pointer\n"
+              << "  -fprofile-generate[=file] Instrument to record a profile (default.profdata)\n"
+              << "  -fprofile-use[=file]  Optimize with a recorded profile\n"
+              << "  -finstrument-functions Print per-function calls and cycles at exit\n"
+              << "  -fsave-optimization-record[=yaml|json] Write what each pass did or missed and why\n"
+              << "  -foptimization-record-file=<file> Where to write it (default <output>.opt.yaml)\n"
+              << "  --param <name>=<n>    Per-function IR size limit for a pass group: max-local-opt-size,\n"
+              << "                        max-dataflow-size, max-loop-opt-size or max-regalloc-size\n"
+              << "  --size-report         Print bytes saved by each -Os transform\n"
               << "  --print-stages        Print compilation stages\n"
               << "  --print-ir            Print intermediate representation\n"
               << "  --print-asm           Print generated assembly\n"
@@ -447,18 +856,22 @@ void CompilerDriver::print_performance_report() const {
 }
 
 std::string CompilerDriver::get_temporary_filename(const std::string& suffix) {
-    static int counter = 0;
-    return "temp_" + std::to_string(counter++) + suffix;
+    // Process id and driver address keep concurrent compilers apart
+    std::ostringstream name;
+    name << "cmmc-" << getpid() << "-" << std::hex << reinterpret_cast<uintptr_t>(this) << std::dec << "-"
+         << temporary_counter++ << suffix;
+    std::string path = (std::filesystem::temp_directory_path() / name.str()).string();
+    intermediate_files.push_back(path);
+    return path;
 }
 
 void CompilerDriver::cleanup_intermediate_files() {
-    // Remove temporary files
-    std::filesystem::remove("temp.s");
-    std::filesystem::remove("temp.o");
-    for (int i = 0; i < 100; ++i) {
-        std::filesystem::remove("temp_" + std::to_string(i) + ".s");
-        std::filesystem::remove("temp_" + std::to_string(i) + ".o");
+    // Only this driver's files; others may be mid-compile
+    for (const auto& file : intermediate_files) {
+        std::error_code ignored;
+        std::filesystem::remove(file, ignored);
     }
+    intermediate_files.clear();
 }
 
 void CompilerDriver::print_stage_info(const std::string& stage_name, bool success) {
@@ -7,8 +7,14 @@
 #include "ir-optimizer.h"
 #include "assembly-generator.h"
 #include "advanced-optimizer.h"
-#include "debug-info-generator.h"
 #include "compiler-profiler.h"
+#include "profile-instrumenter.h"
+#include "target-features.h"
+#include "optimization-remarks.h"
+#include "compile-budget.h"
+#include "baseline-compiler.h"
+#include "tiered-jit.h"
+#include "declaration-stream.h"
 #include <memory>
 #include <string>
 #include <vector>
@@ -18,7 +24,8 @@ enum class OptimizationLevel {
     O0 = 0,  // No optimization
     O1 = 1,  // Basic optimization
     O2 = 2,  // Standard optimization
-    O3 = 3   // Aggressive optimization
+    O3 = 3,  // Aggressive optimization
+    Os = 4   // O3 without code-growing transforms, plus size passes
 };
 
 enum class OutputFormat {
@@ -27,6 +34,12 @@ enum class OutputFormat {
     EXECUTABLE
 };
 
+enum class FramePointer {
+    DEFAULT,  // Omitted from -O3 up
+    KEEP,
+    OMIT
+};
+
 struct CompilerOptions {
     OptimizationLevel opt_level = OptimizationLevel::O0;
     bool debug_info = false;
@@ -36,8 +49,19 @@ struct CompilerOptions {
     bool print_cfg = false;
     bool print_assembly = false;
     bool keep_intermediate = false;
+    bool size_report = false;       // print the bytes -Os saved per transform
+    bool instrument_functions = false;   // rdtsc timing report at exit
+    bool fast_compile = false;      // -O0 code straight from the AST (BaselineCompiler)
+    bool streaming = false;         // --stream: lower, optimize and emit one function at a time
+    uint64_t jit_hot_threshold = TieredJit::DEFAULT_HOT_THRESHOLD;   // --jit recompiles at this heat
     OutputFormat output_format = OutputFormat::EXECUTABLE;
-    std::string target_architecture = "x86_64";
+    FramePointer frame_pointer = FramePointer::DEFAULT;
+    std::string profile_generate;   // instrument and write counts here (empty: off)
+    std::string profile_use;        // optimize with counts read from here (empty: off)
+    std::string target_architecture = "x86-64";   // -march value
+    std::string optimization_record_format;   // "yaml" or "json" (empty: no record)
+    std::string optimization_record_file;     // empty: the output name with .opt.<format>
+    CompileBudget budget;                     // --param limits on superlinear passes
     std::vector<std::string> include_paths;
     std::vector<std::string> library_paths;
 };
@@ -50,25 +74,55 @@ private:
     std::unique_ptr<IRGenerator> ir_generator;
     std::unique_ptr<IROptimizer> optimizer;
     std::unique_ptr<AdvancedOptimizer> advanced_optimizer;
-    std::unique_ptr<AssemblyGenerator> code_gen;
-    std::unique_ptr<DebugInfoGenerator> debug_gen;
     std::unique_ptr<CompilerProfiler> profiler;
     
+    // File compile() read the source from; named in -g line tables
+    std::string source_path;
+    
     // Store parsed AST to reuse across phases
     std::unique_ptr<Program> ast;
     
+    // IR produced by generation and rewritten in place by optimization
+    IRCode ir_code;
+    
+    // Output of code generation, written out or handed back by the caller
+    std::string assembly_text;
+    
+    // Temporary files of this driver, removed by cleanup_intermediate_files
+    std::vector<std::string> intermediate_files;
+    int temporary_counter = 0;
+    
+    // Counter layout for -fprofile-generate and -fprofile-use
+    ProfileInstrumenter profile_instrumenter;
+    
+    // Features of options.target_architecture, resolved when it is set
+    TargetMachine target;
+    
+    // Pass decisions for -fsave-optimization-record
+    RemarkCollector remarks;
+    
     CompilerOptions options;
     std::vector<std::string> error_messages;
     std::vector<std::string> warning_messages;
     
     // Compilation pipeline methods
+    bool generate_assembly(const std::string& source_code);
+    bool stream_assembly(const std::string& source_code, std::ostream& out);
+    std::string streaming_unsupported() const;
     bool run_lexical_analysis(const std::string& source);
     bool run_syntax_analysis();
     bool run_semantic_analysis();
     bool run_ir_generation();
     bool run_optimization();
-    bool run_code_generation(const std::string& output_file);
-    bool run_assembly_and_linking(const std::string& assembly_file, const std::string& output_file);
+    void optimize_ir(IRCode& code);
+    void write_optimization_record(const std::string& output_file);
+    bool run_code_generation();
+    void configure_code_generator(AssemblyGenerator& code_gen);
+    bool run_baseline_code_generation();
+    std::string baseline_unsupported() const;
+    void print_assembly() const;
+    bool run_assembly_and_linking(const std::string& assembly_file, const std::string& output_file, bool link);
+    bool write_text_file(const std::string& path, const std::string& text);
     
     // Utility methods
     void print_stage_info(const std::string& stage_name, bool success);
@@ -77,18 +131,47 @@ private:
     
 public:
     CompilerDriver();
+    explicit CompilerDriver(const CompilerOptions& options);   // throws on an unknown target
     ~CompilerDriver();
     
+    CompilerDriver(const CompilerDriver&) = delete;
+    CompilerDriver& operator=(const CompilerDriver&) = delete;
+    
     // Main compilation interface
     bool compile(const std::string& source_file, const std::string& output_file);
     bool compile_from_source(const std::string& source_code, const std::string& output_file);
     
+    // Compile without writing outputs: the assembly is left for get_assembly
+    // and, given `object`, assembled into it. Temporary files are private to
+    // this driver, so drivers on different threads do not interfere.
+    bool compile_to_memory(const std::string& source_code, std::vector<unsigned char>* object = nullptr);
+    const std::string& get_assembly() const { return assembly_text; }
+    std::string get_optimization_record() const;   // empty unless a record format is set
+    const CompilerProfiler& get_profiler() const { return *profiler; }
+    void set_source_name(const std::string& name);   // for -g line tables
+    
+    // --jit: run the program in this process, baseline code first and hot
+    // functions recompiled at -O3; main's value goes to exit_code
+    bool run_jit(const std::string& source_file, long& exit_code);
+    
     // Configuration methods
     void set_optimization_level(OptimizationLevel level);
     void enable_debug_info(bool enable);
     void set_verbose(bool verbose);
     void print_compilation_stages(bool enable);
     void set_output_format(OutputFormat format);
+    void set_frame_pointer(FramePointer mode);
+    void set_profile_generate(const std::string& path);
+    void set_profile_use(const std::string& path);
+    void set_size_report(bool enable);
+    void set_instrument_functions(bool enable);
+    void set_fast_compile(bool enable);   // used at -O0 unless an option needs the IR
+    void set_streaming(bool enable);      // unless an option needs the whole program
+    void set_jit_hot_threshold(uint64_t threshold);
+    void set_optimization_record(const std::string& format);   // throws unless yaml or json
+    void set_optimization_record_file(const std::string& path);
+    void set_param(const std::string& name, size_t value);   // throws on unknown names
+    void set_target_architecture(const std::string& march);   // throws on unknown names
     void add_include_path(const std::string& path);
     void add_library_path(const std::string& path);
     
@@ -104,6 +187,7 @@ public:
     
     // Performance and profiling
     void enable_profiling(bool enable);
+    bool enable_hardware_counters(bool enable);   // false when no counter can be opened
     void print_performance_report() const;
     
     // Testing support
@@ -4,9 +4,75 @@
 #include <iomanip>
 #include <algorithm>
 #include <sstream>
+#include <stdexcept>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#endif
+
+namespace {
+
+#ifdef __linux__
+struct CounterEvent {
+    uint32_t type;
+    uint64_t config;
+};
+
+// In HardwareCounter order
+const CounterEvent hardware_events[HARDWARE_COUNTER_COUNT] = {
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+    {PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS},
+};
+
+// Counts this thread in user space, which perf_event_paranoid allows
+// unprivileged up to level 2
+int open_counter(const CounterEvent& event) {
+    perf_event_attr attr;
+    std::memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = event.type;
+    attr.config = event.config;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    return static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, -1, PERF_FLAG_FD_CLOEXEC));
+}
+#endif
+
+std::string format_count(long long count) {
+    return count < 0 ? "n/a" : std::to_string(count);
+}
+
+} // namespace
+
+const char* hardware_counter_name(HardwareCounter counter) {
+    switch (counter) {
+        case HardwareCounter::Cycles: return "cycles";
+        case HardwareCounter::Instructions: return "instructions";
+        case HardwareCounter::CacheMisses: return "cache_misses";
+        case HardwareCounter::BranchMisses: return "branch_misses";
+        case HardwareCounter::PageFaults: return "page_faults";
+    }
+    return "unknown";
+}
 
 CompilerProfiler::CompilerProfiler() 
-    : profiling_enabled(false), peak_memory_usage(0), current_memory_usage(0) {}
+    : profiling_enabled(false), peak_memory_usage(0), current_memory_usage(0),
+      hardware_counters_requested(false) {
+    hardware_fds.fill(-1);
+}
+
+CompilerProfiler::~CompilerProfiler() {
+    close_hardware_counters();
+}
 
 void CompilerProfiler::enable_profiling(bool enable) {
     profiling_enabled = enable;
@@ -19,6 +85,67 @@ bool CompilerProfiler::is_profiling_enabled() const {
     return profiling_enabled;
 }
 
+bool CompilerProfiler::enable_hardware_counters(bool enable) {
+    close_hardware_counters();
+    hardware_counters_requested = enable;
+    hardware_counter_status.clear();
+    if (!enable) return false;
+    
+#ifdef __linux__
+    std::string failures;
+    for (size_t k = 0; k < HARDWARE_COUNTER_COUNT; ++k) {
+        hardware_fds[k] = open_counter(hardware_events[k]);
+        if (hardware_fds[k] < 0) {
+            failures += std::string(failures.empty() ? "" : ", ") +
+                        hardware_counter_name(static_cast<HardwareCounter>(k)) + ": " + std::strerror(errno);
+        }
+    }
+    if (!has_hardware_counters()) {
+        hardware_counter_status = "unavailable (" + failures + ")";
+    } else if (!failures.empty()) {
+        hardware_counter_status = "partial (" + failures + ")";
+    } else {
+        hardware_counter_status = "available";
+    }
+#else
+    hardware_counter_status = "unavailable (perf_event_open is Linux-only)";
+#endif
+    return has_hardware_counters();
+}
+
+const std::string& CompilerProfiler::get_hardware_counter_status() const {
+    return hardware_counter_status;
+}
+
+bool CompilerProfiler::has_hardware_counters() const {
+    return std::any_of(hardware_fds.begin(), hardware_fds.end(), [](int fd) { return fd >= 0; });
+}
+
+void CompilerProfiler::close_hardware_counters() {
+#ifdef __linux__
+    for (int fd : hardware_fds) {
+        if (fd >= 0) close(fd);
+    }
+#endif
+    hardware_fds.fill(-1);
+    phase_start_counts.clear();
+}
+
+HardwareCounts CompilerProfiler::read_hardware_counters() const {
+    HardwareCounts counts;
+    counts.fill(-1);
+#ifdef __linux__
+    for (size_t k = 0; k < HARDWARE_COUNTER_COUNT; ++k) {
+        uint64_t values[3];   // value, time enabled, time running
+        if (hardware_fds[k] < 0 || read(hardware_fds[k], values, sizeof(values)) != sizeof(values)) continue;
+        // Scale up when the kernel multiplexed the counter off the PMU
+        double scale = values[2] > 0 && values[2] < values[1] ? static_cast<double>(values[1]) / values[2] : 1.0;
+        counts[k] = static_cast<long long>(values[0] * scale);
+    }
+#endif
+    return counts;
+}
+
 void CompilerProfiler::start_phase(const std::string& phase_name) {
     if (!profiling_enabled) return;
     
@@ -29,6 +156,11 @@ void CompilerProfiler::start_phase(const std::string& phase_name) {
         phase_profiles[phase_name] = PhaseProfile();
         phase_profiles[phase_name].name = phase_name;
     }
+    
+    // Last, so the phase's counts leave out the profiler's own work
+    if (has_hardware_counters()) {
+        phase_start_counts[phase_name] = read_hardware_counters();
+    }
 }
 
 void CompilerProfiler::end_phase(const std::string& phase_name) {
@@ -41,6 +173,7 @@ void CompilerProfiler::end_phase(const std::string& phase_name) {
     }
     
     auto end_time = std::chrono::high_resolution_clock::now();
+    HardwareCounts end_counts = has_hardware_counters() ? read_hardware_counters() : HardwareCounts();
     auto duration = std::chrono::duration<double>(end_time - it->second);
     double elapsed_time = duration.count();
     
@@ -51,6 +184,16 @@ void CompilerProfiler::end_phase(const std::string& phase_name) {
     profile.average_time = profile.total_time / profile.call_count;
     profile.execution_times.push_back(elapsed_time);
     
+    auto start_counts = phase_start_counts.find(phase_name);
+    if (start_counts != phase_start_counts.end()) {
+        for (size_t k = 0; k < HARDWARE_COUNTER_COUNT; ++k) {
+            if (start_counts->second[k] < 0 || end_counts[k] < 0) continue;
+            profile.hardware_counts[k] = std::max(profile.hardware_counts[k], 0LL) +
+                                         std::max(end_counts[k] - start_counts->second[k], 0LL);
+        }
+        phase_start_counts.erase(start_counts);
+    }
+    
     // Remove from start times
     phase_start_times.erase(it);
     
@@ -140,6 +283,38 @@ void CompilerProfiler::generate_performance_report() const {
     
     std::cout << std::string(72, '-') << std::endl;
     
+    if (hardware_counters_requested) {
+        if (!has_hardware_counters()) {
+            std::cout << "\nHardware counters " << hardware_counter_status << std::endl;
+        } else {
+            std::cout << "\nHardware Counters:" << std::endl;
+            std::cout << std::setw(20) << "Phase" << std::setw(14) << "Cycles" << std::setw(14) << "Instructions"
+                      << std::setw(6) << "IPC" << std::setw(12) << "Cache Miss" << std::setw(12) << "Branch Miss"
+                      << std::setw(10) << "Faults" << std::endl;
+            std::cout << std::string(88, '-') << std::endl;
+            for (const auto& profile : phase_profiles) {
+                const auto& counts = profile.second.hardware_counts;
+                long long cycles = counts[static_cast<size_t>(HardwareCounter::Cycles)];
+                long long instructions = counts[static_cast<size_t>(HardwareCounter::Instructions)];
+                std::string ipc = "n/a";
+                if (cycles > 0 && instructions >= 0) {
+                    std::ostringstream ratio;
+                    ratio << std::fixed << std::setprecision(2) << static_cast<double>(instructions) / cycles;
+                    ipc = ratio.str();
+                }
+                std::cout << std::setw(20) << profile.second.name << std::setw(14) << format_count(cycles)
+                          << std::setw(14) << format_count(instructions) << std::setw(6) << ipc
+                          << std::setw(12) << format_count(counts[static_cast<size_t>(HardwareCounter::CacheMisses)])
+                          << std::setw(12) << format_count(counts[static_cast<size_t>(HardwareCounter::BranchMisses)])
+                          << std::setw(10) << format_count(counts[static_cast<size_t>(HardwareCounter::PageFaults)])
+                          << std::endl;
+            }
+            if (hardware_counter_status != "available") {
+                std::cout << "Hardware counters " << hardware_counter_status << std::endl;
+            }
+        }
+    }
+    
     // Performance counters
     if (!performance_counters.empty()) {
         std::cout << "\nPerformance Counters:" << std::endl;
@@ -187,7 +362,18 @@ void CompilerProfiler::generate_detailed_report(const std::string& output_file)
             if (i > 0) file << ", ";
             file << format_time(p.execution_times[i]);
         }
-        file << "\n\n";
+        file << "\n";
+        if (hardware_counters_requested) {
+            for (size_t k = 0; k < HARDWARE_COUNTER_COUNT; ++k) {
+                file << "    " << hardware_counter_name(static_cast<HardwareCounter>(k)) << ": "
+                     << format_count(p.hardware_counts[k]) << "\n";
+            }
+        }
+        file << "\n";
+    }
+    
+    if (hardware_counters_requested) {
+        file << "Hardware counters: " << hardware_counter_status << "\n\n";
     }
     
     file << "Performance Counters:\n";
@@ -208,6 +394,9 @@ void CompilerProfiler::generate_json_report(const std::string& output_file) cons
     file << "  \"performance_report\": {\n";
     file << "    \"total_compilation_time\": " << get_total_compilation_time() << ",\n";
     file << "    \"peak_memory_usage\": " << peak_memory_usage << ",\n";
+    if (hardware_counters_requested) {
+        file << "    \"hardware_counter_status\": \"" << hardware_counter_status << "\",\n";
+    }
     file << "    \"phases\": [\n";
     
     bool first = true;
@@ -227,7 +416,20 @@ void CompilerProfiler::generate_json_report(const std::string& output_file) cons
             if (i > 0) file << ", ";
             file << p.execution_times[i];
         }
-        file << "]\n";
+        file << "]";
+        if (hardware_counters_requested) {
+            file << ",\n        \"hardware_counters\": {";
+            for (size_t k = 0; k < HARDWARE_COUNTER_COUNT; ++k) {
+                file << (k ? ", " : "") << "\"" << hardware_counter_name(static_cast<HardwareCounter>(k)) << "\": ";
+                if (p.hardware_counts[k] < 0) {
+                    file << "null";
+                } else {
+                    file << p.hardware_counts[k];
+                }
+            }
+            file << "}";
+        }
+        file << "\n";
         file << "      }";
     }
     
@@ -248,6 +450,34 @@ void CompilerProfiler::generate_json_report(const std::string& output_file) cons
     file.close();
 }
 
+void CompilerProfiler::generate_csv_report(const std::string& output_file) const {
+    std::ofstream file(output_file);
+    if (!file.is_open()) {
+        throw std::runtime_error("Cannot open CSV performance report file: " + output_file);
+    }
+    
+    // Counter columns are always present and left empty when unavailable,
+    // so runs with and without counters load the same way
+    file << "phase,total_time,average_time,call_count,memory_usage";
+    for (size_t k = 0; k < HARDWARE_COUNTER_COUNT; ++k) {
+        file << "," << hardware_counter_name(static_cast<HardwareCounter>(k));
+    }
+    file << "\n";
+    
+    for (const auto& profile : phase_profiles) {
+        const auto& p = profile.second;
+        file << p.name << "," << p.total_time << "," << p.average_time << "," << p.call_count << ","
+             << p.memory_usage;
+        for (long long count : p.hardware_counts) {
+            file << ",";
+            if (count >= 0) file << count;
+        }
+        file << "\n";
+    }
+    
+    file.close();
+}
+
 double CompilerProfiler::get_total_compilation_time() const {
     if (total_start_time.time_since_epoch().count() == 0) return 0.0;
     return std::chrono::duration<double>(total_end_time - total_start_time).count();
@@ -266,6 +496,14 @@ double CompilerProfiler::get_phase_percentage(const std::string& phase_name) con
     return (phase_time / total_time) * 100.0;
 }
 
+HardwareCounts CompilerProfiler::get_phase_hardware_counts(const std::string& phase_name) const {
+    auto it = phase_profiles.find(phase_name);
+    if (it != phase_profiles.end()) return it->second.hardware_counts;
+    HardwareCounts none;
+    none.fill(-1);
+    return none;
+}
+
 std::vector<std::string> CompilerProfiler::get_slowest_phases(int count) const {
     std::vector<std::pair<std::string, double>> phase_times;
     
@@ -299,6 +537,24 @@ std::vector<std::string> CompilerProfiler::get_optimization_suggestions() const
             suggestions.push_back("Consider optimizing " + phase + " phase (takes " + 
                                 std::to_string(static_cast<int>(percentage)) + "% of compilation time)");
         }
+        
+        // Misses per thousand instructions say what a slow phase waits on
+        HardwareCounts counts = get_phase_hardware_counts(phase);
+        long long instructions = counts[static_cast<size_t>(HardwareCounter::Instructions)];
+        if (instructions <= 0) continue;
+        long long cache_misses = counts[static_cast<size_t>(HardwareCounter::CacheMisses)];
+        long long branch_misses = counts[static_cast<size_t>(HardwareCounter::BranchMisses)];
+        double cache_mpki = cache_misses < 0 ? 0.0 : cache_misses * 1000.0 / instructions;
+        double branch_mpki = branch_misses < 0 ? 0.0 : branch_misses * 1000.0 / instructions;
+        if (cache_mpki >= 10.0 && cache_mpki >= branch_mpki) {
+            suggestions.push_back("Phase " + phase + " looks memory-bound (" +
+                                  std::to_string(static_cast<int>(cache_mpki)) +
+                                  " cache misses per 1000 instructions); consider denser data structures");
+        } else if (branch_mpki >= 10.0) {
+            suggestions.push_back("Phase " + phase + " looks branch-bound (" +
+                                  std::to_string(static_cast<int>(branch_mpki)) +
+                                  " branch misses per 1000 instructions); consider more predictable control flow");
+        }
     }
     
     if (peak_memory_usage > 100 * 1024 * 1024) { // 100MB
@@ -321,6 +577,7 @@ void CompilerProfiler::reset() {
     phase_start_times.clear();
     memory_usage.clear();
     performance_counters.clear();
+    phase_start_counts.clear();
     peak_memory_usage = 0;
     current_memory_usage = 0;
     total_start_time = std::chrono::high_resolution_clock::time_point();
@@ -1,11 +1,22 @@
 #pragma once
 
+#include <array>
 #include <string>
 #include <map>
 #include <chrono>
 #include <vector>
 #include <memory>
 
+// Events counted through perf_event_open around every phase; cycles against
+// instructions and the miss counts tell a memory-bound phase from a
+// branch-bound one
+enum class HardwareCounter { Cycles, Instructions, CacheMisses, BranchMisses, PageFaults };
+constexpr size_t HARDWARE_COUNTER_COUNT = 5;
+const char* hardware_counter_name(HardwareCounter counter);
+
+// One value per HardwareCounter; -1 where the counter could not be opened
+using HardwareCounts = std::array<long long, HARDWARE_COUNTER_COUNT>;
+
 struct PhaseProfile {
     std::string name;
     double total_time;
@@ -13,8 +24,11 @@ struct PhaseProfile {
     size_t call_count;
     size_t memory_usage;
     std::vector<double> execution_times;
+    HardwareCounts hardware_counts;   // summed over calls
     
-    PhaseProfile() : total_time(0.0), average_time(0.0), call_count(0), memory_usage(0) {}
+    PhaseProfile() : total_time(0.0), average_time(0.0), call_count(0), memory_usage(0) {
+        hardware_counts.fill(-1);
+    }
 };
 
 class CompilerProfiler {
@@ -34,14 +48,34 @@ private:
     // Performance counters
     std::map<std::string, size_t> performance_counters;
     
+    // perf_event_open descriptors, -1 where unavailable; counts at each
+    // open phase's start
+    std::array<int, HARDWARE_COUNTER_COUNT> hardware_fds;
+    std::map<std::string, HardwareCounts> phase_start_counts;
+    bool hardware_counters_requested;
+    std::string hardware_counter_status;
+    
+    HardwareCounts read_hardware_counters() const;
+    void close_hardware_counters();
+    bool has_hardware_counters() const;
+    
 public:
     CompilerProfiler();
-    ~CompilerProfiler() = default;
+    ~CompilerProfiler();
+    CompilerProfiler(const CompilerProfiler&) = delete;
+    CompilerProfiler& operator=(const CompilerProfiler&) = delete;
     
     // Profiling control
     void enable_profiling(bool enable = true);
     bool is_profiling_enabled() const;
     
+    // Hardware counters, sampled at every start_phase and end_phase; false
+    // (with the reason in get_hardware_counter_status) when none can be
+    // opened, e.g. under perf_event_paranoid or in a VM without a PMU.
+    // Counters that open are used even if others do not.
+    bool enable_hardware_counters(bool enable = true);
+    const std::string& get_hardware_counter_status() const;
+    
     // Phase timing
     void start_phase(const std::string& phase_name);
     void end_phase(const std::string& phase_name);
@@ -67,7 +101,9 @@ public:
     double get_total_compilation_time() const;
     double get_phase_time(const std::string& phase_name) const;
     double get_phase_percentage(const std::string& phase_name) const;
+    HardwareCounts get_phase_hardware_counts(const std::string& phase_name) const;
     std::vector<std::string> get_slowest_phases(int count = 5) const;
+    const std::map<std::string, PhaseProfile>& get_phase_profiles() const { return phase_profiles; }
     
     // Optimization suggestions
     std::vector<std::string> get_optimization_suggestions() const;
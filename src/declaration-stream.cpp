@@ -0,0 +1,58 @@
+#include "declaration-stream.h"
+#include "parser.h"
+
+DeclarationStream::DeclarationStream(const std::string& source, bool skip_bodies)
+    : lexer(source), skip_bodies(skip_bodies), finished(false) {}
+
+std::unique_ptr<ASTNode> DeclarationStream::next() {
+    while (pending.empty()) {
+        if (!read_chunk()) return nullptr;
+    }
+    auto declaration = std::move(pending.front());
+    pending.pop_front();
+    return declaration;
+}
+
+bool DeclarationStream::read_chunk() {
+    if (finished) return false;
+
+    std::vector<Token> tokens;
+    int depth = 0;
+    while (true) {
+        Token token = lexer.nextToken();
+        if (token.type() == TokenType::Eof) {
+            finished = true;
+            if (tokens.empty()) return false;
+            tokens.push_back(token);
+            break;
+        }
+        bool in_body = depth > 0;
+        if (token.type() == TokenType::LBrace) {
+            ++depth;
+        } else if (token.type() == TokenType::RBrace) {
+            --depth;
+        }
+        if (!skip_bodies || !in_body || depth <= 0) {
+            tokens.push_back(token);
+        }
+        // A stray `}` ends its own chunk and is reported there
+        if ((token.type() == TokenType::RBrace && depth <= 0) ||
+            (token.type() == TokenType::Semicolon && depth == 0)) {
+            break;
+        }
+    }
+    if (tokens.back().type() != TokenType::Eof) {
+        Token last = tokens.back();
+        tokens.emplace_back(TokenType::Eof, "", last.line(), last.column() + static_cast<int>(last.value().size()));
+    }
+
+    // A chunk normally holds one declaration, but parse it as a program so
+    // recovery and error messages are the parser's own
+    Parser parser(tokens);
+    auto program = std::unique_ptr<Program>(static_cast<Program*>(parser.parse_program().release()));
+    errors.insert(errors.end(), parser.get_errors().begin(), parser.get_errors().end());
+    for (auto& declaration : program->declarations) {
+        pending.push_back(std::move(declaration));
+    }
+    return true;
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include "ast.h"
+#include "lexer.h"
+#include <deque>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Parses a source one top-level declaration at a time, for streaming
+// compilation. Tokens are pulled from the lexer only up to the end of the
+// next declaration (a `;` or the `}` closing a body, at brace depth zero),
+// so neither the whole token list nor the whole AST is ever held.
+class DeclarationStream {
+private:
+    Lexer lexer;
+    bool skip_bodies;
+    bool finished;
+    std::deque<std::unique_ptr<ASTNode>> pending;   // parsed from the last chunk, not yet returned
+    std::vector<std::string> errors;
+
+    // Lex and parse the next chunk; false at the end of the source
+    bool read_chunk();
+
+public:
+    // With `skip_bodies`, function bodies are lexed but not parsed and come
+    // back empty: enough for a pass that only collects signatures
+    explicit DeclarationStream(const std::string& source, bool skip_bodies = false);
+
+    // The next declaration, or nullptr at the end. Declarations with syntax
+    // errors are skipped and recorded as Parser::parse_program does; lexical
+    // errors throw like Lexer::tokenize
+    std::unique_ptr<ASTNode> next();
+
+    // Syntax errors so far, in source order
+    const std::vector<std::string>& get_errors() const { return errors; }
+};
@@ -0,0 +1,724 @@
+#include "graph-coloring-allocator.h"
+#include "cfg.h"
+#include "profile-instrumenter.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace {
+
+using Bits = std::vector<uint64_t>;
+
+inline void bits_set(Bits& bits, int i) { bits[i >> 6] |= uint64_t(1) << (i & 63); }
+
+// dst |= src, returns true if dst changed
+bool bits_union(Bits& dst, const Bits& src) {
+    bool changed = false;
+    for (size_t w = 0; w < dst.size(); ++w) {
+        uint64_t merged = dst[w] | src[w];
+        changed |= merged != dst[w];
+        dst[w] = merged;
+    }
+    return changed;
+}
+
+template <typename Fn>
+void bits_for_each(const Bits& bits, Fn fn) {
+    for (size_t w = 0; w < bits.size(); ++w) {
+        for (uint64_t word = bits[w]; word; word &= word - 1) {
+            fn(static_cast<int>(w * 64 + __builtin_ctzll(word)));
+        }
+    }
+}
+
+bool is_constant_operand(const std::string& str) {
+    return !str.empty() &&
+           (std::isdigit(static_cast<unsigned char>(str[0])) ||
+            (str[0] == '-' && str.length() > 1));
+}
+
+// Variables read and written by an instruction. Array names count as uses of the
+// base they name; labels and callee names are not register candidates.
+void instruction_operands(const IRInstruction& instr, std::vector<std::string>& uses, std::string& def) {
+    uses.clear();
+    def.clear();
+
+    auto use = [&uses](const std::string& operand) {
+        if (!operand.empty() && !is_constant_operand(operand)) {
+            uses.push_back(operand);
+        }
+    };
+
+    switch (instr.op) {
+        case OpCode::ADD: case OpCode::SUB: case OpCode::MUL: case OpCode::DIV: case OpCode::MOD:
+        case OpCode::EQ: case OpCode::NE: case OpCode::LT: case OpCode::LE: case OpCode::GT: case OpCode::GE:
+        case OpCode::AND: case OpCode::OR:
+        case OpCode::BIT_AND: case OpCode::BIT_OR: case OpCode::BIT_XOR: case OpCode::SHL: case OpCode::SHR:
+            use(instr.arg1);
+            use(instr.arg2);
+            def = instr.result;
+            break;
+        case OpCode::NOT: case OpCode::BIT_NOT: case OpCode::ASSIGN: case OpCode::COPY:
+            use(instr.arg1);
+            def = instr.result;
+            break;
+        case OpCode::SELECT:
+            // The old value survives when the condition is false
+            use(instr.arg1);
+            use(instr.arg2);
+            use(instr.result);
+            def = instr.result;
+            break;
+        case OpCode::IF_FALSE: case OpCode::IF_TRUE: case OpCode::PARAM: case OpCode::RETURN:
+            use(instr.arg1);
+            break;
+        case OpCode::CALL: case OpCode::LOAD_PARAM:
+            def = instr.result;
+            break;
+        case OpCode::ARRAY_ACCESS:
+            use(instr.arg1);
+            use(instr.arg2);
+            def = instr.result;
+            break;
+        case OpCode::ARRAY_ASSIGN:
+            use(instr.result);
+            use(instr.arg1);
+            use(instr.arg2);
+            break;
+        default:
+            break;
+    }
+}
+
+bool is_move(const IRInstruction& instr) {
+    return (instr.op == OpCode::ASSIGN || instr.op == OpCode::COPY) &&
+           !is_constant_operand(instr.arg1) && instr.arg1 != instr.result;
+}
+
+} // namespace
+
+GraphColoringAllocator::GraphColoringAllocator(RegMask available)
+    : palette(available), k(__builtin_popcount(available)) {}
+
+RegisterAssignment GraphColoringAllocator::allocate(const IRCode& instructions) {
+    RegisterAssignment assignment;
+    AllocationStats total;
+
+    for (size_t i = 0; i < instructions.size(); ++i) {
+        if (instructions[i].op != OpCode::FUNCTION_BEGIN) continue;
+
+        size_t end = i;
+        while (end < instructions.size() && instructions[end].op != OpCode::FUNCTION_END) {
+            ++end;
+        }
+        IRCode function_code(instructions.begin() + i,
+                             instructions.begin() + std::min(end + 1, instructions.size()));
+        assignment[instructions[i].result] = allocate_function(function_code);
+
+        total.variables += stats.variables;
+        total.colored += stats.colored;
+        total.spilled += stats.spilled;
+        total.rematerialized += stats.rematerialized;
+        total.coalesced_moves += stats.coalesced_moves;
+        i = end;
+    }
+
+    stats = total;
+    return assignment;
+}
+
+FunctionAllocation GraphColoringAllocator::allocate_function(const IRCode& function_code) {
+    clear();
+    build(function_code);
+    make_worklists();
+
+    while (!simplify_worklist.empty() || !worklist_moves.empty() ||
+           !freeze_worklist.empty() || !spill_worklist.empty()) {
+        if (!simplify_worklist.empty()) {
+            simplify();
+        } else if (!worklist_moves.empty()) {
+            coalesce();
+        } else if (!freeze_worklist.empty()) {
+            freeze();
+        } else {
+            select_spill();
+        }
+    }
+    assign_colors();
+
+    FunctionAllocation result;
+    for (size_t n = 0; n < names.size(); ++n) {
+        if (state[n] == NodeState::COLORED) {
+            result.registers[names[n]] = color[n];
+            result.used_registers |= reg_bit(color[n]);
+            ++stats.colored;
+        } else if (!remat_value[n].empty()) {
+            result.constants[names[n]] = remat_value[n];
+            ++stats.rematerialized;
+        } else {
+            ++stats.spilled;
+        }
+    }
+
+    for (const auto& site : call_sites) {
+        RegMask live = 0;
+        for (int node : site.second) {
+            if (state[node] == NodeState::COLORED) {
+                live |= static_cast<RegMask>(reg_bit(color[node]) & CALLER_SAVED_REGS);
+            }
+        }
+        if (live) result.call_saves[site.first] = live;
+    }
+    stats.variables = names.size();
+    return result;
+}
+
+void GraphColoringAllocator::clear() {
+    names.clear();
+    node_index.clear();
+    adj_set.clear();
+    adj_list.clear();
+    degree.clear();
+    moves.clear();
+    move_list.clear();
+    state.clear();
+    alias.clear();
+    color.clear();
+    spill_cost.clear();
+    remat_value.clear();
+    crosses_call.clear();
+    call_sites.clear();
+    simplify_worklist.clear();
+    freeze_worklist.clear();
+    spill_worklist.clear();
+    worklist_moves.clear();
+    select_stack.clear();
+    stats = AllocationStats();
+}
+
+int GraphColoringAllocator::get_node(const std::string& var) {
+    auto it = node_index.find(var);
+    if (it != node_index.end()) {
+        return it->second;
+    }
+
+    int node = static_cast<int>(names.size());
+    node_index.emplace(var, node);
+    names.push_back(var);
+    adj_list.emplace_back();
+    degree.push_back(0);
+    move_list.emplace_back();
+    state.push_back(NodeState::INITIAL);
+    alias.push_back(node);
+    color.push_back(PhysReg::NONE);
+    spill_cost.push_back(0.0);
+    remat_value.emplace_back();
+    crosses_call.push_back(false);
+    return node;
+}
+
+void GraphColoringAllocator::add_edge(int u, int v) {
+    if (u == v) return;
+    uint64_t key = (uint64_t(std::min(u, v)) << 32) | uint64_t(std::max(u, v));
+    if (!adj_set.insert(key).second) return;
+
+    adj_list[u].push_back(v);
+    adj_list[v].push_back(u);
+    ++degree[u];
+    ++degree[v];
+}
+
+bool GraphColoringAllocator::interferes(int u, int v) const {
+    uint64_t key = (uint64_t(std::min(u, v)) << 32) | uint64_t(std::max(u, v));
+    return adj_set.count(key) != 0;
+}
+
+void GraphColoringAllocator::build(const IRCode& code) {
+    ControlFlowGraph cfg;
+    cfg.build_from_ir(code);
+    const auto& blocks = cfg.get_blocks();
+    if (blocks.empty()) return;
+
+    std::vector<std::string> uses;
+    std::string def;
+
+    // Number every scalar variable first
+    for (const auto& instr : code) {
+        instruction_operands(instr, uses, def);
+        for (const auto& var : uses) get_node(var);
+        if (!def.empty()) get_node(def);
+    }
+
+    // Loop depth from backward edges: blocks are numbered in program order, so a
+    // successor with a smaller id closes a loop over the blocks in between
+    std::vector<int> depth_delta(blocks.size() + 1, 0);
+    for (const auto& block : blocks) {
+        for (BasicBlock* succ : block->successors) {
+            if (succ->id <= block->id) {
+                ++depth_delta[succ->id];
+                --depth_delta[block->id + 1];
+            }
+        }
+    }
+    std::vector<double> block_weight(blocks.size());
+    for (size_t b = 0, depth = 0; b < blocks.size(); ++b) {
+        depth += depth_delta[b];
+        block_weight[b] = std::pow(10.0, static_cast<double>(std::min<size_t>(depth, 8)));
+    }
+
+    // Counts from -fprofile-use replace the estimate; blocks without a counter
+    // of their own run as often as the block before them
+    std::vector<int64_t> counts(blocks.size(), -1);
+    int64_t entry_count = -1;
+    for (size_t b = 0; b < blocks.size(); ++b) {
+        for (const auto& instr : blocks[b]->instructions) {
+            counts[b] = profiled_count(instr);
+            if (counts[b] >= 0) break;
+        }
+        if (entry_count < 0) entry_count = counts[b];
+    }
+    if (entry_count >= 0) {
+        for (size_t b = 0; b < blocks.size(); ++b) {
+            if (counts[b] < 0) counts[b] = b > 0 ? counts[b - 1] : entry_count;
+            block_weight[b] = std::max(static_cast<double>(counts[b]) /
+                                       static_cast<double>(std::max<int64_t>(entry_count, 1)), 1e-3);
+        }
+    }
+
+    // Only values read in some block before being written there can be live
+    // across a block boundary. Block-level liveness tracks just those, so its
+    // bitsets stay small when a huge function has few long-lived values.
+    std::vector<std::vector<int>> exposed_uses(blocks.size()), block_defs(blocks.size());
+    std::vector<size_t> last_def_block(names.size(), SIZE_MAX);
+    std::vector<bool> is_global(names.size(), false);
+    for (size_t b = 0; b < blocks.size(); ++b) {
+        for (const auto& instr : blocks[b]->instructions) {
+            instruction_operands(instr, uses, def);
+            for (const auto& var : uses) {
+                int node = node_index[var];
+                if (last_def_block[node] != b) {
+                    exposed_uses[b].push_back(node);
+                    is_global[node] = true;
+                }
+            }
+            if (!def.empty()) {
+                int node = node_index[def];
+                last_def_block[node] = b;
+                block_defs[b].push_back(node);
+            }
+        }
+    }
+    std::vector<int> global_index(names.size(), -1);
+    std::vector<int> global_nodes;   // in node order, so bit order is node order
+    for (size_t n = 0; n < names.size(); ++n) {
+        if (!is_global[n]) continue;
+        global_index[n] = static_cast<int>(global_nodes.size());
+        global_nodes.push_back(static_cast<int>(n));
+    }
+    size_t words = (global_nodes.size() + 63) / 64;
+
+    std::vector<Bits> use_bits(blocks.size(), Bits(words, 0));
+    std::vector<Bits> def_bits(blocks.size(), Bits(words, 0));
+    std::vector<Bits> live_in(blocks.size(), Bits(words, 0));
+    std::vector<Bits> live_out(blocks.size(), Bits(words, 0));
+    for (size_t b = 0; b < blocks.size(); ++b) {
+        for (int node : exposed_uses[b]) bits_set(use_bits[b], global_index[node]);
+        for (int node : block_defs[b]) {
+            if (global_index[node] >= 0) bits_set(def_bits[b], global_index[node]);
+        }
+    }
+
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (size_t b = blocks.size(); b-- > 0;) {
+            for (BasicBlock* succ : blocks[b]->successors) {
+                changed |= bits_union(live_out[b], live_in[succ->id]);
+            }
+            Bits in = live_out[b];
+            for (size_t w = 0; w < words; ++w) {
+                in[w] = use_bits[b][w] | (in[w] & ~def_bits[b][w]);
+            }
+            changed |= bits_union(live_in[b], in);
+        }
+    }
+
+    // Values live on entry (parameters, globals, reads before any write) keep
+    // their memory home; they never enter the graph
+    std::vector<bool> entry_live(names.size(), false);
+    bits_for_each(live_in[cfg.get_entry_block()->id],
+                  [&](int g) { entry_live[global_nodes[g]] = true; });
+
+    // Rematerialization: every definition assigns the same constant
+    std::vector<bool> remat_ok(names.size(), true);
+    std::vector<bool> defined(names.size(), false);
+    for (const auto& instr : code) {
+        instruction_operands(instr, uses, def);
+        if (def.empty()) continue;
+        int node = node_index[def];
+        bool constant_def = (instr.op == OpCode::ASSIGN || instr.op == OpCode::COPY) &&
+                            is_constant_operand(instr.arg1);
+        if (!constant_def || (defined[node] && remat_value[node] != instr.arg1)) {
+            remat_ok[node] = false;
+        }
+        if (constant_def && !defined[node]) remat_value[node] = instr.arg1;
+        defined[node] = true;
+    }
+    for (size_t n = 0; n < names.size(); ++n) {
+        if (!remat_ok[n] || !defined[n] || entry_live[n]) {
+            remat_value[n].clear();
+        }
+    }
+
+    // Interference: walk each block backwards from its live-out set. Blocks
+    // partition the function in order, so offsets are running block sizes.
+    // The live set is sparse, and visited in node order as a bitset would be.
+    std::vector<int> live;
+    std::vector<int> live_position(names.size(), -1);
+    auto make_live = [&](int node) {
+        if (live_position[node] >= 0) return;
+        live_position[node] = static_cast<int>(live.size());
+        live.push_back(node);
+    };
+    auto make_dead = [&](int node) {
+        int position = live_position[node];
+        if (position < 0) return;
+        live[position] = live.back();
+        live_position[live.back()] = position;
+        live.pop_back();
+        live_position[node] = -1;
+    };
+    std::vector<int> live_sorted;
+    auto for_each_live = [&](auto fn) {
+        live_sorted = live;
+        std::sort(live_sorted.begin(), live_sorted.end());
+        for (int node : live_sorted) fn(node);
+    };
+
+    size_t block_offset = 0;
+    for (size_t b = 0; b < blocks.size(); ++b) {
+        for (int node : live) live_position[node] = -1;
+        live.clear();
+        bits_for_each(live_out[b], [&](int g) { make_live(global_nodes[g]); });
+        const auto& instructions = blocks[b]->instructions;
+
+        for (size_t i = instructions.size(); i-- > 0;) {
+            const IRInstruction& instr = instructions[i];
+            instruction_operands(instr, uses, def);
+
+            int def_node = def.empty() ? -1 : node_index[def];
+            if (instr.op == OpCode::CALL) {
+                std::vector<int> crossing;
+                for_each_live([&](int node) {
+                    if (node != def_node && !entry_live[node]) {
+                        crossing.push_back(node);
+                        crosses_call[node] = true;
+                    }
+                });
+                call_sites.emplace_back(block_offset + i, std::move(crossing));
+            }
+            for (const auto& var : uses) {
+                spill_cost[node_index[var]] += block_weight[b];
+            }
+            if (def_node >= 0) spill_cost[def_node] += block_weight[b];
+
+            if (is_move(instr)) {
+                int src = node_index[instr.arg1];
+                make_dead(src);
+                if (!entry_live[src] && !entry_live[def_node]) {
+                    int m = static_cast<int>(moves.size());
+                    moves.push_back({def_node, src, MoveState::WORKLIST});
+                    move_list[def_node].push_back(m);
+                    move_list[src].push_back(m);
+                }
+            }
+
+            if (def_node >= 0 && !entry_live[def_node]) {
+                for_each_live([&](int other) {
+                    if (!entry_live[other]) add_edge(def_node, other);
+                });
+            }
+
+            if (def_node >= 0) make_dead(def_node);
+            for (const auto& var : uses) make_live(node_index[var]);
+        }
+        block_offset += instructions.size();
+    }
+
+    for (size_t n = 0; n < names.size(); ++n) {
+        if (entry_live[n]) {
+            state[n] = NodeState::SPILLED;
+        } else if (!remat_value[n].empty()) {
+            // Rematerialized values cost nothing to keep out of registers
+            spill_cost[n] = 0.0;
+        }
+    }
+}
+
+void GraphColoringAllocator::make_worklists() {
+    for (size_t n = 0; n < names.size(); ++n) {
+        int node = static_cast<int>(n);
+        if (state[n] != NodeState::INITIAL) continue;
+
+        if (degree[n] >= k) {
+            state[n] = NodeState::SPILL;
+            spill_worklist.insert(node);
+        } else if (move_related(node)) {
+            state[n] = NodeState::FREEZE;
+            freeze_worklist.insert(node);
+        } else {
+            state[n] = NodeState::SIMPLIFY;
+            simplify_worklist.push_back(node);
+        }
+    }
+
+    for (size_t m = moves.size(); m-- > 0;) {
+        worklist_moves.push_back(static_cast<int>(m));
+    }
+}
+
+std::vector<int> GraphColoringAllocator::adjacent(int node) const {
+    std::vector<int> result;
+    for (int other : adj_list[node]) {
+        if (state[other] != NodeState::SELECTED && state[other] != NodeState::COALESCED) {
+            result.push_back(other);
+        }
+    }
+    return result;
+}
+
+std::vector<int> GraphColoringAllocator::node_moves(int node) const {
+    std::vector<int> result;
+    for (int m : move_list[node]) {
+        if (moves[m].state == MoveState::ACTIVE || moves[m].state == MoveState::WORKLIST) {
+            result.push_back(m);
+        }
+    }
+    return result;
+}
+
+bool GraphColoringAllocator::move_related(int node) const {
+    for (int m : move_list[node]) {
+        if (moves[m].state == MoveState::ACTIVE || moves[m].state == MoveState::WORKLIST) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void GraphColoringAllocator::simplify() {
+    int node = simplify_worklist.back();
+    simplify_worklist.pop_back();
+    if (state[node] != NodeState::SIMPLIFY) return;
+
+    state[node] = NodeState::SELECTED;
+    select_stack.push_back(node);
+    for (int other : adjacent(node)) {
+        decrement_degree(other);
+    }
+}
+
+void GraphColoringAllocator::decrement_degree(int node) {
+    int old_degree = degree[node]--;
+    if (old_degree != k || state[node] != NodeState::SPILL) return;
+
+    enable_moves(node);
+    for (int other : adjacent(node)) {
+        enable_moves(other);
+    }
+    spill_worklist.erase(node);
+    if (move_related(node)) {
+        state[node] = NodeState::FREEZE;
+        freeze_worklist.insert(node);
+    } else {
+        state[node] = NodeState::SIMPLIFY;
+        simplify_worklist.push_back(node);
+    }
+}
+
+void GraphColoringAllocator::enable_moves(int node) {
+    for (int m : node_moves(node)) {
+        if (moves[m].state == MoveState::ACTIVE) {
+            moves[m].state = MoveState::WORKLIST;
+            worklist_moves.push_back(m);
+        }
+    }
+}
+
+void GraphColoringAllocator::coalesce() {
+    int m = worklist_moves.back();
+    worklist_moves.pop_back();
+    if (moves[m].state != MoveState::WORKLIST) return;
+
+    // Merge the node with fewer neighbours into the other: merging moves
+    // every edge of v, and a long-lived value collects edges from every
+    // temporary coalesced into it
+    int u = get_alias(moves[m].dst);
+    int v = get_alias(moves[m].src);
+    if (degree[u] < degree[v]) std::swap(u, v);
+
+    if (u == v) {
+        moves[m].state = MoveState::COALESCED;
+        ++stats.coalesced_moves;
+        add_worklist(u);
+    } else if (interferes(u, v)) {
+        moves[m].state = MoveState::CONSTRAINED;
+        add_worklist(u);
+        add_worklist(v);
+    } else if (george_test(u, v) || briggs_test(u, v)) {
+        moves[m].state = MoveState::COALESCED;
+        ++stats.coalesced_moves;
+        combine(u, v);
+        add_worklist(u);
+    } else {
+        moves[m].state = MoveState::ACTIVE;
+    }
+}
+
+void GraphColoringAllocator::add_worklist(int node) {
+    if (state[node] == NodeState::FREEZE && !move_related(node) && degree[node] < k) {
+        freeze_worklist.erase(node);
+        state[node] = NodeState::SIMPLIFY;
+        simplify_worklist.push_back(node);
+    }
+}
+
+// George: every neighbour of v is already a neighbour of u or is insignificant
+bool GraphColoringAllocator::george_test(int u, int v) const {
+    for (int t : adjacent(v)) {
+        if (degree[t] >= k && !interferes(t, u)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Briggs: the merged node has fewer than k significant neighbours
+bool GraphColoringAllocator::briggs_test(int u, int v) const {
+    std::vector<int> neighbours = adjacent(u);
+    for (int t : adjacent(v)) {
+        neighbours.push_back(t);
+    }
+    std::sort(neighbours.begin(), neighbours.end());
+    neighbours.erase(std::unique(neighbours.begin(), neighbours.end()), neighbours.end());
+
+    int significant = 0;
+    for (int t : neighbours) {
+        if (degree[t] >= k) ++significant;
+    }
+    return significant < k;
+}
+
+void GraphColoringAllocator::combine(int u, int v) {
+    if (state[v] == NodeState::FREEZE) {
+        freeze_worklist.erase(v);
+    } else {
+        spill_worklist.erase(v);
+    }
+    state[v] = NodeState::COALESCED;
+    alias[v] = u;
+    spill_cost[u] += spill_cost[v];
+    crosses_call[u] = crosses_call[u] || crosses_call[v];
+    move_list[u].insert(move_list[u].end(), move_list[v].begin(), move_list[v].end());
+    enable_moves(v);
+
+    for (int t : adjacent(v)) {
+        add_edge(t, u);
+        decrement_degree(t);
+    }
+
+    if (degree[u] >= k && state[u] == NodeState::FREEZE) {
+        freeze_worklist.erase(u);
+        state[u] = NodeState::SPILL;
+        spill_worklist.insert(u);
+    }
+}
+
+int GraphColoringAllocator::get_alias(int node) const {
+    while (state[node] == NodeState::COALESCED) {
+        node = alias[node];
+    }
+    return node;
+}
+
+void GraphColoringAllocator::freeze() {
+    int node = *freeze_worklist.begin();
+    freeze_worklist.erase(freeze_worklist.begin());
+    state[node] = NodeState::SIMPLIFY;
+    simplify_worklist.push_back(node);
+    freeze_moves(node);
+}
+
+void GraphColoringAllocator::freeze_moves(int node) {
+    for (int m : node_moves(node)) {
+        int x = moves[m].dst;
+        int y = moves[m].src;
+        int v = get_alias(y) == get_alias(node) ? get_alias(x) : get_alias(y);
+
+        moves[m].state = MoveState::FROZEN;
+        if (state[v] == NodeState::FREEZE && !move_related(v) && degree[v] < k) {
+            freeze_worklist.erase(v);
+            state[v] = NodeState::SIMPLIFY;
+            simplify_worklist.push_back(v);
+        }
+    }
+}
+
+void GraphColoringAllocator::select_spill() {
+    // Cheapest value per interference removed, weighted by block frequency
+    int best = -1;
+    double best_ratio = std::numeric_limits<double>::max();
+    for (int node : spill_worklist) {
+        double ratio = spill_cost[node] / std::max(degree[node], 1);
+        if (ratio < best_ratio) {
+            best_ratio = ratio;
+            best = node;
+        }
+    }
+
+    spill_worklist.erase(best);
+    state[best] = NodeState::SIMPLIFY;
+    simplify_worklist.push_back(best);
+    freeze_moves(best);
+}
+
+void GraphColoringAllocator::assign_colors() {
+    // Optimistic coloring: potential spills popped off the stack may still fit
+    while (!select_stack.empty()) {
+        int node = select_stack.back();
+        select_stack.pop_back();
+
+        RegMask ok_colors = palette;
+        for (int other : adj_list[node]) {
+            int target = get_alias(other);
+            if (state[target] == NodeState::COLORED) {
+                ok_colors &= static_cast<RegMask>(~reg_bit(color[target]));
+            }
+        }
+
+        if (ok_colors == 0) {
+            state[node] = NodeState::SPILLED;
+            continue;
+        }
+
+        // Callee-saved registers survive calls for the price of one save per
+        // function; caller-saved ones would need a save at every call
+        RegMask preferred = static_cast<RegMask>(
+            ok_colors & (crosses_call[node] ? CALLEE_SAVED_REGS : CALLER_SAVED_REGS));
+        state[node] = NodeState::COLORED;
+        color[node] = static_cast<PhysReg>(__builtin_ctz(preferred ? preferred : ok_colors));
+    }
+
+    for (size_t n = 0; n < names.size(); ++n) {
+        if (state[n] != NodeState::COALESCED) continue;
+        int target = get_alias(static_cast<int>(n));
+        if (state[target] == NodeState::COLORED) {
+            color[n] = color[target];
+        }
+    }
+    // Resolve coalesced states only after every color has been read through the alias chain
+    for (size_t n = 0; n < names.size(); ++n) {
+        if (state[n] != NodeState::COALESCED) continue;
+        state[n] = color[n] != PhysReg::NONE ? NodeState::COLORED : NodeState::SPILLED;
+    }
+}
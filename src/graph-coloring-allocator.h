@@ -0,0 +1,119 @@
+#pragma once
+
+#include "ir-types.h"
+#include "register-allocator.h"
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <unordered_set>
+#include <set>
+#include <cstdint>
+
+// Register assignment for one function, consumed by the assembly generator
+struct FunctionAllocation {
+    std::unordered_map<std::string, PhysReg> registers;      // variable -> register
+    std::unordered_map<std::string, std::string> constants;  // rematerialized variable -> value
+    RegMask used_registers = 0;
+
+    // Caller-saved registers holding values live across each call, keyed by
+    // the call's offset from FUNCTION_BEGIN
+    std::unordered_map<size_t, RegMask> call_saves;
+};
+
+// Assignments for a whole program, keyed by function name
+using RegisterAssignment = std::unordered_map<std::string, FunctionAllocation>;
+
+struct AllocationStats {
+    size_t variables = 0;
+    size_t colored = 0;
+    size_t spilled = 0;
+    size_t rematerialized = 0;
+    size_t coalesced_moves = 0;
+};
+
+// Chaitin-Briggs allocator with iterated (George/Appel) conservative coalescing.
+// Variables that cannot be colored stay in their stack slots; variables whose
+// every definition is the same constant are rematerialized instead. Values live
+// across calls prefer callee-saved registers, the rest prefer caller-saved ones.
+class GraphColoringAllocator {
+private:
+    enum class MoveState { WORKLIST, ACTIVE, COALESCED, CONSTRAINED, FROZEN };
+    enum class NodeState { INITIAL, SIMPLIFY, FREEZE, SPILL, COALESCED, SELECTED, COLORED, SPILLED };
+
+    struct Move {
+        int dst;
+        int src;
+        MoveState state;
+    };
+
+    RegMask palette;
+    int k;
+
+    // Interference graph
+    std::vector<std::string> names;
+    std::unordered_map<std::string, int> node_index;
+    std::unordered_set<uint64_t> adj_set;
+    std::vector<std::vector<int>> adj_list;
+    std::vector<int> degree;
+
+    // Move bookkeeping
+    std::vector<Move> moves;
+    std::vector<std::vector<int>> move_list;
+
+    // Per-node state
+    std::vector<NodeState> state;
+    std::vector<int> alias;
+    std::vector<PhysReg> color;
+    std::vector<double> spill_cost;
+    std::vector<std::string> remat_value;   // empty when not rematerializable
+    std::vector<bool> crosses_call;         // live across at least one call
+
+    // Nodes live across each call site (offset from FUNCTION_BEGIN)
+    std::vector<std::pair<size_t, std::vector<int>>> call_sites;
+
+    // Worklists; the simplify and move stacks are pruned lazily by state
+    std::vector<int> simplify_worklist;
+    std::set<int> freeze_worklist;
+    std::set<int> spill_worklist;
+    std::vector<int> worklist_moves;
+    std::vector<int> select_stack;
+
+    AllocationStats stats;
+
+    // Graph construction
+    void clear();
+    int get_node(const std::string& var);
+    void add_edge(int u, int v);
+    bool interferes(int u, int v) const;
+    void build(const IRCode& code);
+
+    // Iterated coalescing phases
+    void make_worklists();
+    std::vector<int> adjacent(int node) const;
+    std::vector<int> node_moves(int node) const;
+    bool move_related(int node) const;
+    void simplify();
+    void decrement_degree(int node);
+    void enable_moves(int node);
+    void coalesce();
+    void add_worklist(int node);
+    bool george_test(int u, int v) const;
+    bool briggs_test(int u, int v) const;
+    void combine(int u, int v);
+    int get_alias(int node) const;
+    void freeze();
+    void freeze_moves(int node);
+    void select_spill();
+    void assign_colors();
+
+public:
+    explicit GraphColoringAllocator(RegMask available = COLORABLE_REGS);
+
+    // Allocate one function given as FUNCTION_BEGIN ... FUNCTION_END
+    FunctionAllocation allocate_function(const IRCode& function_code);
+
+    // Allocate every function in the program
+    RegisterAssignment allocate(const IRCode& instructions);
+
+    const AllocationStats& get_stats() const { return stats; }
+};
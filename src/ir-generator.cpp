@@ -3,7 +3,7 @@
 #include <sstream>
 
 IRGenerator::IRGenerator(SemanticAnalyzer* semantic_analyzer)
-    : temp_counter(0), label_counter(0), analyzer(semantic_analyzer) {}
+    : temp_counter(0), label_counter(0), current_line(0), analyzer(semantic_analyzer) {}
 
 IRCode IRGenerator::generate(Program& program) {
     clear();
@@ -11,6 +11,17 @@ IRCode IRGenerator::generate(Program& program) {
     return instructions;
 }
 
+IRCode IRGenerator::generate_declaration(ASTNode& declaration) {
+    instructions.clear();
+    if (auto var = dynamic_cast<VarDeclaration*>(&declaration)) {
+        global_variables.insert(var->name);
+    }
+    declaration.accept(*this);
+    IRCode code;
+    code.swap(instructions);
+    return code;
+}
+
 std::string IRGenerator::new_temp() {
     return "t" + std::to_string(temp_counter++);
 }
@@ -21,7 +32,7 @@ std::string IRGenerator::new_label() {
 
 void IRGenerator::emit(OpCode op, const std::string& result, 
                       const std::string& arg1, const std::string& arg2) {
-    instructions.emplace_back(op, result, arg1, arg2);
+    instructions.emplace_back(op, result, arg1, arg2, current_line);
 }
 
 void IRGenerator::print_ir() const {
@@ -34,16 +45,21 @@ void IRGenerator::print_ir() const {
 
 void IRGenerator::clear() {
     instructions.clear();
+    global_variables.clear();
     temp_counter = 0;
     label_counter = 0;
     param_stack.clear();
     current_function.clear();
     last_expression_result.clear();
+    current_line = 0;
 }
 
 void IRGenerator::visit(Program& node) {
     // Generate IR for all declarations
     for (const auto& decl : node.declarations) {
+        if (auto var = dynamic_cast<VarDeclaration*>(decl.get())) {
+            global_variables.insert(var->name);
+        }
         decl->accept(*this);
     }
 }
@@ -56,10 +72,16 @@ void IRGenerator::visit(VarDeclaration& node) {
 
 void IRGenerator::visit(FunDeclaration& node) {
     current_function = node.name;
+    current_line = node.line;
     
     // Function begin marker
     emit(OpCode::FUNCTION_BEGIN, node.name);
     
+    // Parameters arrive on the stack; LOAD_PARAM gives each one its value
+    for (size_t i = 0; i < node.params.size(); ++i) {
+        emit(OpCode::LOAD_PARAM, node.params[i]->name, std::to_string(i));
+    }
+    
     // Function body
     if (node.body) {
         node.body->accept(*this);
@@ -85,9 +107,7 @@ void IRGenerator::visit(CompoundStmt& node) {
     
     // Process statements
     for (const auto& stmt : node.statements) {
-        if (stmt) {
-            stmt->accept(*this);
-        }
+        generate_statement(stmt.get());
     }
 }
 
@@ -97,14 +117,11 @@ void IRGenerator::visit(IfStmt& node) {
     
     // Generate condition
     if (node.cond) {
-        generate_expression(node.cond.get());
-        emit(OpCode::IF_FALSE, else_label, last_expression_result);
+        generate_condition(node.cond.get(), else_label, false);
     }
     
     // Generate then statement
-    if (node.thenStmt) {
-        node.thenStmt->accept(*this);
-    }
+    generate_statement(node.thenStmt.get());
     
     // Jump to end if no else
     if (node.elseStmt) {
@@ -115,9 +132,7 @@ void IRGenerator::visit(IfStmt& node) {
     emit(OpCode::LABEL, else_label);
     
     // Generate else statement
-    if (node.elseStmt) {
-        node.elseStmt->accept(*this);
-    }
+    generate_statement(node.elseStmt.get());
     
     // End label
     if (node.elseStmt) {
@@ -126,25 +141,27 @@ void IRGenerator::visit(IfStmt& node) {
 }
 
 void IRGenerator::visit(WhileStmt& node) {
-    std::string loop_label = new_label();
+    // Rotated into a guarded do-while: each iteration runs one conditional
+    // backward branch instead of a test at the top plus a jump back
+    std::string body_label = new_label();
     std::string end_label = new_label();
     
-    // Loop start
-    emit(OpCode::LABEL, loop_label);
-    
-    // Generate condition
+    // Guard: skip the loop when the condition fails on entry
     if (node.cond) {
-        generate_expression(node.cond.get());
-        emit(OpCode::IF_FALSE, end_label, last_expression_result);
+        generate_condition(node.cond.get(), end_label, false);
     }
     
-    // Generate body
-    if (node.body) {
-        node.body->accept(*this);
-    }
+    // Loop body
+    emit(OpCode::LABEL, body_label);
+    generate_statement(node.body.get());
     
-    // Jump back to loop start
-    emit(OpCode::GOTO, loop_label);
+    // Re-test at the bottom and branch back while it holds
+    current_line = node.line;
+    if (node.cond) {
+        generate_condition(node.cond.get(), body_label, true);
+    } else {
+        emit(OpCode::GOTO, body_label);
+    }
     
     // End label
     emit(OpCode::LABEL, end_label);
@@ -162,6 +179,8 @@ void IRGenerator::visit(ReturnStmt& node) {
 void IRGenerator::visit(BinaryOp& node) {
     if (node.op == "=") {
         generate_assignment(node);
+    } else if (node.op == "&&" || node.op == "||") {
+        generate_logical_operation(node);
     } else {
         generate_binary_operation(node);
     }
@@ -177,6 +196,8 @@ void IRGenerator::visit(UnaryOp& node) {
             emit(OpCode::SUB, result, "0", last_expression_result);
         } else if (node.op == "!") {
             emit(OpCode::NOT, result, last_expression_result);
+        } else if (node.op == "~") {
+            emit(OpCode::BIT_NOT, result, last_expression_result);
         }
         
         last_expression_result = result;
@@ -216,6 +237,13 @@ void IRGenerator::generate_expression(ASTNode* expr) {
     }
 }
 
+void IRGenerator::generate_statement(ASTNode* stmt) {
+    if (stmt) {
+        if (stmt->line > 0) current_line = stmt->line;
+        stmt->accept(*this);
+    }
+}
+
 void IRGenerator::generate_assignment(BinaryOp& assignment) {
     // Generate right side
     generate_expression(assignment.right.get());
@@ -260,8 +288,11 @@ void IRGenerator::generate_binary_operation(BinaryOp& binary_op) {
     else if (binary_op.op == "<=") op_code = OpCode::LE;
     else if (binary_op.op == ">") op_code = OpCode::GT;
     else if (binary_op.op == ">=") op_code = OpCode::GE;
-    else if (binary_op.op == "&&") op_code = OpCode::AND;
-    else if (binary_op.op == "||") op_code = OpCode::OR;
+    else if (binary_op.op == "&") op_code = OpCode::BIT_AND;
+    else if (binary_op.op == "|") op_code = OpCode::BIT_OR;
+    else if (binary_op.op == "^") op_code = OpCode::BIT_XOR;
+    else if (binary_op.op == "<<") op_code = OpCode::SHL;
+    else if (binary_op.op == ">>") op_code = OpCode::SHR;
     else {
         op_code = OpCode::NOP; // Unknown operation
     }
@@ -270,11 +301,78 @@ void IRGenerator::generate_binary_operation(BinaryOp& binary_op) {
     last_expression_result = result;
 }
 
+void IRGenerator::generate_logical_operation(BinaryOp& logical_op) {
+    // Both paths define the value, so it is a variable rather than one of the
+    // single-definition temporaries; '.' keeps it apart from source names
+    std::string result = "sc." + std::to_string(temp_counter++);
+    std::string end_label = new_label();
+    bool is_and = logical_op.op == "&&";
+    
+    // The left operand alone decides when && sees false or || sees true
+    emit(OpCode::ASSIGN, result, is_and ? "0" : "1");
+    generate_condition(logical_op.left.get(), end_label, !is_and);
+    
+    generate_expression(logical_op.right.get());
+    std::string right_result = new_temp();
+    emit(OpCode::NE, right_result, last_expression_result, "0");
+    emit(OpCode::ASSIGN, result, right_result);
+    emit(OpCode::LABEL, end_label);
+    
+    last_expression_result = result;
+}
+
+void IRGenerator::generate_condition(ASTNode* cond, const std::string& target, bool jump_if) {
+    // Jump to target when cond is jump_if, fall through otherwise. && and ||
+    // become chains of branches, so each comparison feeds a branch directly
+    if (auto logical = dynamic_cast<BinaryOp*>(cond)) {
+        if (logical->op == "&&" || logical->op == "||") {
+            bool is_and = logical->op == "&&";
+            if (jump_if != is_and) {
+                // Either operand alone can take the jump
+                generate_condition(logical->left.get(), target, jump_if);
+                generate_condition(logical->right.get(), target, jump_if);
+            } else {
+                // The left operand can only rule the jump out
+                std::string skip_label = new_label();
+                generate_condition(logical->left.get(), skip_label, !jump_if);
+                generate_condition(logical->right.get(), target, jump_if);
+                emit(OpCode::LABEL, skip_label);
+            }
+            return;
+        }
+    }
+    if (auto negation = dynamic_cast<UnaryOp*>(cond)) {
+        if (negation->op == "!") {
+            generate_condition(negation->operand.get(), target, !jump_if);
+            return;
+        }
+    }
+    
+    generate_expression(cond);
+    emit(jump_if ? OpCode::IF_TRUE : OpCode::IF_FALSE, target, last_expression_result);
+}
+
 void IRGenerator::generate_function_call(Call& call) {
-    // Generate arguments in reverse order (for stack-based parameter passing)
+    // Generate arguments in reverse order (for stack-based parameter passing).
+    // All of them are evaluated before the first push, so the branches of
+    // && and || and nested calls never fall between the PARAMs of one call
+    std::vector<std::string> values(call.args.size());
     for (int i = call.args.size() - 1; i >= 0; --i) {
         generate_expression(call.args[i].get());
-        emit(OpCode::PARAM, "", last_expression_result);
+        values[i] = last_expression_result;
+        
+        // A variable is read now: an argument evaluated after it may assign it
+        auto var = dynamic_cast<Variable*>(call.args[i].get());
+        if (auto assignment = dynamic_cast<BinaryOp*>(call.args[i].get())) {
+            if (assignment->op == "=") var = dynamic_cast<Variable*>(assignment->left.get());
+        }
+        if (i > 0 && var && !var->index) {
+            values[i] = new_temp();
+            emit(OpCode::ASSIGN, values[i], last_expression_result);
+        }
+    }
+    for (int i = call.args.size() - 1; i >= 0; --i) {
+        emit(OpCode::PARAM, "", values[i]);
     }
     
     // Generate call
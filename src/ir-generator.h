@@ -7,6 +7,7 @@
 #include <vector>
 #include <string>
 #include <unordered_map>
+#include <unordered_set>
 #include <sstream>
 
 class IRGenerator : public Visitor {
@@ -24,15 +25,26 @@ private:
     // Expression result storage
     std::string last_expression_result;
     
+    // Source line of the statement being lowered, stamped on each instruction
+    int current_line;
+    
     // Symbol table reference for type information
     SemanticAnalyzer* analyzer;
     
+    // Variables declared at file scope
+    std::unordered_set<std::string> global_variables;
+    
 public:
     IRGenerator(SemanticAnalyzer* semantic_analyzer = nullptr);
     
     // Main entry point for IR generation
     IRCode generate(Program& program);
     
+    // One top-level declaration of a program seen a declaration at a time:
+    // returns its IR alone (none for a global variable, which is recorded),
+    // numbering temporaries and labels on from the previous call
+    IRCode generate_declaration(ASTNode& declaration);
+    
     // Utility functions
     std::string new_temp();
     std::string new_label();
@@ -41,6 +53,7 @@ public:
     
     // Get generated IR
     const IRCode& get_instructions() const { return instructions; }
+    const std::unordered_set<std::string>& get_global_variables() const { return global_variables; }
     
     // Print IR for debugging
     void print_ir() const;
@@ -68,8 +81,11 @@ public:
 private:
     // Helper functions for code generation
     void generate_expression(ASTNode* expr);
+    void generate_statement(ASTNode* stmt);
     void generate_assignment(BinaryOp& assignment);
     void generate_binary_operation(BinaryOp& binary_op);
+    void generate_logical_operation(BinaryOp& logical_op);
+    void generate_condition(ASTNode* cond, const std::string& target, bool jump_if);
     void generate_function_call(Call& call);
     void generate_array_access(Variable& var);
     void generate_comparison(BinaryOp& comparison);
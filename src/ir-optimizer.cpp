@@ -2,13 +2,15 @@
 #include <iostream>
 #include <algorithm>
 #include <sstream>
+#include <climits>
 
 IRCode IROptimizer::optimize(const IRCode& instructions) {
     IRCode optimized = instructions;
     
     // Apply optimization passes
     constant_folding(optimized);
-    copy_propagation(optimized);
+    run_within_budget(optimized, budget.local_function_size, "copy-propagation", remarks,
+                      [this](IRCode& code) { copy_propagation(code); });
     algebraic_simplification(optimized);
     dead_code_elimination(optimized);
     
@@ -17,8 +19,28 @@ IRCode IROptimizer::optimize(const IRCode& instructions) {
 
 void IROptimizer::constant_folding(IRCode& instructions) {
     constant_map.clear();
+    std::unordered_map<std::string, long long> folded;
+    std::string function;
     
-    for (auto& instr : instructions) {
+    for (size_t i = 0; i < instructions.size(); ++i) {
+        IRInstruction& instr = instructions[i];
+        // Facts only hold within a basic block; labels are join points
+        if (instr.is_label() || instr.op == OpCode::FUNCTION_BEGIN) {
+            if (instr.op == OpCode::FUNCTION_BEGIN) function = instr.result;
+            constant_map.clear();
+            continue;
+        }
+        
+        // Replace variables with their constant values
+        if (instr.op != OpCode::CALL) {
+            if (constant_map.find(instr.arg1) != constant_map.end()) {
+                instr.arg1 = constant_map[instr.arg1];
+            }
+            if (constant_map.find(instr.arg2) != constant_map.end()) {
+                instr.arg2 = constant_map[instr.arg2];
+            }
+        }
+        
         // Check if both operands are constants
         if (is_constant(instr.arg1) && is_constant(instr.arg2)) {
             std::string result = evaluate_constant_expression(instr.op, instr.arg1, instr.arg2);
@@ -27,63 +49,195 @@ void IROptimizer::constant_folding(IRCode& instructions) {
                 instr.op = OpCode::ASSIGN;
                 instr.arg1 = result;
                 instr.arg2 = "";
-                
-                // Remember this constant
-                constant_map[instr.result] = result;
+                ++folded[function];
             }
         }
         
-        // Replace variables with their constant values
-        if (constant_map.find(instr.arg1) != constant_map.end()) {
-            instr.arg1 = constant_map[instr.arg1];
+        if (instr.op == OpCode::BIT_NOT && is_constant(instr.arg1)) {
+            instr.op = OpCode::ASSIGN;
+            instr.arg1 = std::to_string(~get_constant_value(instr.arg1));
+            ++folded[function];
         }
-        if (constant_map.find(instr.arg2) != constant_map.end()) {
-            instr.arg2 = constant_map[instr.arg2];
+        
+        // Branches on a known condition become jumps or disappear
+        if ((instr.op == OpCode::IF_FALSE || instr.op == OpCode::IF_TRUE) && is_constant(instr.arg1)) {
+            bool taken = (get_constant_value(instr.arg1) != 0) == (instr.op == OpCode::IF_TRUE);
+            if (remarks) {
+                remarks->emit("constant-folding", RemarkKind::Applied, "BranchFolded", instructions, i,
+                              std::string("condition is always ") + (get_constant_value(instr.arg1) ? "true" : "false") +
+                              ", branch " + (taken ? "always taken" : "removed"));
+            }
+            instr.op = taken ? OpCode::GOTO : OpCode::NOP;
+            if (!taken) instr.result = "";
+            instr.arg1 = "";
+            continue;
         }
         
-        // Track new constants
-        if (instr.op == OpCode::ASSIGN && is_constant(instr.arg1)) {
+        // Track new constants, forget redefined ones
+        if ((instr.op == OpCode::ASSIGN || instr.op == OpCode::COPY) && is_constant(instr.arg1)) {
             constant_map[instr.result] = instr.arg1;
+        } else if (instr.modifies_result()) {
+            constant_map.erase(instr.result);
         }
     }
-}
-
-void IROptimizer::dead_code_elimination(IRCode& instructions) {
-    mark_used_variables(instructions);
     
-    // Remove instructions that define unused variables
     instructions.erase(
         std::remove_if(instructions.begin(), instructions.end(),
-            [this](const IRInstruction& instr) {
-                return is_dead_code(instr, used_variables);
-            }),
+            [](const IRInstruction& instr) { return instr.op == OpCode::NOP && instr.result.empty(); }),
         instructions.end()
     );
+    if (remarks) {
+        remarks->emit_per_function("constant-folding", "ExpressionsFolded", instructions, folded,
+                                   "operations on constant operands evaluated at compile time", "Instructions");
+    }
+}
+
+void IROptimizer::dead_code_elimination(IRCode& instructions) {
+    // Liveness is per function, so each one is cleaned up on its own
+    IRCode result;
+    result.reserve(instructions.size());
+    std::unordered_map<std::string, long long> removed;
+    size_t i = 0;
+    while (i < instructions.size()) {
+        if (instructions[i].op != OpCode::FUNCTION_BEGIN) {
+            result.push_back(instructions[i++]);
+            continue;
+        }
+        size_t end = i;
+        while (end + 1 < instructions.size() && instructions[end].op != OpCode::FUNCTION_END) ++end;
+        
+        IRCode function(instructions.begin() + i, instructions.begin() + end + 1);
+        if (function.size() <= budget.local_function_size) {
+            while (remove_dead_definitions(function)) {}
+        } else {
+            // Past the budget one round has to do
+            remove_dead_definitions(function);
+            if (remarks) {
+                remarks->emit_function("dce", RemarkKind::Missed, "OverBudget", function.front().result,
+                                       function.front().line_number,
+                                       "function is over the size limit; one round of dead code elimination "
+                                       "instead of iterating to a fixpoint",
+                                       {{"Size", static_cast<long long>(end + 1 - i)},
+                                        {"Limit", static_cast<long long>(budget.local_function_size)}});
+            }
+        }
+        removed[function.front().result] = static_cast<long long>(end + 1 - i - function.size());
+        result.insert(result.end(), function.begin(), function.end());
+        i = end + 1;
+    }
+    instructions.swap(result);
+    if (remarks) {
+        remarks->emit_per_function("dce", "DeadDefinitionsRemoved", instructions, removed,
+                                   "definitions never read on any path", "Instructions");
+    }
+}
+
+bool IROptimizer::remove_dead_definitions(IRCode& function) {
+    std::unordered_map<std::string, size_t> labels;
+    std::unordered_set<std::string> params;
+    std::unordered_set<std::string> arrays;
+    for (size_t i = 0; i < function.size(); ++i) {
+        const IRInstruction& instr = function[i];
+        if (instr.is_label()) labels[instr.result] = i;
+        if (instr.op == OpCode::LOAD_PARAM) params.insert(instr.result);
+        if (instr.op == OpCode::ARRAY_ASSIGN) arrays.insert(instr.result);
+        if (instr.op == OpCode::ARRAY_ACCESS) arrays.insert(instr.arg1);
+    }
+    
+    // Globals outlive the function and may be read by any callee; so may
+    // arrays passed in, which live in the caller
+    std::unordered_set<std::string> exit_live(global_variables.begin(), global_variables.end());
+    for (const auto& param : params) {
+        if (arrays.count(param)) exit_live.insert(param);
+    }
+    
+    auto successors = [&](size_t i) {
+        std::vector<size_t> next;
+        const IRInstruction& instr = function[i];
+        if (instr.is_branch()) {
+            auto it = labels.find(instr.result);
+            if (it != labels.end()) next.push_back(it->second);
+        }
+        if (instr.op != OpCode::GOTO && instr.op != OpCode::RETURN &&
+            instr.op != OpCode::FUNCTION_END && i + 1 < function.size()) {
+            next.push_back(i + 1);
+        }
+        return next;
+    };
+    
+    // Backward liveness to a fixed point; array stores do not kill the array
+    std::vector<std::unordered_set<std::string>> live_in(function.size());
+    std::vector<std::unordered_set<std::string>> live_out(function.size());
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (size_t i = function.size(); i-- > 0;) {
+            const IRInstruction& instr = function[i];
+            std::unordered_set<std::string> out;
+            if (instr.op == OpCode::RETURN || instr.op == OpCode::FUNCTION_END) out = exit_live;
+            for (size_t succ : successors(i)) {
+                out.insert(live_in[succ].begin(), live_in[succ].end());
+            }
+            
+            std::unordered_set<std::string> in = out;
+            if (instr.op != OpCode::ARRAY_ASSIGN) in.erase(instr.get_defined_variable());
+            for (const auto& var : instr.get_used_variables()) in.insert(var);
+            if (instr.is_function_call()) in.insert(global_variables.begin(), global_variables.end());
+            
+            if (in != live_in[i] || out != live_out[i]) {
+                live_in[i].swap(in);
+                live_out[i].swap(out);
+                changed = true;
+            }
+        }
+    }
+    
+    size_t before = function.size();
+    IRCode live_code;
+    live_code.reserve(function.size());
+    for (size_t i = 0; i < function.size(); ++i) {
+        if (!is_dead_code(function[i], live_out[i])) live_code.push_back(function[i]);
+    }
+    function.swap(live_code);
+    return function.size() != before;
 }
 
 void IROptimizer::copy_propagation(IRCode& instructions) {
     copy_map.clear();
     
     for (auto& instr : instructions) {
+        if (instr.is_label() || instr.op == OpCode::FUNCTION_BEGIN) {
+            copy_map.clear();
+            continue;
+        }
+        
         // Replace variables with their copies
-        if (copy_map.find(instr.arg1) != copy_map.end()) {
-            instr.arg1 = copy_map[instr.arg1];
+        if (instr.op != OpCode::CALL) {
+            if (copy_map.find(instr.arg1) != copy_map.end()) {
+                instr.arg1 = copy_map[instr.arg1];
+            }
+            if (copy_map.find(instr.arg2) != copy_map.end()) {
+                instr.arg2 = copy_map[instr.arg2];
+            }
         }
-        if (copy_map.find(instr.arg2) != copy_map.end()) {
-            instr.arg2 = copy_map[instr.arg2];
+        
+        // Invalidate copies of and from a redefined variable
+        if (instr.modifies_result() && instr.op != OpCode::ARRAY_ASSIGN) {
+            copy_map.erase(instr.result);
+            for (auto it = copy_map.begin(); it != copy_map.end();) {
+                if (it->second == instr.result) {
+                    it = copy_map.erase(it);
+                } else {
+                    ++it;
+                }
+            }
         }
         
         // Track copy operations
-        if (instr.op == OpCode::ASSIGN && !is_constant(instr.arg1)) {
-            copy_map[instr.result] = instr.arg1;
-        } else if (instr.op == OpCode::COPY) {
+        if ((instr.op == OpCode::ASSIGN || instr.op == OpCode::COPY) &&
+            !is_constant(instr.arg1) && instr.arg1 != instr.result) {
             copy_map[instr.result] = instr.arg1;
         }
-        
-        // Invalidate copies when variable is redefined
-        if (instr.modifies_result()) {
-            copy_map.erase(instr.result);
-        }
     }
 }
 
@@ -138,39 +292,39 @@ std::string IROptimizer::evaluate_constant_expression(OpCode op, const std::stri
         case OpCode::GE: result = (val1 >= val2) ? 1 : 0; break;
         case OpCode::AND: result = (val1 && val2) ? 1 : 0; break;
         case OpCode::OR: result = (val1 || val2) ? 1 : 0; break;
+        case OpCode::BIT_AND: result = val1 & val2; break;
+        case OpCode::BIT_OR: result = val1 | val2; break;
+        case OpCode::BIT_XOR: result = val1 ^ val2; break;
+        case OpCode::SHL: {
+            // Fold only shifts whose value the int folding can represent
+            if (val2 < 0 || val2 > 31) return "";
+            long long shifted = static_cast<long long>(val1) * (1LL << val2);
+            if (shifted < INT_MIN || shifted > INT_MAX) return "";
+            result = static_cast<int>(shifted);
+            break;
+        }
+        case OpCode::SHR:
+            if (val2 < 0 || val2 > 63) return "";
+            result = val2 > 31 ? (val1 < 0 ? -1 : 0) : val1 >> val2;
+            break;
         default: return "";
     }
     
     return std::to_string(result);
 }
 
-bool IROptimizer::is_dead_code(const IRInstruction& instr, const std::unordered_set<std::string>& used_vars) {
-    // Don't remove labels, branches, calls, or returns
+bool IROptimizer::is_dead_code(const IRInstruction& instr, const std::unordered_set<std::string>& live_out) {
+    // Don't remove labels, branches, calls, returns or counters
     if (instr.is_label() || instr.is_branch() || instr.is_function_call() || 
         instr.op == OpCode::RETURN || instr.op == OpCode::FUNCTION_BEGIN || 
-        instr.op == OpCode::FUNCTION_END) {
+        instr.op == OpCode::FUNCTION_END || instr.op == OpCode::PROFILE_COUNT) {
         return false;
     }
     
-    // Remove if result is not used
+    // Remove if nothing reads the result before it is overwritten; for an
+    // array store, before the function returns
     std::string defined_var = instr.get_defined_variable();
-    if (!defined_var.empty() && used_vars.find(defined_var) == used_vars.end()) {
-        return true;
-    }
-    
-    return false;
-}
-
-void IROptimizer::mark_used_variables(const IRCode& instructions) {
-    used_variables.clear();
-    
-    // Mark all variables that are used
-    for (const auto& instr : instructions) {
-        auto used_vars = instr.get_used_variables();
-        for (const auto& var : used_vars) {
-            used_variables.insert(var);
-        }
-    }
+    return !defined_var.empty() && live_out.find(defined_var) == live_out.end();
 }
 
 bool IROptimizer::simplify_expression(IRInstruction& instr) {
@@ -203,6 +357,22 @@ bool IROptimizer::simplify_expression(IRInstruction& instr) {
         return true;
     }
     
+    // x | 0 = x, x ^ 0 = x, x << 0 = x, x >> 0 = x
+    if ((instr.op == OpCode::BIT_OR || instr.op == OpCode::BIT_XOR ||
+         instr.op == OpCode::SHL || instr.op == OpCode::SHR) && instr.arg2 == "0") {
+        instr.op = OpCode::COPY;
+        instr.arg2 = "";
+        return true;
+    }
+    
+    // x & 0 = 0
+    if (instr.op == OpCode::BIT_AND && instr.arg2 == "0") {
+        instr.op = OpCode::ASSIGN;
+        instr.arg1 = "0";
+        instr.arg2 = "";
+        return true;
+    }
+    
     // x / 1 = x
     if (instr.op == OpCode::DIV && instr.arg2 == "1") {
         instr.op = OpCode::COPY;
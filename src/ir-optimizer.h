@@ -1,6 +1,8 @@
 #pragma once
 
 #include "ir-types.h"
+#include "optimization-remarks.h"
+#include "compile-budget.h"
 #include <vector>
 #include <unordered_map>
 #include <unordered_set>
@@ -10,19 +12,30 @@ class IROptimizer {
 private:
     // Helper data structures for optimization
     std::unordered_map<std::string, std::string> copy_map;
-    std::unordered_set<std::string> used_variables;
+    std::unordered_set<std::string> global_variables;
     std::unordered_map<std::string, std::string> constant_map;
     
+    // -fsave-optimization-record: where passes report their decisions (null: off)
+    RemarkCollector* remarks = nullptr;
+    
+    // Functions over budget.local_function_size get the linear passes only
+    CompileBudget budget;
+    
     // Helper functions
     bool is_constant(const std::string& str);
     int get_constant_value(const std::string& str);
     std::string evaluate_constant_expression(OpCode op, const std::string& arg1, const std::string& arg2);
-    bool is_dead_code(const IRInstruction& instr, const std::unordered_set<std::string>& used_vars);
-    void mark_used_variables(const IRCode& instructions);
+    bool is_dead_code(const IRInstruction& instr, const std::unordered_set<std::string>& live_out);
+    bool remove_dead_definitions(IRCode& function);
     
 public:
     IROptimizer() = default;
     
+    // File-scope variables, which stay live across calls and after returns
+    void set_global_variables(const std::unordered_set<std::string>& globals) { global_variables = globals; }
+    void set_remarks(RemarkCollector* collector) { remarks = collector; }
+    void set_budget(const CompileBudget& limits) { budget = limits; }
+    
     // Main optimization entry point
     IRCode optimize(const IRCode& instructions);
     
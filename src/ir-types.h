@@ -16,14 +16,17 @@ enum class OpCode {
     // Logical operations
     AND, OR, NOT,
     
-    // Assignment operations
-    ASSIGN, COPY,
+    // Bitwise operations; SHR shifts arithmetically since ints are signed
+    BIT_AND, BIT_OR, BIT_XOR, BIT_NOT, SHL, SHR,
+    
+    // Assignment operations; SELECT is result = arg1 ? arg2 : result
+    ASSIGN, COPY, SELECT,
     
     // Control flow
     GOTO, IF_FALSE, IF_TRUE,
     
     // Function operations
-    PARAM, CALL, RETURN,
+    PARAM, CALL, RETURN, LOAD_PARAM,
     
     // Array operations
     ARRAY_ACCESS, ARRAY_ASSIGN,
@@ -31,8 +34,9 @@ enum class OpCode {
     // Labels and markers
     LABEL, FUNCTION_BEGIN, FUNCTION_END,
     
-    // Special operations
-    NOP, HALT
+    // Special operations; PROFILE_COUNT bumps counter arg1, arg2 holds its
+    // count from a training run under -fprofile-use
+    NOP, HALT, PROFILE_COUNT
 };
 
 // Convert opcode to string for debugging
@@ -52,14 +56,22 @@ inline std::string opCodeToString(OpCode op) {
         case OpCode::AND: return "AND";
         case OpCode::OR: return "OR";
         case OpCode::NOT: return "NOT";
+        case OpCode::BIT_AND: return "BIT_AND";
+        case OpCode::BIT_OR: return "BIT_OR";
+        case OpCode::BIT_XOR: return "BIT_XOR";
+        case OpCode::BIT_NOT: return "BIT_NOT";
+        case OpCode::SHL: return "SHL";
+        case OpCode::SHR: return "SHR";
         case OpCode::ASSIGN: return "ASSIGN";
         case OpCode::COPY: return "COPY";
+        case OpCode::SELECT: return "SELECT";
         case OpCode::GOTO: return "GOTO";
         case OpCode::IF_FALSE: return "IF_FALSE";
         case OpCode::IF_TRUE: return "IF_TRUE";
         case OpCode::PARAM: return "PARAM";
         case OpCode::CALL: return "CALL";
         case OpCode::RETURN: return "RETURN";
+        case OpCode::LOAD_PARAM: return "LOAD_PARAM";
         case OpCode::ARRAY_ACCESS: return "ARRAY_ACCESS";
         case OpCode::ARRAY_ASSIGN: return "ARRAY_ASSIGN";
         case OpCode::LABEL: return "LABEL";
@@ -67,6 +79,7 @@ inline std::string opCodeToString(OpCode op) {
         case OpCode::FUNCTION_END: return "FUNCTION_END";
         case OpCode::NOP: return "NOP";
         case OpCode::HALT: return "HALT";
+        case OpCode::PROFILE_COUNT: return "PROFILE_COUNT";
         default: return "UNKNOWN";
     }
 }
@@ -132,6 +145,10 @@ public:
         if (!arg2.empty() && !is_constant(arg2)) {
             used.push_back(arg2);
         }
+        // A select keeps the old value when the condition is false
+        if (op == OpCode::SELECT) {
+            used.push_back(result);
+        }
         return used;
     }
     
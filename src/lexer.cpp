@@ -62,6 +62,9 @@ Token Lexer::nextToken() {
         if (pos_ + 1 < source_.size() && source_[pos_ + 1] == '=') {
             advance(); advance();
             return Token(TokenType::LessEqual, "<=", line_, column_ - 1);
+        } else if (pos_ + 1 < source_.size() && source_[pos_ + 1] == '<') {
+            advance(); advance();
+            return Token(TokenType::ShiftLeft, "<<", line_, column_ - 1);
         } else {
             advance();
             return Token(TokenType::Less, "<", line_, column_);
@@ -71,17 +74,30 @@ Token Lexer::nextToken() {
         if (pos_ + 1 < source_.size() && source_[pos_ + 1] == '=') {
             advance(); advance();
             return Token(TokenType::GreaterEqual, ">=", line_, column_ - 1);
+        } else if (pos_ + 1 < source_.size() && source_[pos_ + 1] == '>') {
+            advance(); advance();
+            return Token(TokenType::ShiftRight, ">>", line_, column_ - 1);
         } else {
             advance();
             return Token(TokenType::Greater, ">", line_, column_);
         }
     }
 
+    if ((c == '&' || c == '|') && pos_ + 1 < source_.size() && source_[pos_ + 1] == c) {
+        advance(); advance();
+        return c == '&' ? Token(TokenType::AndAnd, "&&", line_, column_ - 1)
+                        : Token(TokenType::OrOr, "||", line_, column_ - 1);
+    }
+
     switch (c) {
         case '+': advance(); return Token(TokenType::Plus, "+", line_, column_);
         case '-': advance(); return Token(TokenType::Minus, "-", line_, column_);
         case '*': advance(); return Token(TokenType::Star, "*", line_, column_);
         case '/': advance(); return Token(TokenType::Slash, "/", line_, column_);
+        case '&': advance(); return Token(TokenType::Ampersand, "&", line_, column_);
+        case '|': advance(); return Token(TokenType::Pipe, "|", line_, column_);
+        case '^': advance(); return Token(TokenType::Caret, "^", line_, column_);
+        case '~': advance(); return Token(TokenType::Tilde, "~", line_, column_);
         case '{': advance(); return Token(TokenType::LBrace, "{", line_, column_);
         case '}': advance(); return Token(TokenType::RBrace, "}", line_, column_);
         case '(': advance(); return Token(TokenType::LParen, "(", line_, column_);
@@ -11,6 +11,8 @@ enum class TokenType {
     Not,
     // Operators
     Plus, Minus, Star, Slash,
+    Ampersand, Pipe, Caret, Tilde, ShiftLeft, ShiftRight,
+    AndAnd, OrOr,
     Equal, EqualEqual, NotEqual,
     Less, LessEqual, Greater, GreaterEqual,
     // Delimiters
@@ -36,6 +38,14 @@ inline std::string TokenTypeToString(TokenType type, const std::string& value) {
         case TokenType::Minus:        return "MINUS(" + value + ")";
         case TokenType::Star:         return "STAR(" + value + ")";
         case TokenType::Slash:        return "SLASH(" + value + ")";
+        case TokenType::Ampersand:    return "AMPERSAND(" + value + ")";
+        case TokenType::Pipe:         return "PIPE(" + value + ")";
+        case TokenType::Caret:        return "CARET(" + value + ")";
+        case TokenType::Tilde:        return "TILDE(" + value + ")";
+        case TokenType::ShiftLeft:    return "SHIFTLEFT(" + value + ")";
+        case TokenType::ShiftRight:   return "SHIFTRIGHT(" + value + ")";
+        case TokenType::AndAnd:       return "ANDAND(" + value + ")";
+        case TokenType::OrOr:         return "OROR(" + value + ")";
         case TokenType::Equal:        return "EQUAL(" + value + ")";
         case TokenType::EqualEqual:   return "EQUALEQUAL(" + value + ")";
         case TokenType::NotEqual:     return "NOTEQUAL(" + value + ")";
@@ -0,0 +1,30 @@
+#include "libcmmc.h"
+#include <stdexcept>
+
+CompileResult cmmc_compile(const CompileRequest& request) {
+    CompileResult result;
+    try {
+        CompilerDriver driver(request.options);
+        driver.set_source_name(request.source_name);
+        if (request.collect_profile) {
+            driver.enable_profiling(true);
+            if (request.hardware_counters) {
+                driver.enable_hardware_counters(true);
+            }
+        }
+
+        bool want_object = request.options.output_format == OutputFormat::OBJECT;
+        result.success = driver.compile_to_memory(request.source, want_object ? &result.object : nullptr);
+        result.assembly = driver.get_assembly();
+        result.errors = driver.get_errors();
+        result.warnings = driver.get_warnings();
+        result.optimization_record = driver.get_optimization_record();
+        if (request.collect_profile) {
+            result.profile = driver.get_profiler().get_phase_profiles();
+        }
+    } catch (const std::exception& e) {
+        result.success = false;
+        result.errors.push_back(e.what());
+    }
+    return result;
+}
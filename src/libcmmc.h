@@ -0,0 +1,31 @@
+#pragma once
+
+#include "compiler-driver.h"
+#include <map>
+#include <string>
+#include <vector>
+
+// Embedding API, archived as bin/libcmmc.a by `make lib`. Each call runs its
+// own CompilerDriver and returns every output in the result, so calls on
+// different threads share no state. Options that print (verbose,
+// print_stages, print_ir, print_assembly) still write to stdout.
+
+struct CompileRequest {
+    std::string source;
+    std::string source_name = "<source>";   // named in -g line tables
+    CompilerOptions options;                // OutputFormat::OBJECT also assembles an object
+    bool collect_profile = false;           // per-phase times in CompileResult::profile
+    bool hardware_counters = false;         // with collect_profile: counts per phase too
+};
+
+struct CompileResult {
+    bool success = false;
+    std::string assembly;
+    std::vector<unsigned char> object;               // ELF relocatable for OutputFormat::OBJECT
+    std::vector<std::string> errors;
+    std::vector<std::string> warnings;
+    std::map<std::string, PhaseProfile> profile;     // keyed by phase name
+    std::string optimization_record;                 // set with optimization_record_format
+};
+
+CompileResult cmmc_compile(const CompileRequest& request);
@@ -0,0 +1,139 @@
+#include "optimization-remarks.h"
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+namespace {
+
+// Single-quoted YAML scalar: quotes are doubled, nothing else is special
+std::string yaml_quote(const std::string& text) {
+    std::string quoted = "'";
+    for (char c : text) {
+        quoted += c;
+        if (c == '\'') quoted += '\'';
+    }
+    return quoted + "'";
+}
+
+std::string json_quote(const std::string& text) {
+    std::string quoted = "\"";
+    for (char c : text) {
+        switch (c) {
+            case '"': quoted += "\\\""; break;
+            case '\\': quoted += "\\\\"; break;
+            case '\n': quoted += "\\n"; break;
+            case '\t': quoted += "\\t"; break;
+            default: quoted += c; break;
+        }
+    }
+    return quoted + "\"";
+}
+
+} // namespace
+
+const char* remark_kind_name(RemarkKind kind) {
+    switch (kind) {
+        case RemarkKind::Applied: return "applied";
+        case RemarkKind::Missed: return "missed";
+        case RemarkKind::Analysis: return "analysis";
+    }
+    return "analysis";
+}
+
+std::string RemarkCollector::function_at(const IRCode& instructions, size_t index) {
+    for (size_t i = std::min(index + 1, instructions.size()); i-- > 0;) {
+        if (instructions[i].op == OpCode::FUNCTION_BEGIN) return instructions[i].result;
+        if (instructions[i].op == OpCode::FUNCTION_END && i != index) break;
+    }
+    return "";
+}
+
+void RemarkCollector::emit(const std::string& pass, RemarkKind kind, const std::string& name,
+                           const IRCode& instructions, size_t index, const std::string& reason,
+                           std::vector<std::pair<std::string, long long>> metrics) {
+    int line = index < instructions.size() ? instructions[index].line_number : 0;
+    emit_function(pass, kind, name, function_at(instructions, index), line, reason, std::move(metrics));
+}
+
+void RemarkCollector::emit_function(const std::string& pass, RemarkKind kind, const std::string& name,
+                                    const std::string& function, int line, const std::string& reason,
+                                    std::vector<std::pair<std::string, long long>> metrics) {
+    OptimizationRemark remark;
+    remark.pass = pass;
+    remark.kind = kind;
+    remark.name = name;
+    remark.function = function;
+    remark.line = line;
+    remark.reason = reason;
+    remark.metrics = std::move(metrics);
+    remarks.push_back(std::move(remark));
+}
+
+void RemarkCollector::emit_per_function(const std::string& pass, const std::string& name,
+                                        const IRCode& instructions,
+                                        const std::unordered_map<std::string, long long>& counts,
+                                        const std::string& reason, const std::string& metric) {
+    for (const auto& instr : instructions) {
+        if (instr.op != OpCode::FUNCTION_BEGIN) continue;
+        auto it = counts.find(instr.result);
+        if (it == counts.end() || it->second == 0) continue;
+        emit_function(pass, RemarkKind::Applied, name, instr.result, instr.line_number, reason,
+                      {{metric, it->second}});
+    }
+}
+
+std::string RemarkCollector::to_yaml() const {
+    std::ostringstream out;
+    for (const auto& remark : remarks) {
+        const char* tag = remark.kind == RemarkKind::Applied ? "!Passed" :
+                          remark.kind == RemarkKind::Missed ? "!Missed" : "!Analysis";
+        out << "--- " << tag << "\n"
+            << "Pass:     " << remark.pass << "\n"
+            << "Name:     " << remark.name << "\n"
+            << "Function: " << yaml_quote(remark.function) << "\n"
+            << "Line:     " << remark.line << "\n"
+            << "Reason:   " << yaml_quote(remark.reason) << "\n";
+        if (!remark.metrics.empty()) {
+            out << "Metrics:\n";
+            for (const auto& metric : remark.metrics) {
+                out << "  " << metric.first << ": " << metric.second << "\n";
+            }
+        }
+        out << "...\n";
+    }
+    return out.str();
+}
+
+std::string RemarkCollector::to_json() const {
+    std::ostringstream out;
+    out << "[";
+    for (size_t r = 0; r < remarks.size(); ++r) {
+        const auto& remark = remarks[r];
+        out << (r ? ",\n " : "\n ")
+            << "{\"pass\": " << json_quote(remark.pass)
+            << ", \"kind\": \"" << remark_kind_name(remark.kind) << "\""
+            << ", \"name\": " << json_quote(remark.name)
+            << ", \"function\": " << json_quote(remark.function)
+            << ", \"line\": " << remark.line
+            << ", \"reason\": " << json_quote(remark.reason)
+            << ", \"metrics\": {";
+        for (size_t m = 0; m < remark.metrics.size(); ++m) {
+            out << (m ? ", " : "") << json_quote(remark.metrics[m].first) << ": " << remark.metrics[m].second;
+        }
+        out << "}}";
+    }
+    out << (remarks.empty() ? "]\n" : "\n]\n");
+    return out.str();
+}
+
+void RemarkCollector::write(const std::string& path, const std::string& format) const {
+    if (format != "yaml" && format != "json") {
+        throw std::runtime_error("unknown optimization record format " + format);
+    }
+    std::ofstream file(path);
+    if (!file.is_open()) {
+        throw std::runtime_error("cannot write optimization record " + path);
+    }
+    file << (format == "yaml" ? to_yaml() : to_json());
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include "ir-types.h"
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+enum class RemarkKind {
+    Applied,    // the pass transformed the code
+    Missed,     // the pass looked at the code and gave up, with the reason
+    Analysis    // what the pass measured, without a decision attached
+};
+
+// One decision of an optimization pass, in the shape of LLVM's optimization
+// records so the same tooling can read both
+struct OptimizationRemark {
+    std::string pass;
+    RemarkKind kind = RemarkKind::Analysis;
+    std::string name;       // short CamelCase identifier of the decision
+    std::string function;
+    int line = 0;           // source line, 0 when unknown
+    std::string reason;
+    std::vector<std::pair<std::string, long long>> metrics;
+};
+
+// Remarks collected during one compilation for -fsave-optimization-record.
+// Passes take a pointer that stays null unless records were asked for, so
+// they pay nothing otherwise.
+class RemarkCollector {
+private:
+    std::vector<OptimizationRemark> remarks;
+
+public:
+    // Record a remark about instructions[index], attributed to the function
+    // that contains it
+    void emit(const std::string& pass, RemarkKind kind, const std::string& name,
+              const IRCode& instructions, size_t index, const std::string& reason,
+              std::vector<std::pair<std::string, long long>> metrics = {});
+
+    // Record a remark about a whole function
+    void emit_function(const std::string& pass, RemarkKind kind, const std::string& name,
+                       const std::string& function, int line, const std::string& reason,
+                       std::vector<std::pair<std::string, long long>> metrics = {});
+
+    // Record an applied remark for every function with a nonzero count,
+    // in program order; the count goes in metric `metric`
+    void emit_per_function(const std::string& pass, const std::string& name, const IRCode& instructions,
+                           const std::unordered_map<std::string, long long>& counts,
+                           const std::string& reason, const std::string& metric);
+
+    const std::vector<OptimizationRemark>& get_remarks() const { return remarks; }
+    void clear() { remarks.clear(); }
+
+    // YAML documents tagged !Passed, !Missed or !Analysis, as clang writes
+    std::string to_yaml() const;
+    // A JSON array of remark objects
+    std::string to_json() const;
+
+    // Write the remarks in `format` ("yaml" or "json"); throws when the file
+    // cannot be written or the format is unknown
+    void write(const std::string& path, const std::string& format) const;
+
+    // Name of the function whose body holds instructions[index], empty outside one
+    static std::string function_at(const IRCode& instructions, size_t index);
+};
+
+const char* remark_kind_name(RemarkKind kind);
@@ -1,18 +1,14 @@
 #include "parser.h"
 
 std::unique_ptr<ASTNode> Parser::parse_program() {
-    std::cerr << "Entering parse_program\n";
     auto program = std::make_unique<Program>();
     while (!isAtEnd()) {
-        std::cerr << "Parsing declaration at token: " << peek().value() << "\n";
         try {
             program->declarations.push_back(parse_declaration());
         } catch (const std::exception& e) {
-            std::cerr << "Caught exception: " << e.what() << "\n";
             error_recovery(e.what());
         }
     }
-    std::cerr << "Exiting parse_program\n";
     return program;
 }
 
@@ -51,6 +47,7 @@ std::unique_ptr<ASTNode> Parser::parse_var_declaration(const std::string& type,
 }
 
 std::unique_ptr<ASTNode, std::default_delete<ASTNode>> Parser::parse_fun_declaration(const std::string& type, const std::string& name) {
+    int line = peek().line();
     match(TokenType::LParen);
     auto params = parse_params();
     if (!match(TokenType::RParen))
@@ -59,6 +56,7 @@ std::unique_ptr<ASTNode, std::default_delete<ASTNode>> Parser::parse_fun_declara
     auto func = std::make_unique<FunDeclaration>(type, name);
     func->params = std::move(params);
     func->body = std::move(body);
+    func->line = line;
     return func;
 }
 
@@ -119,11 +117,15 @@ std::unique_ptr<ASTNode> Parser::parse_compound_stmt() {
 }
 
 std::unique_ptr<ASTNode> Parser::parse_statement() {
-    if (check(TokenType::If)) return parse_selection_stmt();
-    if (check(TokenType::While)) return parse_iteration_stmt();
-    if (check(TokenType::Return)) return parse_return_stmt();
-    if (check(TokenType::LBrace)) return parse_compound_stmt();
-    return parse_expression_stmt();
+    int line = peek().line();
+    std::unique_ptr<ASTNode> stmt;
+    if (check(TokenType::If)) stmt = parse_selection_stmt();
+    else if (check(TokenType::While)) stmt = parse_iteration_stmt();
+    else if (check(TokenType::Return)) stmt = parse_return_stmt();
+    else if (check(TokenType::LBrace)) stmt = parse_compound_stmt();
+    else stmt = parse_expression_stmt();
+    stmt->line = line;
+    return stmt;
 }
 
 std::unique_ptr<ASTNode> Parser::parse_expression_stmt() {
@@ -217,18 +219,85 @@ std::unique_ptr<ASTNode> Parser::parse_var() {
 }
 
 std::unique_ptr<ASTNode> Parser::parse_simple_expression() {
-    auto left = parse_additive_expression();
+    return parse_logical_or_expression();
+}
+
+// || binds loosest, then &&, both below the bitwise operators
+std::unique_ptr<ASTNode> Parser::parse_logical_or_expression() {
+    auto left = parse_logical_and_expression();
+    while (check(TokenType::OrOr)) {
+        advance();
+        auto right = parse_logical_and_expression();
+        left = std::make_unique<BinaryOp>("||", std::move(left), std::move(right));
+    }
+    return left;
+}
+
+std::unique_ptr<ASTNode> Parser::parse_logical_and_expression() {
+    auto left = parse_bitwise_or_expression();
+    while (check(TokenType::AndAnd)) {
+        advance();
+        auto right = parse_bitwise_or_expression();
+        left = std::make_unique<BinaryOp>("&&", std::move(left), std::move(right));
+    }
+    return left;
+}
+
+// Bitwise operators bind as in C: | below ^ below & below comparisons
+std::unique_ptr<ASTNode> Parser::parse_bitwise_or_expression() {
+    auto left = parse_bitwise_xor_expression();
+    while (check(TokenType::Pipe)) {
+        advance();
+        auto right = parse_bitwise_xor_expression();
+        left = std::make_unique<BinaryOp>("|", std::move(left), std::move(right));
+    }
+    return left;
+}
+
+std::unique_ptr<ASTNode> Parser::parse_bitwise_xor_expression() {
+    auto left = parse_bitwise_and_expression();
+    while (check(TokenType::Caret)) {
+        advance();
+        auto right = parse_bitwise_and_expression();
+        left = std::make_unique<BinaryOp>("^", std::move(left), std::move(right));
+    }
+    return left;
+}
+
+std::unique_ptr<ASTNode> Parser::parse_bitwise_and_expression() {
+    auto left = parse_relational_expression();
+    while (check(TokenType::Ampersand)) {
+        advance();
+        auto right = parse_relational_expression();
+        left = std::make_unique<BinaryOp>("&", std::move(left), std::move(right));
+    }
+    return left;
+}
+
+std::unique_ptr<ASTNode> Parser::parse_relational_expression() {
+    auto left = parse_shift_expression();
     if (check(TokenType::Less) || check(TokenType::LessEqual) ||
         check(TokenType::Greater) || check(TokenType::GreaterEqual) ||
         check(TokenType::EqualEqual) || check(TokenType::NotEqual)) {
         std::string op = peek().value();
         advance();
-        auto right = parse_additive_expression();
+        auto right = parse_shift_expression();
         return std::make_unique<BinaryOp>(op, std::move(left), std::move(right));
     }
     return left;
 }
 
+std::unique_ptr<ASTNode> Parser::parse_shift_expression() {
+    auto left = parse_additive_expression();
+    while (check(TokenType::ShiftLeft) || check(TokenType::ShiftRight)) {
+        std::string op = peek().value();
+        advance();
+        auto right = parse_additive_expression();
+        left = std::make_unique<BinaryOp>(op, std::move(left), std::move(right));
+    }
+    return left;
+}
+
 std::unique_ptr<ASTNode> Parser::parse_additive_expression() {
     auto left = parse_term();
     while (check(TokenType::Plus) || check(TokenType::Minus)) {
@@ -301,6 +370,11 @@ std::unique_ptr<ASTNode> Parser::parse_factor() {
         return std::make_unique<UnaryOp>("!", std::move(operand));
     }
     
+    if (match(TokenType::Tilde)) {
+        auto operand = parse_factor();
+        return std::make_unique<UnaryOp>("~", std::move(operand));
+    }
+    
     throw std::runtime_error("Expected expression");
 }
 
@@ -348,8 +422,8 @@ bool Parser::isAtEnd() const {
 }
 
 void Parser::error_recovery(const std::string& msg) {
-    std::cerr << "Syntax error at line " << peek().line()
-              << ", col " << peek().column() << ": " << msg << std::endl;
+    errors.push_back("Syntax error at line " + std::to_string(peek().line()) +
+                     ", col " + std::to_string(peek().column()) + ": " + msg);
     if (!isAtEnd()) advance();
     synchronize();
 }
@@ -4,10 +4,12 @@
 #include <vector>
 #include <memory>
 #include <stdexcept>
+#include <string>
 
 class Parser {
     std::vector<Token> tokens;
     size_t current = 0;
+    std::vector<std::string> errors;   // one per declaration skipped by error_recovery
 
 public:
     Parser(const std::vector<Token>& toks) : tokens(toks) {}
@@ -27,6 +29,13 @@ public:
     std::unique_ptr<ASTNode> parse_expression();
     std::unique_ptr<ASTNode> parse_var();
     std::unique_ptr<ASTNode> parse_simple_expression();
+    std::unique_ptr<ASTNode> parse_logical_or_expression();
+    std::unique_ptr<ASTNode> parse_logical_and_expression();
+    std::unique_ptr<ASTNode> parse_bitwise_or_expression();
+    std::unique_ptr<ASTNode> parse_bitwise_xor_expression();
+    std::unique_ptr<ASTNode> parse_bitwise_and_expression();
+    std::unique_ptr<ASTNode> parse_relational_expression();
+    std::unique_ptr<ASTNode> parse_shift_expression();
     std::unique_ptr<ASTNode> parse_additive_expression();
     std::unique_ptr<ASTNode> parse_term();
     std::unique_ptr<ASTNode> parse_factor();
@@ -36,6 +45,9 @@ public:
     void error_recovery(const std::string& msg);
     void synchronize();
 
+    // Syntax errors parse_program recovered from, in source order
+    const std::vector<std::string>& get_errors() const { return errors; }
+
 private:
     const Token& peek() const { return tokens[current]; }
     const Token& previous() const { return tokens[current - 1]; }
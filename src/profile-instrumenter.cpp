@@ -0,0 +1,106 @@
+#include "profile-instrumenter.h"
+#include <fstream>
+#include <stdexcept>
+
+namespace {
+
+constexpr uint64_t FNV_OFFSET = 14695981039346656037ull;
+constexpr uint64_t FNV_PRIME = 1099511628211ull;
+
+void hash_string(uint64_t& hash, const std::string& text) {
+    for (unsigned char c : text) {
+        hash = (hash ^ c) * FNV_PRIME;
+    }
+    hash = (hash ^ 0xFF) * FNV_PRIME;
+}
+
+} // namespace
+
+ProfileInstrumenter::ProfileInstrumenter() : counter_count(0), checksum(FNV_OFFSET) {}
+
+void ProfileInstrumenter::instrument(IRCode& instructions) {
+    counter_count = 0;
+    checksum = FNV_OFFSET;
+
+    IRCode instrumented;
+    instrumented.reserve(instructions.size() * 2);
+    auto add_counter = [&](const std::string& site, int line) {
+        hash_string(checksum, site);
+        instrumented.emplace_back(OpCode::PROFILE_COUNT, "", std::to_string(counter_count++), "", line);
+    };
+
+    bool in_function = false;
+    bool block_start = false;
+    for (const auto& instr : instructions) {
+        // Blocks start at labels, after the function entry and after jumps
+        if (instr.op == OpCode::FUNCTION_BEGIN) {
+            hash_string(checksum, instr.result);
+            instrumented.push_back(instr);
+            in_function = true;
+            block_start = true;
+            continue;
+        }
+        if (instr.op == OpCode::FUNCTION_END) {
+            in_function = false;
+        }
+        if (instr.is_label()) {
+            instrumented.push_back(instr);
+            block_start = in_function;
+            continue;
+        }
+
+        if (block_start && in_function) {
+            add_counter("block", instr.line_number);
+        }
+        block_start = false;
+        if (instr.op == OpCode::CALL) {
+            add_counter("call " + instr.arg1, instr.line_number);
+        }
+        instrumented.push_back(instr);
+        if (instr.is_branch() || instr.op == OpCode::RETURN) {
+            block_start = true;
+        }
+    }
+    instructions.swap(instrumented);
+    hash_string(checksum, std::to_string(counter_count));
+}
+
+void ProfileInstrumenter::apply_counts(IRCode& instructions, const std::vector<uint64_t>& counts) const {
+    for (auto& instr : instructions) {
+        if (instr.op != OpCode::PROFILE_COUNT) continue;
+        size_t id = std::stoul(instr.arg1);
+        if (id < counts.size()) instr.arg2 = std::to_string(counts[id]);
+    }
+}
+
+std::vector<uint64_t> ProfileInstrumenter::read_profile(const std::string& path) const {
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        throw std::runtime_error("cannot open profile " + path);
+    }
+
+    char magic[8];
+    uint64_t file_checksum = 0;
+    uint64_t file_counters = 0;
+    file.read(magic, sizeof(magic));
+    file.read(reinterpret_cast<char*>(&file_checksum), sizeof(file_checksum));
+    file.read(reinterpret_cast<char*>(&file_counters), sizeof(file_counters));
+    if (!file || std::string(magic, sizeof(magic)) != PROFILE_MAGIC) {
+        throw std::runtime_error(path + " is not a profile");
+    }
+    if (file_checksum != checksum || file_counters != counter_count) {
+        throw std::runtime_error(path + " was collected from a different program or optimization level");
+    }
+
+    std::vector<uint64_t> counts(counter_count);
+    file.read(reinterpret_cast<char*>(counts.data()), static_cast<std::streamsize>(counter_count * sizeof(uint64_t)));
+    if (!file) {
+        throw std::runtime_error(path + " is truncated");
+    }
+    return counts;
+}
+
+int64_t profiled_count(const IRInstruction& instr) {
+    if (instr.op != OpCode::PROFILE_COUNT || instr.arg2.empty()) return -1;
+    return std::stoll(instr.arg2);
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include "ir-types.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Counter layout for -fprofile-generate and -fprofile-use. A PROFILE_COUNT is
+// placed at the start of every basic block and before every call, and the
+// counters are numbered in instruction order. Both modes instrument the same
+// IR at the same point in the pipeline, so counts from a training run map
+// back to the blocks and call sites by counter id.
+class ProfileInstrumenter {
+private:
+    size_t counter_count;
+    uint64_t checksum;
+
+public:
+    ProfileInstrumenter();
+
+    // Insert the counters; the checksum identifies the resulting layout
+    void instrument(IRCode& instructions);
+
+    // Record counts read from a profile in the PROFILE_COUNTs
+    void apply_counts(IRCode& instructions, const std::vector<uint64_t>& counts) const;
+
+    size_t get_counter_count() const { return counter_count; }
+    uint64_t get_checksum() const { return checksum; }
+
+    // Counts written by an instrumented program; throws if the file is
+    // missing or was produced for a different counter layout
+    std::vector<uint64_t> read_profile(const std::string& path) const;
+};
+
+// Profiled count of a PROFILE_COUNT, or -1 when it carries none
+int64_t profiled_count(const IRInstruction& instr);
+
+// Magic at the start of profile files
+constexpr char PROFILE_MAGIC[] = "CMMCPROF";
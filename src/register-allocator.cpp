@@ -1,82 +1,107 @@
 #include "register-allocator.h"
 #include <iostream>
-#include <algorithm>
 #include <stdexcept>
 
+namespace {
+
+const std::array<std::string, PHYS_REG_COUNT + 1> REG_NAMES = {
+    "rax", "rcx", "rdx", "rbx", "rsp", "rbp", "rsi", "rdi",
+    "r8", "r9", "r10", "r11", "r12", "r13", "r14", "r15",
+    ""
+};
+
+const std::array<std::string, PHYS_REG_COUNT + 1> REG_NAMES_8 = {
+    "al", "cl", "dl", "bl", "spl", "bpl", "sil", "dil",
+    "r8b", "r9b", "r10b", "r11b", "r12b", "r13b", "r14b", "r15b",
+    ""
+};
+
+// Index of the lowest set bit; mask must be non-zero
+inline PhysReg lowest_reg(RegMask mask) {
+    return static_cast<PhysReg>(__builtin_ctz(mask));
+}
+
+} // namespace
+
+const std::string& reg_name(PhysReg reg) {
+    return REG_NAMES[static_cast<size_t>(reg)];
+}
+
+const std::string& reg_name8(PhysReg reg) {
+    return REG_NAMES_8[static_cast<size_t>(reg)];
+}
+
 RegisterAllocator::RegisterAllocator() : next_spill_offset(-16) {
     initialize_registers();
 }
 
 void RegisterAllocator::initialize_registers() {
-    // x86-64 general purpose registers (excluding rsp, rbp)
-    general_purpose_regs = {
-        "rax", "rbx", "rcx", "rdx", "rsi", "rdi",
-        "r8", "r9", "r10", "r11", "r12", "r13", "r14", "r15"
-    };
-    
-    // Caller-saved registers (caller must save before function call)
-    caller_saved_regs = {
-        "rax", "rcx", "rdx", "rsi", "rdi", "r8", "r9", "r10", "r11"
-    };
-    
-    // Callee-saved registers (callee must save if used)
-    callee_saved_regs = {
-        "rbx", "r12", "r13", "r14", "r15"
-    };
-    
-    // Initialize available registers queue
-    // Start with caller-saved registers as they're easier to manage
-    for (const auto& reg : caller_saved_regs) {
-        if (reg != "rax") { // Reserve rax for return values
-            available_registers.push(reg);
-        }
-    }
-    
-    // Add some callee-saved registers
-    for (const auto& reg : callee_saved_regs) {
-        available_registers.push(reg);
+    free_regs = ALLOCATABLE_REGS;
+    used_callee_saved = 0;
+    next_stamp = 0;
+    alloc_stamp.fill(0);
+    for (auto& owner : reg_owner) {
+        owner.clear();
     }
 }
 
-std::string RegisterAllocator::allocate_register() {
-    if (available_registers.empty()) {
-        // Need to spill a register
-        std::string reg_to_spill = select_register_to_spill();
-        spill_register(reg_to_spill);
-        return reg_to_spill;
-    }
-    
-    std::string reg = available_registers.front();
-    available_registers.pop();
-    used_registers.insert(reg);
-    
+PhysReg RegisterAllocator::take_register(PhysReg reg) {
+    RegMask bit = reg_bit(reg);
+    free_regs &= static_cast<RegMask>(~bit);
+    used_callee_saved |= static_cast<RegMask>(bit & CALLEE_SAVED_REGS);
+    alloc_stamp[static_cast<size_t>(reg)] = next_stamp++;
     return reg;
 }
 
-std::string RegisterAllocator::allocate_register(const std::string& temp) {
+PhysReg RegisterAllocator::allocate_register(RegMask exclude) {
+    RegMask candidates = static_cast<RegMask>(free_regs & ~exclude);
+
+    // Caller-saved registers first: they need no save in the prologue
+    RegMask caller = static_cast<RegMask>(candidates & CALLER_SAVED_REGS);
+    if (caller) {
+        return take_register(lowest_reg(caller));
+    }
+    if (candidates) {
+        return take_register(lowest_reg(candidates));
+    }
+
+    // Need to spill a register
+    RegMask in_use = static_cast<RegMask>(ALLOCATABLE_REGS & ~free_regs & ~exclude);
+    PhysReg reg_to_spill = select_register_to_spill(in_use);
+    spill_register(reg_to_spill);
+    free_regs &= static_cast<RegMask>(~reg_bit(reg_to_spill));
+    alloc_stamp[static_cast<size_t>(reg_to_spill)] = next_stamp++;
+    return reg_to_spill;
+}
+
+PhysReg RegisterAllocator::allocate_register(const std::string& temp) {
     // Check if already allocated
-    if (temp_to_register.find(temp) != temp_to_register.end()) {
-        return temp_to_register[temp];
+    auto it = temp_to_register.find(temp);
+    if (it != temp_to_register.end()) {
+        return it->second;
     }
-    
-    std::string reg = allocate_register();
-    temp_to_register[temp] = reg;
-    
+
+    PhysReg reg = allocate_register();
+    reg_owner[static_cast<size_t>(reg)] = temp;
+    temp_to_register.emplace(temp, reg);
+
     return reg;
 }
 
-void RegisterAllocator::free_register(const std::string& reg) {
-    if (used_registers.find(reg) != used_registers.end()) {
-        used_registers.erase(reg);
-        available_registers.push(reg);
-        
-        // Remove from temp mapping
-        for (auto it = temp_to_register.begin(); it != temp_to_register.end(); ++it) {
-            if (it->second == reg) {
-                temp_to_register.erase(it);
-                break;
-            }
-        }
+void RegisterAllocator::free_register(PhysReg reg) {
+    if (reg == PhysReg::NONE) return;
+
+    RegMask bit = reg_bit(reg);
+    if ((ALLOCATABLE_REGS & bit) == 0 || (free_regs & bit) != 0) {
+        return;
+    }
+    free_regs |= bit;
+
+    // Remove from temp mapping
+    std::string& owner = reg_owner[static_cast<size_t>(reg)];
+    if (!owner.empty()) {
+        temp_to_register.erase(owner);
+        owner.clear();
     }
 }
 
@@ -87,12 +112,16 @@ void RegisterAllocator::free_register_for_temp(const std::string& temp) {
     }
 }
 
+void RegisterAllocator::reserve_registers(RegMask regs) {
+    free_regs &= static_cast<RegMask>(~regs);
+}
+
 void RegisterAllocator::spill_to_memory(const std::string& temp) {
     auto it = temp_to_register.find(temp);
     if (it != temp_to_register.end()) {
         spilled_variables[temp] = next_spill_offset;
         next_spill_offset -= 8;
-        
+
         // Free the register
         free_register(it->second);
     }
@@ -103,30 +132,29 @@ std::string RegisterAllocator::load_from_memory(const std::string& temp) {
     if (it != spilled_variables.end()) {
         return "[rbp " + std::to_string(it->second) + "]";
     }
-    
+
     throw std::runtime_error("Variable " + temp + " not found in spilled variables");
 }
 
-std::string RegisterAllocator::select_register_to_spill() {
-    // Simple strategy: spill the least recently used register
-    // For now, just pick the first used register
-    if (!used_registers.empty()) {
-        return *used_registers.begin();
+PhysReg RegisterAllocator::select_register_to_spill(RegMask candidates) const {
+    // Spill the register that has held its value the longest
+    if (candidates == 0) {
+        throw std::runtime_error("No registers available for spilling");
     }
-    
-    throw std::runtime_error("No registers available for spilling");
-}
 
-void RegisterAllocator::spill_register(const std::string& reg) {
-    // Find the temp using this register
-    std::string temp_to_spill;
-    for (const auto& pair : temp_to_register) {
-        if (pair.second == reg) {
-            temp_to_spill = pair.first;
-            break;
+    PhysReg oldest = lowest_reg(candidates);
+    for (RegMask rest = candidates; rest; rest &= static_cast<RegMask>(rest - 1)) {
+        PhysReg reg = lowest_reg(rest);
+        if (alloc_stamp[static_cast<size_t>(reg)] < alloc_stamp[static_cast<size_t>(oldest)]) {
+            oldest = reg;
         }
     }
-    
+    return oldest;
+}
+
+void RegisterAllocator::spill_register(PhysReg reg) {
+    // Move the temp using this register (if any) to memory
+    std::string temp_to_spill = reg_owner[static_cast<size_t>(reg)];
     if (!temp_to_spill.empty()) {
         spill_to_memory(temp_to_spill);
     }
@@ -136,60 +164,81 @@ bool RegisterAllocator::is_allocated(const std::string& temp) const {
     return temp_to_register.find(temp) != temp_to_register.end();
 }
 
-std::string RegisterAllocator::get_register(const std::string& temp) const {
+PhysReg RegisterAllocator::get_register(const std::string& temp) const {
     auto it = temp_to_register.find(temp);
     if (it != temp_to_register.end()) {
         return it->second;
     }
-    return "";
+    return PhysReg::NONE;
 }
 
 bool RegisterAllocator::has_available_registers() const {
-    return !available_registers.empty();
+    return free_regs != 0;
 }
 
-void RegisterAllocator::save_caller_saved_registers() {
-    // Implementation for saving caller-saved registers before function calls
-    // This would emit assembly instructions to save registers
+std::vector<std::string> RegisterAllocator::save_caller_saved_registers(RegMask live, const SaveSlot& slot) const {
+    std::vector<std::string> code;
+    for (RegMask regs = static_cast<RegMask>(live & CALLER_SAVED_REGS); regs;
+         regs &= static_cast<RegMask>(regs - 1)) {
+        PhysReg reg = lowest_reg(regs);
+        code.push_back("mov " + slot(reg) + ", " + reg_name(reg));
+    }
+    return code;
 }
 
-void RegisterAllocator::restore_caller_saved_registers() {
-    // Implementation for restoring caller-saved registers after function calls
+std::vector<std::string> RegisterAllocator::restore_caller_saved_registers(RegMask live, const SaveSlot& slot) const {
+    std::vector<std::string> code;
+    for (RegMask regs = static_cast<RegMask>(live & CALLER_SAVED_REGS); regs;
+         regs &= static_cast<RegMask>(regs - 1)) {
+        PhysReg reg = lowest_reg(regs);
+        code.push_back("mov " + reg_name(reg) + ", " + slot(reg));
+    }
+    return code;
 }
 
-void RegisterAllocator::save_callee_saved_registers() {
-    // Implementation for saving callee-saved registers at function entry
+std::vector<std::string> RegisterAllocator::save_callee_saved_registers(RegMask used) const {
+    std::vector<std::string> code;
+    for (RegMask regs = static_cast<RegMask>(used & CALLEE_SAVED_REGS); regs;
+         regs &= static_cast<RegMask>(regs - 1)) {
+        code.push_back("push " + reg_name(lowest_reg(regs)));
+    }
+    return code;
 }
 
-void RegisterAllocator::restore_callee_saved_registers() {
-    // Implementation for restoring callee-saved registers at function exit
+std::vector<std::string> RegisterAllocator::restore_callee_saved_registers(RegMask used) const {
+    // Pop in the reverse order of save_callee_saved_registers
+    std::vector<std::string> code;
+    for (int bit = PHYS_REG_COUNT - 1; bit >= 0; --bit) {
+        PhysReg reg = static_cast<PhysReg>(bit);
+        if (used & CALLEE_SAVED_REGS & reg_bit(reg)) {
+            code.push_back("pop " + reg_name(reg));
+        }
+    }
+    return code;
 }
 
 void RegisterAllocator::print_allocation_state() const {
     std::cout << "Register Allocation State:" << std::endl;
     std::cout << "Used registers: ";
-    for (const auto& reg : used_registers) {
-        std::cout << reg << " ";
+    for (RegMask used = static_cast<RegMask>(ALLOCATABLE_REGS & ~free_regs); used;
+         used &= static_cast<RegMask>(used - 1)) {
+        std::cout << reg_name(lowest_reg(used)) << " ";
     }
     std::cout << std::endl;
-    
+
     std::cout << "Temp to register mapping:" << std::endl;
     for (const auto& pair : temp_to_register) {
-        std::cout << "  " << pair.first << " -> " << pair.second << std::endl;
+        std::cout << "  " << pair.first << " -> " << reg_name(pair.second) << std::endl;
     }
-    
-    std::cout << "Available registers: " << available_registers.size() << std::endl;
+
+    std::cout << "Available registers: " << __builtin_popcount(free_regs) << std::endl;
 }
 
 void RegisterAllocator::reset() {
     temp_to_register.clear();
-    used_registers.clear();
     spilled_variables.clear();
     next_spill_offset = -16;
-    
+
     // Reinitialize available registers
-    while (!available_registers.empty()) {
-        available_registers.pop();
-    }
     initialize_registers();
 }
@@ -1,57 +1,107 @@
 #pragma once
 
 #include <string>
+#include <array>
+#include <unordered_map>
 #include <vector>
-#include <map>
-#include <set>
-#include <queue>
-#include <memory>
+#include <functional>
+#include <cstdint>
+
+// x86-64 general purpose registers, numbered by their hardware encoding
+enum class PhysReg : uint8_t {
+    RAX = 0, RCX, RDX, RBX, RSP, RBP, RSI, RDI,
+    R8, R9, R10, R11, R12, R13, R14, R15,
+    NONE
+};
+
+constexpr int PHYS_REG_COUNT = 16;
+
+// Register sets are bitmasks indexed by the register encoding
+using RegMask = uint16_t;
+
+constexpr RegMask reg_bit(PhysReg reg) {
+    return static_cast<RegMask>(1u << static_cast<unsigned>(reg));
+}
+
+// Register classes (System V AMD64 ABI)
+constexpr RegMask CALLER_SAVED_REGS =
+    reg_bit(PhysReg::RAX) | reg_bit(PhysReg::RCX) | reg_bit(PhysReg::RDX) |
+    reg_bit(PhysReg::RSI) | reg_bit(PhysReg::RDI) | reg_bit(PhysReg::R8) |
+    reg_bit(PhysReg::R9) | reg_bit(PhysReg::R10) | reg_bit(PhysReg::R11);
+
+constexpr RegMask CALLEE_SAVED_REGS =
+    reg_bit(PhysReg::RBX) | reg_bit(PhysReg::R12) | reg_bit(PhysReg::R13) |
+    reg_bit(PhysReg::R14) | reg_bit(PhysReg::R15);
+
+// rsp/rbp hold the frame, rax is kept for return values, setcc and idiv
+constexpr RegMask RESERVED_REGS =
+    reg_bit(PhysReg::RSP) | reg_bit(PhysReg::RBP) | reg_bit(PhysReg::RAX);
+
+constexpr RegMask ALLOCATABLE_REGS = static_cast<RegMask>(0xFFFFu & ~RESERVED_REGS);
+
+// Registers the code generator keeps for operand loads; the rest may hold variables
+constexpr RegMask SCRATCH_REGS =
+    reg_bit(PhysReg::RCX) | reg_bit(PhysReg::RDX) | reg_bit(PhysReg::R10) | reg_bit(PhysReg::R11);
+
+constexpr RegMask COLORABLE_REGS = static_cast<RegMask>(ALLOCATABLE_REGS & ~SCRATCH_REGS);
+
+// Register name lookup (no allocation, suitable for instruction emission)
+const std::string& reg_name(PhysReg reg);
+const std::string& reg_name8(PhysReg reg);
 
 class RegisterAllocator {
 private:
-    std::map<std::string, std::string> temp_to_register;
-    std::set<std::string> used_registers;
-    std::queue<std::string> available_registers;
-    void spill_register(const std::string& reg);
-    
-    // Register categories
-    std::vector<std::string> general_purpose_regs;
-    std::vector<std::string> caller_saved_regs;
-    std::vector<std::string> callee_saved_regs;
-    
+    RegMask free_regs;            // allocatable registers not holding a value
+    RegMask used_callee_saved;    // callee-saved registers handed out since reset
+
+    // Per-register state, indexed by encoding
+    std::array<std::string, PHYS_REG_COUNT> reg_owner;   // temp held, empty for scratch use
+    std::array<uint32_t, PHYS_REG_COUNT> alloc_stamp;    // allocation order for spill choice
+    uint32_t next_stamp;
+
+    std::unordered_map<std::string, PhysReg> temp_to_register;
+
     // Spilling support
-    std::map<std::string, int> spilled_variables;
+    std::unordered_map<std::string, int> spilled_variables;
     int next_spill_offset;
-    
+
     // Helper functions
     void initialize_registers();
-    std::string select_register_to_spill();
-    
+    PhysReg take_register(PhysReg reg);
+    PhysReg select_register_to_spill(RegMask candidates) const;
+    void spill_register(PhysReg reg);
+
 public:
     RegisterAllocator();
     ~RegisterAllocator() = default;
-    
-    // Main allocation interface
-    std::string allocate_register();
-    std::string allocate_register(const std::string& temp);
-    void free_register(const std::string& reg);
+
+    // Main allocation interface; caller-saved registers are preferred
+    PhysReg allocate_register(RegMask exclude = 0);
+    PhysReg allocate_register(const std::string& temp);
+    void free_register(PhysReg reg);
     void free_register_for_temp(const std::string& temp);
-    
+    void reserve_registers(RegMask regs);   // withhold registers until reset
+
     // Spilling interface
     void spill_to_memory(const std::string& temp);
     std::string load_from_memory(const std::string& temp);
-    
+
     // Query interface
     bool is_allocated(const std::string& temp) const;
-    std::string get_register(const std::string& temp) const;
+    PhysReg get_register(const std::string& temp) const;
     bool has_available_registers() const;
-    
-    // Function call support
-    void save_caller_saved_registers();
-    void restore_caller_saved_registers();
-    void save_callee_saved_registers();
-    void restore_callee_saved_registers();
-    
+    bool is_free(PhysReg reg) const { return (free_regs & reg_bit(reg)) != 0; }
+    RegMask get_free_registers() const { return free_regs; }
+    RegMask get_used_callee_saved() const { return used_callee_saved; }
+
+    // Function call support. Caller-saved registers in `live` go to the memory
+    // operands returned by `slot`; callee-saved registers in `used` are pushed.
+    using SaveSlot = std::function<std::string(PhysReg)>;
+    std::vector<std::string> save_caller_saved_registers(RegMask live, const SaveSlot& slot) const;
+    std::vector<std::string> restore_caller_saved_registers(RegMask live, const SaveSlot& slot) const;
+    std::vector<std::string> save_callee_saved_registers(RegMask used) const;
+    std::vector<std::string> restore_callee_saved_registers(RegMask used) const;
+
     // Debug and utility
     void print_allocation_state() const;
     void reset();
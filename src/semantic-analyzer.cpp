@@ -27,23 +27,7 @@ bool SemanticAnalyzer::analyze(Program& program) {
     // First pass: collect all function declarations
     for (const auto& decl : program.declarations) {
         if (auto func_decl = dynamic_cast<FunDeclaration*>(decl.get())) {
-            DataType return_type = stringToDataType(func_decl->return_type);
-            auto func_symbol = std::make_unique<FunctionSymbol>(
-                func_decl->name, return_type, 0, SourceLocation());
-            
-            // Add parameters
-            // for (const auto& param : func_decl->params) {
-            //     DataType param_type = stringToDataType(param->type);
-            //     auto param_symbol = std::make_unique<VariableSymbol>(
-            //         param->name, param_type, param->isArray, -1, true, 0, SourceLocation());
-            //     func_symbol->parameters.push_back(std::move(param_symbol));
-            // }
-            
-            func_symbol->is_defined = (func_decl->body != nullptr);
-            
-            if (!current_scope->declare_symbol(std::move(func_symbol))) {
-                error_collector.redefinition(func_decl->name, SourceLocation());
-            }
+            declare_function(*func_decl);
         }
     }
     
@@ -58,6 +42,40 @@ bool SemanticAnalyzer::analyze(Program& program) {
     return !error_collector.has_errors();
 }
 
+void SemanticAnalyzer::declare_function(FunDeclaration& function) {
+    DataType return_type = stringToDataType(function.return_type);
+    auto func_symbol = std::make_unique<FunctionSymbol>(
+        function.name, return_type, 0, SourceLocation());
+    
+    // Add parameters
+    // for (const auto& param : function.params) {
+    //     DataType param_type = stringToDataType(param->type);
+    //     auto param_symbol = std::make_unique<VariableSymbol>(
+    //         param->name, param_type, param->isArray, -1, true, 0, SourceLocation());
+    //     func_symbol->parameters.push_back(std::move(param_symbol));
+    // }
+    
+    func_symbol->is_defined = (function.body != nullptr);
+    
+    if (!current_scope->declare_symbol(std::move(func_symbol))) {
+        error_collector.redefinition(function.name, SourceLocation());
+    }
+}
+
+bool SemanticAnalyzer::analyze_declaration(ASTNode& declaration) {
+    size_t errors_before = error_collector.error_count();
+    declaration.accept(*this);
+    
+    // Nothing looks into a finished function's scopes again
+    global_scope->release_child_scopes();
+    return error_collector.error_count() == errors_before;
+}
+
+bool SemanticAnalyzer::finish_analysis() {
+    check_main_function();
+    return !error_collector.has_errors();
+}
+
 void SemanticAnalyzer::visit(Program& node) {
     // Program analysis is handled in analyze() method
     (void)node; // Prevent unused parameter warning
@@ -321,6 +339,15 @@ void SemanticAnalyzer::check_binary_operation(BinaryOp& binary_op) {
         error_collector.add_error("Binary operation requires integer operands", 
                                 SourceLocation(), ErrorType::TYPE_MISMATCH);
     }
+    
+    // Shifts by a negative amount or the full width are undefined
+    if (binary_op.op == "<<" || binary_op.op == ">>") {
+        auto count = dynamic_cast<Number*>(binary_op.right.get());
+        if (count && (count->value < 0 || count->value > 63)) {
+            error_collector.add_error("Shift count " + std::to_string(count->value) + " is out of range",
+                                    SourceLocation(), ErrorType::TYPE_MISMATCH);
+        }
+    }
 }
 
 void SemanticAnalyzer::check_unary_operation(UnaryOp& unary_op) {
@@ -376,7 +403,8 @@ void SemanticAnalyzer::check_main_function() {
 
 VariableSymbol* SemanticAnalyzer::get_variable_symbol(const std::string& name) {
     Symbol* symbol = current_scope->lookup_symbol(name);
-    if (symbol && symbol->symbol_type == SymbolType::VARIABLE) {
+    if (symbol && (symbol->symbol_type == SymbolType::VARIABLE ||
+                   symbol->symbol_type == SymbolType::PARAMETER)) {
         return dynamic_cast<VariableSymbol*>(symbol);
     }
     return nullptr;
@@ -44,6 +44,13 @@ public:
     // Main analysis entry point
     bool analyze(Program& program);
     
+    // The same checks a declaration at a time, for streaming: declare every
+    // function first, then analyze each declaration in source order, then
+    // finish. Each function's scopes are released once it has been checked.
+    void declare_function(FunDeclaration& function);
+    bool analyze_declaration(ASTNode& declaration);   // false if it added errors
+    bool finish_analysis();
+    
     // Get analysis results
     const SemanticErrorCollector& get_error_collector() const { return error_collector; }
     bool has_errors() const { return error_collector.has_errors(); }
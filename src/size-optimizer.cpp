@@ -0,0 +1,518 @@
+#include "size-optimizer.h"
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <map>
+#include <set>
+
+namespace {
+
+const char* const GPR64[] = {
+    "rax", "rbx", "rcx", "rdx", "rsi", "rdi", "rbp", "rsp",
+    "r8", "r9", "r10", "r11", "r12", "r13", "r14", "r15"
+};
+const char* const GPR32[] = {
+    "eax", "ebx", "ecx", "edx", "esi", "edi", "ebp", "esp",
+    "r8d", "r9d", "r10d", "r11d", "r12d", "r13d", "r14d", "r15d"
+};
+
+// Longest sequence considered for outlining
+constexpr size_t MAX_OUTLINE_LENGTH = 16;
+
+// Encoded sizes of the instructions the passes insert
+constexpr long CALL_BYTES = 5;
+constexpr long RET_BYTES = 1;
+
+std::string trim(const std::string& text) {
+    size_t begin = text.find_first_not_of(" \t");
+    if (begin == std::string::npos) return "";
+    size_t end = text.find_last_not_of(" \t");
+    return text.substr(begin, end - begin + 1);
+}
+
+bool is_label(const std::string& line) {
+    return !line.empty() && line[0] != ' ' && line.back() == ':';
+}
+
+bool is_directive(const std::string& line) {
+    std::string text = trim(line);
+    return !text.empty() && text[0] == '.' && !is_label(line);
+}
+
+// Split an instruction line into mnemonic and operands; false for labels,
+// comments, directives and blank lines
+bool parse_instruction(const std::string& line, std::string& mnemonic, std::vector<std::string>& operands) {
+    if (line.empty() || line[0] != ' ') return false;
+    std::string text = trim(line);
+    if (text.empty() || text[0] == '#' || text[0] == '.') return false;
+
+    size_t space = text.find(' ');
+    mnemonic = text.substr(0, space);
+    operands.clear();
+    if (space == std::string::npos) return true;
+
+    std::string rest = text.substr(space + 1);
+    size_t start = 0;
+    while (start <= rest.size()) {
+        size_t comma = rest.find(',', start);
+        std::string operand = trim(rest.substr(start, comma == std::string::npos ? std::string::npos : comma - start));
+        if (!operand.empty()) operands.push_back(operand);
+        if (comma == std::string::npos) break;
+        start = comma + 1;
+    }
+    return true;
+}
+
+bool is_instruction(const std::string& line) {
+    std::string mnemonic;
+    std::vector<std::string> operands;
+    return parse_instruction(line, mnemonic, operands);
+}
+
+int register_index(const std::string& name, const char* const* table) {
+    for (int i = 0; i < 16; ++i) {
+        if (name == table[i]) return i;
+    }
+    return -1;
+}
+
+// r8-r15 in any width, and the byte registers that only exist with REX
+bool needs_rex_register(const std::string& name) {
+    return (name.size() > 1 && name[0] == 'r' && std::isdigit(static_cast<unsigned char>(name[1]))) ||
+           name == "sil" || name == "dil" || name == "bpl" || name == "spl";
+}
+
+bool parse_immediate(const std::string& text, long long& value) {
+    if (text.empty()) return false;
+    size_t start = text[0] == '-' ? 1 : 0;
+    if (start == text.size()) return false;
+    for (size_t i = start; i < text.size(); ++i) {
+        if (!std::isdigit(static_cast<unsigned char>(text[i]))) return false;
+    }
+    value = std::strtoll(text.c_str(), nullptr, 10);
+    return true;
+}
+
+bool fits_int8(long long value) {
+    return value >= -128 && value <= 127;
+}
+
+// SIB and displacement bytes of a memory operand
+size_t memory_operand_bytes(const std::string& operand, bool& rex) {
+    size_t open = operand.find('[');
+    size_t close = operand.find(']');
+    std::string inner = operand.substr(open + 1, close - open - 1);
+    if (inner.find("rip") != std::string::npos) return 4;
+
+    std::vector<std::string> tokens;
+    std::string token;
+    for (char c : inner) {
+        if (c == ' ') {
+            if (!token.empty()) tokens.push_back(token);
+            token.clear();
+        } else {
+            token += c;
+        }
+    }
+    if (!token.empty()) tokens.push_back(token);
+
+    std::string base;
+    bool index = false;
+    bool symbolic = false;
+    long long displacement = 0;
+    for (size_t i = 0; i < tokens.size(); ++i) {
+        const std::string& term = tokens[i];
+        if (term == "+" || term == "-" || term == "*") continue;
+        long long value;
+        if (parse_immediate(term, value)) {
+            if (i > 0 && tokens[i - 1] == "*") continue;   // scale
+            displacement += i > 0 && tokens[i - 1] == "-" ? -value : value;
+        } else if (register_index(term, GPR64) >= 0) {
+            rex |= needs_rex_register(term);
+            if (i + 1 < tokens.size() && tokens[i + 1] == "*") {
+                index = true;
+            } else if (base.empty()) {
+                base = term;
+            } else {
+                index = true;
+            }
+        } else {
+            symbolic = true;
+        }
+    }
+
+    size_t bytes = 0;
+    if (index || base == "rsp" || base == "r12") bytes += 1;
+    if (symbolic) {
+        bytes += 4;
+    } else if (displacement == 0) {
+        if (base == "rbp" || base == "r13") bytes += 1;
+    } else {
+        bytes += fits_int8(displacement) ? 1 : 4;
+    }
+    return bytes;
+}
+
+// Index of the previous instruction in the same straight-line code, or -1
+// when a label, directive or routine boundary comes first
+long previous_instruction(const std::vector<AsmLine>& lines, long i) {
+    for (long j = i - 1; j >= 0; --j) {
+        if (lines[j].routine != lines[i].routine) return -1;
+        if (is_label(lines[j].text) || is_directive(lines[j].text)) return -1;
+        if (is_instruction(lines[j].text)) return j;
+    }
+    return -1;
+}
+
+// Whether the flags an instruction at `i` would set are overwritten before
+// anything reads them
+bool flags_dead_after(const std::vector<AsmLine>& lines, size_t i) {
+    static const std::set<std::string> writers = {
+        "cmp", "test", "add", "sub", "and", "or", "xor", "imul", "idiv", "div", "neg", "andn"
+    };
+    for (size_t j = i + 1; j < lines.size() && lines[j].routine == lines[i].routine; ++j) {
+        if (is_label(lines[j].text) || is_directive(lines[j].text)) return false;
+        std::string mnemonic;
+        std::vector<std::string> operands;
+        if (!parse_instruction(lines[j].text, mnemonic, operands)) continue;
+        if (mnemonic.rfind("cmov", 0) == 0 || mnemonic.rfind("set", 0) == 0 ||
+            mnemonic == "adc" || mnemonic == "sbb" || mnemonic[0] == 'j') {
+            return false;
+        }
+        if (writers.count(mnemonic) || mnemonic == "call" || mnemonic == "ret") return true;
+    }
+    return false;
+}
+
+} // namespace
+
+SizeOptimizer::SizeOptimizer() : tail_labels(0), outlined_functions(0) {}
+
+void SizeOptimizer::record(const std::string& transform, long bytes) {
+    if (bytes <= 0) return;
+    for (auto& entry : savings) {
+        if (entry.first == transform) {
+            entry.second += bytes;
+            return;
+        }
+    }
+    savings.push_back({transform, bytes});
+}
+
+void SizeOptimizer::optimize(std::vector<AsmLine>& lines) {
+    strip_unused_runtime(lines);
+    shorten_encodings(lines);
+    merge_tails(lines);
+    outline_sequences(lines);
+}
+
+void SizeOptimizer::strip_unused_runtime(std::vector<AsmLine>& lines) {
+    std::set<std::string> routines;
+    for (const auto& line : lines) {
+        if (line.runtime) routines.insert(line.routine);
+    }
+
+    std::set<std::string> used;
+    std::vector<std::string> worklist;
+    auto scan = [&](const AsmLine& line) {
+        std::string mnemonic;
+        std::vector<std::string> operands;
+        if (!parse_instruction(line.text, mnemonic, operands)) return;
+        for (const auto& operand : operands) {
+            std::string word;
+            for (size_t i = 0; i <= operand.size(); ++i) {
+                char c = i < operand.size() ? operand[i] : ' ';
+                if (std::isalnum(static_cast<unsigned char>(c)) || c == '_' || c == '.') {
+                    word += c;
+                    continue;
+                }
+                if (routines.count(word) && used.insert(word).second) worklist.push_back(word);
+                word.clear();
+            }
+        }
+    };
+
+    // Routines reached from the program, then from those routines
+    for (const auto& line : lines) {
+        if (!line.runtime) scan(line);
+    }
+    while (!worklist.empty()) {
+        std::string routine = worklist.back();
+        worklist.pop_back();
+        for (const auto& line : lines) {
+            if (line.runtime && line.routine == routine) scan(line);
+        }
+    }
+
+    long saved = 0;
+    std::vector<AsmLine> kept;
+    kept.reserve(lines.size());
+    for (auto& line : lines) {
+        if (line.runtime && !used.count(line.routine)) {
+            saved += static_cast<long>(estimate_size(line.text));
+        } else {
+            kept.push_back(std::move(line));
+        }
+    }
+    lines.swap(kept);
+    record("unused runtime routines", saved);
+}
+
+void SizeOptimizer::shorten_encodings(std::vector<AsmLine>& lines) {
+    long saved = 0;
+    for (size_t i = 0; i < lines.size(); ++i) {
+        std::string mnemonic;
+        std::vector<std::string> operands;
+        if (!parse_instruction(lines[i].text, mnemonic, operands) || mnemonic != "mov" || operands.size() != 2) {
+            continue;
+        }
+        int reg = register_index(operands[0], GPR64);
+        long long value;
+        if (reg < 0 || operands[0] == "rsp" || !parse_immediate(operands[1], value)) continue;
+
+        // Writes to a 32-bit register zero the upper half
+        std::string narrow = GPR32[reg];
+        std::string replacement;
+        if (value == 0 && flags_dead_after(lines, i)) {
+            replacement = "    xor " + narrow + ", " + narrow;
+        } else if (value >= 0 && value <= 0xFFFFFFFFLL) {
+            replacement = "    mov " + narrow + ", " + operands[1];
+        } else {
+            continue;
+        }
+        saved += static_cast<long>(estimate_size(lines[i].text)) - static_cast<long>(estimate_size(replacement));
+        lines[i].text = replacement;
+    }
+    record("shorter encodings", saved);
+}
+
+void SizeOptimizer::merge_tails(std::vector<AsmLine>& lines) {
+    auto is_exit = [&](size_t i) {
+        std::string mnemonic;
+        std::vector<std::string> operands;
+        return parse_instruction(lines[i].text, mnemonic, operands) && (mnemonic == "ret" || mnemonic == "jmp");
+    };
+
+    long saved = 0;
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        std::vector<long> exits;
+        for (size_t i = 0; i < lines.size(); ++i) {
+            if (is_exit(i)) exits.push_back(static_cast<long>(i));
+        }
+
+        for (size_t k = 1; k < exits.size() && !changed; ++k) {
+            long dup = exits[k];
+
+            // Longest run of identical instructions before an earlier copy of the exit
+            long best_kept = -1;
+            long best_start = -1;
+            long best_bytes = 0;
+            std::vector<long> best_removed;
+            for (size_t j = 0; j < k; ++j) {
+                long kept = exits[j];
+                if (lines[kept].text != lines[dup].text || lines[kept].routine != lines[dup].routine) continue;
+                long bytes = 0;
+                long start = kept;
+                std::vector<long> removed;
+                long a = previous_instruction(lines, kept);
+                long b = previous_instruction(lines, dup);
+                while (a >= 0 && b > kept && lines[a].text == lines[b].text) {
+                    bytes += static_cast<long>(estimate_size(lines[b].text));
+                    removed.push_back(b);
+                    start = a;
+                    a = previous_instruction(lines, a);
+                    b = previous_instruction(lines, b);
+                }
+                if (bytes > best_bytes) {
+                    best_kept = kept;
+                    best_start = start;
+                    best_bytes = bytes;
+                    best_removed = removed;
+                }
+            }
+            if (best_kept < 0) continue;
+
+            // Jump to a label already heading the kept copy, or add one
+            std::string label;
+            long before = best_start - 1;
+            while (before >= 0 && !is_label(lines[before].text) && !is_instruction(lines[before].text) &&
+                   !is_directive(lines[before].text)) {
+                --before;
+            }
+            bool reuse = before >= 0 && is_label(lines[before].text) && lines[before].routine == lines[best_start].routine;
+            label = reuse ? lines[before].text.substr(0, lines[before].text.size() - 1)
+                          : ".Ltail" + std::to_string(tail_labels);
+
+            std::string jump = "    jmp " + label;
+            long gain = best_bytes + static_cast<long>(estimate_size(lines[dup].text)) -
+                        static_cast<long>(estimate_size(jump));
+            if (gain <= 0) continue;
+
+            lines[dup].text = jump;
+            for (long index : best_removed) {   // descending
+                lines.erase(lines.begin() + index);
+            }
+            if (!reuse) {
+                AsmLine head = lines[best_start];
+                head.text = label + ":";
+                lines.insert(lines.begin() + best_start, head);
+                ++tail_labels;
+            }
+            saved += gain;
+            changed = true;
+        }
+    }
+    record("tail merging", saved);
+}
+
+void SizeOptimizer::outline_sequences(std::vector<AsmLine>& lines) {
+    // The call pushes a return address, so sequences must not address the
+    // stack through rsp or change control flow
+    auto movable = [&](const AsmLine& line) {
+        std::string mnemonic;
+        std::vector<std::string> operands;
+        if (!line.outlinable || !parse_instruction(line.text, mnemonic, operands)) return false;
+        if (mnemonic[0] == 'j' || mnemonic == "call" || mnemonic == "ret" || mnemonic == "push" ||
+            mnemonic == "pop" || mnemonic == "syscall" || mnemonic == "leave") {
+            return false;
+        }
+        return line.text.find("rsp") == std::string::npos;
+    };
+
+    std::vector<AsmLine> helpers;
+    long saved = 0;
+    while (true) {
+        // Straight runs of movable instructions; comments do not break a run
+        std::vector<std::vector<size_t>> runs;
+        std::vector<size_t> run;
+        for (size_t i = 0; i < lines.size(); ++i) {
+            bool blank = !is_instruction(lines[i].text) && !is_label(lines[i].text) && !is_directive(lines[i].text);
+            if (blank && (run.empty() || lines[i].routine == lines[run.back()].routine)) continue;
+            if (movable(lines[i]) && (run.empty() || lines[i].routine == lines[run.back()].routine)) {
+                run.push_back(i);
+                continue;
+            }
+            if (run.size() >= 2) runs.push_back(run);
+            run.clear();
+            if (movable(lines[i])) run.push_back(i);
+        }
+        if (run.size() >= 2) runs.push_back(run);
+
+        // Most profitable repeated sequence, counting non-overlapping copies
+        long best_benefit = 0;
+        std::vector<std::pair<size_t, size_t>> best_copies;
+        size_t best_length = 0;
+        for (size_t length = 2; length <= MAX_OUTLINE_LENGTH; ++length) {
+            std::map<std::string, std::vector<std::pair<size_t, size_t>>> sequences;
+            for (size_t r = 0; r < runs.size(); ++r) {
+                for (size_t pos = 0; pos + length <= runs[r].size(); ++pos) {
+                    std::string key;
+                    for (size_t n = 0; n < length; ++n) key += trim(lines[runs[r][pos + n]].text) + "\n";
+                    sequences[key].push_back({r, pos});
+                }
+            }
+            for (const auto& sequence : sequences) {
+                std::vector<std::pair<size_t, size_t>> copies;
+                for (const auto& copy : sequence.second) {
+                    if (!copies.empty() && copies.back().first == copy.first &&
+                        copy.second < copies.back().second + length) {
+                        continue;
+                    }
+                    copies.push_back(copy);
+                }
+                if (copies.size() < 2) continue;
+
+                long bytes = 0;
+                for (size_t n = 0; n < length; ++n) {
+                    bytes += static_cast<long>(estimate_size(lines[runs[copies[0].first][copies[0].second + n]].text));
+                }
+                long count = static_cast<long>(copies.size());
+                long benefit = count * bytes - count * CALL_BYTES - (bytes + RET_BYTES);
+                if (benefit > best_benefit) {
+                    best_benefit = benefit;
+                    best_copies = copies;
+                    best_length = length;
+                }
+            }
+        }
+        if (best_benefit <= 0) break;
+
+        std::string name = "__cmmc_outlined_" + std::to_string(outlined_functions++);
+        const std::vector<size_t>& first = runs[best_copies[0].first];
+        helpers.push_back({name + ":", name, false, false});
+        for (size_t n = 0; n < best_length; ++n) {
+            helpers.push_back({lines[first[best_copies[0].second + n]].text, name, false, false});
+        }
+        helpers.push_back({"    ret", name, false, false});
+        helpers.push_back({"    ", name, false, false});
+
+        // Each copy becomes a call; comments between its instructions stay
+        std::vector<size_t> removed;
+        for (const auto& copy : best_copies) {
+            const std::vector<size_t>& copy_run = runs[copy.first];
+            lines[copy_run[copy.second]].text = "    call " + name;
+            for (size_t n = 1; n < best_length; ++n) removed.push_back(copy_run[copy.second + n]);
+        }
+        std::sort(removed.rbegin(), removed.rend());
+        for (size_t index : removed) {
+            lines.erase(lines.begin() + static_cast<long>(index));
+        }
+        saved += best_benefit;
+    }
+
+    lines.insert(lines.end(), helpers.begin(), helpers.end());
+    record("outlining", saved);
+}
+
+size_t SizeOptimizer::estimate_size(const std::string& line) {
+    std::string mnemonic;
+    std::vector<std::string> operands;
+    if (!parse_instruction(line, mnemonic, operands)) return 0;
+
+    if (mnemonic == "call") return 5;
+    if (mnemonic[0] == 'j') return 2;
+    if (operands.empty()) {
+        return mnemonic == "cqo" || mnemonic == "syscall" ? 2 : 1;
+    }
+    if (mnemonic == "push" || mnemonic == "pop") {
+        return needs_rex_register(operands[0]) ? 2 : 1;
+    }
+    if (mnemonic == "andn" || mnemonic == "shlx" || mnemonic == "sarx" || mnemonic == "shrx") {
+        return 5;   // three-byte VEX prefix, opcode and ModRM
+    }
+
+    // Opcode and ModRM, then prefix, SIB, displacement and immediate
+    size_t size = 2;
+    bool rex = false;
+    bool memory = false;
+    for (const auto& operand : operands) {
+        if (operand.find('[') != std::string::npos) {
+            memory = true;
+            size += memory_operand_bytes(operand, rex);
+            rex |= operand.find("qword") != std::string::npos;
+        } else {
+            rex |= register_index(operand, GPR64) >= 0 || needs_rex_register(operand);
+        }
+    }
+
+    long long value = 0;
+    bool immediate = operands.size() > 1 && parse_immediate(operands.back(), value);
+    if (mnemonic == "mov" && immediate && !memory) {
+        // B8+r takes no ModRM; 64-bit destinations sign-extend a 32-bit immediate
+        if (register_index(operands[0], GPR64) >= 0) {
+            return value >= -2147483648LL && value <= 2147483647LL ? 7 : 10;
+        }
+        return needs_rex_register(operands[0]) ? 6 : 5;
+    }
+    if (!immediate && (mnemonic == "movzx" || mnemonic == "imul" ||
+                       mnemonic.rfind("cmov", 0) == 0 || mnemonic.rfind("set", 0) == 0)) {
+        size += 1;   // 0F escape
+    }
+    if (immediate) {
+        bool byte_operand = operands[0].find("byte ptr") != std::string::npos;
+        size += mnemonic != "mov" && fits_int8(value) ? 1 : (byte_operand ? 1 : 4);
+    }
+    return size + (rex ? 1 : 0);
+}
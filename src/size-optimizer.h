@@ -0,0 +1,52 @@
+#pragma once
+
+#include <string>
+#include <utility>
+#include <vector>
+
+// One line of generated assembly, tagged with what the size passes need to know
+struct AsmLine {
+    std::string text;
+    std::string routine;        // function or runtime routine the line belongs to, empty outside
+    bool runtime = false;       // part of a runtime library routine
+    bool outlinable = false;    // may move into a called helper: nothing lives in the red zone here
+};
+
+// Machine-level passes for -Os, run on the assembly of the whole program
+// before it is written out. Savings are estimated from instruction encodings
+// (see estimate_size) and recorded per transform.
+class SizeOptimizer {
+private:
+    std::vector<std::pair<std::string, long>> savings;
+    int tail_labels;
+    int outlined_functions;
+
+    void record(const std::string& transform, long bytes);
+
+public:
+    SizeOptimizer();
+
+    // All passes, in order
+    void optimize(std::vector<AsmLine>& lines);
+
+    // Drop runtime routines nothing calls
+    void strip_unused_runtime(std::vector<AsmLine>& lines);
+
+    // Zero registers with xor and load small immediates through 32-bit moves
+    void shorten_encodings(std::vector<AsmLine>& lines);
+
+    // Cross-jumping: a return or jump preceded by the same instructions as
+    // another one in the routine jumps into that copy instead
+    void merge_tails(std::vector<AsmLine>& lines);
+
+    // Replace instruction sequences repeated across the program with calls
+    // to one shared copy
+    void outline_sequences(std::vector<AsmLine>& lines);
+
+    // Estimated bytes saved by each transform that changed something
+    const std::vector<std::pair<std::string, long>>& get_savings() const { return savings; }
+
+    // Encoded size of one line of Intel-syntax assembly; labels, comments and
+    // directives take none. Jumps are assumed to get the assembler's short form.
+    static size_t estimate_size(const std::string& line);
+};
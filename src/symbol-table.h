@@ -13,13 +13,29 @@ private:
     SymbolTable* parent;
     std::vector<std::unique_ptr<SymbolTable>> children;
     int scope_level;
+    
+    // Nearest enclosing scope that declares something. Lookups follow it,
+    // so blocks nested deep inside each other without declarations of
+    // their own do not make every lookup walk all of them.
+    SymbolTable* enclosing;
+    
+    // Descendants that skipped over empty scopes to `from` stop at `to`
+    // instead, once `to` gets its first symbol
+    void retarget(SymbolTable* from, SymbolTable* to) {
+        for (auto& child : children) {
+            if (child->enclosing != from) continue;
+            child->enclosing = to;
+            if (child->symbols.empty()) child->retarget(from, to);
+        }
+    }
 
 public:
     // Constructor for root scope
-    SymbolTable() : parent(nullptr), scope_level(0) {}
+    SymbolTable() : parent(nullptr), scope_level(0), enclosing(nullptr) {}
 
     // Constructor for child scope
-    SymbolTable(SymbolTable* p, int level) : parent(p), scope_level(level) {}
+    SymbolTable(SymbolTable* p, int level)
+        : parent(p), scope_level(level), enclosing(p && p->symbols.empty() ? p->enclosing : p) {}
 
     // Destructor
     ~SymbolTable() = default;
@@ -47,6 +63,7 @@ public:
         }
 
         // Add symbol to current scope
+        if (symbols.empty()) retarget(enclosing, this);
         symbols[name] = std::move(symbol);
         return true;
     }
@@ -59,9 +76,12 @@ public:
             return it->second.get();
         }
 
-        // If not found and has parent, search parent scope
-        if (parent != nullptr) {
-            return parent->lookup_symbol(name);
+        // If not found, search the enclosing scopes that declare anything
+        for (SymbolTable* scope = enclosing; scope != nullptr; scope = scope->enclosing) {
+            auto found = scope->symbols.find(name);
+            if (found != scope->symbols.end()) {
+                return found->second.get();
+            }
         }
 
         // Symbol not found
@@ -77,6 +97,11 @@ public:
         return nullptr;
     }
 
+    // Drop the scopes entered from this one; none may be current
+    void release_child_scopes() {
+        children.clear();
+    }
+
     // Get scope level
     int get_scope_level() const {
         return scope_level;
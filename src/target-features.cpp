@@ -0,0 +1,93 @@
+#include "target-features.h"
+#include <stdexcept>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#endif
+
+const char* feature_name(TargetFeature feature) {
+    static const char* const names[] = {
+        "cx16", "sahf", "popcnt", "sse3", "ssse3", "sse4.1", "sse4.2",
+        "avx", "avx2", "bmi", "bmi2", "f16c", "fma", "lzcnt", "movbe", "xsave"
+    };
+    return names[static_cast<unsigned>(feature)];
+}
+
+std::string TargetMachine::describe() const {
+    std::string text = name;
+    std::string list;
+    for (unsigned f = 0; f < static_cast<unsigned>(TargetFeature::COUNT); ++f) {
+        if (features & (1u << f)) {
+            list += std::string(list.empty() ? "" : " ") + "+" + feature_name(static_cast<TargetFeature>(f));
+        }
+    }
+    if (!list.empty()) text += " (" + list + ")";
+    return text;
+}
+
+TargetMachine select_target(const std::string& march) {
+    TargetMachine target;
+    target.name = march;
+    if (march == "x86-64") {
+        target.features = 0;
+    } else if (march == "x86-64-v2") {
+        target.features = X86_64_V2_FEATURES;
+    } else if (march == "x86-64-v3") {
+        target.features = X86_64_V3_FEATURES;
+    } else if (march == "native") {
+        target.features = detect_host_features();
+    } else {
+        throw std::runtime_error("unknown -march value '" + march +
+                                 "' (expected x86-64, x86-64-v2, x86-64-v3 or native)");
+    }
+    return target;
+}
+
+FeatureMask detect_host_features() {
+    FeatureMask features = 0;
+#if defined(__x86_64__) || defined(__i386__)
+    unsigned eax = 0, ebx = 0, ecx = 0, edx = 0;
+    auto set = [&features](bool present, TargetFeature feature) {
+        if (present) features |= feature_bit(feature);
+    };
+    
+    unsigned max_leaf = __get_cpuid_max(0, nullptr);
+    if (max_leaf >= 1 && __get_cpuid(1, &eax, &ebx, &ecx, &edx)) {
+        set(ecx & (1u << 0), TargetFeature::SSE3);
+        set(ecx & (1u << 9), TargetFeature::SSSE3);
+        set(ecx & (1u << 12), TargetFeature::FMA);
+        set(ecx & (1u << 13), TargetFeature::CMPXCHG16B);
+        set(ecx & (1u << 19), TargetFeature::SSE4_1);
+        set(ecx & (1u << 20), TargetFeature::SSE4_2);
+        set(ecx & (1u << 22), TargetFeature::MOVBE);
+        set(ecx & (1u << 23), TargetFeature::POPCNT);
+        set(ecx & (1u << 27), TargetFeature::OSXSAVE);
+        set(ecx & (1u << 28), TargetFeature::AVX);
+        set(ecx & (1u << 29), TargetFeature::F16C);
+    }
+    if (max_leaf >= 7) {
+        __cpuid_count(7, 0, eax, ebx, ecx, edx);
+        set(ebx & (1u << 3), TargetFeature::BMI1);
+        set(ebx & (1u << 5), TargetFeature::AVX2);
+        set(ebx & (1u << 8), TargetFeature::BMI2);
+    }
+    if (__get_cpuid_max(0x80000000u, nullptr) >= 0x80000001u &&
+        __get_cpuid(0x80000001u, &eax, &ebx, &ecx, &edx)) {
+        set(ecx & (1u << 0), TargetFeature::LAHF_SAHF);
+        set(ecx & (1u << 5), TargetFeature::LZCNT);
+    }
+    
+    // XCR0 bits 1 and 2: the OS saves SSE and AVX state on context switches
+    bool ymm_saved = false;
+    if (features & feature_bit(TargetFeature::OSXSAVE)) {
+        unsigned xcr0_low = 0, xcr0_high = 0;
+        __asm__ volatile("xgetbv" : "=a"(xcr0_low), "=d"(xcr0_high) : "c"(0));
+        ymm_saved = (xcr0_low & 0x6) == 0x6;
+    }
+    if (!ymm_saved) {
+        features &= ~(feature_bit(TargetFeature::AVX) | feature_bit(TargetFeature::AVX2) |
+                      feature_bit(TargetFeature::FMA) | feature_bit(TargetFeature::F16C));
+    }
+#endif
+    return features;
+}
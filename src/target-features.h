@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+// Instruction set extensions beyond baseline x86-64, grouped by the
+// psABI microarchitecture level that first requires them
+enum class TargetFeature : uint8_t {
+    // x86-64-v2
+    CMPXCHG16B = 0, LAHF_SAHF, POPCNT, SSE3, SSSE3, SSE4_1, SSE4_2,
+    // x86-64-v3
+    AVX, AVX2, BMI1, BMI2, F16C, FMA, LZCNT, MOVBE, OSXSAVE,
+    COUNT
+};
+
+// Feature sets are bitmasks indexed by TargetFeature
+using FeatureMask = uint32_t;
+
+constexpr FeatureMask feature_bit(TargetFeature feature) {
+    return 1u << static_cast<unsigned>(feature);
+}
+
+constexpr FeatureMask X86_64_V2_FEATURES =
+    feature_bit(TargetFeature::CMPXCHG16B) | feature_bit(TargetFeature::LAHF_SAHF) |
+    feature_bit(TargetFeature::POPCNT) | feature_bit(TargetFeature::SSE3) |
+    feature_bit(TargetFeature::SSSE3) | feature_bit(TargetFeature::SSE4_1) |
+    feature_bit(TargetFeature::SSE4_2);
+
+constexpr FeatureMask X86_64_V3_FEATURES = X86_64_V2_FEATURES |
+    feature_bit(TargetFeature::AVX) | feature_bit(TargetFeature::AVX2) |
+    feature_bit(TargetFeature::BMI1) | feature_bit(TargetFeature::BMI2) |
+    feature_bit(TargetFeature::F16C) | feature_bit(TargetFeature::FMA) |
+    feature_bit(TargetFeature::LZCNT) | feature_bit(TargetFeature::MOVBE) |
+    feature_bit(TargetFeature::OSXSAVE);
+
+// The machine selected with -march: instruction selection may use exactly
+// the features in the mask
+struct TargetMachine {
+    std::string name = "x86-64";
+    FeatureMask features = 0;
+    
+    bool has(TargetFeature feature) const { return (features & feature_bit(feature)) != 0; }
+    
+    // Name followed by the enabled features, e.g. "x86-64-v2 (+cx16 +popcnt ...)"
+    std::string describe() const;
+};
+
+// Lower-case name as used by compilers and /proc/cpuinfo
+const char* feature_name(TargetFeature feature);
+
+// Machine for -march=x86-64|x86-64-v2|x86-64-v3|native; throws on other names
+TargetMachine select_target(const std::string& march);
+
+// Features CPUID reports on the machine running the compiler; AVX and the
+// extensions using its registers count only when the OS saves the YMM state
+FeatureMask detect_host_features();
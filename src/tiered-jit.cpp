@@ -0,0 +1,293 @@
+#include "tiered-jit.h"
+#include "assembly-generator.h"
+#include "baseline-compiler.h"
+#include "ir-generator.h"
+#include "ir-optimizer.h"
+#include "advanced-optimizer.h"
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <sstream>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace {
+
+// Slots, stubs and every image must be within rel32 reach of each other,
+// and the runtime routines address their buffers with sign-extended 32-bit
+// absolutes, so the region sits below 2 GiB
+constexpr size_t ARENA_BYTES = size_t(1) << 29;
+constexpr uintptr_t ARENA_HINT = uintptr_t(1) << 28;
+constexpr uintptr_t ABSOLUTE_LIMIT = uintptr_t(1) << 31;
+
+void run_tool(const std::string& command) {
+    if (std::system(command.c_str()) != 0) {
+        throw std::runtime_error("command failed: " + command);
+    }
+}
+
+std::string hex(uintptr_t value) {
+    std::ostringstream out;
+    out << "0x" << std::hex << value;
+    return out.str();
+}
+
+bool touches(const IRInstruction& instr, const std::unordered_set<std::string>& names) {
+    return names.count(instr.result) || names.count(instr.arg1) || names.count(instr.arg2);
+}
+
+} // namespace
+
+TieredJit::TieredJit(Program& program, SemanticAnalyzer& analyzer)
+    : program(program), analyzer(analyzer), hot_threshold(DEFAULT_HOT_THRESHOLD), arena(nullptr),
+      arena_used(0), temp_counter(0), ir_ready(false), stop_requested(false) {
+    void* reserved = mmap(reinterpret_cast<void*>(ARENA_HINT), ARENA_BYTES, PROT_NONE,
+                          MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (reserved == MAP_FAILED) {
+        throw std::runtime_error("cannot reserve code memory: " + std::string(std::strerror(errno)));
+    }
+    if (reinterpret_cast<uintptr_t>(reserved) + ARENA_BYTES > ABSOLUTE_LIMIT) {
+        munmap(reserved, ARENA_BYTES);
+        throw std::runtime_error("cannot reserve code memory below 2 GiB");
+    }
+    arena = static_cast<unsigned char*>(reserved);
+}
+
+TieredJit::~TieredJit() {
+    if (tiering_thread.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(stop_mutex);
+            stop_requested = true;
+        }
+        stop_signal.notify_all();
+        tiering_thread.join();
+    }
+    munmap(arena, ARENA_BYTES);
+}
+
+void TieredJit::set_hot_threshold(uint64_t threshold) {
+    hot_threshold = threshold;
+}
+
+long TieredJit::run() {
+    BaselineCompiler compiler;
+    compiler.set_tiering(true);
+    std::string functions_assembly = compiler.compile(program);
+    const auto& names = compiler.get_functions();
+    if (std::find(names.begin(), names.end(), "main") == names.end()) {
+        throw std::runtime_error("program has no main function");
+    }
+
+    std::string assembly_file = temporary_path(".s");
+    {
+        AssemblyGenerator generator(assembly_file);
+        generator.generate_from_assembly(functions_assembly);
+        generator.close_output();
+    }
+    baseline = load(assembly_file, {});
+
+    functions.clear();
+    counters.clear();
+    for (const auto& name : names) {
+        FunctionTier function;
+        function.name = name;
+        functions.push_back(function);
+        Counters counter;
+        counter.calls = reinterpret_cast<const uint64_t*>(baseline.symbols.at(BaselineCompiler::calls_symbol(name)));
+        counter.back_edges =
+            reinterpret_cast<const uint64_t*>(baseline.symbols.at(BaselineCompiler::back_edges_symbol(name)));
+        counter.slot = reinterpret_cast<uint64_t*>(baseline.symbols.at(BaselineCompiler::slot_symbol(name)));
+        counters.push_back(counter);
+    }
+
+    stop_requested = false;
+    tiering_thread = std::thread(&TieredJit::tiering_loop, this);
+
+    // The program writes with raw syscalls, after anything still buffered
+    std::cout.flush();
+    std::fflush(stdout);
+    auto entry = reinterpret_cast<long (*)()>(baseline.symbols.at(BaselineCompiler::ENTRY_SYMBOL));
+    long result = entry();
+
+    {
+        std::lock_guard<std::mutex> lock(stop_mutex);
+        stop_requested = true;
+    }
+    stop_signal.notify_all();
+    tiering_thread.join();
+
+    for (size_t i = 0; i < functions.size(); ++i) {
+        functions[i].calls = *counters[i].calls;
+        functions[i].back_edges = *counters[i].back_edges;
+    }
+    return result;
+}
+
+TieredJit::Image TieredJit::load(const std::string& assembly_file,
+                                 const std::vector<std::pair<std::string, uintptr_t>>& definitions) {
+    Image image;
+    image.base = reinterpret_cast<uintptr_t>(arena + arena_used);
+
+    // -N keeps text and data in one unaligned run starting at the base
+    std::string object_file = temporary_path(".o");
+    std::string linked_file = temporary_path(".elf");
+    std::string symbol_file = temporary_path(".sym");
+    std::string binary_file = temporary_path(".bin");
+    std::string link = "ld -N --no-warn-rwx-segments -Ttext=" + hex(image.base);
+    for (const auto& definition : definitions) {
+        link += " --defsym " + definition.first + "=" + hex(definition.second);
+    }
+    try {
+        run_tool("as -64 " + assembly_file + " -o " + object_file);
+        run_tool(link + " " + object_file + " -o " + linked_file);
+        run_tool("nm -P " + linked_file + " > " + symbol_file);
+        run_tool("objcopy -O binary -j .text -j .data " + linked_file + " " + binary_file);
+    } catch (...) {
+        for (const auto& file : {assembly_file, object_file, linked_file, symbol_file, binary_file}) {
+            std::filesystem::remove(file);
+        }
+        throw;
+    }
+
+    std::ifstream symbols(symbol_file);
+    std::string line;
+    while (std::getline(symbols, line)) {
+        std::istringstream fields(line);
+        std::string name, type, value;
+        if (fields >> name >> type >> value && type != "U") {
+            image.symbols[name] = std::stoull(value, nullptr, 16);
+        }
+    }
+    std::ifstream binary(binary_file, std::ios::binary);
+    std::vector<char> bytes((std::istreambuf_iterator<char>(binary)), std::istreambuf_iterator<char>());
+    for (const auto& file : {assembly_file, object_file, linked_file, symbol_file, binary_file}) {
+        std::filesystem::remove(file);
+    }
+
+    // .bss follows the copied bytes; fresh pages are already zero
+    auto end = image.symbols.find("_end");
+    size_t span = end != image.symbols.end() ? end->second - image.base : bytes.size();
+    size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    span = std::max(span, bytes.size());
+    span = (span + page - 1) / page * page;
+    if (span > ARENA_BYTES - arena_used) {
+        throw std::runtime_error("out of code memory");
+    }
+    // Images hold both code and the counters and slots written while it runs
+    if (mprotect(arena + arena_used, span, PROT_READ | PROT_WRITE | PROT_EXEC) != 0) {
+        throw std::runtime_error("cannot map code: " + std::string(std::strerror(errno)));
+    }
+    std::memcpy(arena + arena_used, bytes.data(), bytes.size());
+    arena_used += span;
+    return image;
+}
+
+void TieredJit::tiering_loop() {
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(stop_mutex);
+            if (stop_signal.wait_for(lock, std::chrono::milliseconds(1), [this] { return stop_requested; })) {
+                return;
+            }
+        }
+        for (size_t i = 0; i < functions.size(); ++i) {
+            if (functions[i].tier != Tier::Baseline) continue;
+            uint64_t heat = __atomic_load_n(counters[i].calls, __ATOMIC_RELAXED) +
+                            __atomic_load_n(counters[i].back_edges, __ATOMIC_RELAXED);
+            if (heat < hot_threshold) continue;
+            try {
+                optimize_function(i);
+            } catch (const std::exception& e) {
+                functions[i].tier = Tier::Ineligible;
+                functions[i].reason = e.what();
+            }
+        }
+    }
+}
+
+void TieredJit::optimize_function(size_t index) {
+    FunctionTier& function = functions[index];
+    auto start = std::chrono::steady_clock::now();
+
+    if (!ir_ready) {
+        IRGenerator generator(&analyzer);
+        program_ir = generator.generate(program);
+        global_variables = generator.get_global_variables();
+        ir_ready = true;
+    }
+
+    // The function alone; its calls reach the other functions through stubs
+    auto begin = std::find_if(program_ir.begin(), program_ir.end(), [&](const IRInstruction& instr) {
+        return instr.op == OpCode::FUNCTION_BEGIN && instr.result == function.name;
+    });
+    auto finish = std::find_if(begin, program_ir.end(),
+                               [](const IRInstruction& instr) { return instr.op == OpCode::FUNCTION_END; });
+    if (begin == program_ir.end() || finish == program_ir.end()) {
+        throw std::runtime_error("no IR for the function");
+    }
+    IRCode code(begin, finish + 1);
+
+    // The IR pipeline keeps neither globals nor local arrays in memory
+    for (const auto& instr : code) {
+        if (instr.op == OpCode::ARRAY_ACCESS || instr.op == OpCode::ARRAY_ASSIGN) {
+            function.tier = Tier::Ineligible;
+            function.reason = "uses arrays";
+            return;
+        }
+        if (touches(instr, global_variables)) {
+            function.tier = Tier::Ineligible;
+            function.reason = "uses global variables";
+            return;
+        }
+    }
+
+    IROptimizer local;
+    local.set_global_variables(global_variables);
+    code = local.optimize(code);
+    AdvancedOptimizer advanced;
+    advanced.apply_dataflow_optimizations(code);
+    advanced.apply_aggressive_optimizations(code);
+
+    std::string assembly_file = temporary_path(".s");
+    {
+        AssemblyGenerator generator(assembly_file);
+        generator.set_register_assignment(advanced.get_register_assignment());
+        generator.set_omit_frame_pointer(true);
+        generator.set_shrink_wrap(true);
+        generator.set_block_layout(true);
+        generator.generate_from_ir(code);
+        generator.close_output();
+    }
+
+    std::vector<std::pair<std::string, uintptr_t>> definitions;
+    for (const auto& other : functions) {
+        if (other.name != function.name) {
+            definitions.push_back({other.name, baseline.symbols.at(BaselineCompiler::stub_symbol(other.name))});
+        }
+    }
+    Image image = load(assembly_file, definitions);
+
+    // Once the program has returned the new code can never run, so it is
+    // dropped and the function reports the tier it actually ran at
+    std::lock_guard<std::mutex> lock(stop_mutex);
+    if (stop_requested) return;
+    // An aligned 8-byte store: callers see either the old or the new code
+    __atomic_store_n(counters[index].slot, static_cast<uint64_t>(image.symbols.at(function.name)), __ATOMIC_RELEASE);
+    function.tier = Tier::Optimized;
+    function.compile_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+std::string TieredJit::temporary_path(const std::string& suffix) {
+    std::ostringstream name;
+    name << "cmmc-jit-" << getpid() << "-" << std::hex << reinterpret_cast<uintptr_t>(this) << std::dec << "-"
+         << temp_counter++ << suffix;
+    return (std::filesystem::temp_directory_path() / name.str()).string();
+}
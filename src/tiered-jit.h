@@ -0,0 +1,101 @@
+#pragma once
+
+#include "ast.h"
+#include "ir-types.h"
+#include "semantic-analyzer.h"
+#include <condition_variable>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+// In-process execution with two tiers. The whole program is first compiled
+// by BaselineCompiler with tiering hooks; a background thread polls each
+// function's call and back-edge counters and, once their sum reaches the hot
+// threshold, compiles that function alone through the -O3 pipeline and
+// stores the new code's address in its dispatch slot. Calls made after that
+// run the optimized code; an activation already running stays in the
+// baseline code (there is no on-stack replacement).
+//
+// Code is assembled and linked with as and ld at a fixed address inside one
+// reserved region, so slots, stubs and images stay within rel32 reach.
+class TieredJit {
+public:
+    enum class Tier {
+        Baseline,
+        Optimized,
+        Ineligible   // stays in the baseline; `reason` says why
+    };
+
+    struct FunctionTier {
+        std::string name;
+        uint64_t calls = 0;
+        uint64_t back_edges = 0;
+        Tier tier = Tier::Baseline;
+        std::string reason;
+        double compile_seconds = 0.0;   // -O3 compile, assemble and load
+    };
+
+    static constexpr uint64_t DEFAULT_HOT_THRESHOLD = 10000;
+
+    TieredJit(Program& program, SemanticAnalyzer& analyzer);
+    ~TieredJit();
+
+    TieredJit(const TieredJit&) = delete;
+    TieredJit& operator=(const TieredJit&) = delete;
+
+    // Calls plus back edges after which a function is recompiled
+    void set_hot_threshold(uint64_t threshold);
+
+    // Compile the baseline, run main and return its value; throws
+    // std::runtime_error when code cannot be built or loaded
+    long run();
+
+    // Counters and tiers as run() left them, in declaration order
+    const std::vector<FunctionTier>& get_functions() const { return functions; }
+
+private:
+    struct Image {
+        uintptr_t base = 0;
+        std::map<std::string, uintptr_t> symbols;
+    };
+
+    struct Counters {
+        const uint64_t* calls = nullptr;
+        const uint64_t* back_edges = nullptr;
+        uint64_t* slot = nullptr;
+    };
+
+    Program& program;
+    SemanticAnalyzer& analyzer;
+    uint64_t hot_threshold;
+
+    // Reserved address range; images are placed one after another
+    unsigned char* arena;
+    size_t arena_used;
+    int temp_counter;
+
+    Image baseline;
+    std::vector<FunctionTier> functions;
+    std::vector<Counters> counters;
+
+    // -O3 input, generated on the tiering thread when first needed
+    IRCode program_ir;
+    std::unordered_set<std::string> global_variables;
+    bool ir_ready;
+
+    std::thread tiering_thread;
+    std::mutex stop_mutex;
+    std::condition_variable stop_signal;
+    bool stop_requested;
+
+    // Assemble and link `assembly_file` (removed afterwards) at the next free
+    // address, defining each of `definitions`, and copy it into place
+    Image load(const std::string& assembly_file, const std::vector<std::pair<std::string, uintptr_t>>& definitions);
+    void tiering_loop();
+    void optimize_function(size_t index);
+    std::string temporary_path(const std::string& suffix);
+};
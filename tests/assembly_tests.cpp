@@ -3,9 +3,12 @@
 #include "parser.h"
 #include "lexer.h"
 #include "semantic-analyzer.h"
+#include "baseline-compiler.h"
 #include <gtest/gtest.h>
 #include <fstream>
+#include <sstream>
 #include <filesystem>
+#include <algorithm>
 
 class AssemblyTest : public ::testing::Test {
 protected:
@@ -150,6 +153,599 @@ TEST_F(AssemblyTest, ControlFlow) {
     EXPECT_TRUE(found_jump);
 }
 
+TEST_F(AssemblyTest, SavesLiveCallerSavedRegistersAroundCalls) {
+    IRCode ir = {
+        IRInstruction(OpCode::FUNCTION_BEGIN, "main"),
+        IRInstruction(OpCode::CALL, "a", "input", "0"),
+        IRInstruction(OpCode::CALL, "b", "input", "0"),
+        IRInstruction(OpCode::ADD, "c", "a", "b"),
+        IRInstruction(OpCode::RETURN, "", "c"),
+        IRInstruction(OpCode::FUNCTION_END, "main"),
+    };
+
+    GraphColoringAllocator allocator(reg_bit(PhysReg::RSI) | reg_bit(PhysReg::RDI));
+    AssemblyGenerator asm_generator("test_output/call_saves.s");
+    asm_generator.set_register_assignment(allocator.allocate(ir));
+    asm_generator.generate_from_ir(ir);
+    asm_generator.close_output();
+
+    std::ifstream asm_file("test_output/call_saves.s");
+    std::vector<std::string> lines;
+    std::string line;
+    bool in_main = false;
+    while (std::getline(asm_file, line)) {
+        if (line == "main:") in_main = true;
+        if (in_main && line.find('#') == std::string::npos) lines.push_back(line);
+    }
+
+    // a lives in rsi across the second call only: one save, one restore
+    int calls = 0, saves = 0, restores = 0;
+    for (const auto& l : lines) {
+        if (l.find("call input") != std::string::npos) ++calls;
+        if (l.find("mov [rbp") != std::string::npos && l.find("rsi") != std::string::npos) {
+            EXPECT_EQ(calls, 1);
+            ++saves;
+        }
+        if (l.find("mov rsi, [rbp") != std::string::npos) {
+            EXPECT_EQ(calls, 2);
+            ++restores;
+        }
+        // No callee-saved register is assigned, so none is pushed
+        EXPECT_EQ(l.find("push rbx"), std::string::npos);
+    }
+    EXPECT_EQ(calls, 2);
+    EXPECT_EQ(saves, 1);
+    EXPECT_EQ(restores, 1);
+}
+
+TEST_F(AssemblyTest, OmitsFrameForLeafFunctions) {
+    IRCode ir = {
+        IRInstruction(OpCode::FUNCTION_BEGIN, "add"),
+        IRInstruction(OpCode::LOAD_PARAM, "a", "0"),
+        IRInstruction(OpCode::LOAD_PARAM, "b", "1"),
+        IRInstruction(OpCode::ADD, "c", "a", "b"),
+        IRInstruction(OpCode::RETURN, "", "c"),
+        IRInstruction(OpCode::FUNCTION_END, "add"),
+    };
+
+    auto function_lines = [&ir](const std::string& path, bool omit) {
+        AssemblyGenerator asm_generator(path);
+        asm_generator.set_omit_frame_pointer(omit);
+        asm_generator.generate_from_ir(ir);
+        asm_generator.close_output();
+
+        std::ifstream asm_file(path);
+        std::string text, line;
+        bool in_add = false;
+        while (std::getline(asm_file, line)) {
+            if (line == "add:") in_add = true;
+            if (in_add && line.find('#') == std::string::npos) text += line + "\n";
+            if (in_add && line == "    ret") break;
+        }
+        return text;
+    };
+
+    // Arguments are read above the return address, c lives in the red zone
+    std::string omitted = function_lines("test_output/leaf_fpo.s", true);
+    EXPECT_EQ(omitted.find("rbp"), std::string::npos);
+    EXPECT_EQ(omitted.find("sub rsp"), std::string::npos);
+    EXPECT_NE(omitted.find("[rsp + 8]"), std::string::npos);
+    EXPECT_NE(omitted.find("[rsp + 16]"), std::string::npos);
+    EXPECT_NE(omitted.find("[rsp - 8]"), std::string::npos);
+
+    std::string kept = function_lines("test_output/leaf_fp.s", false);
+    EXPECT_NE(kept.find("push rbp"), std::string::npos);
+    EXPECT_NE(kept.find("[rbp + 16]"), std::string::npos);
+    EXPECT_NE(kept.find("[rbp + 24]"), std::string::npos);
+}
+
+TEST_F(AssemblyTest, ShrinkWrapsEarlyReturnPath) {
+    // if (n < 2) return n; return f(n - 1) + n;
+    IRCode ir = {
+        IRInstruction(OpCode::FUNCTION_BEGIN, "f"),
+        IRInstruction(OpCode::LOAD_PARAM, "n", "0"),
+        IRInstruction(OpCode::LT, "t0", "n", "2"),
+        IRInstruction(OpCode::IF_FALSE, "L0", "t0"),
+        IRInstruction(OpCode::RETURN, "", "n"),
+        IRInstruction(OpCode::LABEL, "L0"),
+        IRInstruction(OpCode::SUB, "t1", "n", "1"),
+        IRInstruction(OpCode::PARAM, "", "t1"),
+        IRInstruction(OpCode::CALL, "t2", "f", "1"),
+        IRInstruction(OpCode::ADD, "t3", "t2", "n"),
+        IRInstruction(OpCode::RETURN, "", "t3"),
+        IRInstruction(OpCode::FUNCTION_END, "f"),
+    };
+
+    AssemblyGenerator asm_generator("test_output/shrink_wrap.s");
+    asm_generator.set_omit_frame_pointer(true);
+    asm_generator.set_shrink_wrap(true);
+    asm_generator.generate_from_ir(ir);
+    asm_generator.close_output();
+
+    std::ifstream asm_file("test_output/shrink_wrap.s");
+    std::vector<std::string> lines;
+    std::string line;
+    bool in_f = false;
+    while (std::getline(asm_file, line)) {
+        if (line == "f:") in_f = true;
+        if (in_f && line.find('#') == std::string::npos) lines.push_back(line);
+    }
+
+    // The frame is set up after L0 and torn down only on that path
+    int label = -1, setup = -1, first_ret = -1, teardowns = 0;
+    for (int i = 0; i < static_cast<int>(lines.size()); ++i) {
+        if (lines[i] == "L0:") label = i;
+        if (lines[i].find("sub rsp") != std::string::npos && setup < 0) setup = i;
+        if (lines[i] == "    ret" && first_ret < 0) first_ret = i;
+        if (lines[i].find("add rsp, 40") != std::string::npos) ++teardowns;
+    }
+    ASSERT_GE(label, 0);
+    EXPECT_LT(first_ret, label);
+    EXPECT_EQ(setup, label + 1);
+    EXPECT_EQ(teardowns, 1);
+
+    // n is read from its incoming slot both before and after the frame exists
+    EXPECT_EQ(lines[1], "    mov rcx, [rsp + 8]");
+}
+
+TEST_F(AssemblyTest, LowersSelectToConditionalMove) {
+    IRCode ir = {
+        IRInstruction(OpCode::FUNCTION_BEGIN, "main"),
+        IRInstruction(OpCode::CALL, "a", "input", "0"),
+        IRInstruction(OpCode::ASSIGN, "m", "5"),
+        IRInstruction(OpCode::GT, "c", "a", "5"),
+        IRInstruction(OpCode::SELECT, "m", "c", "a"),
+        IRInstruction(OpCode::RETURN, "", "m"),
+        IRInstruction(OpCode::FUNCTION_END, "main"),
+    };
+
+    AssemblyGenerator asm_generator("test_output/select.s");
+    asm_generator.generate_from_ir(ir);
+    asm_generator.close_output();
+
+    std::ifstream asm_file("test_output/select.s");
+    std::string line;
+    bool found_cmov = false;
+    bool found_jump = false;
+    bool in_main = false;
+    while (std::getline(asm_file, line)) {
+        if (line == "main:") in_main = true;
+        if (!in_main || line.find('#') != std::string::npos) continue;
+        if (line.find("cmovnz") != std::string::npos) found_cmov = true;
+        if (line.find("    j") == 0) found_jump = true;
+    }
+    EXPECT_TRUE(found_cmov);
+    EXPECT_FALSE(found_jump);
+}
+
+TEST_F(AssemblyTest, LowersBitwiseOpsForTarget) {
+    IRCode ir = {
+        IRInstruction(OpCode::FUNCTION_BEGIN, "main"),
+        IRInstruction(OpCode::CALL, "a", "input", "0"),
+        IRInstruction(OpCode::CALL, "b", "input", "0"),
+        IRInstruction(OpCode::SHL, "s", "a", "b"),
+        IRInstruction(OpCode::BIT_NOT, "n", "b"),
+        IRInstruction(OpCode::BIT_AND, "m", "s", "n"),
+        IRInstruction(OpCode::DIV, "q", "m", "8"),
+        IRInstruction(OpCode::ADD, "r", "q", "b"),
+        IRInstruction(OpCode::RETURN, "", "r"),
+        IRInstruction(OpCode::FUNCTION_END, "main"),
+    };
+
+    auto main_body = [&](const std::string& march) {
+        std::string path = "test_output/bitwise-" + march + ".s";
+        AssemblyGenerator asm_generator(path);
+        asm_generator.set_target(select_target(march));
+        asm_generator.generate_from_ir(ir);
+        asm_generator.close_output();
+
+        std::ifstream asm_file(path);
+        std::string line;
+        std::string body;
+        bool in_main = false;
+        while (std::getline(asm_file, line)) {
+            if (line == "main:") in_main = true;
+            if (in_main && line.find('#') == std::string::npos) body += line + "\n";
+        }
+        return body;
+    };
+
+    // Variable shift counts go through cl unless BMI2 is available
+    std::string baseline = main_body("x86-64");
+    EXPECT_NE(baseline.find("shl rdx, cl"), std::string::npos);
+    EXPECT_NE(baseline.find("not "), std::string::npos);
+    EXPECT_EQ(baseline.find("andn"), std::string::npos);
+    EXPECT_EQ(baseline.find("idiv"), std::string::npos);
+    EXPECT_NE(baseline.find("sar "), std::string::npos);
+
+    std::string v3 = main_body("x86-64-v3");
+    EXPECT_NE(v3.find("shlx"), std::string::npos);
+    EXPECT_NE(v3.find("andn"), std::string::npos);
+    EXPECT_EQ(v3.find("not "), std::string::npos);
+}
+
+TEST_F(AssemblyTest, EmitsSourceLineDirectives) {
+    std::string source = "int main(void) {\n"
+                         "    int x;\n"
+                         "    x = input();\n"
+                         "    while (x > 0)\n"
+                         "        x = x - 3;\n"
+                         "    return x;\n"
+                         "}\n";
+
+    auto [program, analyzer] = parseAndAnalyze(source);
+    ASSERT_TRUE(program != nullptr);
+
+    IRGenerator ir_generator(analyzer.get());
+    auto ir = ir_generator.generate(*program);
+
+    // Every instruction carries the line of its statement; the loop test
+    // repeated at the bottom belongs to the while
+    for (const auto& instr : ir) {
+        if (instr.op == OpCode::SUB) {
+            EXPECT_EQ(instr.line_number, 5);
+        }
+        if (instr.op == OpCode::GT) {
+            EXPECT_EQ(instr.line_number, 4);
+        }
+        if (instr.op == OpCode::RETURN) {
+            EXPECT_EQ(instr.line_number, 6);
+        }
+    }
+
+    AssemblyGenerator asm_generator("test_output/lines.s");
+    asm_generator.set_debug_source("lines.cm");
+    asm_generator.generate_from_ir(ir);
+    asm_generator.close_output();
+
+    std::ifstream asm_file("test_output/lines.s");
+    std::string line;
+    std::vector<std::string> locs;
+    bool found_file = false;
+    while (std::getline(asm_file, line)) {
+        if (line == "    .file 1 \"lines.cm\"") found_file = true;
+        if (line.find(".loc 1 ") != std::string::npos) locs.push_back(line.substr(line.find(".loc")));
+    }
+    EXPECT_TRUE(found_file);
+    std::vector<std::string> expected = {".loc 1 1", ".loc 1 3", ".loc 1 4", ".loc 1 5", ".loc 1 4", ".loc 1 6"};
+    EXPECT_EQ(locs, expected);
+}
+
+TEST_F(AssemblyTest, InstrumentsFunctionsWithTimers) {
+    IRCode ir = {
+        IRInstruction(OpCode::FUNCTION_BEGIN, "pick"),
+        IRInstruction(OpCode::LOAD_PARAM, "x", "0"),
+        IRInstruction(OpCode::IF_TRUE, "L0", "x"),
+        IRInstruction(OpCode::RETURN, "", "1"),
+        IRInstruction(OpCode::LABEL, "L0"),
+        IRInstruction(OpCode::RETURN, "", "2"),
+        IRInstruction(OpCode::FUNCTION_END, "pick"),
+        IRInstruction(OpCode::FUNCTION_BEGIN, "main"),
+        IRInstruction(OpCode::PARAM, "", "0"),
+        IRInstruction(OpCode::CALL, "r", "pick", "1"),
+        IRInstruction(OpCode::RETURN, "", "r"),
+        IRInstruction(OpCode::FUNCTION_END, "main"),
+    };
+
+    AssemblyGenerator asm_generator("test_output/timers.s");
+    asm_generator.set_instrument_functions(true);
+    asm_generator.generate_from_ir(ir);
+    asm_generator.close_output();
+
+    std::ifstream asm_file("test_output/timers.s");
+    std::string line;
+    int rdtsc = 0;
+    int row_updates = 0;
+    bool reports = false;
+    while (std::getline(asm_file, line)) {
+        if (line == "    rdtsc") ++rdtsc;
+        if (line.find("[rip + __cmmc_timer_table + 32") != std::string::npos) ++row_updates;
+        if (line == "    call __cmmc_timer_report") reports = true;
+    }
+    // One entry hook per function and one exit hook per ret, including the
+    // implicit ones at FUNCTION_END; main's row is updated on entry and exit
+    EXPECT_EQ(rdtsc, 2 + 5);
+    EXPECT_EQ(row_updates, 1 + 2 * 2);
+    EXPECT_TRUE(reports);
+}
+
+TEST_F(AssemblyTest, AlignsLoopHeaders) {
+    IRCode ir = {
+        IRInstruction(OpCode::FUNCTION_BEGIN, "main"),
+        IRInstruction(OpCode::ASSIGN, "i", "0"),
+        IRInstruction(OpCode::LABEL, "L0"),
+        IRInstruction(OpCode::ADD, "i", "i", "1"),
+        IRInstruction(OpCode::LT, "t0", "i", "10"),
+        IRInstruction(OpCode::IF_TRUE, "L0", "t0"),
+        IRInstruction(OpCode::IF_FALSE, "L1", "t0"),
+        IRInstruction(OpCode::LABEL, "L1"),
+        IRInstruction(OpCode::RETURN, "", "i"),
+        IRInstruction(OpCode::FUNCTION_END, "main"),
+    };
+
+    AssemblyGenerator asm_generator("test_output/loop_align.s");
+    asm_generator.generate_from_ir(ir);
+    asm_generator.close_output();
+
+    std::ifstream asm_file("test_output/loop_align.s");
+    std::string line, previous;
+    bool header_aligned = false, exit_aligned = false;
+    while (std::getline(asm_file, line)) {
+        bool aligned = previous.find(".p2align") != std::string::npos;
+        if (line == "L0:") header_aligned = aligned;
+        if (line == "L1:") exit_aligned = aligned;
+        previous = line;
+    }
+    // Only targets of backward branches are padded
+    EXPECT_TRUE(header_aligned);
+    EXPECT_FALSE(exit_aligned);
+}
+
+TEST_F(AssemblyTest, LaysOutBlocksAndSplitsColdCode) {
+    // fail() never returns; main loops, bails out on a bad value and
+    // returns early on zero
+    IRCode ir = {
+        IRInstruction(OpCode::FUNCTION_BEGIN, "fail"),
+        IRInstruction(OpCode::LABEL, "L9"),
+        IRInstruction(OpCode::GOTO, "L9"),
+        IRInstruction(OpCode::FUNCTION_END, "fail"),
+        IRInstruction(OpCode::FUNCTION_BEGIN, "main"),
+        IRInstruction(OpCode::ASSIGN, "i", "0"),
+        IRInstruction(OpCode::LABEL, "L0"),
+        IRInstruction(OpCode::CALL, "x", "input", "0"),
+        IRInstruction(OpCode::LT, "t0", "x", "0"),
+        IRInstruction(OpCode::IF_FALSE, "L1", "t0"),
+        IRInstruction(OpCode::CALL, "t1", "fail", "0"),
+        IRInstruction(OpCode::LABEL, "L1"),
+        IRInstruction(OpCode::IF_TRUE, "L2", "x"),
+        IRInstruction(OpCode::RETURN, "", "i"),
+        IRInstruction(OpCode::LABEL, "L2"),
+        IRInstruction(OpCode::ADD, "i", "i", "x"),
+        IRInstruction(OpCode::LT, "t2", "i", "100"),
+        IRInstruction(OpCode::IF_TRUE, "L0", "t2"),
+        IRInstruction(OpCode::RETURN, "", "i"),
+        IRInstruction(OpCode::FUNCTION_END, "main"),
+    };
+
+    AssemblyGenerator asm_generator("test_output/block_layout.s");
+    asm_generator.set_block_layout(true);
+    asm_generator.generate_from_ir(ir);
+    asm_generator.close_output();
+
+    std::ifstream asm_file("test_output/block_layout.s");
+    std::vector<std::string> lines;
+    std::string line;
+    bool in_main = false;
+    while (std::getline(asm_file, line)) {
+        if (line == "main:") in_main = true;
+        if (in_main && line.find('#') == std::string::npos) lines.push_back(line);
+    }
+    auto find = [&lines](const std::string& text) {
+        for (int i = 0; i < static_cast<int>(lines.size()); ++i) {
+            if (lines[i].find(text) != std::string::npos) return i;
+        }
+        return -1;
+    };
+
+    // The call to fail() sits in the cold section, after the hot code
+    int cold = find(".text.unlikely");
+    int call_fail = find("call fail");
+    ASSERT_GE(cold, 0);
+    EXPECT_GT(call_fail, cold);
+
+    // The loop body follows its test, with the early return moved behind it;
+    // the i < 100 test branches on the flags of its cmp
+    int body = find("L2:");
+    int loop_branch = find("jl L0");
+    int early_return = find("jz L2");
+    ASSERT_GE(body, 0);
+    EXPECT_LT(early_return, 0);
+    EXPECT_LT(body, cold);
+    EXPECT_GT(loop_branch, body);
+}
+
+TEST_F(AssemblyTest, BaselineCompilesStraightFromAst) {
+    std::string source = "int g;\n"
+                         "int sum(int n) {\n"
+                         "    int i; int s;\n"
+                         "    i = 0; s = 0;\n"
+                         "    while (i < n) { s = s + i * 3; i = i + 1; }\n"
+                         "    return s;\n"
+                         "}\n"
+                         "int main(void) {\n"
+                         "    g = sum(4);\n"
+                         "    if (g > 10 && g < 100) g = g + 1;\n"
+                         "    return g / 3;\n"
+                         "}\n";
+
+    auto [program, analyzer] = parseAndAnalyze(source);
+    ASSERT_TRUE(program != nullptr);
+
+    BaselineCompiler baseline;
+    baseline.set_debug_lines(true);
+    AssemblyGenerator asm_generator("test_output/baseline.s");
+    asm_generator.set_debug_source("baseline.cm");
+    asm_generator.generate_from_assembly(baseline.compile(*program));
+    asm_generator.close_output();
+
+    std::ifstream asm_file("test_output/baseline.s");
+    std::stringstream buffer;
+    buffer << asm_file.rdbuf();
+    std::string assembly = buffer.str();
+
+    // Runtime routines from the generator, functions from the AST walk
+    EXPECT_NE(assembly.find("_start:"), std::string::npos);
+    EXPECT_NE(assembly.find("output:"), std::string::npos);
+    EXPECT_NE(assembly.find("sum:\n    push rbp\n    mov rbp, rsp\n    sub rsp, 16\n"), std::string::npos);
+    EXPECT_NE(assembly.find("main:\n    push rbp\n    mov rbp, rsp\n"), std::string::npos);
+
+    // Parameters come from the caller's pushes, globals from .bss
+    EXPECT_NE(assembly.find("cmp rax, qword ptr [rbp + 16]"), std::string::npos);
+    EXPECT_NE(assembly.find("push 4\n    call sum\n    add rsp, 8\n"), std::string::npos);
+    EXPECT_NE(assembly.find("mov qword ptr [rip + __cmmc_global_g], rax"), std::string::npos);
+    EXPECT_NE(assembly.find("__cmmc_global_g: .zero 8"), std::string::npos);
+    EXPECT_NE(assembly.find("cqo\n    idiv rcx"), std::string::npos);
+    EXPECT_NE(assembly.find(".loc 1 9"), std::string::npos);
+
+    // Nothing went through the IR
+    EXPECT_EQ(assembly.find("# IR"), std::string::npos);
+    EXPECT_EQ(assembly.find("\nL0:"), std::string::npos);
+}
+
+TEST(TargetFeaturesTest, SelectsMarchLevels) {
+    TargetMachine baseline = select_target("x86-64");
+    EXPECT_EQ(baseline.features, 0u);
+    EXPECT_EQ(baseline.describe(), "x86-64");
+
+    TargetMachine v2 = select_target("x86-64-v2");
+    EXPECT_TRUE(v2.has(TargetFeature::POPCNT));
+    EXPECT_TRUE(v2.has(TargetFeature::SSE4_2));
+    EXPECT_FALSE(v2.has(TargetFeature::AVX2));
+
+    TargetMachine v3 = select_target("x86-64-v3");
+    EXPECT_TRUE(v3.has(TargetFeature::BMI2));
+    EXPECT_TRUE(v3.has(TargetFeature::LZCNT));
+    EXPECT_EQ(v3.features & X86_64_V2_FEATURES, X86_64_V2_FEATURES);
+    EXPECT_NE(v3.describe().find("+avx2"), std::string::npos);
+
+    // native reports what this machine's CPUID does
+    EXPECT_EQ(select_target("native").features, detect_host_features());
+    EXPECT_THROW(select_target("skylake"), std::runtime_error);
+}
+
+TEST(SizeOptimizerTest, ShrinksAssembly) {
+    // Sizes match what the assembler encodes
+    EXPECT_EQ(SizeOptimizer::estimate_size("    mov rax, 5"), 7u);
+    EXPECT_EQ(SizeOptimizer::estimate_size("    mov eax, 5"), 5u);
+    EXPECT_EQ(SizeOptimizer::estimate_size("    xor eax, eax"), 2u);
+    EXPECT_EQ(SizeOptimizer::estimate_size("    mov rax, [rsp + 8]"), 5u);
+    EXPECT_EQ(SizeOptimizer::estimate_size("    imul rax, rbx"), 4u);
+    EXPECT_EQ(SizeOptimizer::estimate_size("    # comment"), 0u);
+
+    auto line = [](const std::string& text, const std::string& routine, bool runtime = false) {
+        AsmLine asm_line;
+        asm_line.text = text;
+        asm_line.routine = routine;
+        asm_line.runtime = runtime;
+        asm_line.outlinable = !runtime && !routine.empty();
+        return asm_line;
+    };
+    std::vector<AsmLine> lines = {
+        line("_start:", ""),
+        line("    call main", ""),
+        line("unused:", "unused", true),
+        line("    ret", "unused", true),
+        line("main:", "main"),
+        line("    mov rax, 0", "main"),
+        line("    test rax, rax", "main"),
+        line("    jz L1", "main"),
+        line("    mov rcx, [rbp - 8]", "main"),
+        line("    imul rcx, rcx", "main"),
+        line("    add rcx, [rbp - 16]", "main"),
+        line("    mov rax, rcx", "main"),
+        line("    add rsp, 8", "main"),
+        line("    pop rbx", "main"),
+        line("    ret", "main"),
+        line("L1:", "main"),
+        line("    mov rcx, [rbp - 8]", "main"),
+        line("    imul rcx, rcx", "main"),
+        line("    add rcx, [rbp - 16]", "main"),
+        line("    mov rdx, rcx", "main"),
+        line("    mov rax, rdx", "main"),
+        line("    add rsp, 8", "main"),
+        line("    pop rbx", "main"),
+        line("    ret", "main"),
+    };
+
+    SizeOptimizer optimizer;
+    optimizer.optimize(lines);
+    std::vector<std::string> text;
+    for (const auto& asm_line : lines) text.push_back(asm_line.text);
+    auto has = [&text](const std::string& wanted) {
+        return std::find(text.begin(), text.end(), wanted) != text.end();
+    };
+
+    // The unused routine is gone and the zeroing move shrank
+    EXPECT_FALSE(has("unused:"));
+    EXPECT_TRUE(has("    xor eax, eax"));
+
+    // The second epilogue jumps into the first
+    EXPECT_TRUE(has(".Ltail0:"));
+    EXPECT_TRUE(has("    jmp .Ltail0"));
+    EXPECT_EQ(std::count(text.begin(), text.end(), "    pop rbx"), 1);
+
+    // The repeated computation lives in one helper
+    EXPECT_EQ(std::count(text.begin(), text.end(), "    call __cmmc_outlined_0"), 2);
+    EXPECT_EQ(std::count(text.begin(), text.end(), "    imul rcx, rcx"), 1);
+
+    std::vector<std::string> transforms;
+    for (const auto& entry : optimizer.get_savings()) {
+        transforms.push_back(entry.first);
+        EXPECT_GT(entry.second, 0);
+    }
+    EXPECT_EQ(transforms, (std::vector<std::string>{
+        "unused runtime routines", "shorter encodings", "tail merging", "outlining"}));
+}
+
+TEST(RegisterAllocatorTest, PrefersCallerSavedRegisters) {
+    RegisterAllocator allocator;
+
+    PhysReg first = allocator.allocate_register();
+    EXPECT_EQ(first, PhysReg::RCX);
+    EXPECT_EQ(reg_name(first), "rcx");
+    EXPECT_EQ(allocator.get_used_callee_saved(), 0);
+
+    // Exhaust the caller-saved class; the next register must be callee-saved
+    while (allocator.get_free_registers() & CALLER_SAVED_REGS) {
+        allocator.allocate_register();
+    }
+    PhysReg callee = allocator.allocate_register();
+    EXPECT_NE(reg_bit(callee) & CALLEE_SAVED_REGS, 0);
+    EXPECT_EQ(allocator.get_used_callee_saved(), reg_bit(callee));
+}
+
+TEST(RegisterAllocatorTest, FreeAndExcludeMasks) {
+    RegisterAllocator allocator;
+
+    PhysReg reg = allocator.allocate_register(reg_bit(PhysReg::RCX) | reg_bit(PhysReg::RDX));
+    EXPECT_EQ(reg, PhysReg::RSI);
+    EXPECT_FALSE(allocator.is_free(PhysReg::RSI));
+
+    allocator.free_register(reg);
+    EXPECT_TRUE(allocator.is_free(PhysReg::RSI));
+    EXPECT_EQ(allocator.get_free_registers(), ALLOCATABLE_REGS);
+
+    // Reserved registers are never handed out
+    for (int i = 0; i < PHYS_REG_COUNT; ++i) {
+        EXPECT_EQ(reg_bit(allocator.allocate_register()) & RESERVED_REGS, 0);
+    }
+}
+
+TEST(RegisterAllocatorTest, TempMappingAndSpilling) {
+    RegisterAllocator allocator;
+
+    PhysReg t0 = allocator.allocate_register("t0");
+    EXPECT_TRUE(allocator.is_allocated("t0"));
+    EXPECT_EQ(allocator.get_register("t0"), t0);
+    EXPECT_EQ(allocator.allocate_register("t0"), t0);
+
+    // Fill every register; the oldest temp (t0) is the one spilled
+    int allocatable = __builtin_popcount(ALLOCATABLE_REGS);
+    for (int i = 1; i < allocatable; ++i) {
+        allocator.allocate_register("t" + std::to_string(i));
+    }
+    EXPECT_FALSE(allocator.has_available_registers());
+
+    PhysReg reused = allocator.allocate_register("extra");
+    EXPECT_EQ(reused, t0);
+    EXPECT_FALSE(allocator.is_allocated("t0"));
+    EXPECT_EQ(allocator.load_from_memory("t0"), "[rbp -16]");
+
+    allocator.free_register_for_temp("extra");
+    EXPECT_TRUE(allocator.is_free(t0));
+    EXPECT_EQ(allocator.get_register("extra"), PhysReg::NONE);
+}
+
 // Conditionally compile main() only when this file is built standalone
 #ifndef UNIT_TEST_MAIN
 int main(int argc, char** argv) {
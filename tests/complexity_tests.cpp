@@ -0,0 +1,365 @@
+#include "lexer.h"
+#include "parser.h"
+#include "semantic-analyzer.h"
+#include "ir-generator.h"
+#include "ir-optimizer.h"
+#include "advanced-optimizer.h"
+#include "assembly-generator.h"
+#include "baseline-compiler.h"
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <filesystem>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Scaling tests: every stage and pass runs on generated programs of doubling
+// size, and the exponent k of time ~ size^k is fitted on a log-log scale as
+// the median slope between pairs of points, so one noisy point cannot drag
+// it. A stage whose exponent exceeds MAX_EXPONENT has gone superlinear: a
+// quadratic one fits near 2, while n log n and timer noise stay well below.
+// Sizes run up to CMMC_COMPLEXITY_MAX_IR IR instructions (default 32k; set
+// it to 1000000 for a full run).
+//
+// Once the IR outgrows the caches even a linear pass slows down per
+// instruction, so a reference workload that touches each instruction once
+// is measured alongside, and whatever it exceeds 1 by is allowed on top.
+
+namespace {
+
+constexpr double MAX_EXPONENT = 1.5;
+
+const std::string REFERENCE = "reference";
+
+// Points faster than this are mostly timer noise and are not fitted
+constexpr double MIN_FIT_SECONDS = 0.002;
+
+// Noise only ever adds time, so each point is the fastest of a few runs
+constexpr int REPEATS = 3;
+
+size_t max_ir_size() {
+    const char* env = std::getenv("CMMC_COMPLEXITY_MAX_IR");
+    return env ? std::strtoul(env, nullptr, 10) : 32000;
+}
+
+// One function whose body is `statements` statements: arithmetic, diamonds,
+// short loops and divisions
+std::string one_large_function(size_t statements) {
+    std::ostringstream out;
+    out << "int main(void) {\n int a; int b; int c; int i; int x;\n a = input(); b = input(); c = 0; x = 0;\n";
+    for (size_t k = 0; k < statements; ++k) {
+        switch (k % 4) {
+            case 0: out << " c = c + a * " << k % 7 + 1 << " + b;\n"; break;
+            case 1: out << " if (c > " << k << ") x = c; else x = a;\n"; break;
+            case 2: out << " i = 0; while (i < 3) { x = x + a * b; i = i + 1; }\n"; break;
+            default: out << " a = x - c / 3;\n"; break;
+        }
+    }
+    out << " output(x);\n return 0;\n}\n";
+    return out.str();
+}
+
+// `functions` small functions, each with a loop, a diamond and a call to
+// the one before it
+std::string many_functions(size_t functions) {
+    std::ostringstream out;
+    for (size_t f = 0; f < functions; ++f) {
+        out << "int f" << f << "(int n) {\n int i; int s;\n s = 0; i = 0;\n"
+            << " while (i < n) { s = s + i * 4; i = i + 1; }\n"
+            << " if (s > 10) s = s - 10; else s = s + 1;\n";
+        if (f > 0) out << " s = s + f" << f - 1 << "(n - 1);\n";
+        out << " return s;\n}\n";
+    }
+    out << "int main(void) {\n output(f" << functions - 1 << "(5));\n return 0;\n}\n";
+    return out.str();
+}
+
+// Ifs nested `depth` deep inside one loop
+std::string nested_ifs(size_t depth) {
+    std::ostringstream out;
+    out << "int main(void) {\n int a; int x;\n a = input(); x = 0;\n while (a > 0) {\n";
+    for (size_t d = 0; d < depth; ++d) out << " if (a > " << d << ") {\n x = x + " << d << ";\n";
+    for (size_t d = 0; d < depth; ++d) out << " }\n";
+    out << " a = a - 1;\n }\n output(x);\n return 0;\n}\n";
+    return out.str();
+}
+
+struct Measurement {
+    double size;
+    double seconds;
+};
+
+// Median slope of log(seconds) against log(size) over every pair of points;
+// NAN when too few points are slow enough to measure
+double fit_exponent(const std::vector<Measurement>& points) {
+    std::vector<std::pair<double, double>> logs;
+    for (const auto& point : points) {
+        if (point.seconds >= MIN_FIT_SECONDS) logs.push_back({std::log(point.size), std::log(point.seconds)});
+    }
+    if (logs.size() < 3) return NAN;
+    std::vector<double> slopes;
+    for (size_t i = 0; i < logs.size(); ++i) {
+        for (size_t j = i + 1; j < logs.size(); ++j) {
+            if (logs[j].first == logs[i].first) continue;
+            slopes.push_back((logs[j].second - logs[i].second) / (logs[j].first - logs[i].first));
+        }
+    }
+    if (slopes.empty()) return NAN;
+    std::sort(slopes.begin(), slopes.end());
+    size_t middle = slopes.size() / 2;
+    return slopes.size() % 2 ? slopes[middle] : (slopes[middle - 1] + slopes[middle]) / 2;
+}
+
+double seconds_for(const std::function<void()>& work) {
+    auto start = std::chrono::steady_clock::now();
+    work();
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// `trial` sets up untimed and returns the seconds of its timed part
+double fastest(const std::function<double()>& trial) {
+    double best = trial();
+    for (int r = 1; r < REPEATS; ++r) best = std::min(best, trial());
+    return best;
+}
+
+// Times every stage and pass on one program and appends to `timings`,
+// keyed by stage name; sizes are in generated IR instructions
+class ScalingRun {
+public:
+    std::map<std::string, std::vector<Measurement>> timings;
+
+    size_t measure(const std::string& source) {
+        std::vector<Token> tokens;
+        double lex = fastest([&] { return seconds_for([&] { tokens = Lexer(source).tokenize(); }); });
+
+        std::unique_ptr<Program> program;
+        double parse = fastest([&] {
+            return seconds_for([&] {
+                Parser parser(tokens);
+                program.reset(dynamic_cast<Program*>(parser.parse_program().release()));
+            });
+        });
+        if (!program) throw std::runtime_error("generated program did not parse");
+
+        std::unique_ptr<SemanticAnalyzer> analyzer;
+        double semantic = fastest([&] {
+            analyzer = std::make_unique<SemanticAnalyzer>();
+            return seconds_for([&] { analyzer->analyze(*program); });
+        });
+
+        std::unique_ptr<IRGenerator> generator;
+        IRCode ir;
+        double irgen = fastest([&] {
+            generator = std::make_unique<IRGenerator>(analyzer.get());
+            return seconds_for([&] { ir = generator->generate(*program); });
+        });
+
+        double size = static_cast<double>(ir.size());
+        record(REFERENCE, size, fastest([&] { return seconds_for([&] { reference_workload(ir); }); }));
+        record("lexer", size, lex);
+        record("parser", size, parse);
+        record("semantic", size, semantic);
+        record("irgen", size, irgen);
+        record("baseline", size, fastest([&] { return seconds_for([&] { baseline_compile(*program); }); }));
+
+        // IROptimizer passes, each on the generated IR
+        IROptimizer local;
+        local.set_global_variables(generator->get_global_variables());
+        time_pass("constant_folding", size, ir, [&](IRCode& code) { local.constant_folding(code); });
+        time_pass("copy_propagation", size, ir, [&](IRCode& code) { local.copy_propagation(code); });
+        time_pass("algebraic_simplification", size, ir, [&](IRCode& code) { local.algebraic_simplification(code); });
+        time_pass("dead_code_elimination", size, ir, [&](IRCode& code) { local.dead_code_elimination(code); });
+
+        IRCode optimized;
+        record("O1 pipeline", size, fastest([&] { return seconds_for([&] { optimized = local.optimize(ir); }); }));
+
+        // AdvancedOptimizer passes, each on the -O1 output
+        AdvancedOptimizer advanced;
+        time_pass("unreachable_code_elimination", size, optimized,
+                  [&](IRCode& code) { advanced.unreachable_code_elimination(code); });
+        time_pass("simplify_cfg", size, optimized, [&](IRCode& code) { advanced.simplify_cfg(code); });
+        time_pass("if_conversion", size, optimized, [&](IRCode& code) { advanced.if_conversion(code); });
+        time_pass("loop_invariant_code_motion", size, optimized,
+                  [&](IRCode& code) { advanced.loop_invariant_code_motion(code); });
+        time_pass("strength_reduction", size, optimized, [&](IRCode& code) { advanced.strength_reduction(code); });
+        time_pass("loop_unrolling", size, optimized, [&](IRCode& code) { advanced.loop_unrolling(code); });
+        time_pass("tail_call_optimization", size, optimized,
+                  [&](IRCode& code) { advanced.tail_call_optimization(code); });
+        time_pass("peephole_optimizations", size, optimized,
+                  [&](IRCode& code) { advanced.peephole_optimizations(code); });
+        time_pass("instruction_scheduling", size, optimized,
+                  [&](IRCode& code) { advanced.instruction_scheduling(code); });
+        time_pass("graph_coloring_allocation", size, optimized,
+                  [&](IRCode& code) { advanced.graph_coloring_allocation(code); });
+
+        // The -O3 pipeline as the driver runs it, then code generation
+        IRCode dataflow, aggressive;
+        record("O2 pipeline", size, fastest([&] {
+            dataflow = optimized;
+            return seconds_for([&] { advanced.apply_dataflow_optimizations(dataflow); });
+        }));
+        record("O3 pipeline", size, fastest([&] {
+            aggressive = dataflow;
+            return seconds_for([&] { advanced.apply_aggressive_optimizations(aggressive); });
+        }));
+        record("codegen", size, fastest([&] {
+            return seconds_for([&] {
+                AssemblyGenerator assembler("complexity_output/program.s");
+                assembler.set_register_assignment(advanced.get_register_assignment());
+                assembler.set_omit_frame_pointer(true);
+                assembler.set_shrink_wrap(true);
+                assembler.set_block_layout(true);
+                assembler.generate_from_ir(aggressive);
+            });
+        }));
+        return ir.size();
+    }
+
+    // --fast-compile code generation from the checked AST
+    static void baseline_compile(Program& program) {
+        AssemblyGenerator assembler("complexity_output/baseline.s");
+        assembler.generate_from_assembly(BaselineCompiler().compile(program));
+    }
+
+    // What -O0 does without --fast-compile: IR generation, then code
+    // generation with no register assignment
+    static void pipeline_compile(Program& program, SemanticAnalyzer& analyzer) {
+        IRGenerator generator(&analyzer);
+        IRCode ir = generator.generate(program);
+        AssemblyGenerator assembler("complexity_output/pipeline.s");
+        assembler.generate_from_ir(ir);
+    }
+
+private:
+    // Copy the IR and count its operands, a few times over to stay clear
+    // of timer noise
+    static void reference_workload(const IRCode& ir) {
+        for (int round = 0; round < 4; ++round) {
+            IRCode copy = ir;
+            std::unordered_map<std::string, int> seen;
+            for (const auto& instr : copy) {
+                ++seen[instr.result];
+                ++seen[instr.arg1];
+                ++seen[instr.arg2];
+            }
+        }
+    }
+
+    void record(const std::string& stage, double size, double seconds) {
+        timings[stage].push_back({size, seconds});
+    }
+
+    void time_pass(const std::string& pass, double size, const IRCode& input,
+                   const std::function<void(IRCode&)>& run) {
+        record(pass, size, fastest([&] {
+            IRCode code = input;
+            return seconds_for([&] { run(code); });
+        }));
+    }
+};
+
+class ComplexityTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        std::filesystem::create_directory("complexity_output");
+    }
+
+    void TearDown() override {
+        std::filesystem::remove_all("complexity_output");
+    }
+
+    // Doubles `scale` from `first` until the program passes the IR size
+    // limit or `scale` passes `last`, then checks every stage's exponent.
+    // A sweep that fails is run again and each point keeps its faster time,
+    // so one busy moment on the machine does not fail the test.
+    void expect_near_linear(const std::function<std::string(size_t)>& generate, size_t first,
+                            size_t last = SIZE_MAX) {
+        auto sweep = [&] {
+            ScalingRun run;
+            size_t limit = max_ir_size();
+            for (size_t scale = first; scale <= last; scale *= 2) {
+                if (run.measure(generate(scale)) >= limit) break;
+            }
+            return run.timings;
+        };
+        auto timings = sweep();
+        if (!within_allowed(timings, false)) {
+            auto again = sweep();
+            for (auto& stage : timings) {
+                for (size_t p = 0; p < stage.second.size() && p < again[stage.first].size(); ++p) {
+                    stage.second[p].seconds = std::min(stage.second[p].seconds, again[stage.first][p].seconds);
+                }
+            }
+            within_allowed(timings, true);
+        }
+    }
+
+    // Whether every stage scales within the allowance; with `report`, each
+    // one that does not fails the test
+    static bool within_allowed(const std::map<std::string, std::vector<Measurement>>& timings, bool report) {
+        double reference = fit_exponent(timings.at(REFERENCE));
+        double allowed = MAX_EXPONENT + (std::isnan(reference) ? 0.0 : std::max(0.0, reference - 1.0));
+        bool within = true;
+        for (const auto& stage : timings) {
+            double exponent = fit_exponent(stage.second);
+            if (stage.first == REFERENCE || std::isnan(exponent) || exponent <= allowed) continue;
+            within = false;
+            if (!report) continue;
+            std::ostringstream points;
+            for (const auto& point : stage.second) points << " " << point.size << ":" << point.seconds << "s";
+            ADD_FAILURE() << stage.first << " scales as size^" << exponent << " (" << points.str()
+                          << " ), reference as size^" << reference << ", allowed " << allowed;
+        }
+        return within;
+    }
+};
+
+} // namespace
+
+TEST_F(ComplexityTest, OneLargeFunction) {
+    expect_near_linear(one_large_function, 128);
+}
+
+TEST_F(ComplexityTest, ManyFunctions) {
+    expect_near_linear(many_functions, 32);
+}
+
+// The parser recurses once per level, so depth stays within the stack
+TEST_F(ComplexityTest, NestingDepth) {
+    expect_near_linear(nested_ifs, 32, 2048);
+}
+
+// The baseline compiler exists to cut -O0 latency, so it has to beat the IR
+// pipeline's back end on the same checked AST by a clear margin
+TEST_F(ComplexityTest, BaselineFasterThanPipeline) {
+    for (const std::string& source : {one_large_function(2048), many_functions(512)}) {
+        Parser parser(Lexer(source).tokenize());
+        std::unique_ptr<Program> program(dynamic_cast<Program*>(parser.parse_program().release()));
+        ASSERT_TRUE(program);
+        SemanticAnalyzer analyzer;
+        analyzer.analyze(*program);
+
+        double baseline = fastest([&] { return seconds_for([&] { ScalingRun::baseline_compile(*program); }); });
+        double pipeline = fastest([&] {
+            return seconds_for([&] { ScalingRun::pipeline_compile(*program, analyzer); });
+        });
+        EXPECT_LT(baseline * 1.5, pipeline) << "baseline " << baseline << "s, pipeline " << pipeline << "s";
+    }
+}
+
+// Conditionally compile main() only when this file is built standalone
+#ifndef UNIT_TEST_MAIN
+int main(int argc, char** argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
+#endif
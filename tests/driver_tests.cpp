@@ -0,0 +1,184 @@
+#include "compiler-driver.h"
+#include <gtest/gtest.h>
+#include <sys/wait.h>
+#include <cstdlib>
+#include <filesystem>
+#include <random>
+#include <sstream>
+#include <string>
+
+namespace {
+
+// Small random programs for differential testing: a few functions of three
+// parameters, each a bounded loop of assignments, ifs, early returns and
+// calls to the functions before it, with && and || in call arguments.
+// Stored values are masked, so nothing overflows whatever the level folds.
+class ProgramGenerator {
+public:
+    explicit ProgramGenerator(unsigned seed) : rng(seed) {}
+
+    std::string program() {
+        std::ostringstream out;
+        functions = 2 + pick(2);
+        for (int f = 0; f < functions; ++f) {
+            out << "int f" << f << "(int p0, int p1, int p2) {\n"
+                << "    int v1; int v2; int l1;\n"
+                << "    v1 = " << pick(10) << "; v2 = " << pick(10) << "; l1 = 0;\n"
+                << "    while (l1 < " << 2 + pick(6) << ") {\n";
+            for (int k = 1 + pick(4); k > 0; --k) out << "        " << statement(f) << "\n";
+            out << "        l1 = l1 + 1;\n"
+                << "    }\n"
+                << "    return " << expression(2) << ";\n"
+                << "}\n";
+        }
+        out << "int main(void) { return f" << functions - 1 << "(" << pick(5) << ", " << pick(5) << ", "
+            << pick(5) << "); }\n";
+        return out.str();
+    }
+
+private:
+    std::mt19937 rng;
+    int functions = 0;
+
+    int pick(int n) {
+        return static_cast<int>(rng() % n);
+    }
+
+    std::string variable() {
+        static const char* names[] = {"v1", "v2", "p0", "p1", "p2"};
+        return names[pick(5)];
+    }
+
+    std::string expression(int depth) {
+        if (depth == 0 || pick(3) == 0) {
+            return pick(2) ? variable() : std::to_string(pick(21));
+        }
+        static const char* operators[] = {"+", "-", "<", ">", "==", "&&", "||", "&"};
+        return "(" + expression(depth - 1) + " " + operators[pick(8)] + " " + expression(depth - 1) + ")";
+    }
+
+    // Function f calls only the functions defined before it
+    std::string statement(int f) {
+        switch (pick(f > 0 ? 5 : 3)) {
+            case 0: return variable() + " = " + expression(2) + " & 1023;";
+            case 1: return "if (" + expression(2) + ") { " + variable() + " = " + expression(1) + " & 1023; }";
+            case 2: return "if (" + expression(1) + ") return " + expression(2) + ";";
+            case 3: return call(f);
+            default: return "if (" + expression(2) + ") { " + call(f) + " }";
+        }
+    }
+
+    std::string call(int f) {
+        return variable() + " = f" + std::to_string(pick(f)) + "(" + expression(2) + ", " + expression(2) + ", " +
+               expression(2) + ") & 1023;";
+    }
+};
+
+} // namespace
+
+// End-to-end: programs are compiled to executables, run, and judged by
+// their exit status
+class DriverTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        std::filesystem::create_directory("driver_output");
+    }
+
+    void TearDown() override {
+        std::filesystem::remove_all("driver_output");
+    }
+
+    // Exit status of the compiled program, or -1 when it did not compile
+    // or did not exit normally
+    int run_program(const std::string& source, const CompilerOptions& options) {
+        CompilerDriver driver(options);
+        std::string executable = "driver_output/program";
+        if (!driver.compile_from_source(source, executable)) {
+            for (const auto& error : driver.get_errors()) ADD_FAILURE() << error;
+            return -1;
+        }
+        int status = std::system(("./" + executable + " > /dev/null 2>&1").c_str());
+        std::filesystem::remove(executable);
+        return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+    }
+
+    int run_program(const std::string& source, OptimizationLevel level) {
+        CompilerOptions options;
+        options.opt_level = level;
+        return run_program(source, options);
+    }
+};
+
+// Short-circuit arguments branch between the pushes of one call
+TEST_F(DriverTest, CallArgumentsWithBranches) {
+    std::string source = "int pick(int a, int b, int c) { return a * 100 + b * 10 + c; }\n"
+                         "int main(void) {\n"
+                         "    int x; int y; int i; int s;\n"
+                         "    x = 1; y = 0; i = 0; s = 0;\n"
+                         "    while (i < 3) { s = s + pick(x && y, x || y, i < 2 && x); i = i + 1; }\n"
+                         "    return s;\n"
+                         "}\n";
+
+    for (OptimizationLevel level : {OptimizationLevel::O0, OptimizationLevel::O1, OptimizationLevel::O2,
+                                    OptimizationLevel::O3, OptimizationLevel::Os}) {
+        EXPECT_EQ(run_program(source, level), 32) << "at -O" << static_cast<int>(level);
+    }
+}
+
+// Block layout moved the block with the third argument push and the call
+// ahead of the blocks with the first two; with the frame pointer omitted its
+// locals were addressed as if nothing had been pushed
+TEST_F(DriverTest, LaidOutCallArgumentsKeepPushDepth) {
+    std::string source = "int f0(int p0, int p1, int p2) { return 9; }\n"
+                         "int f1(int p0, int p1, int p2) {\n"
+                         "    int v1; int v2; int l1;\n"
+                         "    v1 = 3; v2 = 6; l1 = 0;\n"
+                         "    while (l1 < 9) {\n"
+                         "        if (p2 - (p1 + v1)) { p1 = f0((p1 + p0) && (p1 && 20), p0, v2); }\n"
+                         "        v1 = v1 + 1;\n"
+                         "        if (p0) return p2 + v2;\n"
+                         "        l1 = l1 + 1;\n"
+                         "    }\n"
+                         "    return 0;\n"
+                         "}\n"
+                         "int main(void) { return f1(1, 0, 1); }\n";
+
+    CompilerOptions options;
+    options.opt_level = OptimizationLevel::O2;
+    EXPECT_EQ(run_program(source, options), 7);
+    options.frame_pointer = FramePointer::OMIT;
+    EXPECT_EQ(run_program(source, options), 7);
+    options.streaming = true;
+    EXPECT_EQ(run_program(source, options), 7);
+}
+
+// Random programs from a fixed seed behave at every level as they do at -O0.
+// Programs 25 and 29 of this seed went wrong at -O2 with the frame pointer
+// omitted while block layout could split the argument pushes of a call
+TEST_F(DriverTest, OptimizedMatchesUnoptimizedOnRandomPrograms) {
+    ProgramGenerator generator(2024);
+    for (int n = 0; n < 40; ++n) {
+        std::string source = generator.program();
+        int expected = run_program(source, OptimizationLevel::O0);
+        ASSERT_GE(expected, 0) << "program " << n << ":\n" << source;
+
+        CompilerOptions options;
+        for (OptimizationLevel level : {OptimizationLevel::O2, OptimizationLevel::O3, OptimizationLevel::Os}) {
+            options.opt_level = level;
+            EXPECT_EQ(run_program(source, options), expected)
+                << "program " << n << " at -O" << static_cast<int>(level) << ":\n" << source;
+        }
+        options.opt_level = OptimizationLevel::O2;
+        options.frame_pointer = FramePointer::OMIT;
+        EXPECT_EQ(run_program(source, options), expected) << "program " << n << " at -O2 -fomit-frame-pointer:\n"
+                                                          << source;
+    }
+}
+
+// Conditionally compile main() only when this file is built standalone
+#ifndef UNIT_TEST_MAIN
+int main(int argc, char** argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
+#endif
@@ -1,6 +1,9 @@
 #include "ir-generator.h"
 #include "ir-optimizer.h"
+#include "advanced-optimizer.h"
+#include "graph-coloring-allocator.h"
 #include "cfg.h"
+#include "profile-instrumenter.h"
 #include "parser.h"
 #include "lexer.h"
 #include "semantic-analyzer.h"
@@ -9,6 +12,8 @@
 #include <string>
 #include <gtest/gtest.h>
 #include <iostream>
+#include <fstream>
+#include <cstdio>
 
 class IRTest : public ::testing::Test {
 protected:
@@ -92,6 +97,88 @@ TEST_F(IRTest, ControlFlow) {
     EXPECT_TRUE(found_label);
 }
 
+TEST_F(IRTest, ShortCircuitsLogicalOperators) {
+    std::string source = R"(
+        int main(void) {
+            int x;
+            int y;
+            x = input();
+            y = 0;
+            if (x != 0 && 100 / x > 3 || !(x < 50)) {
+                y = 1;
+            }
+            return y + (x > 1 && x < 9);
+        }
+    )";
+
+    auto [program, analyzer] = parseAndAnalyze(source);
+    ASSERT_TRUE(program != nullptr);
+
+    IRGenerator generator(analyzer.get());
+    auto ir = generator.generate(*program);
+
+    // Every comparison feeds a branch directly and the division only runs
+    // once x != 0 has been tested
+    size_t first_branch = ir.size();
+    size_t division = ir.size();
+    int branches = 0;
+    for (size_t i = 0; i < ir.size(); ++i) {
+        EXPECT_NE(ir[i].op, OpCode::AND);
+        EXPECT_NE(ir[i].op, OpCode::OR);
+        EXPECT_NE(ir[i].op, OpCode::NOT);
+        if (ir[i].op == OpCode::IF_FALSE || ir[i].op == OpCode::IF_TRUE) {
+            first_branch = std::min(first_branch, i);
+            ++branches;
+        }
+        if (ir[i].op == OpCode::DIV) division = i;
+    }
+    EXPECT_EQ(branches, 4);
+    EXPECT_LT(first_branch, division);
+    EXPECT_LT(division, ir.size());
+}
+
+TEST_F(IRTest, EvaluatesCallArgumentsBeforePushing) {
+    std::string source = R"(
+        int f(int p, int q, int r) {
+            return p + q + r;
+        }
+        int main(void) {
+            int a;
+            int b;
+            int c;
+            int d;
+            a = input();
+            b = input();
+            c = input();
+            d = input();
+            return f((a && b), c, d);
+        }
+    )";
+
+    auto [program, analyzer] = parseAndAnalyze(source);
+    ASSERT_TRUE(program != nullptr);
+
+    IRGenerator generator(analyzer.get());
+    auto ir = generator.generate(*program);
+
+    // The pushes of f's arguments run straight into the call, with the
+    // branch of && and its label before them
+    size_t call = ir.size();
+    for (size_t i = 0; i < ir.size(); ++i) {
+        if (ir[i].op == OpCode::CALL && ir[i].arg1 == "f") call = i;
+    }
+    ASSERT_GE(call, 3u);
+    ASSERT_LT(call, ir.size());
+    for (size_t i = call - 3; i < call; ++i) {
+        EXPECT_EQ(ir[i].op, OpCode::PARAM);
+    }
+    bool branch = false;
+    for (size_t i = 0; i < call - 3; ++i) {
+        if (ir[i].is_label() || ir[i].is_branch()) branch = true;
+    }
+    EXPECT_TRUE(branch);
+}
+
 TEST_F(IRTest, Optimization) {
     std::string source = R"(
         int main(void) {
@@ -117,6 +204,38 @@ TEST_F(IRTest, Optimization) {
     EXPECT_LE(optimized.size(), ir.size());
 }
 
+TEST_F(IRTest, FoldsBitwiseAndShiftConstants) {
+    std::string source = R"(
+        int main(void) {
+            int x;
+            x = 12 & 10 | 1 << 4;
+            x = ~(x ^ 3) >> 1;
+            return x;
+        }
+    )";
+
+    auto [program, analyzer] = parseAndAnalyze(source);
+    ASSERT_TRUE(program != nullptr);
+
+    IRGenerator generator(analyzer.get());
+    auto ir = generator.generate(*program);
+
+    IROptimizer optimizer;
+    auto optimized = optimizer.optimize(ir);
+
+    for (const auto& instr : optimized) {
+        EXPECT_NE(instr.op, OpCode::BIT_AND);
+        EXPECT_NE(instr.op, OpCode::BIT_OR);
+        EXPECT_NE(instr.op, OpCode::BIT_XOR);
+        EXPECT_NE(instr.op, OpCode::BIT_NOT);
+        EXPECT_NE(instr.op, OpCode::SHL);
+        EXPECT_NE(instr.op, OpCode::SHR);
+        if (instr.op == OpCode::RETURN) {
+            EXPECT_EQ(instr.arg1, "-14");
+        }
+    }
+}
+
 TEST_F(IRTest, CFGConstruction) {
     std::string source = R"(
         int main(void) {
@@ -142,6 +261,540 @@ TEST_F(IRTest, CFGConstruction) {
     EXPECT_TRUE(cfg.get_entry_block() != nullptr);
 }
 
+TEST(ControlFlowGraphTest, DominatorsAndPostDominators) {
+    // if (c) return 1; x = 2; return x;
+    IRCode ir = {
+        IRInstruction(OpCode::FUNCTION_BEGIN, "f"),
+        IRInstruction(OpCode::IF_FALSE, "L0", "c"),
+        IRInstruction(OpCode::RETURN, "", "1"),
+        IRInstruction(OpCode::LABEL, "L0"),
+        IRInstruction(OpCode::ASSIGN, "x", "2"),
+        IRInstruction(OpCode::RETURN, "", "x"),
+        IRInstruction(OpCode::FUNCTION_END, "f"),
+    };
+
+    ControlFlowGraph cfg;
+    cfg.build_from_ir(ir);
+    cfg.compute_dominators();
+    cfg.compute_post_dominators();
+
+    const auto& blocks = cfg.get_blocks();
+    BasicBlock* test = blocks[1].get();
+    BasicBlock* early = blocks[2].get();
+    BasicBlock* late = cfg.find_block_by_label("L0");
+    ASSERT_TRUE(late != nullptr);
+
+    // RETURN ends its block, so the early exit does not fall into L0
+    EXPECT_EQ(early->successors.count(late), 0u);
+    EXPECT_EQ(cfg.get_immediate_dominator(late), test);
+    EXPECT_TRUE(cfg.dominates(test, early));
+    EXPECT_FALSE(cfg.dominates(early, late));
+    EXPECT_EQ(cfg.nearest_common_dominator(early, late), test);
+
+    EXPECT_TRUE(cfg.post_dominates(cfg.get_exit_block(), test));
+    EXPECT_FALSE(cfg.post_dominates(late, test));
+    EXPECT_EQ(cfg.get_immediate_post_dominator(late), cfg.get_exit_block());
+}
+
+TEST_F(IRTest, WhileLoopsAreRotated) {
+    std::string source = R"(
+        int main(void) {
+            int i;
+            int j;
+            int n;
+            n = input();
+            i = 0;
+            while (i < n) {
+                i = i + 1;
+            }
+            j = 0;
+            while (j < 100) {
+                j = j + 2;
+            }
+            return i + j;
+        }
+    )";
+
+    auto [program, analyzer] = parseAndAnalyze(source);
+    ASSERT_TRUE(program != nullptr);
+
+    IRGenerator generator(analyzer.get());
+    auto ir = generator.generate(*program);
+
+    // Guard, body, then a single conditional branch back to the body
+    int guards = 0, back_edges = 0, jumps = 0;
+    for (const auto& instr : ir) {
+        if (instr.op == OpCode::IF_FALSE) ++guards;
+        if (instr.op == OpCode::IF_TRUE) ++back_edges;
+        if (instr.op == OpCode::GOTO) ++jumps;
+    }
+    EXPECT_EQ(guards, 2);
+    EXPECT_EQ(back_edges, 2);
+    EXPECT_EQ(jumps, 0);
+
+    // Only the first guard depends on input; the second folds away
+    IROptimizer optimizer;
+    auto optimized = optimizer.optimize(ir);
+    guards = 0;
+    for (const auto& instr : optimized) {
+        if (instr.op == OpCode::IF_FALSE) ++guards;
+    }
+    EXPECT_EQ(guards, 1);
+}
+
+TEST_F(IRTest, ConstantsDoNotCrossLabels) {
+    std::string source = R"(
+        int main(void) {
+            int i;
+            i = 0;
+            while (i < 10) {
+                i = i + 1;
+            }
+            return i;
+        }
+    )";
+
+    auto [program, analyzer] = parseAndAnalyze(source);
+    ASSERT_TRUE(program != nullptr);
+
+    IRGenerator generator(analyzer.get());
+    IROptimizer optimizer;
+    auto optimized = optimizer.optimize(generator.generate(*program));
+
+    // The guard folds away; the bottom test must still read the updated i,
+    // not the value it had before the loop
+    bool compares_variable = false;
+    for (const auto& instr : optimized) {
+        if (instr.op == OpCode::LT && !std::isdigit(instr.arg1[0])) compares_variable = true;
+    }
+    EXPECT_TRUE(compares_variable);
+}
+
+TEST_F(IRTest, GraphColoringSeparatesInterferingValues) {
+    IRCode ir = {
+        IRInstruction(OpCode::FUNCTION_BEGIN, "f"),
+        IRInstruction(OpCode::CALL, "a", "input", "0"),
+        IRInstruction(OpCode::CALL, "b", "input", "0"),
+        IRInstruction(OpCode::ADD, "c", "a", "b"),
+        IRInstruction(OpCode::ASSIGN, "d", "c"),
+        IRInstruction(OpCode::ADD, "e", "d", "a"),
+        IRInstruction(OpCode::RETURN, "", "e"),
+        IRInstruction(OpCode::FUNCTION_END, "f"),
+    };
+
+    GraphColoringAllocator allocator;
+    auto assignment = allocator.allocate(ir);
+    ASSERT_EQ(assignment.count("f"), 1u);
+    const auto& regs = assignment["f"].registers;
+
+    ASSERT_EQ(regs.size(), 5u);
+    EXPECT_NE(regs.at("a"), regs.at("b"));
+    EXPECT_NE(regs.at("a"), regs.at("d"));
+    // The copy is coalesced away
+    EXPECT_EQ(regs.at("c"), regs.at("d"));
+    EXPECT_GE(allocator.get_stats().coalesced_moves, 1u);
+
+    // Only a survives a call: it gets a callee-saved register, the rest do not
+    EXPECT_NE(reg_bit(regs.at("a")) & CALLEE_SAVED_REGS, 0);
+    EXPECT_NE(reg_bit(regs.at("b")) & CALLER_SAVED_REGS, 0);
+    EXPECT_NE(reg_bit(regs.at("e")) & CALLER_SAVED_REGS, 0);
+    EXPECT_TRUE(assignment["f"].call_saves.empty());
+}
+
+TEST_F(IRTest, GraphColoringRecordsCallerSavedLiveAcrossCalls) {
+    IRCode ir = {
+        IRInstruction(OpCode::FUNCTION_BEGIN, "f"),
+        IRInstruction(OpCode::CALL, "a", "input", "0"),
+        IRInstruction(OpCode::CALL, "b", "input", "0"),
+        IRInstruction(OpCode::ADD, "c", "a", "b"),
+        IRInstruction(OpCode::RETURN, "", "c"),
+        IRInstruction(OpCode::FUNCTION_END, "f"),
+    };
+
+    // With no callee-saved register available, a must be saved around the second call
+    GraphColoringAllocator allocator(reg_bit(PhysReg::RSI) | reg_bit(PhysReg::RDI));
+    auto allocation = allocator.allocate(ir)["f"];
+
+    ASSERT_EQ(allocation.registers.count("a"), 1u);
+    ASSERT_EQ(allocation.call_saves.size(), 1u);
+    EXPECT_EQ(allocation.call_saves.count(2), 1u);
+    EXPECT_EQ(allocation.call_saves.at(2), reg_bit(allocation.registers.at("a")));
+}
+
+TEST_F(IRTest, GraphColoringRematerializesAndWeighsLoops) {
+    IRCode ir = {
+        IRInstruction(OpCode::FUNCTION_BEGIN, "f"),
+        IRInstruction(OpCode::ASSIGN, "k", "5"),
+        IRInstruction(OpCode::CALL, "n", "input", "0"),
+        IRInstruction(OpCode::ASSIGN, "i", "0"),
+        IRInstruction(OpCode::LABEL, "L0"),
+        IRInstruction(OpCode::LT, "t0", "i", "n"),
+        IRInstruction(OpCode::IF_FALSE, "L1", "t0"),
+        IRInstruction(OpCode::ADD, "i", "i", "k"),
+        IRInstruction(OpCode::GOTO, "L0"),
+        IRInstruction(OpCode::LABEL, "L1"),
+        IRInstruction(OpCode::RETURN, "", "i"),
+        IRInstruction(OpCode::FUNCTION_END, "f"),
+    };
+
+    // A single register forces everything but the hottest value out
+    GraphColoringAllocator allocator(reg_bit(PhysReg::RBX));
+    auto allocation = allocator.allocate(ir)["f"];
+
+    EXPECT_EQ(allocation.registers.size(), 1u);
+    EXPECT_EQ(allocation.registers.count("i"), 1u);
+    ASSERT_EQ(allocation.constants.count("k"), 1u);
+    EXPECT_EQ(allocation.constants.at("k"), "5");
+    EXPECT_EQ(allocation.constants.count("n"), 0u);
+}
+
+TEST_F(IRTest, AggressiveOptimizationAssignsRegisters) {
+    std::string source = R"(
+        int main(void) {
+            int x;
+            int i;
+            x = 0;
+            i = 0;
+            while (i < 10) {
+                x = x + i;
+                i = i + 1;
+            }
+            return x;
+        }
+    )";
+
+    auto [program, analyzer] = parseAndAnalyze(source);
+    ASSERT_TRUE(program != nullptr);
+
+    IRGenerator generator(analyzer.get());
+    IROptimizer optimizer;
+    auto ir = optimizer.optimize(generator.generate(*program));
+
+    AdvancedOptimizer advanced;
+    advanced.apply_dataflow_optimizations(ir);
+    advanced.apply_aggressive_optimizations(ir);
+
+    const auto& assignment = advanced.get_register_assignment();
+    ASSERT_EQ(assignment.count("main"), 1u);
+    EXPECT_EQ(assignment.at("main").registers.count("x"), 1u);
+    EXPECT_EQ(assignment.at("main").registers.count("i"), 1u);
+}
+
+TEST_F(IRTest, IfConversionProducesSelects) {
+    std::string source = R"(
+        int main(void) {
+            int a;
+            int m;
+            a = input();
+            if (a > 5) m = a; else m = 5;
+            if (a < 0) a = 0 - a;
+            if (a > 100) m = input();
+            return m + a;
+        }
+    )";
+
+    auto [program, analyzer] = parseAndAnalyze(source);
+    ASSERT_TRUE(program != nullptr);
+
+    IRGenerator generator(analyzer.get());
+    IROptimizer optimizer;
+    auto ir = optimizer.optimize(generator.generate(*program));
+
+    AdvancedOptimizer advanced;
+    advanced.apply_dataflow_optimizations(ir);
+
+    // The diamond and the triangle become selects; the arm with a call stays a branch
+    int selects = 0, branches = 0;
+    for (const auto& instr : ir) {
+        if (instr.op == OpCode::SELECT) ++selects;
+        if (instr.op == OpCode::IF_FALSE) ++branches;
+    }
+    EXPECT_EQ(selects, 2);
+    EXPECT_EQ(branches, 1);
+}
+
+TEST_F(IRTest, OptimizationRemarksExplainDecisions) {
+    std::string source = R"(
+int count(int n) {
+    if (n == 0) return 0;
+    return count(n - 1);
+}
+int main(void) {
+    int a;
+    int b;
+    int i;
+    int x;
+    a = input();
+    b = input();
+    x = 0;
+    i = 0;
+    while (i < 10) {
+        x = x + a * b + a / b;
+        i = i + 1;
+    }
+    return x + count(3);
+}
+    )";
+
+    auto [program, analyzer] = parseAndAnalyze(source);
+    ASSERT_TRUE(program != nullptr);
+
+    RemarkCollector remarks;
+    IRGenerator generator(analyzer.get());
+    IROptimizer optimizer;
+    optimizer.set_remarks(&remarks);
+    auto ir = optimizer.optimize(generator.generate(*program));
+
+    AdvancedOptimizer advanced;
+    advanced.set_remarks(&remarks);
+    advanced.apply_dataflow_optimizations(ir);
+    advanced.apply_aggressive_optimizations(ir);
+
+    auto find = [&](const std::string& pass, const std::string& name) -> const OptimizationRemark* {
+        for (const auto& remark : remarks.get_remarks()) {
+            if (remark.pass == pass && remark.name == name) return &remark;
+        }
+        return nullptr;
+    };
+
+    // The product is hoisted, the division may trap and stays, the loop is unrolled
+    const OptimizationRemark* hoisted = find("licm", "Hoisted");
+    ASSERT_NE(hoisted, nullptr);
+    EXPECT_EQ(hoisted->kind, RemarkKind::Applied);
+    EXPECT_EQ(hoisted->function, "main");
+    EXPECT_EQ(hoisted->line, 16);
+    const OptimizationRemark* division = find("licm", "NotHoisted");
+    ASSERT_NE(division, nullptr);
+    EXPECT_EQ(division->kind, RemarkKind::Missed);
+    EXPECT_NE(division->reason.find("trap"), std::string::npos);
+    const OptimizationRemark* unrolled = find("loop-unroll", "Unrolled");
+    ASSERT_NE(unrolled, nullptr);
+    EXPECT_EQ(unrolled->line, 15);
+
+    // The recursive call passes an argument, so it cannot become a jump
+    const OptimizationRemark* tail = find("tail-call", "HasArguments");
+    ASSERT_NE(tail, nullptr);
+    EXPECT_EQ(tail->function, "count");
+    EXPECT_EQ(tail->line, 4);
+
+    std::string yaml = remarks.to_yaml();
+    EXPECT_NE(yaml.find("--- !Passed\nPass:     licm\nName:     Hoisted\nFunction: 'main'\nLine:     16\n"),
+              std::string::npos);
+    EXPECT_NE(yaml.find("--- !Missed\nPass:     tail-call\n"), std::string::npos);
+    std::string json = remarks.to_json();
+    EXPECT_NE(json.find("{\"pass\": \"loop-unroll\", \"kind\": \"applied\", \"name\": \"Unrolled\""),
+              std::string::npos);
+}
+
+TEST_F(IRTest, CompileBudgetSkipsOversizedFunctions) {
+    std::string source = R"(
+        int pick(int a) {
+            int m;
+            if (a > 5) m = a; else m = 5;
+            return m;
+        }
+        int main(void) {
+            int a;
+            int m;
+            a = input();
+            if (a > 5) m = a; else m = 5;
+            output(m * 2 + a * 3 - m * a + 7);
+            output(a + m + pick(a) * 4 - 9);
+            return pick(m);
+        }
+    )";
+
+    auto [program, analyzer] = parseAndAnalyze(source);
+    ASSERT_TRUE(program != nullptr);
+
+    IRGenerator generator(analyzer.get());
+    IROptimizer optimizer;
+    auto ir = optimizer.optimize(generator.generate(*program));
+
+    // The limit lies between the two functions' sizes
+    size_t pick_size = 0, main_size = 0;
+    std::string function;
+    for (const auto& instr : ir) {
+        if (instr.op == OpCode::FUNCTION_BEGIN) function = instr.result;
+        (function == "pick" ? pick_size : main_size)++;
+    }
+    ASSERT_LT(pick_size, main_size);
+
+    RemarkCollector remarks;
+    CompileBudget budget;
+    budget.dataflow_function_size = pick_size;
+    AdvancedOptimizer advanced;
+    advanced.set_budget(budget);
+    advanced.set_remarks(&remarks);
+    advanced.apply_dataflow_optimizations(ir);
+
+    // pick is if-converted; main keeps its branch and its place after pick
+    std::vector<std::string> order;
+    int pick_selects = 0, main_selects = 0;
+    for (const auto& instr : ir) {
+        if (instr.op == OpCode::FUNCTION_BEGIN) {
+            function = instr.result;
+            order.push_back(function);
+        }
+        if (instr.op == OpCode::SELECT) ++(function == "pick" ? pick_selects : main_selects);
+    }
+    EXPECT_EQ(order, (std::vector<std::string>{"pick", "main"}));
+    EXPECT_EQ(pick_selects, 1);
+    EXPECT_EQ(main_selects, 0);
+
+    int over_budget = 0;
+    for (const auto& remark : remarks.get_remarks()) {
+        if (remark.name != "OverBudget") continue;
+        ++over_budget;
+        EXPECT_EQ(remark.kind, RemarkKind::Missed);
+        EXPECT_EQ(remark.function, "main");
+    }
+    EXPECT_EQ(over_budget, 3);   // simplify-cfg, if-conversion and dce
+}
+
+TEST(IROptimizerTest, LivenessRemovesDeadStores) {
+    IRCode ir = {
+        IRInstruction(OpCode::FUNCTION_BEGIN, "main"),
+        IRInstruction(OpCode::ASSIGN, "x", "1"),
+        IRInstruction(OpCode::ASSIGN, "x", "2"),
+        IRInstruction(OpCode::ARRAY_ASSIGN, "a", "0", "x"),
+        IRInstruction(OpCode::ARRAY_ASSIGN, "g", "0", "x"),
+        IRInstruction(OpCode::LABEL, "L0"),
+        IRInstruction(OpCode::ASSIGN, "y", "x"),
+        IRInstruction(OpCode::CALL, "t0", "input", "0"),
+        IRInstruction(OpCode::IF_TRUE, "L0", "t0"),
+        IRInstruction(OpCode::RETURN, "", "x"),
+        IRInstruction(OpCode::FUNCTION_END, "main"),
+        IRInstruction(OpCode::FUNCTION_BEGIN, "f"),
+        IRInstruction(OpCode::ASSIGN, "y", "3"),
+        IRInstruction(OpCode::RETURN, "", "y"),
+        IRInstruction(OpCode::FUNCTION_END, "f"),
+    };
+
+    IROptimizer optimizer;
+    optimizer.set_global_variables({"g"});
+    optimizer.dead_code_elimination(ir);
+
+    // x = 1 is overwritten, the local array is never read and y is dead in
+    // the loop even though f reads a y of its own; the global store and the
+    // call stay
+    std::vector<std::string> expected = {
+        "FUNCTION_BEGIN main",
+        "ASSIGN x, 2",
+        "ARRAY_ASSIGN g, 0, x",
+        "LABEL L0",
+        "CALL t0, input, 0",
+        "IF_TRUE L0, t0",
+        "RETURN, x",
+        "FUNCTION_END main",
+        "FUNCTION_BEGIN f",
+        "ASSIGN y, 3",
+        "RETURN, y",
+        "FUNCTION_END f",
+    };
+    std::vector<std::string> actual;
+    for (const auto& instr : ir) actual.push_back(instr.to_string());
+    EXPECT_EQ(actual, expected);
+}
+
+TEST(AdvancedOptimizerTest, SimplifyCfgThreadsJumpsAndKnownBranches) {
+    IRCode ir = {
+        IRInstruction(OpCode::FUNCTION_BEGIN, "main"),
+        IRInstruction(OpCode::CALL, "c", "input", "0"),
+        IRInstruction(OpCode::IF_FALSE, "L0", "c"),
+        IRInstruction(OpCode::GOTO, "L1"),
+        IRInstruction(OpCode::LABEL, "L0"),
+        IRInstruction(OpCode::ASSIGN, "f", "1"),
+        IRInstruction(OpCode::GOTO, "L2"),
+        IRInstruction(OpCode::LABEL, "L1"),
+        IRInstruction(OpCode::GOTO, "L3"),
+        IRInstruction(OpCode::LABEL, "L2"),
+        IRInstruction(OpCode::IF_FALSE, "L4", "f"),
+        IRInstruction(OpCode::RETURN, "", "1"),
+        IRInstruction(OpCode::LABEL, "L4"),
+        IRInstruction(OpCode::RETURN, "", "2"),
+        IRInstruction(OpCode::LABEL, "L3"),
+        IRInstruction(OpCode::RETURN, "", "3"),
+        IRInstruction(OpCode::FUNCTION_END, "main"),
+    };
+
+    AdvancedOptimizer optimizer;
+    optimizer.simplify_cfg(ir);
+
+    // The branch over a jump is inverted and threaded through L1; f is known
+    // to be set on the way into L2, so its test and the f == 0 path vanish
+    std::vector<std::string> expected = {
+        "FUNCTION_BEGIN main",
+        "CALL c, input, 0",
+        "IF_TRUE L3, c",
+        "ASSIGN f, 1",
+        "RETURN, 1",
+        "LABEL L3",
+        "RETURN, 3",
+        "FUNCTION_END main",
+    };
+    std::vector<std::string> actual;
+    for (const auto& instr : ir) actual.push_back(instr.to_string());
+    EXPECT_EQ(actual, expected);
+}
+
+TEST(ProfileInstrumenterTest, CountsBlocksAndCallsAndReadsProfiles) {
+    IRCode ir = {
+        IRInstruction(OpCode::FUNCTION_BEGIN, "main"),
+        IRInstruction(OpCode::CALL, "x", "input", "0"),
+        IRInstruction(OpCode::IF_FALSE, "L0", "x"),
+        IRInstruction(OpCode::ASSIGN, "x", "1"),
+        IRInstruction(OpCode::LABEL, "L0"),
+        IRInstruction(OpCode::RETURN, "", "x"),
+        IRInstruction(OpCode::FUNCTION_END, "main"),
+    };
+
+    ProfileInstrumenter instrumenter;
+    instrumenter.instrument(ir);
+
+    // Entry, call, fall-through and L0 each get a counter, in order
+    ASSERT_EQ(instrumenter.get_counter_count(), 4u);
+    std::vector<std::string> ids;
+    for (size_t i = 0; i < ir.size(); ++i) {
+        if (ir[i].op != OpCode::PROFILE_COUNT) continue;
+        ids.push_back(ir[i].arg1);
+    }
+    EXPECT_EQ(ids, (std::vector<std::string>{"0", "1", "2", "3"}));
+    EXPECT_EQ(ir[1].op, OpCode::PROFILE_COUNT);
+    EXPECT_EQ(ir[2].op, OpCode::PROFILE_COUNT);
+    EXPECT_EQ(ir[3].op, OpCode::CALL);
+
+    // A profile written for this layout maps back by counter id
+    std::vector<uint64_t> counts = {5, 5, 2, 5};
+    {
+        std::ofstream file("test_profile.profdata", std::ios::binary);
+        uint64_t checksum = instrumenter.get_checksum();
+        uint64_t counters = counts.size();
+        file.write(PROFILE_MAGIC, 8);
+        file.write(reinterpret_cast<const char*>(&checksum), sizeof(checksum));
+        file.write(reinterpret_cast<const char*>(&counters), sizeof(counters));
+        file.write(reinterpret_cast<const char*>(counts.data()), counts.size() * sizeof(uint64_t));
+    }
+    instrumenter.apply_counts(ir, instrumenter.read_profile("test_profile.profdata"));
+    EXPECT_EQ(profiled_count(ir[1]), 5);
+    for (const auto& instr : ir) {
+        if (instr.op == OpCode::PROFILE_COUNT && instr.arg1 == "2") {
+            EXPECT_EQ(profiled_count(instr), 2);
+        }
+    }
+
+    // A different program does not accept it
+    ProfileInstrumenter other;
+    IRCode other_ir = {
+        IRInstruction(OpCode::FUNCTION_BEGIN, "f"),
+        IRInstruction(OpCode::RETURN, "", "0"),
+        IRInstruction(OpCode::FUNCTION_END, "f"),
+    };
+    other.instrument(other_ir);
+    EXPECT_THROW(other.read_profile("test_profile.profdata"), std::runtime_error);
+    std::remove("test_profile.profdata");
+}
+
 // Conditionally compile main() only when this file is built standalone
 #ifndef UNIT_TEST_MAIN
 int main(int argc, char** argv) {
@@ -0,0 +1,78 @@
+#include "tiered-jit.h"
+#include "parser.h"
+#include "lexer.h"
+#include "semantic-analyzer.h"
+#include <gtest/gtest.h>
+#include <memory>
+#include <string>
+#include <tuple>
+
+class TieredJitTest : public ::testing::Test {
+protected:
+    std::tuple<std::unique_ptr<Program>, std::shared_ptr<SemanticAnalyzer>>
+    parseAndAnalyze(const std::string& source) {
+        Lexer lexer(source);
+        auto tokens = lexer.tokenize();
+        Parser parser(tokens);
+        auto ast = parser.parse_program();
+        auto program = std::unique_ptr<Program>(dynamic_cast<Program*>(ast.release()));
+        if (!program) {
+            throw std::runtime_error("Parse error: AST root is not Program");
+        }
+        auto analyzer = std::make_shared<SemanticAnalyzer>();
+        analyzer->analyze(*program);
+        return std::make_tuple(std::move(program), analyzer);
+    }
+};
+
+TEST_F(TieredJitTest, RecompilesHotFunctions) {
+    std::string source = "int g;\n"
+                         "int work(int n) {\n"
+                         "    int i; int s;\n"
+                         "    i = 0; s = 0;\n"
+                         "    while (i < n) { s = s + i * 3; i = i + 1; }\n"
+                         "    return s;\n"
+                         "}\n"
+                         "void bump(int v) { g = g + v; }\n"
+                         "int main(void) {\n"
+                         "    int k; int t;\n"
+                         "    k = 0; t = 0;\n"
+                         "    while (k < 20000) { t = t + work(2000) - work(1999); bump(1); k = k + 1; }\n"
+                         "    return t / 20000 - g / 20000;\n"
+                         "}\n";
+
+    auto [program, analyzer] = parseAndAnalyze(source);
+    ASSERT_TRUE(program != nullptr);
+
+    TieredJit jit(*program, *analyzer);
+    jit.set_hot_threshold(1000);
+    // work(2000) - work(1999) is 3 * 1999, the same from either tier
+    EXPECT_EQ(jit.run(), 5996);
+
+    const auto& functions = jit.get_functions();
+    ASSERT_EQ(functions.size(), 3u);
+    EXPECT_EQ(functions[0].name, "work");
+    EXPECT_EQ(functions[0].tier, TieredJit::Tier::Optimized);
+    // Counting stops once callers reach the optimized code
+    EXPECT_GE(functions[0].calls, 1000u);
+    EXPECT_LT(functions[0].calls, 40000u);
+
+    // The IR pipeline keeps globals in registers, so bump stays baseline
+    EXPECT_EQ(functions[1].name, "bump");
+    EXPECT_EQ(functions[1].tier, TieredJit::Tier::Ineligible);
+    EXPECT_EQ(functions[1].reason, "uses global variables");
+    EXPECT_EQ(functions[1].calls, 20000u);
+
+    // main is hot from its loop but reads g too
+    EXPECT_EQ(functions[2].name, "main");
+    EXPECT_EQ(functions[2].tier, TieredJit::Tier::Ineligible);
+    EXPECT_EQ(functions[2].back_edges, 20000u);
+}
+
+// Conditionally compile main() only when this file is built standalone
+#ifndef UNIT_TEST_MAIN
+int main(int argc, char** argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
+#endif
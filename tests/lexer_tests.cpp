@@ -43,6 +43,31 @@ TEST(LexerTest, OperatorTokenization) {
     EXPECT_EQ(tokens[10].type(), TokenType::GreaterEqual);
 }
 
+TEST(LexerTest, BitwiseOperatorTokenization) {
+    std::string code = "& | ^ ~ << >> <<= < >";
+    Lexer lexer(code);
+    auto tokens = lexer.tokenize();
+
+    EXPECT_EQ(tokens[0].type(), TokenType::Ampersand);
+    EXPECT_EQ(tokens[1].type(), TokenType::Pipe);
+    EXPECT_EQ(tokens[2].type(), TokenType::Caret);
+    EXPECT_EQ(tokens[3].type(), TokenType::Tilde);
+    EXPECT_EQ(tokens[4].type(), TokenType::ShiftLeft);
+    EXPECT_EQ(tokens[5].type(), TokenType::ShiftRight);
+    EXPECT_EQ(tokens[6].type(), TokenType::ShiftLeft);
+    EXPECT_EQ(tokens[7].type(), TokenType::Equal);
+    EXPECT_EQ(tokens[8].type(), TokenType::Less);
+    EXPECT_EQ(tokens[9].type(), TokenType::Greater);
+
+    Lexer logical("a && b || !c & d | e");
+    auto logical_tokens = logical.tokenize();
+    EXPECT_EQ(logical_tokens[1].type(), TokenType::AndAnd);
+    EXPECT_EQ(logical_tokens[3].type(), TokenType::OrOr);
+    EXPECT_EQ(logical_tokens[4].type(), TokenType::Not);
+    EXPECT_EQ(logical_tokens[6].type(), TokenType::Ampersand);
+    EXPECT_EQ(logical_tokens[8].type(), TokenType::Pipe);
+}
+
 // Conditionally compile main() only when this file is built standalone
 #ifndef UNIT_TEST_MAIN
 int main(int argc, char** argv) {
@@ -0,0 +1,167 @@
+#include "libcmmc.h"
+#include <gtest/gtest.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+std::string program_returning(int value) {
+    return "int twice(int x) { return x + x; }\n"
+           "int main(void) {\n"
+           "    int i; int s;\n"
+           "    i = 0; s = 0;\n"
+           "    while (i < " + std::to_string(value) + ") { s = s + twice(1); i = i + 1; }\n"
+           "    return s;\n"
+           "}\n";
+}
+
+} // namespace
+
+TEST(LibcmmcTest, CompilesToAssemblyInMemory) {
+    CompileRequest request;
+    request.source = program_returning(3);
+    request.options.opt_level = OptimizationLevel::O2;
+    request.options.output_format = OutputFormat::ASSEMBLY;
+
+    CompileResult result = cmmc_compile(request);
+
+    ASSERT_TRUE(result.success);
+    EXPECT_TRUE(result.errors.empty());
+    EXPECT_NE(result.assembly.find("twice:"), std::string::npos);
+    EXPECT_NE(result.assembly.find("main:"), std::string::npos);
+    EXPECT_TRUE(result.object.empty());
+}
+
+TEST(LibcmmcTest, AssemblesObjectBytes) {
+    CompileRequest request;
+    request.source = program_returning(3);
+    request.options.output_format = OutputFormat::OBJECT;
+
+    CompileResult result = cmmc_compile(request);
+
+    ASSERT_TRUE(result.success);
+    ASSERT_GT(result.object.size(), 4u);
+    EXPECT_EQ(result.object[0], 0x7f);
+    EXPECT_EQ(result.object[1], 'E');
+    EXPECT_EQ(result.object[2], 'L');
+    EXPECT_EQ(result.object[3], 'F');
+}
+
+TEST(LibcmmcTest, ReturnsDiagnostics) {
+    CompileRequest request;
+    request.source = "int main(void) {\n    int x\n    return x;\n}\n";
+
+    testing::internal::CaptureStdout();
+    testing::internal::CaptureStderr();
+    CompileResult result = cmmc_compile(request);
+    std::string out = testing::internal::GetCapturedStdout();
+    std::string err = testing::internal::GetCapturedStderr();
+
+    EXPECT_FALSE(result.success);
+    ASSERT_FALSE(result.errors.empty());
+    EXPECT_NE(result.errors[0].find("Syntax error at line 3"), std::string::npos);
+    EXPECT_TRUE(out.empty());
+    EXPECT_TRUE(err.empty());
+}
+
+TEST(LibcmmcTest, CollectsPhaseProfile) {
+    CompileRequest request;
+    request.source = program_returning(3);
+    request.options.opt_level = OptimizationLevel::O2;
+    request.options.output_format = OutputFormat::ASSEMBLY;
+    request.collect_profile = true;
+
+    CompileResult result = cmmc_compile(request);
+
+    ASSERT_TRUE(result.success);
+    EXPECT_EQ(result.profile.count("lexical_analysis"), 1u);
+    EXPECT_EQ(result.profile.count("code_generation"), 1u);
+    EXPECT_EQ(result.profile.count("total_compilation"), 1u);
+}
+
+TEST(LibcmmcTest, StreamingMatchesWholeProgram) {
+    std::string source = "int g;\n"
+                         "int twice(int x) { return x + x; }\n"
+                         "int count(int n) {\n"
+                         "    int i; int s;\n"
+                         "    i = 0; s = 0;\n"
+                         "    while (i < n) { if (i > 1) s = s + i; i = i + 1; }\n"
+                         "    return s;\n"
+                         "}\n"
+                         "int main(void) { g = 4; return twice(g) + count(g); }\n";
+    for (auto level : {OptimizationLevel::O0, OptimizationLevel::O1, OptimizationLevel::O2, OptimizationLevel::O3}) {
+        CompileRequest request;
+        request.source = source;
+        request.options.opt_level = level;
+        request.options.output_format = OutputFormat::ASSEMBLY;
+        CompileResult whole = cmmc_compile(request);
+        request.options.streaming = true;
+        CompileResult streamed = cmmc_compile(request);
+
+        ASSERT_TRUE(whole.success);
+        ASSERT_TRUE(streamed.success);
+        EXPECT_TRUE(streamed.warnings.empty());
+        EXPECT_EQ(streamed.assembly, whole.assembly) << "at -O" << static_cast<int>(level);
+    }
+}
+
+TEST(LibcmmcTest, StreamingReportsErrors) {
+    CompileRequest request;
+    request.options.streaming = true;
+
+    // A syntax error inside a body is found on the second pass
+    request.source = "int f(void) {\n    int x\n    return 1;\n}\n"
+                     "int main(void) { return f(); }\n";
+    CompileResult syntax = cmmc_compile(request);
+    EXPECT_FALSE(syntax.success);
+    ASSERT_FALSE(syntax.errors.empty());
+    EXPECT_NE(syntax.errors[0].find("Syntax error at line 3"), std::string::npos);
+
+    // Semantic errors from every function, as the whole-program check reports them
+    request.source = "int f(void) { return y; }\n"
+                     "int main(void) { return z; }\n";
+    CompileResult semantic = cmmc_compile(request);
+    request.options.streaming = false;
+    CompileResult whole = cmmc_compile(request);
+    request.options.streaming = true;
+    EXPECT_FALSE(semantic.success);
+    EXPECT_EQ(semantic.errors.size(), 4u);
+    EXPECT_EQ(semantic.errors, whole.errors);
+
+    // Options that need the whole program fall back to it
+    request.source = program_returning(3);
+    request.options.opt_level = OptimizationLevel::Os;
+    CompileResult fallback = cmmc_compile(request);
+    EXPECT_TRUE(fallback.success);
+    ASSERT_EQ(fallback.warnings.size(), 1u);
+    EXPECT_EQ(fallback.warnings[0], "--stream ignored: -Os needs the whole program");
+}
+
+TEST(LibcmmcTest, ConcurrentCompilesMatchSequential) {
+    const int count = 8;
+    std::vector<CompileRequest> requests(count);
+    std::vector<CompileResult> expected(count);
+    for (int i = 0; i < count; ++i) {
+        requests[i].source = program_returning(i + 1);
+        requests[i].options.opt_level = static_cast<OptimizationLevel>(i % 4);
+        requests[i].options.output_format = OutputFormat::OBJECT;
+        expected[i] = cmmc_compile(requests[i]);
+        ASSERT_TRUE(expected[i].success);
+    }
+
+    std::vector<CompileResult> results(count);
+    std::vector<std::thread> threads;
+    for (int i = 0; i < count; ++i) {
+        threads.emplace_back([&, i] { results[i] = cmmc_compile(requests[i]); });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    for (int i = 0; i < count; ++i) {
+        EXPECT_TRUE(results[i].success);
+        EXPECT_EQ(results[i].assembly, expected[i].assembly);
+        EXPECT_EQ(results[i].object, expected[i].object);
+    }
+}
@@ -1,5 +1,6 @@
 #include "lexer.h"
 #include "parser.h"
+#include "declaration-stream.h"
 #include <gtest/gtest.h>
 #include <iostream>
 #include <sstream>
@@ -47,11 +48,14 @@ TEST(ParserTest, SyntaxError) {
     auto tokens = lexer.tokenize();
     Parser parser(tokens);
 
+    // Errors are collected for the caller rather than printed
     testing::internal::CaptureStderr();
     auto ast = parser.parse_program();
     std::string err = testing::internal::GetCapturedStderr();
 
-    ASSERT_NE(err.find("Syntax error"), std::string::npos);
+    EXPECT_TRUE(err.empty());
+    ASSERT_FALSE(parser.get_errors().empty());
+    EXPECT_EQ(parser.get_errors()[0].rfind("Syntax error at line 4", 0), 0u);
 }
 
 TEST(ParserTest, ParseFunctionWithParameters) {
@@ -85,6 +89,96 @@ TEST(ParserTest, ParseFunctionWithParameters) {
     ASSERT_NE(output.find("FunDeclaration(int main)"), std::string::npos);
 }
 
+TEST(ParserTest, BitwiseOperatorPrecedence) {
+    std::string code = R"(
+        int main(void) {
+            int x;
+            x = 1 | 2 ^ 3 & 4 << 1 < ~5;
+            return x;
+        }
+    )";
+
+    Lexer lexer(code);
+    auto tokens = lexer.tokenize();
+    Parser parser(tokens);
+    auto ast = parser.parse_program();
+    auto program = dynamic_cast<Program*>(ast.get());
+    ASSERT_TRUE(program != nullptr);
+
+    // Loosest to tightest: | ^ & relational << and unary ~
+    auto main_fn = dynamic_cast<FunDeclaration*>(program->declarations[0].get());
+    auto body = dynamic_cast<CompoundStmt*>(main_fn->body.get());
+    auto stmt = dynamic_cast<ExpressionStmt*>(body->statements[0].get());
+    auto assign = dynamic_cast<BinaryOp*>(stmt->expr.get());
+    auto bit_or = dynamic_cast<BinaryOp*>(assign->right.get());
+    ASSERT_TRUE(bit_or != nullptr);
+    EXPECT_EQ(bit_or->op, "|");
+    auto bit_xor = dynamic_cast<BinaryOp*>(bit_or->right.get());
+    ASSERT_TRUE(bit_xor != nullptr);
+    EXPECT_EQ(bit_xor->op, "^");
+    auto bit_and = dynamic_cast<BinaryOp*>(bit_xor->right.get());
+    ASSERT_TRUE(bit_and != nullptr);
+    EXPECT_EQ(bit_and->op, "&");
+    auto less = dynamic_cast<BinaryOp*>(bit_and->right.get());
+    ASSERT_TRUE(less != nullptr);
+    EXPECT_EQ(less->op, "<");
+    auto shift = dynamic_cast<BinaryOp*>(less->left.get());
+    ASSERT_TRUE(shift != nullptr);
+    EXPECT_EQ(shift->op, "<<");
+    auto bit_not = dynamic_cast<UnaryOp*>(less->right.get());
+    ASSERT_TRUE(bit_not != nullptr);
+    EXPECT_EQ(bit_not->op, "~");
+}
+
+TEST(ParserTest, DeclarationStreamYieldsOneDeclarationAtATime) {
+    std::string code = R"(
+        int g;
+        int add(int a, int b) {
+            if (a) { return a + b; }
+            return b;
+        }
+        void f(void) {
+            int x
+            x = 1;
+        }
+        int main(void) { return add(g, 2); }
+    )";
+
+    DeclarationStream stream(code);
+    auto global = stream.next();
+    ASSERT_TRUE(dynamic_cast<VarDeclaration*>(global.get()) != nullptr);
+    auto add = stream.next();
+    auto add_fn = dynamic_cast<FunDeclaration*>(add.get());
+    ASSERT_TRUE(add_fn != nullptr);
+    EXPECT_EQ(add_fn->name, "add");
+    EXPECT_EQ(dynamic_cast<CompoundStmt*>(add_fn->body.get())->statements.size(), 2u);
+
+    // f has a syntax error: it is skipped and recorded, as a whole-program parse would
+    auto main_decl = stream.next();
+    auto main_fn = dynamic_cast<FunDeclaration*>(main_decl.get());
+    ASSERT_TRUE(main_fn != nullptr);
+    EXPECT_EQ(main_fn->name, "main");
+    EXPECT_EQ(stream.next(), nullptr);
+    Lexer lexer(code);
+    Parser parser(lexer.tokenize());
+    parser.parse_program();
+    ASSERT_FALSE(stream.get_errors().empty());
+    EXPECT_EQ(stream.get_errors(), parser.get_errors());
+    EXPECT_EQ(stream.get_errors()[0].rfind("Syntax error at line 9", 0), 0u);
+
+    // Skipping bodies keeps the signatures and finds no errors inside them
+    DeclarationStream signatures(code, true);
+    signatures.next();
+    auto signature = signatures.next();
+    auto add_signature = dynamic_cast<FunDeclaration*>(signature.get());
+    ASSERT_TRUE(add_signature != nullptr);
+    EXPECT_EQ(add_signature->params.size(), 2u);
+    ASSERT_TRUE(add_signature->body != nullptr);
+    EXPECT_TRUE(dynamic_cast<CompoundStmt*>(add_signature->body.get())->statements.empty());
+    while (signatures.next()) {}
+    EXPECT_TRUE(signatures.get_errors().empty());
+}
+
 // Conditionally compile main() only when this file is built standalone
 #ifndef UNIT_TEST_MAIN
 int main(int argc, char **argv) {
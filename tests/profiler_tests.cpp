@@ -0,0 +1,66 @@
+#include "compiler-profiler.h"
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+TEST(CompilerProfilerTest, ReportsHardwareCountersPerPhase) {
+    std::filesystem::create_directory("test_output");
+    CompilerProfiler profiler;
+    profiler.enable_profiling(true);
+    bool available = profiler.enable_hardware_counters(true);
+    // Where perf_event_open is not allowed this falls back, saying why
+    EXPECT_EQ(available, profiler.get_hardware_counter_status().rfind("unavailable", 0) != 0);
+
+    profiler.start_phase("outer");
+    profiler.start_phase("work");
+    volatile long long sum = 0;
+    std::vector<long long> values(1 << 16, 3);
+    for (long long value : values) sum = sum + value;
+    profiler.end_phase("work");
+    profiler.end_phase("outer");
+
+    HardwareCounts work = profiler.get_phase_hardware_counts("work");
+    HardwareCounts outer = profiler.get_phase_hardware_counts("outer");
+    size_t instructions = static_cast<size_t>(HardwareCounter::Instructions);
+    if (!available) {
+        for (long long count : work) EXPECT_EQ(count, -1);
+    } else if (work[instructions] >= 0) {
+        // Nested phases each get their own counts
+        EXPECT_GT(work[instructions], 65536);
+        EXPECT_GE(outer[instructions], work[instructions]);
+    }
+
+    // The CSV keeps its counter columns either way
+    profiler.generate_csv_report("test_output/profile.csv");
+    std::ifstream csv("test_output/profile.csv");
+    std::string header, row;
+    std::getline(csv, header);
+    EXPECT_EQ(header, "phase,total_time,average_time,call_count,memory_usage,"
+                      "cycles,instructions,cache_misses,branch_misses,page_faults");
+    int rows = 0;
+    while (std::getline(csv, row)) {
+        EXPECT_EQ(std::count(row.begin(), row.end(), ','), 9);
+        ++rows;
+    }
+    EXPECT_EQ(rows, 2);
+
+    profiler.generate_json_report("test_output/profile.json");
+    std::ifstream json_file("test_output/profile.json");
+    std::stringstream json;
+    json << json_file.rdbuf();
+    EXPECT_NE(json.str().find("\"hardware_counter_status\""), std::string::npos);
+    EXPECT_NE(json.str().find("\"hardware_counters\": {\"cycles\": "), std::string::npos);
+    std::filesystem::remove_all("test_output");
+}
+
+// Conditionally compile main() only when this file is built standalone
+#ifndef UNIT_TEST_MAIN
+int main(int argc, char** argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
+#endif
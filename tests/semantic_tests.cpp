@@ -35,6 +35,23 @@ TEST_F(SemanticAnalyzerTest, ValidMainFunction) {
     EXPECT_FALSE(analyzer.has_errors());
 }
 
+TEST_F(SemanticAnalyzerTest, ParametersAreVisibleInBody) {
+    std::string source = R"(
+        int add(int a, int b) {
+            return a + b;
+        }
+        int main(void) {
+            return add(40, 2);
+        }
+    )";
+
+    auto ast = parseProgram(source);
+    ASSERT_TRUE(ast != nullptr);
+
+    EXPECT_TRUE(analyzer.analyze(*ast));
+    EXPECT_FALSE(analyzer.has_errors());
+}
+
 TEST_F(SemanticAnalyzerTest, MissingMainFunction) {
     std::string source = R"(
         int foo(void) {
@@ -66,6 +83,23 @@ TEST_F(SemanticAnalyzerTest, UndefinedVariable) {
     EXPECT_TRUE(analyzer.has_errors());
 }
 
+TEST_F(SemanticAnalyzerTest, ShiftCountOutOfRange) {
+    std::string source = R"(
+        int main(void) {
+            int x;
+            x = 1 << 64;
+            return x >> 63;
+        }
+    )";
+
+    auto ast = parseProgram(source);
+    ASSERT_TRUE(ast != nullptr);
+
+    bool result = analyzer.analyze(*ast);
+    EXPECT_FALSE(result);
+    EXPECT_TRUE(analyzer.has_errors());
+}
+
 TEST_F(SemanticAnalyzerTest, VoidVariableError) {
     std::string source = R"(
         int main(void) {